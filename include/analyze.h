@@ -0,0 +1,58 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include <stdint.h>
+#include "output.h"
+#include "types.h"
+
+// subtrees per worker the b-trees are split into, so one large table
+// does not leave the other workers idle
+#define ANALYZE_TASKS_PER_THREAD 16
+
+// space used by one b-tree and its overflow pages
+typedef struct {
+    uint64_t leaf_pages;
+    uint64_t interior_pages;
+    uint64_t overflow_pages;        // from the payload sizes, chains are not read
+    uint64_t cells;                 // on leaf and interior pages
+    uint64_t entries;               // rows, or index entries
+    uint64_t payload_bytes;         // record bytes, overflow included
+    uint64_t overflow_bytes;        // of payload_bytes, kept on overflow pages
+    uint64_t usable_bytes;          // of the b-tree pages
+    uint64_t unallocated_bytes;     // between cell pointer array and cell content
+    uint64_t freeblock_bytes;
+    uint64_t freeblocks;
+    uint64_t fragmented_bytes;
+    uint64_t non_sequential;        // leaves not right after the previous leaf
+    uint32_t depth;
+    uint64_t errors;                // malformed pages, cells or subtrees
+} analyze_space_t;
+
+// a schema object with a b-tree
+typedef struct {
+    const char *type;               // borrowed from the schema
+    const char *name;
+    const char *tbl_name;
+    uint32_t root_page;
+    analyze_space_t space;
+} analyze_object_t;
+
+// result of analyze_database()
+typedef struct {
+    analyze_object_t *objects;      // sqlite_master first, then schema order
+    size_t count;
+    uint32_t page_count;
+    uint32_t freelist_trunk_pages;
+    uint32_t freelist_leaf_pages;
+    uint32_t ptrmap_pages;          // auto-vacuum pointer maps
+    uint32_t lock_pages;            // the page holding the lock byte, if any
+    int freelist_error;
+} analyze_result_t;
+
+int analyze_database(database_t *db, const schema_t *schema, int threads,
+                     analyze_result_t *result);
+void analyze_free(analyze_result_t *result);
+void analyze_print(out_t *out, const database_t *db,
+                   const analyze_result_t *result, int json_mode);
+
+#endif
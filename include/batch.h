@@ -0,0 +1,19 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include "output.h"
+#include "types.h"
+
+// totals of a batch_run()
+typedef struct {
+    size_t files;
+    size_t failed;      // files whose summary lists errors
+} batch_result_t;
+
+int batch_list_files(const char *source, char ***paths, size_t *count);
+void batch_free_files(char **paths, size_t count);
+int batch_run(out_t *out, char **paths, size_t count,
+              const db_options_t *opts, int threads, batch_result_t *result);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include "cell.h"
+#include "types.h"
+
+// deeper trees than this are treated as corrupt (or cyclic)
+#define BTREE_MAX_DEPTH 32
+// children of an interior page read ahead at a time, see db_set_access()
+#define BTREE_PREFETCH_PAGES 64
+
+// Called for each leaf page of a walk, in key order. Returning non-zero
+// stops the walk. Page data read in the callback is released after it
+// returns, see db_release_pages().
+typedef int (*btree_leaf_fn)(database_t *db, uint32_t page_num,
+                             btree_page_header_t *page, void *ctx);
+
+// Called for each page of btree_visit_pages(), `depth` levels below the
+// root. Returning non-zero stops the walk.
+typedef int (*btree_page_fn)(database_t *db, uint32_t page_num,
+                             btree_page_header_t *page, int depth, void *ctx);
+
+// Called for each record a seek produces (an index entry or a table row).
+// Returning non-zero stops the seek. The record's page data is released
+// after it returns.
+typedef int (*btree_record_fn)(database_t *db, const record_t *rec, void *ctx);
+
+int btree_walk_table(database_t *db, uint32_t root_page,
+                     btree_leaf_fn fn, void *ctx);
+int btree_walk_table_range(database_t *db, uint32_t root_page,
+                           int64_t lo, int64_t hi, btree_leaf_fn fn, void *ctx);
+int btree_visit_pages(database_t *db, uint32_t root_page,
+                      btree_page_fn fn, void *ctx);
+int btree_count_rows(database_t *db, uint32_t root_page, uint64_t *rows);
+int btree_find_rowid(database_t *db, uint32_t root_page, int64_t rowid,
+                     uint32_t *leaf_page, uint16_t *cell_index);
+int lookup_rowid(database_t *db, const schema_entry_t *table, int64_t rowid,
+                 record_scratch_t *scratch, record_t *rec);
+int btree_seek_index(database_t *db, uint32_t root_page,
+                     const record_value_t *key, size_t nkey,
+                     record_scratch_t *scratch, btree_record_fn fn, void *ctx);
+int lookup_index(database_t *db, schema_t *schema, const schema_entry_t *index,
+                 const record_value_t *key, size_t nkey,
+                 record_scratch_t *scratch, btree_record_fn fn, void *ctx);
+
+#endif
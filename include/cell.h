@@ -3,8 +3,111 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "output.h"
+#include "types.h"
 
-int parse_cell(uint8_t *page_data, uint16_t cell_offset, size_t page_size);
-int parse_cell_json(uint8_t *page_data, uint16_t cell_offset, size_t page_size);
+// SQLite's default SQLITE_MAX_COLUMN
+#define RECORD_MAX_COLUMNS 2000
+
+typedef enum {
+    VALUE_NULL,
+    VALUE_INTEGER,
+    VALUE_FLOAT,
+    VALUE_TEXT,
+    VALUE_BLOB
+} value_type_t;
+
+// typed column value; text and blob data point into the mapping. A value
+// that continues into overflow pages has data == NULL and is read through
+// record_value_segments().
+typedef struct {
+    value_type_t type;
+    int64_t integer;
+    double real;
+    const uint8_t *data;
+    size_t size;
+} record_value_t;
+
+// contiguous piece of a payload inside one page of the mapping
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+} payload_segment_t;
+
+// walks a byte range of a payload as segments: first the part stored in
+// the cell, then the chain of overflow pages
+typedef struct {
+    database_t *db;
+    const uint8_t *local;
+    size_t local_left;
+    uint32_t next_page;     // next overflow page to visit, 0 at the end
+    uint32_t pages_left;    // guard against cyclic chains
+    uint64_t skip;          // overflow bytes before the range starts
+    uint64_t remaining;     // bytes of the range not yet returned
+} payload_iter_t;
+
+// caller-owned buffers reused for every decoded row
+typedef struct {
+    uint64_t *serial_types;
+    size_t *offsets;
+    size_t capacity;
+} record_scratch_t;
+
+// one decoded table or index cell; the arrays belong to the scratch it was decoded
+// with and are overwritten by the next decode
+typedef struct {
+    database_t *db;
+    int64_t rowid;
+    uint64_t payload_size;
+    const uint8_t *payload;     // start of the record header
+    size_t local_size;          // payload bytes stored in the cell
+    uint32_t first_overflow;    // first overflow page, 0 if none
+    size_t column_count;
+    int truncated;              // more columns than the scratch can hold
+    const uint64_t *serial_types;
+    const size_t *offsets;      // content offset of each column in payload
+} record_t;
+
+// forward iterator over the cells of one leaf table page
+typedef struct {
+    database_t *db;
+    uint8_t *page_data;
+    btree_page_header_t page;
+    uint16_t next_cell;
+    record_scratch_t *scratch;
+    record_t record;
+} cell_cursor_t;
+
+size_t cell_local_payload(const database_t *db, uint8_t page_type,
+                          uint64_t payload_size);
+int cell_decode_table(database_t *db, const uint8_t *page_data,
+                      uint16_t cell_offset, record_scratch_t *scratch,
+                      record_t *rec);
+int cell_decode_index(database_t *db, const uint8_t *page_data,
+                      uint8_t page_type, uint16_t cell_offset,
+                      record_scratch_t *scratch, record_t *rec);
+int record_column(const record_t *rec, size_t i, record_value_t *value);
+int record_value_compare(const record_t *rec, size_t i, const record_value_t *value,
+                         const record_value_t *key, int *result);
+size_t record_number_text(const record_value_t *value, char *buf, size_t size);
+int record_value_prefix(const record_t *rec, size_t i, const record_value_t *value,
+                        const uint8_t *prefix, size_t len, int nocase);
+int record_compare(const record_t *rec, const record_value_t *key, size_t nkey,
+                   int *result);
+int record_value_segments(const record_t *rec, size_t i, payload_iter_t *it);
+int payload_iter_next(payload_iter_t *it, payload_segment_t *seg);
+
+int cell_cursor_open(cell_cursor_t *cur, database_t *db, uint32_t page_num,
+                     record_scratch_t *scratch);
+int cell_cursor_next(cell_cursor_t *cur);
+
+void print_value(out_t *out, const record_t *rec, size_t i,
+                 const record_value_t *value, int json);
+void print_record(out_t *out, const record_t *rec);
+void print_record_json(out_t *out, const record_t *rec);
+int parse_cell(out_t *out, database_t *db, uint8_t *page_data,
+               uint16_t cell_offset);
+int parse_cell_json(out_t *out, database_t *db, uint8_t *page_data,
+                    uint16_t cell_offset);
 
 #endif
@@ -0,0 +1,33 @@
+#ifndef COLUMNAR_H
+#define COLUMNAR_H
+
+#include <stdint.h>
+#include "types.h"
+
+// Columnar export file, all integers little-endian. See docs/FILE_FORMAT,
+// "Columnar export", for the full layout.
+#define COLUMNAR_MAGIC "LITECOL1"
+#define COLUMNAR_VERSION 1
+#define COLUMNAR_HEADER_SIZE 64
+#define COLUMNAR_ALIGN 64           // every buffer starts on this boundary
+#define COLUMNAR_BATCH_ROWS 65536   // most rows per batch
+#define COLUMNAR_BATCH_BYTES (64u << 20)    // fixed-width budget per batch
+
+// column types of the export
+#define COLUMNAR_INT64   1
+#define COLUMNAR_FLOAT64 2
+#define COLUMNAR_UTF8    3
+#define COLUMNAR_BINARY  4
+
+// column flags
+#define COLUMNAR_FLAG_ROWID 1       // holds the rowid of each row
+
+// size of one column entry and one buffer descriptor in the footer
+#define COLUMNAR_COLUMN_ENTRY_SIZE 16
+#define COLUMNAR_BATCH_ENTRY_SIZE 16
+#define COLUMNAR_BUFFER_ENTRY_SIZE 48
+
+int export_columnar(database_t *db, schema_t *schema, const char *table_name,
+                    const char *path, uint64_t *rows_out);
+
+#endif
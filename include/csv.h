@@ -0,0 +1,12 @@
+#ifndef CSV_H
+#define CSV_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "output.h"
+
+size_t csv_scan(const uint8_t *data, size_t len);
+void csv_print_field(out_t *out, const uint8_t *data, size_t len);
+void csv_quoted_body(out_t *out, const uint8_t *data, size_t len);
+
+#endif
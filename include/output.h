@@ -0,0 +1,55 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// size of the buffer of a file descriptor sink
+#define OUT_BUFFER_SIZE (256 * 1024)
+
+// Buffered output sink. A descriptor sink collects output and hands it to
+// write(2) in OUT_BUFFER_SIZE pieces; a memory sink (fd == -1) keeps
+// growing its buffer so the caller can take the rendered bytes.
+typedef struct {
+    int fd;
+    char *buf;
+    size_t len;
+    size_t cap;
+    int error;      // a write or allocation failed, later output is dropped
+} out_t;
+
+int out_open_fd(out_t *out, int fd);
+int out_open_mem(out_t *out, size_t initial);
+int out_flush(out_t *out);
+void out_close(out_t *out);
+
+void out_write_slow(out_t *out, const void *data, size_t len);
+void out_u64(out_t *out, uint64_t value);
+void out_i64(out_t *out, int64_t value);
+void out_double(out_t *out, double value);
+void out_printf(out_t *out, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static inline void out_write(out_t *out, const void *data, size_t len) {
+    if (len <= out->cap - out->len) {
+        memcpy(out->buf + out->len, data, len);
+        out->len += len;
+    } else {
+        out_write_slow(out, data, len);
+    }
+}
+
+static inline void out_char(out_t *out, char c) {
+    if (out->len < out->cap) {
+        out->buf[out->len++] = c;
+    } else {
+        out_write_slow(out, &c, 1);
+    }
+}
+
+static inline void out_str(out_t *out, const char *s) {
+    out_write(out, s, strlen(s));
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef PAGER_H
+#define PAGER_H
+
+#include <stddef.h>
+#include "types.h"
+
+// pages the pread and io_uring backends keep unless --page-cache is given
+#define PAGER_DEFAULT_PAGES 2048
+// bytes mapped by one window of the window backend, at most
+#define PAGER_WINDOW_BYTES (4 * 1024 * 1024)
+
+pager_t *pager_open(int fd, uint32_t page_size, size_t file_size, db_io_t io,
+                    size_t capacity);
+pager_t *pager_open_window(int fd, uint32_t page_size, size_t file_size,
+                           size_t max_resident);
+uint8_t *pager_get(pager_t *pager, uint32_t page_num);
+void pager_prefetch(pager_t *pager, const uint32_t *pages, size_t count);
+void pager_release(pager_t *pager);
+void pager_advise(pager_t *pager, db_access_t access);
+int pager_read_at(pager_t *pager, size_t offset, uint8_t *buf, size_t len);
+int pager_can_prefetch(const pager_t *pager);
+int pager_exhausted(const pager_t *pager);
+void pager_close(pager_t *pager);
+
+#endif
@@ -4,6 +4,31 @@
 #include "types.h"
 
 database_t* parse_database(const char *filename);
+database_t* parse_database_ex(const char *filename, const db_options_t *opts);
 void free_database(database_t  *db);
+int db_get_page(database_t *db, uint32_t page_num, btree_page_header_t *page);
+uint8_t* db_page_data(database_t *db, uint32_t page_num);
+void db_release_pages(database_t *db);
+void db_set_access(database_t *db, db_access_t access);
+void db_prefetch_pages(database_t *db, uint32_t *pages, size_t count);
+int db_load_all_pages(database_t *db, int threads);
+int db_adopt_directory(database_t *db, const page_directory_t *arrays);
+void db_forget_page(database_t *db, uint32_t page_num);
+int db_refresh_wal(database_t *db, const char *filename, uint32_t *first);
+
+// bytes of each page available to b-tree content
+static inline size_t db_usable_size(const database_t *db) {
+    return (size_t)db->header.page_size - db->header.reserved_space;
+}
+
+// offset of cell `i` from the start of its page
+static inline uint16_t page_cell_pointer(const btree_page_header_t *page,
+                                         uint16_t i) {
+    if (page->cell_pointers) {
+        return page->cell_pointers[i];
+    }
+    const uint8_t *p = page->cell_ptr_array + (size_t)i * 2;
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
 
 #endif
@@ -0,0 +1,16 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stddef.h>
+#include "output.h"
+
+// Renders batch `batch` into the memory sink `out`. `worker` is the index
+// of the calling worker, in [0, threads). Returns 0 to go on, a positive
+// value to end the output after this batch.
+typedef int (*pipeline_render_fn)(void *ctx, size_t batch, int worker,
+                                  out_t *out);
+
+int pipeline_run(out_t *out, size_t batches, int threads, size_t depth,
+                 pipeline_render_fn render, void *ctx);
+
+#endif
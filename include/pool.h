@@ -0,0 +1,14 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+// Called by a worker for each claimed chunk [begin, end) of the item range.
+// `worker` is the index of the calling worker, in [0, threads).
+typedef void (*pool_range_fn)(void *ctx, size_t begin, size_t end, int worker);
+
+int pool_run(size_t count, size_t chunk_size, int threads,
+             pool_range_fn fn, void *ctx);
+int pool_cpu_count(void);
+
+#endif
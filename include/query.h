@@ -0,0 +1,70 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stddef.h>
+#include "cell.h"
+#include "output.h"
+#include "types.h"
+
+// record index standing for the rowid (also used for INTEGER PRIMARY KEY)
+#define QUERY_ROWID -1
+
+typedef enum {
+    QUERY_EQ,
+    QUERY_NE,
+    QUERY_LT,
+    QUERY_LE,
+    QUERY_GT,
+    QUERY_GE,
+    QUERY_IS_NULL,
+    QUERY_NOT_NULL,
+    QUERY_PREFIX,           // GLOB 'abc*', case sensitive
+    QUERY_PREFIX_NOCASE     // LIKE 'abc%', ASCII letters folded
+} query_op_t;
+
+// how print_record_query() lays out a row
+typedef enum {
+    QUERY_TEXT,
+    QUERY_JSON,
+    QUERY_CSV,
+    QUERY_NDJSON
+} query_format_t;
+
+// a table column as the query reads it from a record
+typedef struct {
+    char *name;
+    long source;                // record index, QUERY_ROWID for the rowid
+    column_affinity_t affinity;
+    record_value_t fallback;    // value in rows stored before ADD COLUMN
+    char *fallback_text;
+    char *key;                  // "name": for NDJSON rows
+    size_t key_len;
+} query_column_t;
+
+// one --where predicate; the literal has the column's affinity applied
+typedef struct {
+    query_column_t column;
+    query_op_t op;
+    record_value_t value;
+    char *text;                 // bytes of a text literal
+} query_term_t;
+
+// projection and predicates of a table dump; a row matches when all
+// terms hold
+typedef struct {
+    query_column_t *select;
+    size_t select_count;        // 0 prints whole records
+    query_term_t *terms;
+    size_t term_count;
+    size_t needed;              // record columns the header is decoded for
+} query_t;
+
+int query_prepare(query_t *query, const schema_entry_t *table,
+                  const char *columns, char *const *where, size_t where_count);
+int query_match(const query_t *query, const record_t *rec);
+void print_csv_header(out_t *out, const query_t *query);
+void print_record_query(out_t *out, const query_t *query, const record_t *rec,
+                        query_format_t format);
+void free_query(query_t *query);
+
+#endif
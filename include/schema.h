@@ -1,10 +1,18 @@
 #ifndef SCHEMA_H
 #define SCHEMA_H
 
+#include "output.h"
 #include "types.h"
+#include "cell.h"
 
 schema_t* parse_schema(database_t *db);
 void free_schema(schema_t *schema);
-void print_schema(schema_t *schema);
+void print_schema(out_t *out, schema_t *schema);
+schema_entry_t* schema_find(schema_t *schema, const char *type, const char *name);
+int schema_table_columns(const schema_entry_t *table, table_columns_t *cols);
+void free_table_columns(table_columns_t *cols);
+long schema_find_column(const table_columns_t *cols, const char *name);
+int sql_literal_value(const char *sql, record_value_t *value, char **text);
+column_affinity_t column_affinity(const char *decl_type);
 
 #endif
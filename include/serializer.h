@@ -1,13 +1,31 @@
 #ifndef SERIALIZER_H
 #define SERIALIZER_H
 
+#include "../include/output.h"
 #include "../include/parser.h"
 #include "../include/schema.h"
 
-void json_print_string(const char *str);
-void json_print_text_chk(const uint8_t *data, size_t len);
-void serialize_db_header(db_header_t *header);
-void serialize_schema(schema_t *schema);
-void serialize_page_header(btree_page_header_t *page, int page_num);
+// scan used by the JSON escaper to find bytes that need attention
+#define JSON_SCAN_AUTO   0
+#define JSON_SCAN_SCALAR 1
+#define JSON_SCAN_SSE2   2
+#define JSON_SCAN_AVX2   3
+
+// state of a JSON string value printed in pieces: bytes of a UTF-8
+// sequence that continues in the next piece
+typedef struct {
+    uint8_t pending[4];
+    uint8_t pending_len;
+} json_text_t;
+
+int json_set_scan(int impl);
+void json_text_body(out_t *out, json_text_t *st, const uint8_t *data, size_t len);
+void json_text_end(out_t *out, json_text_t *st);
+void json_print_string(out_t *out, const char *str);
+void json_print_text_body(out_t *out, const uint8_t *data, size_t len);
+void json_print_text_chk(out_t *out, const uint8_t *data, size_t len);
+void serialize_db_header(out_t *out, db_header_t *header);
+void serialize_schema(out_t *out, schema_t *schema);
+void serialize_page_header(out_t *out, btree_page_header_t *page, int page_num);
 
 #endif
@@ -0,0 +1,14 @@
+#ifndef SIDECAR_H
+#define SIDECAR_H
+
+#include <stddef.h>
+#include "types.h"
+
+// appended to the database path
+#define SIDECAR_SUFFIX ".litereader-idx"
+
+int sidecar_attach(database_t *db, const char *db_path, int threads);
+const uint32_t *sidecar_table_leaves(const database_t *db, uint32_t root_page,
+                                     size_t *count, uint64_t *rows);
+
+#endif
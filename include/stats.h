@@ -0,0 +1,93 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include "constants.h"
+#include "output.h"
+
+// Instrumentation for --stats, compiled in by `make STATS=1`
+// (-DLITEREADER_STATS). Otherwise every STATS_* macro expands to nothing.
+
+// phases timed with STATS_BEGIN() / STATS_END()
+typedef enum {
+    STATS_PHASE_MMAP,           // opening and mapping the file and its -wal
+    STATS_PHASE_HEADER,         // header parse, I/O backend and directory setup
+    STATS_PHASE_SCHEMA,         // parse_schema()
+    STATS_PHASE_DECODE,         // cell and record header decoding
+    STATS_PHASE_OUTPUT,         // write(2) of the output
+    STATS_PHASES
+} stats_phase_t;
+
+typedef enum {
+    STATS_PAGES_LEAF_TABLE,     // page headers fetched, by page type
+    STATS_PAGES_INTERIOR_TABLE,
+    STATS_PAGES_LEAF_INDEX,
+    STATS_PAGES_INTERIOR_INDEX,
+    STATS_PAGES_OTHER,
+    STATS_CELLS,                // cells decoded
+    STATS_VARINTS,              // varints read
+    STATS_BYTES_OUT,            // bytes written to the output
+    STATS_ALLOCS,               // malloc, calloc, realloc, aligned_alloc
+    STATS_ALLOC_BYTES,          // bytes those asked for
+    STATS_COUNTERS
+} stats_counter_t;
+
+#ifdef LITEREADER_STATS
+
+// counters of one thread, added to the process totals when it exits
+typedef struct {
+    uint64_t counters[STATS_COUNTERS];
+    uint64_t phase_ns[STATS_PHASES];
+    int registered;
+} stats_block_t;
+
+extern _Thread_local stats_block_t stats_local;
+
+void stats_register(void);
+uint64_t stats_now(void);
+void stats_start(void);
+void stats_report(out_t *out, int json);
+
+static inline void stats_add(stats_counter_t counter, uint64_t n) {
+    if (!stats_local.registered) {
+        stats_register();
+    }
+    stats_local.counters[counter] += n;
+}
+
+static inline void stats_time(stats_phase_t phase, uint64_t start) {
+    if (!stats_local.registered) {
+        stats_register();
+    }
+    stats_local.phase_ns[phase] += stats_now() - start;
+}
+
+static inline stats_counter_t stats_page_counter(uint8_t page_type) {
+    switch (page_type) {
+        case PAGE_TYPE_LEAF_TABLE: return STATS_PAGES_LEAF_TABLE;
+        case PAGE_TYPE_INTERIOR_TABLE: return STATS_PAGES_INTERIOR_TABLE;
+        case PAGE_TYPE_LEAF_INDEX: return STATS_PAGES_LEAF_INDEX;
+        case PAGE_TYPE_INTERIOR_INDEX: return STATS_PAGES_INTERIOR_INDEX;
+        default: return STATS_PAGES_OTHER;
+    }
+}
+
+#define STATS_ADD(counter, n) stats_add((counter), (n))
+#define STATS_PAGE(page_type) stats_add(stats_page_counter(page_type), 1)
+#define STATS_BEGIN(start) uint64_t start = stats_now()
+#define STATS_END(phase, start) stats_time((phase), (start))
+#define STATS_START() stats_start()
+#define STATS_REPORT(out, json) stats_report((out), (json))
+
+#else
+
+#define STATS_ADD(counter, n) ((void)0)
+#define STATS_PAGE(page_type) ((void)0)
+#define STATS_BEGIN(start) ((void)0)
+#define STATS_END(phase, start) ((void)0)
+#define STATS_START() ((void)0)
+#define STATS_REPORT(out, json) ((void)0)
+
+#endif
+
+#endif
@@ -30,7 +30,7 @@ typedef struct {
   uint32_t sqlite_version_number;
 } db_header_t;
 
-// b-tree header section
+// b-tree header section, filled in from the page directory by db_get_page()
 typedef struct {
   uint8_t page_type;
   uint16_t first_freeblock;           // if zero, no free blocks
@@ -39,15 +39,123 @@ typedef struct {
   uint8_t fragmented_free_bytes;
   uint32_t rightmost_pointer;         // appears in the header of interior b-tree pages 
                                       // only and is omitted from all other pages.
-  uint16_t *cell_pointers;
+  uint16_t *cell_pointers;            // decoded offsets, NULL in zero-copy mode
+  const uint8_t *cell_ptr_array;      // raw big-endian array inside the page
 } btree_page_header_t;
 
+// chunk of the cell pointer arena; blocks never move once allocated
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t used;
+    size_t capacity;
+    uint16_t data[];
+} arena_block_t;
+
+// slot states in page_directory_t.loaded
+#define SLOT_EMPTY 0
+#define SLOT_LOADED 1
+#define SLOT_FIELDS 2   // header fields decoded, cell pointers pending
+#define SLOT_CACHED 3   // mapped from a sidecar, cell pointers in it too
+
+// page directory stored as struct-of-arrays, one slot per page. All dense
+// arrays live in a single allocation and all decoded cell pointers in the
+// arena, so teardown is a handful of frees regardless of page count.
+typedef struct {
+    uint8_t *page_types;
+    uint8_t *frag_free_bytes;
+    uint8_t *loaded;                  // non-zero once the slot is valid
+    uint16_t *first_freeblocks;
+    uint16_t *cell_counts;
+    uint16_t *content_starts;
+    uint32_t *rightmost_pointers;
+    uint16_t **cell_pointers;         // into the arena, NULL in zero-copy mode
+    arena_block_t *arena;
+    int zero_copy;
+    void *block;                      // backing allocation of the arrays
+} page_directory_t;
+
+// slot of the WAL page index; page_num 0 marks an empty slot
+typedef struct {
+    uint32_t page_num;
+    uint32_t frame;                   // frame with the latest committed image
+} wal_slot_t;
+
+// committed state of a <db>-wal file, see wal.c. Empty (frames == 0) when
+// the database has no write-ahead log.
+typedef struct {
+    void *data;
+    size_t size;
+    uint32_t page_size;
+    uint32_t frames;                  // frames up to the last commit
+    uint32_t db_size;                 // database size in pages after it
+    wal_slot_t *slots;                // open addressing, mask + 1 slots
+    uint32_t mask;
+    uint32_t checksum[2];             // running checksum after the last commit
+    int big_endian;                   // checksum word order
+    uint8_t header[32];               // log header as indexed, salts included
+} wal_t;
+
+// a table b-tree in a page metadata sidecar
+typedef struct {
+    uint32_t root_page;
+    uint32_t leaf_count;
+    uint64_t first_leaf;              // index into sidecar_t.leaves
+    uint64_t rows;
+} sidecar_table_t;
+
+// page metadata mapped from <db>.litereader-idx, see sidecar.c. The page
+// directory arrays point into the same mapping.
+typedef struct {
+    void *map;
+    size_t size;
+    const uint64_t *cell_offsets;     // per page into cells, or UINT64_MAX
+    const uint16_t *cells;
+    uint64_t cell_total;
+    const sidecar_table_t *tables;    // ascending root page
+    uint32_t table_count;
+    const uint32_t *leaves;           // leaf pages of each table in key order
+} sidecar_t;
+
+// how the main database file is read, see pager.c
+typedef enum {
+    DB_IO_MMAP,         // one read-only mapping of the whole file
+    DB_IO_PREAD,        // pread() into a bounded page cache
+    DB_IO_URING,        // as DB_IO_PREAD, read-ahead batched through io_uring
+    DB_IO_WINDOW        // fixed-size mappings under a hard memory cap
+} db_io_t;
+
+// how pages are about to be visited, for db_set_access()
+typedef enum {
+    DB_ACCESS_NORMAL,
+    DB_ACCESS_SEQUENTIAL,   // every page in file order (the full dump)
+    DB_ACCESS_TREE,         // table scans, children read ahead by io_uring
+    DB_ACCESS_POINT         // a few root-to-leaf paths
+} db_access_t;
+
+// page cache of the pread, io_uring and window backends, see pager.c
+typedef struct pager pager_t;
+
+// options for parse_database_ex()
+typedef struct {
+    int zero_copy;      // read cell pointers from the mapping when needed
+    int no_wal;         // ignore <db>-wal and read the main file only
+    db_io_t io;
+    size_t cache_pages; // page cache size, 0 for PAGER_DEFAULT_PAGES
+    size_t max_resident; // bytes DB_IO_WINDOW maps at once
+} db_options_t;
+
 // complete database structure
 typedef struct {
     db_header_t header;
-    btree_page_header_t *page_headers;
-    void *file_data;
+    page_directory_t pages;             // decoded on first use, see db_get_page()
+    void *file_data;                    // NULL when read through a pager
     size_t file_size;
+    pager_t *pager;
+    int prefetch;                       // walks read children ahead
+    int windowed;                       // DB_IO_WINDOW: no page directory
+    uint8_t *spill;                     // windowed: last array past its page
+    wal_t wal;                          // pages newer than the main file
+    sidecar_t sidecar;                  // cached directory, if one is attached
 } database_t;
 
 // sqlite_master row
@@ -66,4 +174,30 @@ typedef struct {
     size_t capacity;
 } schema_t;
 
+// type affinity of a declared column type, see column_affinity()
+typedef enum {
+    AFFINITY_BLOB,      // no type, or BLOB
+    AFFINITY_TEXT,
+    AFFINITY_NUMERIC,
+    AFFINITY_INTEGER,
+    AFFINITY_REAL
+} column_affinity_t;
+
+// one column of a CREATE TABLE statement
+typedef struct {
+    char *name;
+    char *decl_type;            // declared type as written, "" if none
+    char *default_value;        // DEFAULT literal as written, NULL if none
+    column_affinity_t affinity;
+    int rowid_alias;            // INTEGER PRIMARY KEY, stored as the rowid
+    int stored;                 // 0 for VIRTUAL generated columns
+} table_column_t;
+
+// columns of a table, in declaration order
+typedef struct {
+    table_column_t *columns;
+    size_t count;
+    int without_rowid;
+} table_columns_t;
+
 #endif
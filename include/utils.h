@@ -7,5 +7,7 @@
 uint16_t read_be16(uint8_t *ptr);
 uint32_t read_be32(uint8_t *ptr);
 uint64_t read_varint(uint8_t *data, size_t *bytes_read, size_t max_len);
+size_t read_varints(const uint8_t *data, size_t len, uint64_t *values,
+                    size_t max, size_t *consumed);
 
 #endif
@@ -0,0 +1,46 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include "types.h"
+
+// WAL header and frame header sizes
+#define WAL_HEADER_SIZE 32
+#define WAL_FRAME_HEADER_SIZE 24
+
+int wal_open(wal_t *wal, const char *db_path, uint32_t page_size);
+int wal_extend(wal_t *wal, const char *db_path, uint32_t page_size,
+               uint32_t *first);
+void wal_close(wal_t *wal);
+
+// page number stored in frame `frame` of the log
+static inline uint32_t wal_frame_page(const wal_t *wal, uint32_t frame) {
+    const uint8_t *p = (const uint8_t *)wal->data + WAL_HEADER_SIZE +
+                       (size_t)frame * (WAL_FRAME_HEADER_SIZE + wal->page_size);
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint32_t wal_hash(uint32_t page_num, uint32_t mask) {
+    return (page_num * 0x9E3779B1u) & mask;
+}
+
+// Latest committed image of page `page_num` in the log, or NULL if the
+// main file holds the current version.
+static inline const uint8_t *wal_page(const wal_t *wal, uint32_t page_num) {
+    if (wal->frames == 0) {
+        return NULL;
+    }
+    for (uint32_t h = wal_hash(page_num, wal->mask);; h = (h + 1) & wal->mask) {
+        const wal_slot_t *slot = &wal->slots[h];
+        if (slot->page_num == page_num) {
+            return (const uint8_t *)wal->data + WAL_HEADER_SIZE +
+                   (size_t)slot->frame * (WAL_FRAME_HEADER_SIZE + wal->page_size) +
+                   WAL_FRAME_HEADER_SIZE;
+        }
+        if (slot->page_num == 0) {
+            return NULL;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+#include "types.h"
+
+// a database followed across writes; see watch.c
+typedef struct {
+    const char *path;
+    char *wal_path;
+    db_options_t opts;
+    int threads;
+    int fd;                     // main file, for header reads
+    database_t *db;
+    uint64_t *hashes;           // content hash of each page at the last pass
+    uint32_t page_count;        // pages in `hashes`
+    uint32_t change_counter;
+    struct stat file_stat;
+    struct stat wal_stat;
+    int wal_exists;
+    // delta of the last watch_poll(): changed pages in ascending order,
+    // and pages (page_count, old_page_count] that no longer exist
+    uint32_t *changed;
+    size_t changed_count;
+    size_t changed_cap;
+    uint32_t old_page_count;
+} watch_t;
+
+int watch_open(watch_t *w, const char *path, database_t *db,
+               const db_options_t *opts, int threads);
+int watch_poll(watch_t *w);
+void watch_close(watch_t *w);
+
+#endif
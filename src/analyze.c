@@ -0,0 +1,588 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/analyze.h"
+#include "../include/btree.h"
+#include "../include/cell.h"
+#include "../include/constants.h"
+#include "../include/parser.h"
+#include "../include/pool.h"
+#include "../include/serializer.h"
+#include "../include/utils.h"
+
+/*
+ * Space analysis (--analyze): where the pages and bytes of a file go.
+ *
+ * Every b-tree of the schema, sqlite_master included, is walked once and
+ * each of its pages is charged to the object owning the tree: leaf and
+ * interior pages, cells and payload, and the unused bytes of the page
+ * split into the unallocated gap, the freeblock chain and the fragmented
+ * bytes. Overflow pages are counted from the payload sizes, the chains
+ * are not read. The freelist comes from its trunk chain; pages no b-tree,
+ * freelist or pointer map claims are leaked (or the file is corrupt).
+ *
+ * For several workers the trees are split into subtrees, the children of
+ * their upper interior pages, and each worker charges the subtrees it
+ * walks to accumulators of its own, summed at the end. Subtrees stay in
+ * key order, so leaves out of file order are counted across subtree
+ * boundaries as well.
+ */
+
+// SQLite's lock byte, the page holding it is never used
+#define ANALYZE_PENDING_BYTE 0x40000000u
+
+typedef struct {
+    size_t object;          // index into analyze_result_t.objects
+    uint32_t page;          // subtree root
+    uint32_t depth;         // levels above the subtree root
+    uint8_t leaf_type;      // kind of the object's b-tree
+    uint32_t first_leaf;    // filled in by the walk, 0 if none
+    uint32_t last_leaf;
+} analyze_task_t;
+
+typedef struct {
+    analyze_task_t *items;
+    size_t count;
+    size_t cap;
+} task_list_t;
+
+typedef struct {
+    database_t *db;
+    analyze_task_t *tasks;
+    analyze_space_t *spaces;    // `objects` accumulators per worker
+    size_t objects;
+} analyze_run_t;
+
+typedef struct {
+    analyze_task_t *task;
+    analyze_space_t *space;
+} analyze_walk_t;
+
+static int is_leaf(uint8_t page_type) {
+    return page_type == PAGE_TYPE_LEAF_TABLE || page_type == PAGE_TYPE_LEAF_INDEX;
+}
+
+static int same_kind(uint8_t page_type, uint8_t leaf_type) {
+    if (leaf_type == PAGE_TYPE_LEAF_TABLE) {
+        return page_type == PAGE_TYPE_LEAF_TABLE ||
+               page_type == PAGE_TYPE_INTERIOR_TABLE;
+    }
+    return page_type == PAGE_TYPE_LEAF_INDEX ||
+           page_type == PAGE_TYPE_INTERIOR_INDEX;
+}
+
+static int push_task(task_list_t *list, const analyze_task_t *task) {
+    if (list->count == list->cap) {
+        size_t grown = list->cap ? list->cap * 2 : 64;
+        analyze_task_t *items = realloc(list->items, sizeof(analyze_task_t) * grown);
+        if (!items) {
+            return -1;
+        }
+        list->items = items;
+        list->cap = grown;
+    }
+    list->items[list->count++] = *task;
+    return 0;
+}
+
+// Charges b-tree page page_num to `s`: its cells, their payload (and the
+// overflow pages it needs) and its unused bytes.
+static void add_page(database_t *db, analyze_space_t *s, uint32_t page_num,
+                     const btree_page_header_t *page) {
+    uint8_t *data = db_page_data(db, page_num);
+    size_t page_size = db->header.page_size;
+    size_t usable = db_usable_size(db);
+    int interior = !is_leaf(page->page_type);
+
+    if (interior) {
+        s->interior_pages++;
+    } else {
+        s->leaf_pages++;
+    }
+    s->usable_bytes += usable;
+    s->cells += page->cell_count;
+    s->fragmented_bytes += page->fragmented_free_bytes;
+    if (!data) {
+        s->errors++;
+        return;
+    }
+
+    size_t array_end = (page_num == 1 ? 100 : 0) + (interior ? 12 : 8) +
+                       (size_t)page->cell_count * 2;
+    size_t content = page->cell_content_start ? page->cell_content_start : 65536;
+    if (content < array_end || content > usable) {
+        s->errors++;
+    } else {
+        s->unallocated_bytes += content - array_end;
+    }
+
+    // the chain ascends and blocks take 4 bytes at least, which bounds it
+    size_t offset = page->first_freeblock;
+    size_t budget = usable / 4;
+    while (offset != 0) {
+        if (offset < array_end || offset + 4 > usable || budget-- == 0) {
+            s->errors++;
+            break;
+        }
+        size_t next = read_be16(data + offset);
+        size_t size = read_be16(data + offset + 2);
+        if (size < 4 || offset + size > usable ||
+            (next != 0 && next <= offset + size)) {
+            s->errors++;
+            break;
+        }
+        s->freeblocks++;
+        s->freeblock_bytes += size;
+        offset = next;
+    }
+
+    // interior table cells hold a child and a key, no payload
+    if (page->page_type == PAGE_TYPE_INTERIOR_TABLE) {
+        return;
+    }
+    for (uint16_t i = 0; i < page->cell_count; i++) {
+        size_t cell = page_cell_pointer(page, i);
+        if (page->page_type == PAGE_TYPE_INTERIOR_INDEX) {
+            cell += 4;
+        }
+        size_t bytes_read = 0;
+        uint64_t payload = cell < page_size ?
+            read_varint(data + cell, &bytes_read, page_size - cell) : 0;
+        if (cell >= page_size || bytes_read == 0) {
+            s->errors++;
+            continue;
+        }
+        s->entries++;
+        s->payload_bytes += payload;
+        size_t local = cell_local_payload(db, page->page_type, payload);
+        if (payload > local) {
+            uint64_t spilled = payload - local;
+            s->overflow_bytes += spilled;
+            s->overflow_pages += (spilled + usable - 5) / (usable - 4);
+        }
+    }
+}
+
+// btree_page_fn: charges each page of a subtree to the task's object
+static int walk_page(database_t *db, uint32_t page_num,
+                     btree_page_header_t *page, int depth, void *ctx) {
+    analyze_walk_t *w = ctx;
+    analyze_task_t *t = w->task;
+    if (depth == 0 && !same_kind(page->page_type, t->leaf_type)) {
+        fprintf(stderr, "Error: page %u is not %s b-tree page\n", page_num,
+                t->leaf_type == PAGE_TYPE_LEAF_TABLE ? "a table" : "an index");
+        return 1;
+    }
+    add_page(db, w->space, page_num, page);
+
+    uint32_t level = t->depth + (uint32_t)depth + 1;
+    if (level > w->space->depth) {
+        w->space->depth = level;
+    }
+    if (is_leaf(page->page_type)) {
+        if (t->last_leaf != 0 && page_num != t->last_leaf + 1) {
+            w->space->non_sequential++;
+        }
+        if (t->first_leaf == 0) {
+            t->first_leaf = page_num;
+        }
+        t->last_leaf = page_num;
+    }
+    return 0;
+}
+
+// pool_range_fn: walks subtrees [begin, end)
+static void run_tasks(void *ctx, size_t begin, size_t end, int worker) {
+    analyze_run_t *run = ctx;
+    for (size_t i = begin; i < end; i++) {
+        analyze_task_t *t = &run->tasks[i];
+        analyze_walk_t w = {
+            t, &run->spaces[(size_t)worker * run->objects + t->object]
+        };
+        if (btree_visit_pages(run->db, t->page, walk_page, &w) != 0) {
+            w.space->errors++;
+        }
+    }
+}
+
+// Replaces each task rooted at an interior page by one task per child, in
+// key order, charging the interior page to its object on the way. *split
+// is set if any task was. Returns 0, or -1 if out of memory.
+static int split_tasks(database_t *db, analyze_result_t *r, task_list_t *tasks,
+                       int *split) {
+    task_list_t next = {0};
+    size_t page_size = db->header.page_size;
+    *split = 0;
+    for (size_t i = 0; i < tasks->count; i++) {
+        analyze_task_t t = tasks->items[i];
+        btree_page_header_t page;
+        uint8_t *data = NULL;
+        // leaves stay, as do subtrees the walk will report as malformed
+        if (db_get_page(db, t.page, &page) < 0 || is_leaf(page.page_type) ||
+            !same_kind(page.page_type, t.leaf_type) ||
+            t.depth + 1 >= BTREE_MAX_DEPTH ||
+            (data = db_page_data(db, t.page)) == NULL) {
+            db_release_pages(db);
+            if (push_task(&next, &t) < 0) {
+                free(next.items);
+                return -1;
+            }
+            continue;
+        }
+
+        analyze_space_t *s = &r->objects[t.object].space;
+        add_page(db, s, t.page, &page);
+        if (t.depth + 1 > s->depth) {
+            s->depth = t.depth + 1;
+        }
+        for (uint32_t c = 0; c <= page.cell_count; c++) {
+            analyze_task_t child = t;
+            child.depth = t.depth + 1;
+            if (c < page.cell_count) {
+                size_t cell = page_cell_pointer(&page, (uint16_t)c);
+                if (cell + 4 > page_size) {
+                    s->errors++;
+                    continue;
+                }
+                child.page = read_be32(data + cell);
+            } else {
+                child.page = page.rightmost_pointer;
+            }
+            if (push_task(&next, &child) < 0) {
+                free(next.items);
+                return -1;
+            }
+        }
+        db_release_pages(db);
+        *split = 1;
+    }
+    free(tasks->items);
+    *tasks = next;
+    return 0;
+}
+
+static void space_add(analyze_space_t *dst, const analyze_space_t *src) {
+    dst->leaf_pages += src->leaf_pages;
+    dst->interior_pages += src->interior_pages;
+    dst->overflow_pages += src->overflow_pages;
+    dst->cells += src->cells;
+    dst->entries += src->entries;
+    dst->payload_bytes += src->payload_bytes;
+    dst->overflow_bytes += src->overflow_bytes;
+    dst->usable_bytes += src->usable_bytes;
+    dst->unallocated_bytes += src->unallocated_bytes;
+    dst->freeblock_bytes += src->freeblock_bytes;
+    dst->freeblocks += src->freeblocks;
+    dst->fragmented_bytes += src->fragmented_bytes;
+    dst->non_sequential += src->non_sequential;
+    dst->errors += src->errors;
+    if (src->depth > dst->depth) {
+        dst->depth = src->depth;
+    }
+}
+
+// Follows the freelist trunk chain from the header, counting trunk pages
+// and the leaf pages each lists.
+static void count_freelist(database_t *db, analyze_result_t *r) {
+    uint32_t trunk = db->header.first_freelist_trunk;
+    size_t max_leaves = db_usable_size(db) / 4 - 2;
+    uint32_t seen = 0;
+    while (trunk != 0) {
+        uint8_t *data = trunk <= r->page_count && seen++ < r->page_count ?
+                        db_page_data(db, trunk) : NULL;
+        if (!data) {
+            fprintf(stderr, "Error: invalid freelist trunk page %u\n", trunk);
+            r->freelist_error = 1;
+            break;
+        }
+        uint32_t next = read_be32(data);
+        uint32_t leaves = read_be32(data + 4);
+        db_release_pages(db);
+        if (leaves > max_leaves) {
+            fprintf(stderr, "Error: freelist trunk page %u lists %u leaves\n",
+                    trunk, leaves);
+            r->freelist_error = 1;
+            break;
+        }
+        r->freelist_trunk_pages++;
+        r->freelist_leaf_pages += leaves;
+        trunk = next;
+    }
+}
+
+// Charges every page of the file to a schema object (sqlite_master, then
+// each schema entry with a b-tree), the freelist, the pointer maps or the
+// lock byte page, walking the b-trees on up to `threads` workers. Object
+// names point into `schema`. A pager is not shared between threads and
+// cell pointers decoded into the arena are not either, so only a mapped
+// file in zero-copy mode is walked in parallel. Malformed trees are
+// reported on stderr and counted in their object's errors. Returns 0, or
+// -1 if out of memory.
+int analyze_database(database_t *db, const schema_t *schema, int threads,
+                     analyze_result_t *result) {
+    memset(result, 0, sizeof(*result));
+    if (threads < 1 || db->pager || !db->pages.zero_copy) {
+        threads = 1;
+    }
+    result->page_count = db->header.header_db_size;
+
+    size_t entries = schema ? schema->count : 0;
+    result->objects = calloc(entries + 1, sizeof(analyze_object_t));
+    if (!result->objects) {
+        return -1;
+    }
+    result->objects[0] = (analyze_object_t){
+        .type = "table", .name = "sqlite_master", .tbl_name = "sqlite_master",
+        .root_page = 1,
+    };
+    result->count = 1;
+    for (size_t i = 0; i < entries; i++) {
+        const schema_entry_t *e = &schema->entries[i];
+        if (e->rootpage > 0 && e->rootpage <= UINT32_MAX) {
+            result->objects[result->count++] = (analyze_object_t){
+                .type = e->type, .name = e->name, .tbl_name = e->tbl_name,
+                .root_page = (uint32_t)e->rootpage,
+            };
+        }
+    }
+
+    // WITHOUT ROWID tables are index b-trees, so the root tells the kind
+    task_list_t tasks = {0};
+    for (size_t i = 0; i < result->count; i++) {
+        btree_page_header_t root;
+        int index = db_get_page(db, result->objects[i].root_page, &root) == 0 &&
+                    same_kind(root.page_type, PAGE_TYPE_LEAF_INDEX);
+        db_release_pages(db);
+        analyze_task_t t = {
+            .object = i, .page = result->objects[i].root_page,
+            .leaf_type = index ? PAGE_TYPE_LEAF_INDEX : PAGE_TYPE_LEAF_TABLE,
+        };
+        if (push_task(&tasks, &t) < 0) {
+            goto fail;
+        }
+    }
+    while (threads > 1 && tasks.count < ANALYZE_TASKS_PER_THREAD * (size_t)threads) {
+        int split;
+        if (split_tasks(db, result, &tasks, &split) < 0) {
+            goto fail;
+        }
+        if (!split) {
+            break;
+        }
+    }
+
+    analyze_run_t run = {
+        .db = db,
+        .tasks = tasks.items,
+        .spaces = calloc((size_t)threads * result->count, sizeof(analyze_space_t)),
+        .objects = result->count,
+    };
+    if (!run.spaces) {
+        goto fail;
+    }
+    if (pool_run(tasks.count, 1, threads, run_tasks, &run) < 0) {
+        run_tasks(&run, 0, tasks.count, 0);
+    }
+    for (int w = 0; w < threads; w++) {
+        for (size_t i = 0; i < result->count; i++) {
+            space_add(&result->objects[i].space,
+                      &run.spaces[(size_t)w * result->count + i]);
+        }
+    }
+    free(run.spaces);
+
+    // leaf order across the subtrees of each object
+    for (size_t i = 0, prev = 0; i < tasks.count; i++) {
+        const analyze_task_t *t = &tasks.items[i];
+        if (i > 0 && t->object != tasks.items[i - 1].object) {
+            prev = 0;
+        }
+        if (t->first_leaf == 0) {
+            continue;
+        }
+        if (prev != 0 && t->first_leaf != prev + 1) {
+            result->objects[t->object].space.non_sequential++;
+        }
+        prev = t->last_leaf;
+    }
+    free(tasks.items);
+
+    count_freelist(db, result);
+    size_t page_size = db->header.page_size;
+    if (db->header.page_number_largest_root != 0) {
+        // one map page, then the pages it maps (usable / 5 entries)
+        uint64_t step = db_usable_size(db) / 5 + 1;
+        for (uint64_t p = 2; p <= result->page_count; p += step) {
+            result->ptrmap_pages++;
+        }
+    }
+    if (page_size > 0 && ANALYZE_PENDING_BYTE / page_size + 1 <= result->page_count) {
+        result->lock_pages = 1;
+    }
+    return 0;
+
+fail:
+    free(tasks.items);
+    analyze_free(result);
+    return -1;
+}
+
+void analyze_free(analyze_result_t *result) {
+    free(result->objects);
+    result->objects = NULL;
+    result->count = 0;
+}
+
+// unused bytes of the object's overflow pages
+static uint64_t overflow_unused(const database_t *db, const analyze_space_t *s) {
+    return s->overflow_pages * (db_usable_size(db) - 4) - s->overflow_bytes;
+}
+
+static uint64_t unused_bytes(const analyze_space_t *s) {
+    return s->unallocated_bytes + s->freeblock_bytes + s->fragmented_bytes;
+}
+
+// share of the usable bytes of the b-tree pages in use
+static double fill_factor(const analyze_space_t *s) {
+    uint64_t unused = unused_bytes(s);
+    if (s->usable_bytes == 0 || unused > s->usable_bytes) {
+        return 0.0;
+    }
+    return (double)(s->usable_bytes - unused) / (double)s->usable_bytes;
+}
+
+static void print_field(out_t *out, const char *name, uint64_t value) {
+    out_str(out, ",\"");
+    out_str(out, name);
+    out_str(out, "\":");
+    out_u64(out, value);
+}
+
+static void print_object_json(out_t *out, const database_t *db,
+                              const analyze_object_t *o) {
+    const analyze_space_t *s = &o->space;
+    out_str(out, "{\"type\":");
+    json_print_string(out, o->type);
+    out_str(out, ",\"name\":");
+    json_print_string(out, o->name);
+    out_str(out, ",\"tbl_name\":");
+    json_print_string(out, o->tbl_name);
+    print_field(out, "rootpage", o->root_page);
+    print_field(out, "leaf_pages", s->leaf_pages);
+    print_field(out, "interior_pages", s->interior_pages);
+    print_field(out, "overflow_pages", s->overflow_pages);
+    print_field(out, "depth", s->depth);
+    print_field(out, "cells", s->cells);
+    print_field(out, "entries", s->entries);
+    print_field(out, "payload_bytes", s->payload_bytes);
+    print_field(out, "overflow_payload_bytes", s->overflow_bytes);
+    print_field(out, "unallocated_bytes", s->unallocated_bytes);
+    print_field(out, "freeblocks", s->freeblocks);
+    print_field(out, "freeblock_bytes", s->freeblock_bytes);
+    print_field(out, "fragmented_bytes", s->fragmented_bytes);
+    print_field(out, "overflow_unused_bytes", overflow_unused(db, s));
+    out_str(out, ",\"fill_factor\":");
+    out_double(out, fill_factor(s));
+    print_field(out, "non_sequential_leaves", s->non_sequential);
+    print_field(out, "errors", s->errors);
+    out_char(out, '}');
+}
+
+static void print_object_text(out_t *out, const database_t *db,
+                              const analyze_object_t *o) {
+    const analyze_space_t *s = &o->space;
+    out_printf(out, "\n=== %s %s", o->type, o->name);
+    if (strcmp(o->type, "index") == 0) {
+        out_printf(out, " on %s", o->tbl_name);
+    }
+    out_printf(out, " (root page %u) ===\n", o->root_page);
+    out_printf(out, "Pages:                 %llu (%llu leaf, %llu interior, %llu overflow)\n",
+               (unsigned long long)(s->leaf_pages + s->interior_pages + s->overflow_pages),
+               (unsigned long long)s->leaf_pages,
+               (unsigned long long)s->interior_pages,
+               (unsigned long long)s->overflow_pages);
+    out_printf(out, "Depth:                 %u\n", s->depth);
+    out_printf(out, "Entries:               %llu in %llu cells\n",
+               (unsigned long long)s->entries, (unsigned long long)s->cells);
+    out_printf(out, "Payload bytes:         %llu (%llu on overflow pages)\n",
+               (unsigned long long)s->payload_bytes,
+               (unsigned long long)s->overflow_bytes);
+    out_printf(out, "Unused bytes:          %llu (%llu unallocated, %llu in %llu freeblocks, %llu fragmented)\n",
+               (unsigned long long)unused_bytes(s),
+               (unsigned long long)s->unallocated_bytes,
+               (unsigned long long)s->freeblock_bytes,
+               (unsigned long long)s->freeblocks,
+               (unsigned long long)s->fragmented_bytes);
+    out_printf(out, "Overflow unused bytes: %llu\n",
+               (unsigned long long)overflow_unused(db, s));
+    out_printf(out, "Fill factor:           %.1f%%\n", 100.0 * fill_factor(s));
+    out_printf(out, "Non-sequential leaves: %llu of %llu\n",
+               (unsigned long long)s->non_sequential,
+               (unsigned long long)s->leaf_pages);
+    if (s->errors > 0) {
+        out_printf(out, "Errors:                %llu\n", (unsigned long long)s->errors);
+    }
+}
+
+// Prints the result of analyze_database(): file totals, then one block
+// (or JSON object) per schema object.
+void analyze_print(out_t *out, const database_t *db,
+                   const analyze_result_t *result, int json_mode) {
+    uint64_t btree = 0, overflow = 0, errors = (uint64_t)result->freelist_error;
+    for (size_t i = 0; i < result->count; i++) {
+        const analyze_space_t *s = &result->objects[i].space;
+        btree += s->leaf_pages + s->interior_pages;
+        overflow += s->overflow_pages;
+        errors += s->errors;
+    }
+    uint64_t freelist = (uint64_t)result->freelist_trunk_pages +
+                        result->freelist_leaf_pages;
+    // negative if pages are claimed twice
+    int64_t unaccounted = (int64_t)result->page_count - (int64_t)btree -
+                          (int64_t)overflow - (int64_t)freelist -
+                          (int64_t)result->ptrmap_pages - result->lock_pages;
+
+    if (json_mode) {
+        out_str(out, "{\"page_size\":");
+        out_u64(out, db->header.page_size);
+        print_field(out, "usable_size", db_usable_size(db));
+        print_field(out, "pages", result->page_count);
+        print_field(out, "btree_pages", btree);
+        print_field(out, "overflow_pages", overflow);
+        print_field(out, "freelist_trunk_pages", result->freelist_trunk_pages);
+        print_field(out, "freelist_leaf_pages", result->freelist_leaf_pages);
+        print_field(out, "ptrmap_pages", result->ptrmap_pages);
+        print_field(out, "lock_pages", result->lock_pages);
+        out_str(out, ",\"unaccounted_pages\":");
+        out_i64(out, unaccounted);
+        print_field(out, "errors", errors);
+        out_str(out, ",\"objects\":[");
+        for (size_t i = 0; i < result->count; i++) {
+            out_str(out, i > 0 ? ",\n  " : "\n  ");
+            print_object_json(out, db, &result->objects[i]);
+        }
+        out_str(out, "\n]}\n");
+        return;
+    }
+
+    out_str(out, "=== Space analysis ===\n");
+    out_printf(out, "Page size:             %u (%zu usable)\n",
+               (unsigned)db->header.page_size, db_usable_size(db));
+    out_printf(out, "Pages:                 %u\n", result->page_count);
+    out_printf(out, "B-tree pages:          %llu\n", (unsigned long long)btree);
+    out_printf(out, "Overflow pages:        %llu\n", (unsigned long long)overflow);
+    out_printf(out, "Freelist pages:        %llu (%u trunk, %u leaf)\n",
+               (unsigned long long)freelist, result->freelist_trunk_pages,
+               result->freelist_leaf_pages);
+    out_printf(out, "Pointer map pages:     %u\n", result->ptrmap_pages);
+    if (result->lock_pages > 0) {
+        out_printf(out, "Lock byte pages:       %u\n", result->lock_pages);
+    }
+    out_printf(out, "Unaccounted pages:     %lld\n", (long long)unaccounted);
+    if (errors > 0) {
+        out_printf(out, "Errors:                %llu\n", (unsigned long long)errors);
+    }
+    for (size_t i = 0; i < result->count; i++) {
+        print_object_text(out, db, &result->objects[i]);
+    }
+}
@@ -0,0 +1,326 @@
+#define _POSIX_C_SOURCE 200809L
+#include <dirent.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "../include/batch.h"
+#include "../include/btree.h"
+#include "../include/constants.h"
+#include "../include/parser.h"
+#include "../include/pipeline.h"
+#include "../include/schema.h"
+#include "../include/serializer.h"
+
+/*
+ * Batch mode: one NDJSON summary per database file.
+ *
+ * Each file is one batch of the ordered pipeline, so files are opened,
+ * summarized and closed on the worker threads while the summaries are
+ * written in input order. A summary holds the main header fields, the
+ * schema, the row count of every table (from page headers, no record is
+ * decoded) and the errors met on the way. A file that cannot be read
+ * yields a summary with its error rather than stopping the batch.
+ */
+
+// rows of a table whose b-tree could not be walked
+#define BATCH_NO_ROWS UINT64_MAX
+
+// per-worker scratch, kept from one file to the next
+typedef struct {
+    uint64_t *rows;         // row count of each schema entry
+    size_t rows_cap;
+} batch_worker_t;
+
+typedef struct {
+    char **paths;
+    const db_options_t *opts;
+    batch_worker_t *workers;
+    atomic_size_t failed;
+} batch_t;
+
+static int ends_with(const char *s, const char *suffix) {
+    size_t len = strlen(s), n = strlen(suffix);
+    return len >= n && strcmp(s + len - n, suffix) == 0;
+}
+
+static int add_path(char ***paths, size_t *count, size_t *cap, char *path) {
+    if (!path) {
+        return -1;
+    }
+    if (*count == *cap) {
+        size_t grown = *cap ? *cap * 2 : 64;
+        char **p = realloc(*paths, sizeof(char *) * grown);
+        if (!p) {
+            free(path);
+            return -1;
+        }
+        *paths = p;
+        *cap = grown;
+    }
+    (*paths)[(*count)++] = path;
+    return 0;
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// regular files of a directory, without hidden files and the -wal, -shm,
+// -journal and sidecar files that sit next to databases
+static int list_directory(const char *dir, char ***paths, size_t *count,
+                          size_t *cap) {
+    DIR *d = opendir(dir);
+    if (!d) {
+        perror(dir);
+        return -1;
+    }
+    int rc = 0;
+    struct dirent *e;
+    while (rc == 0 && (e = readdir(d)) != NULL) {
+        const char *name = e->d_name;
+        if (name[0] == '.' || ends_with(name, "-wal") || ends_with(name, "-shm") ||
+            ends_with(name, "-journal") || ends_with(name, ".litereader-idx")) {
+            continue;
+        }
+        size_t len = strlen(dir) + strlen(name) + 2;
+        char *path = malloc(len);
+        if (!path) {
+            rc = -1;
+            break;
+        }
+        snprintf(path, len, "%s/%s", dir, name);
+        struct stat st;
+        if (stat(path, &st) < 0 || !S_ISREG(st.st_mode)) {
+            free(path);
+            continue;
+        }
+        rc = add_path(paths, count, cap, path);
+    }
+    closedir(d);
+    if (rc == 0) {
+        qsort(*paths, *count, sizeof(char *), compare_paths);
+    }
+    return rc;
+}
+
+// one path per line, blank lines skipped
+static int list_file(const char *list, char ***paths, size_t *count,
+                     size_t *cap) {
+    FILE *f = strcmp(list, "-") == 0 ? stdin : fopen(list, "r");
+    if (!f) {
+        perror(list);
+        return -1;
+    }
+    int rc = 0;
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+    while (rc == 0 && (len = getline(&line, &line_cap, f)) >= 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len > 0) {
+            rc = add_path(paths, count, cap, strdup(line));
+        }
+    }
+    free(line);
+    if (f != stdin) {
+        fclose(f);
+    }
+    return rc;
+}
+
+// Collects the files to summarize: the regular files of `source` if it is
+// a directory (sorted by name), else the paths listed in it one per line
+// ("-" reads the list from stdin). Returns 0 with *paths owned by the
+// caller, -1 on error.
+int batch_list_files(const char *source, char ***paths, size_t *count) {
+    size_t cap = 0;
+    struct stat st;
+    *paths = NULL;
+    *count = 0;
+    int rc = strcmp(source, "-") != 0 && stat(source, &st) == 0 &&
+             S_ISDIR(st.st_mode) ? list_directory(source, paths, count, &cap)
+                                 : list_file(source, paths, count, &cap);
+    if (rc < 0) {
+        batch_free_files(*paths, *count);
+        *paths = NULL;
+        *count = 0;
+    }
+    return rc;
+}
+
+void batch_free_files(char **paths, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(paths[i]);
+    }
+    free(paths);
+}
+
+static void print_field(out_t *out, const char *name, uint64_t value) {
+    out_char(out, '"');
+    out_str(out, name);
+    out_str(out, "\":");
+    out_u64(out, value);
+}
+
+static void print_header(out_t *out, const database_t *db) {
+    const db_header_t *h = &db->header;
+    out_str(out, "\"header\":{");
+    print_field(out, "page_size", h->page_size); out_char(out, ',');
+    print_field(out, "file_format_write", h->file_format_write); out_char(out, ',');
+    print_field(out, "file_format_read", h->file_format_read); out_char(out, ',');
+    print_field(out, "reserved_space", h->reserved_space); out_char(out, ',');
+    print_field(out, "file_change_counter", h->file_change_counter); out_char(out, ',');
+    print_field(out, "header_db_size", h->header_db_size); out_char(out, ',');
+    print_field(out, "total_freelist_pages", h->total_freelist_trunk); out_char(out, ',');
+    print_field(out, "schema_cookie", h->schema_cookie); out_char(out, ',');
+    print_field(out, "schema_format_number", h->schema_format_number); out_char(out, ',');
+    print_field(out, "db_text_encoding", h->db_text_encoding); out_char(out, ',');
+    print_field(out, "user_version", h->user_version); out_char(out, ',');
+    print_field(out, "incremental_vacuum_mode", h->incremental_version_mode); out_char(out, ',');
+    print_field(out, "application_id", h->application_id); out_char(out, ',');
+    print_field(out, "sqlite_version_number", h->sqlite_version_number);
+    out_char(out, '}');
+}
+
+static int has_rows(const schema_entry_t *e) {
+    return strcmp(e->type, "table") == 0 && e->rootpage > 0;
+}
+
+// pipeline_render_fn: the summary line of one file
+static int render_file(void *ctx, size_t index, int worker, out_t *out) {
+    batch_t *b = ctx;
+    batch_worker_t *w = &b->workers[worker];
+    const char *path = b->paths[index];
+
+    out_str(out, "{\"file\":");
+    json_print_string(out, path);
+
+    database_t *db = parse_database_ex(path, b->opts);
+    if (!db || memcmp(db->header.magic, SQLITE_MAGIC, 16) != 0) {
+        out_str(out, db ? ",\"ok\":false,\"errors\":[\"invalid sqlite file\"]}\n"
+                        : ",\"ok\":false,\"errors\":[\"failed to parse database\"]}\n");
+        free_database(db);
+        atomic_fetch_add(&b->failed, 1);
+        return 0;
+    }
+
+    // count first, so "ok" can lead the line
+    schema_t *schema = parse_schema(db);
+    size_t entries = schema ? schema->count : 0;
+    size_t errors = schema ? 0 : 1;
+    if (entries > w->rows_cap) {
+        uint64_t *rows = realloc(w->rows, sizeof(uint64_t) * entries);
+        if (!rows) {
+            out->error = 1;
+            free_schema(schema);
+            free_database(db);
+            return 1;
+        }
+        w->rows = rows;
+        w->rows_cap = entries;
+    }
+    for (size_t i = 0; i < entries; i++) {
+        const schema_entry_t *e = &schema->entries[i];
+        if (has_rows(e) &&
+            btree_count_rows(db, (uint32_t)e->rootpage, &w->rows[i]) < 0) {
+            w->rows[i] = BATCH_NO_ROWS;
+            errors++;
+        }
+    }
+
+    out_str(out, errors == 0 ? ",\"ok\":true," : ",\"ok\":false,");
+    print_field(out, "file_size", db->file_size); out_char(out, ',');
+    print_field(out, "wal_frames", db->wal.frames); out_char(out, ',');
+    print_header(out, db);
+
+    out_str(out, ",\"schema\":[");
+    for (size_t i = 0; i < entries; i++) {
+        const schema_entry_t *e = &schema->entries[i];
+        if (i > 0) out_char(out, ',');
+        out_str(out, "{\"type\":"); json_print_string(out, e->type);
+        out_str(out, ",\"name\":"); json_print_string(out, e->name);
+        out_str(out, ",\"tbl_name\":"); json_print_string(out, e->tbl_name);
+        out_str(out, ",\"rootpage\":"); out_i64(out, e->rootpage);
+        out_str(out, ",\"sql\":"); json_print_string(out, e->sql);
+        out_char(out, '}');
+    }
+
+    out_str(out, "],\"tables\":[");
+    int first = 1;
+    for (size_t i = 0; i < entries; i++) {
+        const schema_entry_t *e = &schema->entries[i];
+        if (!has_rows(e)) {
+            continue;
+        }
+        if (!first) out_char(out, ',');
+        first = 0;
+        out_str(out, "{\"name\":"); json_print_string(out, e->name);
+        out_str(out, ",\"rows\":");
+        if (w->rows[i] == BATCH_NO_ROWS) out_str(out, "null");
+        else out_u64(out, w->rows[i]);
+        out_char(out, '}');
+    }
+
+    out_str(out, "],\"errors\":[");
+    first = 1;
+    if (!schema) {
+        out_str(out, "\"failed to parse schema\"");
+        first = 0;
+    }
+    for (size_t i = 0; i < entries; i++) {
+        const schema_entry_t *e = &schema->entries[i];
+        if (has_rows(e) && w->rows[i] == BATCH_NO_ROWS) {
+            if (!first) out_char(out, ',');
+            first = 0;
+            out_str(out, "\"malformed b-tree of table ");
+            json_print_text_body(out, (const uint8_t *)e->name, strlen(e->name));
+            out_char(out, '"');
+        }
+    }
+    out_str(out, "]}\n");
+
+    if (errors > 0) {
+        atomic_fetch_add(&b->failed, 1);
+    }
+    free_schema(schema);
+    free_database(db);
+    return 0;
+}
+
+// Writes one summary line per path to `out`, in order, summarizing up to
+// `threads` files at once with `opts` for each. Returns 0 (the totals in
+// *result) or -1 if out of memory.
+int batch_run(out_t *out, char **paths, size_t count,
+              const db_options_t *opts, int threads, batch_result_t *result) {
+    if (threads < 1) {
+        threads = 1;
+    }
+    batch_t b = { .paths = paths, .opts = opts };
+    atomic_init(&b.failed, 0);
+    b.workers = calloc((size_t)threads, sizeof(batch_worker_t));
+    if (!b.workers) {
+        return -1;
+    }
+
+    // the writer holds two summaries per worker at most
+    if (threads < 2 ||
+        pipeline_run(out, count, threads, 2 * (size_t)threads, render_file, &b) < 0) {
+        for (size_t i = 0; i < count; i++) {
+            if (render_file(&b, i, 0, out) > 0) {
+                break;
+            }
+        }
+    }
+
+    for (int i = 0; i < threads; i++) {
+        free(b.workers[i].rows);
+    }
+    free(b.workers);
+    result->files = count;
+    result->failed = atomic_load(&b.failed);
+    return 0;
+}
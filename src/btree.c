@@ -0,0 +1,620 @@
+#include <stdio.h>
+#include <string.h>
+#include "../include/btree.h"
+#include "../include/constants.h"
+#include "../include/parser.h"
+#include "../include/schema.h"
+#include "../include/sidecar.h"
+#include "../include/utils.h"
+
+// Key of interior table cell `i` (the largest rowid in its left subtree).
+static int interior_key(database_t *db, uint8_t *data,
+                        const btree_page_header_t *page, uint16_t i,
+                        int64_t *key) {
+    uint16_t offset = page_cell_pointer(page, i);
+    size_t page_size = db->header.page_size;
+    size_t bytes_read;
+    if ((size_t)offset + 5 > page_size) {
+        return -1;
+    }
+    *key = (int64_t)read_varint(data + offset + 4, &bytes_read,
+                                page_size - offset - 4);
+    return bytes_read ? 0 : -1;
+}
+
+// Rowid of leaf table cell `i`, stored after the payload size varint.
+static int leaf_rowid(database_t *db, uint8_t *data,
+                      const btree_page_header_t *page, uint16_t i,
+                      int64_t *rowid) {
+    uint16_t offset = page_cell_pointer(page, i);
+    size_t page_size = db->header.page_size;
+    size_t bytes_read;
+    if (offset >= page_size) {
+        return -1;
+    }
+    read_varint(data + offset, &bytes_read, page_size - offset);
+    if (bytes_read == 0 || offset + bytes_read >= page_size) {
+        return -1;
+    }
+    size_t key_len;
+    *rowid = (int64_t)read_varint(data + offset + bytes_read, &key_len,
+                                  page_size - offset - bytes_read);
+    return key_len ? 0 : -1;
+}
+
+// Index of the first cell of a table page whose key (interior) or rowid
+// (leaf) is >= key, cell_count if there is none.
+static int lower_bound(database_t *db, uint32_t page_num,
+                       const btree_page_header_t *page, int64_t key,
+                       uint16_t *index) {
+    uint8_t *data = db_page_data(db, page_num);
+    int leaf = page->page_type == PAGE_TYPE_LEAF_TABLE;
+    uint16_t lo = 0, hi = page->cell_count;
+
+    while (lo < hi) {
+        uint16_t mid = lo + (hi - lo) / 2;
+        int64_t k;
+        int rc = leaf ? leaf_rowid(db, data, page, mid, &k)
+                      : interior_key(db, data, page, mid, &k);
+        if (rc < 0) {
+            fprintf(stderr, "Error: malformed cell on page %u\n", page_num);
+            return -1;
+        }
+        if (k < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *index = lo;
+    return 0;
+}
+
+typedef struct {
+    uint32_t page_num;
+    uint32_t next_child;    // cell index of the next child, cell_count = rightmost
+    uint32_t last_child;    // last child to visit, same numbering
+    uint32_t prefetched;    // children before this one were read ahead
+    btree_page_header_t page;
+} btree_frame_t;
+
+// rowid bounds of a walk; unbounded walks skip the key searches
+typedef struct {
+    int bounded;
+    int64_t lo;
+    int64_t hi;
+} btree_range_t;
+
+// Left child page number of interior table cell `i`, 0 if the cell is
+// out of bounds.
+static uint32_t interior_child(database_t *db, btree_frame_t *f, uint16_t i) {
+    uint8_t *data = db_page_data(db, f->page_num);
+    uint16_t offset = page_cell_pointer(&f->page, i);
+    if (!data || (size_t)offset + 4 > db->header.page_size) {
+        return 0;
+    }
+    return read_be32(data + offset);
+}
+
+// Reads ahead the next BTREE_PREFETCH_PAGES children of an interior page
+// that the walk will visit.
+static void prefetch_children(database_t *db, btree_frame_t *f) {
+    uint32_t pages[BTREE_PREFETCH_PAGES];
+    size_t count = 0;
+    uint32_t i = f->next_child;
+    for (; i <= f->last_child && count < BTREE_PREFETCH_PAGES; i++) {
+        pages[count] = i < f->page.cell_count ? interior_child(db, f, (uint16_t)i)
+                                              : f->page.rightmost_pointer;
+        count++;
+    }
+    f->prefetched = i;
+    db_prefetch_pages(db, pages, count);
+}
+
+// Fetches a frame's page header again after a release: in windowed mode
+// its cell pointer array points into a window that may have been unmapped.
+static int frame_refresh(database_t *db, uint32_t page_num,
+                         btree_page_header_t *page) {
+    if (!db->windowed) {
+        return 0;
+    }
+    if (db_get_page(db, page_num, page) < 0) {
+        fprintf(stderr, "Error: invalid b-tree page %u\n", page_num);
+        return -1;
+    }
+    return 0;
+}
+
+// Enters page_num, which must belong to a b-tree whose leaves are of
+// `leaf_type` (a table or an index b-tree).
+static int push_page(database_t *db, btree_frame_t *stack, int *depth,
+                     uint32_t page_num, uint8_t leaf_type,
+                     const btree_range_t *range) {
+    if (*depth >= BTREE_MAX_DEPTH) {
+        fprintf(stderr, "Error: b-tree deeper than %d at page %u\n",
+                BTREE_MAX_DEPTH, page_num);
+        return -1;
+    }
+
+    btree_frame_t *f = &stack[*depth];
+    if (db_get_page(db, page_num, &f->page) < 0) {
+        fprintf(stderr, "Error: invalid b-tree page %u\n", page_num);
+        return -1;
+    }
+    int table = leaf_type == PAGE_TYPE_LEAF_TABLE;
+    if (f->page.page_type != leaf_type &&
+        f->page.page_type != (table ? PAGE_TYPE_INTERIOR_TABLE
+                                    : PAGE_TYPE_INTERIOR_INDEX)) {
+        fprintf(stderr, "Error: page %u is not %s b-tree page\n", page_num,
+                table ? "a table" : "an index");
+        return -1;
+    }
+    f->page_num = page_num;
+    f->next_child = 0;
+    f->last_child = f->page.cell_count;
+    f->prefetched = 0;
+
+    // child i holds keys in (key[i-1], key[i]], so only the children from
+    // the one holding lo to the one holding hi can intersect the range
+    if (range->bounded && f->page.page_type == PAGE_TYPE_INTERIOR_TABLE) {
+        uint16_t first, last;
+        if (lower_bound(db, page_num, &f->page, range->lo, &first) < 0 ||
+            lower_bound(db, page_num, &f->page, range->hi, &last) < 0) {
+            return -1;
+        }
+        f->next_child = first;
+        f->last_child = last;
+    }
+    (*depth)++;
+    return 0;
+}
+
+static int walk_table(database_t *db, uint32_t root_page,
+                      const btree_range_t *range, btree_leaf_fn fn, void *ctx) {
+    btree_frame_t stack[BTREE_MAX_DEPTH];
+    int depth = 0;
+
+    if (push_page(db, stack, &depth, root_page, PAGE_TYPE_LEAF_TABLE,
+                  range) < 0) {
+        return -1;
+    }
+
+    while (depth > 0) {
+        btree_frame_t *f = &stack[depth - 1];
+
+        if (f->page.page_type == PAGE_TYPE_LEAF_TABLE) {
+            if (fn(db, f->page_num, &f->page, ctx)) {
+                return 1;
+            }
+            // frames keep no page data, only directory entries (or a
+            // header fetched again below)
+            db_release_pages(db);
+            depth--;
+            continue;
+        }
+
+        uint32_t child;
+        if (f->next_child > f->last_child) {
+            depth--;
+            continue;
+        }
+        if (frame_refresh(db, f->page_num, &f->page) < 0) {
+            return -1;
+        }
+        if (db->prefetch && f->next_child >= f->prefetched) {
+            prefetch_children(db, f);
+        }
+        if (f->next_child < f->page.cell_count) {
+            child = interior_child(db, f, (uint16_t)f->next_child);
+        } else {
+            child = f->page.rightmost_pointer;
+        }
+        f->next_child++;
+
+        if (push_page(db, stack, &depth, child, PAGE_TYPE_LEAF_TABLE,
+                      range) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Walks the table b-tree rooted at root_page depth-first, descending
+// through interior pages via each cell's left child and then the rightmost
+// pointer, so leaves are visited in rowid order. Only pages of this table
+// are touched. Returns 0 when every leaf was visited, 1 if the callback
+// stopped the walk, -1 on a malformed tree.
+int btree_walk_table(database_t *db, uint32_t root_page,
+                     btree_leaf_fn fn, void *ctx) {
+    // a sidecar lists the leaves already, no interior page is read
+    size_t count;
+    const uint32_t *leaves = sidecar_table_leaves(db, root_page, &count, NULL);
+    if (leaves) {
+        for (size_t i = 0; i < count; i++) {
+            if (db->prefetch && i % BTREE_PREFETCH_PAGES == 0) {
+                uint32_t pages[BTREE_PREFETCH_PAGES];
+                size_t n = count - i < BTREE_PREFETCH_PAGES ? count - i
+                                                            : BTREE_PREFETCH_PAGES;
+                memcpy(pages, leaves + i, sizeof(uint32_t) * n);
+                db_prefetch_pages(db, pages, n);
+            }
+            btree_page_header_t page;
+            if (db_get_page(db, leaves[i], &page) < 0 ||
+                page.page_type != PAGE_TYPE_LEAF_TABLE) {
+                fprintf(stderr, "Error: invalid b-tree page %u\n", leaves[i]);
+                return -1;
+            }
+            if (fn(db, leaves[i], &page, ctx)) {
+                return 1;
+            }
+            db_release_pages(db);
+        }
+        return 0;
+    }
+
+    btree_range_t all = {0};
+    return walk_table(db, root_page, &all, fn, ctx);
+}
+
+// Like btree_walk_table(), but only descends into subtrees whose key range
+// overlaps [lo, hi], using the interior keys to skip the rest. The first
+// and last leaf visited may also hold rows outside the range; the callback
+// filters those. Returns as btree_walk_table().
+int btree_walk_table_range(database_t *db, uint32_t root_page,
+                           int64_t lo, int64_t hi, btree_leaf_fn fn, void *ctx) {
+    btree_range_t range = { 1, lo, hi };
+    if (lo > hi) {
+        return 0;
+    }
+    return walk_table(db, root_page, &range, fn, ctx);
+}
+
+static int count_leaf_cells(database_t *db, uint32_t page_num,
+                            btree_page_header_t *page, void *ctx) {
+    (void)db;
+    (void)page_num;
+    *(uint64_t *)ctx += page->cell_count;
+    return 0;
+}
+
+// Visits every page of the table or index b-tree rooted at root_page
+// (the kind of tree is that of the root), each interior page before its
+// children and the children in key order. `depth` is 0 for the root. Page
+// data read in the callback is released after it returns. Returns 0 when
+// every page was visited, 1 if the callback stopped the walk, -1 on a
+// malformed tree.
+int btree_visit_pages(database_t *db, uint32_t root_page,
+                      btree_page_fn fn, void *ctx) {
+    btree_frame_t stack[BTREE_MAX_DEPTH];
+    btree_range_t all = {0};
+    int depth = 0;
+
+    btree_page_header_t root;
+    if (db_get_page(db, root_page, &root) < 0) {
+        fprintf(stderr, "Error: invalid b-tree page %u\n", root_page);
+        return -1;
+    }
+    uint8_t leaf_type = root.page_type == PAGE_TYPE_LEAF_INDEX ||
+                        root.page_type == PAGE_TYPE_INTERIOR_INDEX ?
+                        PAGE_TYPE_LEAF_INDEX : PAGE_TYPE_LEAF_TABLE;
+    if (push_page(db, stack, &depth, root_page, leaf_type, &all) < 0) {
+        return -1;
+    }
+    while (depth > 0) {
+        btree_frame_t *f = &stack[depth - 1];
+        if (f->next_child == 0 && fn(db, f->page_num, &f->page, depth - 1, ctx)) {
+            return 1;
+        }
+        if (f->page.page_type == leaf_type || f->next_child > f->last_child) {
+            db_release_pages(db);
+            depth--;
+            continue;
+        }
+        if (frame_refresh(db, f->page_num, &f->page) < 0) {
+            return -1;
+        }
+        if (db->prefetch && f->next_child >= f->prefetched) {
+            prefetch_children(db, f);
+        }
+        uint32_t child = f->next_child < f->page.cell_count ?
+            interior_child(db, f, (uint16_t)f->next_child) :
+            f->page.rightmost_pointer;
+        f->next_child++;
+        if (push_page(db, stack, &depth, child, leaf_type, &all) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// interior index cells hold entries too, so every page's cells count
+static int count_page_cells(database_t *db, uint32_t page_num,
+                            btree_page_header_t *page, int depth, void *ctx) {
+    (void)db;
+    (void)page_num;
+    (void)depth;
+    *(uint64_t *)ctx += page->cell_count;
+    return 0;
+}
+
+// Sets *rows to the number of rows of the table rooted at root_page, or
+// of entries for a WITHOUT ROWID table (an index b-tree). Only page
+// headers are read, no record is decoded; an attached sidecar answers for
+// the tables it covers. Returns 0 on success, -1 on a malformed tree.
+int btree_count_rows(database_t *db, uint32_t root_page, uint64_t *rows) {
+    size_t count;
+    *rows = 0;
+    if (sidecar_table_leaves(db, root_page, &count, rows)) {
+        return 0;
+    }
+    btree_page_header_t root;
+    if (db_get_page(db, root_page, &root) < 0) {
+        fprintf(stderr, "Error: invalid b-tree page %u\n", root_page);
+        return -1;
+    }
+    if (root.page_type == PAGE_TYPE_LEAF_INDEX ||
+        root.page_type == PAGE_TYPE_INTERIOR_INDEX) {
+        return btree_visit_pages(db, root_page, count_page_cells, rows) < 0 ? -1 : 0;
+    }
+    btree_range_t all = {0};
+    return walk_table(db, root_page, &all, count_leaf_cells, rows) < 0 ? -1 : 0;
+}
+
+// Descends from root_page to the leaf that would hold `rowid`, binary
+// searching the keys of each interior page: the child to follow is the
+// left child of the first cell whose key is >= rowid, or the rightmost
+// pointer if there is none. Only one page per tree level is read. Returns
+// 1 with *leaf_page and *cell_index set if the row exists, 0 if it does
+// not (*leaf_page and *cell_index then give the insertion point) and -1 on
+// a malformed tree.
+int btree_find_rowid(database_t *db, uint32_t root_page, int64_t rowid,
+                     uint32_t *leaf_page, uint16_t *cell_index) {
+    uint32_t page_num = root_page;
+
+    for (int depth = 0; depth < BTREE_MAX_DEPTH; depth++) {
+        btree_page_header_t page;
+        uint8_t *data = db_page_data(db, page_num);
+        if (!data || db_get_page(db, page_num, &page) < 0) {
+            fprintf(stderr, "Error: invalid b-tree page %u\n", page_num);
+            return -1;
+        }
+
+        int leaf = page.page_type == PAGE_TYPE_LEAF_TABLE;
+        if (!leaf && page.page_type != PAGE_TYPE_INTERIOR_TABLE) {
+            fprintf(stderr, "Error: page %u is not a table b-tree page\n", page_num);
+            return -1;
+        }
+
+        uint16_t lo;
+        if (lower_bound(db, page_num, &page, rowid, &lo) < 0) {
+            return -1;
+        }
+
+        if (leaf) {
+            *leaf_page = page_num;
+            *cell_index = lo;
+            int64_t key;
+            return lo < page.cell_count &&
+                   leaf_rowid(db, data, &page, lo, &key) == 0 && key == rowid;
+        }
+
+        if (lo == page.cell_count) {
+            page_num = page.rightmost_pointer;
+        } else if ((size_t)page_cell_pointer(&page, lo) + 4 <= db->header.page_size) {
+            page_num = read_be32(data + page_cell_pointer(&page, lo));
+        } else {
+            fprintf(stderr, "Error: malformed cell on page %u\n", page_num);
+            return -1;
+        }
+    }
+
+    fprintf(stderr, "Error: b-tree deeper than %d below page %u\n",
+            BTREE_MAX_DEPTH, root_page);
+    return -1;
+}
+
+// Point lookup of one row of a table by rowid. Returns 1 with the row
+// decoded into rec (using the caller's scratch), 0 if there is no such row
+// and -1 on error.
+int lookup_rowid(database_t *db, const schema_entry_t *table, int64_t rowid,
+                 record_scratch_t *scratch, record_t *rec) {
+    uint32_t leaf_page;
+    uint16_t cell_index;
+
+    if (!table || table->rootpage == 0) {
+        return -1;
+    }
+
+    int rc = btree_find_rowid(db, (uint32_t)table->rootpage, rowid,
+                              &leaf_page, &cell_index);
+    if (rc <= 0) {
+        return rc;
+    }
+
+    btree_page_header_t page;
+    const uint8_t *data = db_page_data(db, leaf_page);
+    if (!data || db_get_page(db, leaf_page, &page) < 0) {
+        fprintf(stderr, "Error: invalid b-tree page %u\n", leaf_page);
+        return -1;
+    }
+    if (cell_decode_table(db, data, page_cell_pointer(&page, cell_index),
+                          scratch, rec) < 0) {
+        return -1;
+    }
+    return 1;
+}
+
+typedef struct {
+    uint32_t page_num;
+    uint16_t next_cell;     // next cell to return, cell_count = done
+    int child_done;         // the child left of next_cell was visited
+    btree_page_header_t page;
+} index_frame_t;
+
+static int push_index_page(database_t *db, index_frame_t *stack, int *depth,
+                           uint32_t page_num, const record_value_t *key,
+                           size_t nkey, record_scratch_t *scratch) {
+    if (*depth >= BTREE_MAX_DEPTH) {
+        fprintf(stderr, "Error: b-tree deeper than %d at page %u\n",
+                BTREE_MAX_DEPTH, page_num);
+        return -1;
+    }
+
+    index_frame_t *f = &stack[*depth];
+    uint8_t *data = db_page_data(db, page_num);
+    if (!data || db_get_page(db, page_num, &f->page) < 0) {
+        fprintf(stderr, "Error: invalid b-tree page %u\n", page_num);
+        return -1;
+    }
+    if (f->page.page_type != PAGE_TYPE_LEAF_INDEX &&
+        f->page.page_type != PAGE_TYPE_INTERIOR_INDEX) {
+        fprintf(stderr, "Error: page %u is not an index b-tree page\n", page_num);
+        return -1;
+    }
+
+    // first cell whose key prefix is >= key
+    uint16_t lo = 0, hi = f->page.cell_count;
+    while (lo < hi) {
+        uint16_t mid = lo + (hi - lo) / 2;
+        record_t rec;
+        int cmp;
+        if (cell_decode_index(db, data, f->page.page_type,
+                              page_cell_pointer(&f->page, mid), scratch, &rec) < 0 ||
+            record_compare(&rec, key, nkey, &cmp) < 0) {
+            fprintf(stderr, "Error: malformed cell on page %u\n", page_num);
+            return -1;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    f->page_num = page_num;
+    f->next_cell = lo;
+    f->child_done = 0;
+    (*depth)++;
+    return 0;
+}
+
+// Finds the entries of the index b-tree rooted at root_page whose first
+// nkey columns equal key, and calls fn for each in index order. Interior
+// index cells hold entries too, so the walk is in-order: the child left of
+// a cell, then the cell. Every page entered is binary searched for the
+// first entry >= key, and the walk ends at the first entry past it, so
+// only the pages on the path to the matches are read. nkey == 0 matches
+// every entry. Returns 0 when all matches were passed, 1 if fn stopped the
+// seek, -1 on a malformed tree.
+int btree_seek_index(database_t *db, uint32_t root_page,
+                     const record_value_t *key, size_t nkey,
+                     record_scratch_t *scratch, btree_record_fn fn, void *ctx) {
+    index_frame_t stack[BTREE_MAX_DEPTH];
+    int depth = 0;
+
+    if (push_index_page(db, stack, &depth, root_page, key, nkey, scratch) < 0) {
+        return -1;
+    }
+
+    while (depth > 0) {
+        index_frame_t *f = &stack[depth - 1];
+        int leaf = f->page.page_type == PAGE_TYPE_LEAF_INDEX;
+        if (frame_refresh(db, f->page_num, &f->page) < 0) {
+            return -1;
+        }
+
+        if (!leaf && !f->child_done) {
+            uint32_t child = f->page.rightmost_pointer;
+            if (f->next_cell < f->page.cell_count) {
+                uint16_t offset = page_cell_pointer(&f->page, f->next_cell);
+                if ((size_t)offset + 4 > db->header.page_size) {
+                    fprintf(stderr, "Error: malformed cell on page %u\n", f->page_num);
+                    return -1;
+                }
+                child = read_be32(db_page_data(db, f->page_num) + offset);
+            }
+            f->child_done = 1;
+            if (push_index_page(db, stack, &depth, child, key, nkey, scratch) < 0) {
+                return -1;
+            }
+            continue;
+        }
+
+        if (f->next_cell >= f->page.cell_count) {
+            depth--;
+            continue;
+        }
+
+        record_t rec;
+        int cmp;
+        if (cell_decode_index(db, db_page_data(db, f->page_num), f->page.page_type,
+                              page_cell_pointer(&f->page, f->next_cell),
+                              scratch, &rec) < 0 ||
+            record_compare(&rec, key, nkey, &cmp) < 0) {
+            fprintf(stderr, "Error: malformed cell on page %u\n", f->page_num);
+            return -1;
+        }
+        if (cmp != 0) {
+            return 0;
+        }
+        f->next_cell++;
+        f->child_done = 0;
+        if (fn(db, &rec, ctx)) {
+            return 1;
+        }
+        db_release_pages(db);
+    }
+    return 0;
+}
+
+typedef struct {
+    const schema_entry_t *table;
+    record_scratch_t *scratch;
+    btree_record_fn fn;
+    void *ctx;
+    int error;
+} index_lookup_t;
+
+static int follow_rowid(database_t *db, const record_t *entry, void *ctx) {
+    index_lookup_t *lookup = ctx;
+    record_t row;
+
+    int rc = lookup_rowid(db, lookup->table, entry->rowid, lookup->scratch, &row);
+    if (rc < 0) {
+        lookup->error = 1;
+        return 1;
+    }
+    // an entry without a row means the index and table disagree; skip it
+    return rc > 0 ? lookup->fn(db, &row, lookup->ctx) : 0;
+}
+
+// Seeks an index for key and calls fn with the full table row of every
+// match, in index order, decoded into the caller's scratch. The table is
+// the index's tbl_name from the schema. Only rowid tables are supported.
+// Returns as btree_seek_index().
+int lookup_index(database_t *db, schema_t *schema, const schema_entry_t *index,
+                 const record_value_t *key, size_t nkey,
+                 record_scratch_t *scratch, btree_record_fn fn, void *ctx) {
+    uint64_t serial_types[RECORD_MAX_COLUMNS];
+    size_t offsets[RECORD_MAX_COLUMNS];
+    record_scratch_t index_scratch = { serial_types, offsets, RECORD_MAX_COLUMNS };
+
+    if (!index || index->rootpage == 0) {
+        return -1;
+    }
+    index_lookup_t lookup = {
+        .table = schema_find(schema, "table", index->tbl_name),
+        .scratch = scratch,
+        .fn = fn,
+        .ctx = ctx,
+    };
+    if (!lookup.table) {
+        fprintf(stderr, "Error: no table %s for index %s\n",
+                index->tbl_name, index->name);
+        return -1;
+    }
+
+    int rc = btree_seek_index(db, (uint32_t)index->rootpage, key, nkey,
+                              &index_scratch, follow_rowid, &lookup);
+    return lookup.error ? -1 : rc;
+}
@@ -4,237 +4,762 @@
 #include "../include/cell.h"
 #include "../include/utils.h"
 #include "../include/constants.h"
+#include "../include/parser.h"
 #include "../include/serializer.h"
+#include "../include/stats.h"
 
-static size_t get_serial_content_size(uint64_t serial_type) {
+// content sizes of serial types 0..11 (10 and 11 are reserved)
+static const uint8_t serial_fixed_size[12] = { 0, 1, 2, 3, 4, 6, 8, 8, 0, 0, 0, 0 };
+
+static inline size_t get_serial_content_size(uint64_t serial_type) {
     if (serial_type >= 12) {
-        if (serial_type % 2 == 0) {
-            return (serial_type - 12) / 2;
-        } else {
-            return (serial_type - 13) / 2;
-        }
-    }
-    
-    switch (serial_type) {
-        case SERIAL_TYPE_NULL: return 0;
-        case SERIAL_TYPE_INT8: return 1;
-        case SERIAL_TYPE_INT16: return 2;
-        case SERIAL_TYPE_INT24: return 3;
-        case SERIAL_TYPE_INT32: return 4;
-        case SERIAL_TYPE_INT48: return 6;
-        case SERIAL_TYPE_INT64: return 8;
-        case SERIAL_TYPE_FLOAT64: return 8;
-        case SERIAL_TYPE_ZERO: return 0;
-        case SERIAL_TYPE_ONE: return 0;
-        default: return 0;
+        // text (odd) and blob (even) alike
+        return (size_t)((serial_type - 12) >> 1);
     }
+    return serial_fixed_size[serial_type];
 }
 
-static int64_t read_int_value(uint8_t *data, size_t size) {
-    int64_t value = 0;
+static int64_t read_int_value(const uint8_t *data, size_t size) {
+    uint64_t value = 0;
     for (size_t i = 0; i < size; i++) {
         value = (value << 8) | data[i];
     }
-    
+
     // sign extend for negative values
     if (size < 8 && (data[0] & 0x80)) {
-        for (size_t i = size; i < 8; i++) {
-            value |= ((int64_t)0xFF << (i * 8));
-        }
+        value |= ~(uint64_t)0 << (size * 8);
     }
-    
+
+    return (int64_t)value;
+}
+
+static double read_float_value(const uint8_t *data) {
+    uint64_t bits = (uint64_t)read_int_value(data, 8);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
     return value;
 }
 
-int parse_cell(uint8_t *page_data, uint16_t cell_offset, size_t page_size) {
+// Number of payload bytes stored in the cell itself for a payload of the
+// given size on a page of the given type; the rest spills into overflow
+// pages. Table leaves keep up to U-35 bytes, index cells up to the
+// max_embed_payload_frac share of the page. A spilled cell keeps at least
+// the min_embed_payload_frac (leaf_payload_frac for table leaves) share,
+// plus whatever makes the overflow part a whole number of pages.
+size_t cell_local_payload(const database_t *db, uint8_t page_type,
+                          uint64_t payload_size) {
+    size_t usable = db_usable_size(db);
+    size_t max_local, min_local;
+
+    if (page_type == PAGE_TYPE_LEAF_TABLE) {
+        max_local = usable - 35;
+        min_local = (usable - 12) * db->header.leaf_payload_frac / 255 - 23;
+    } else {
+        max_local = (usable - 12) * db->header.max_embed_payload_frac / 255 - 23;
+        min_local = (usable - 12) * db->header.min_embed_payload_frac / 255 - 23;
+    }
+
+    if (payload_size <= max_local) {
+        return (size_t)payload_size;
+    }
+    size_t surplus = min_local + (payload_size - min_local) % (usable - 4);
+    return surplus <= max_local ? surplus : min_local;
+}
+
+// Prepares it to walk payload bytes [offset, offset + size) of a record.
+static int payload_iter_init(payload_iter_t *it, const record_t *rec,
+                             uint64_t offset, uint64_t size) {
+    if (offset > rec->payload_size || size > rec->payload_size - offset) {
+        return -1;
+    }
+
+    memset(it, 0, sizeof(*it));
+    it->db = rec->db;
+    it->remaining = size;
+    it->next_page = rec->first_overflow;
+    if (rec->first_overflow) {
+        size_t per_page = db_usable_size(rec->db) - 4;
+        uint64_t spilled = rec->payload_size - rec->local_size;
+        it->pages_left = (uint32_t)((spilled + per_page - 1) / per_page);
+    }
+
+    if (offset < rec->local_size) {
+        it->local = rec->payload + offset;
+        it->local_left = rec->local_size - offset;
+        if (it->local_left > size) {
+            it->local_left = size;
+        }
+    } else {
+        it->skip = offset - rec->local_size;
+    }
+    return 0;
+}
+
+// Returns the next segment of the range: 1 with seg filled in, 0 once the
+// whole range was returned, -1 on a broken overflow chain. Segments point
+// into the mapping; nothing is copied.
+int payload_iter_next(payload_iter_t *it, payload_segment_t *seg) {
+    if (it->remaining == 0) {
+        return 0;
+    }
+
+    if (it->local_left > 0) {
+        seg->data = it->local;
+        seg->size = it->local_left;
+        it->remaining -= it->local_left;
+        it->local_left = 0;
+        return 1;
+    }
+
+    size_t per_page = db_usable_size(it->db) - 4;
+    for (;;) {
+        if (it->next_page == 0 || it->pages_left == 0) {
+            return -1;
+        }
+        uint8_t *page = db_page_data(it->db, it->next_page);
+        if (!page) {
+            return -1;
+        }
+        it->pages_left--;
+        it->next_page = read_be32(page);
+
+        // overflow pages only hold a next pointer and content, so whole
+        // pages before the range are skipped without looking at the data
+        if (it->skip >= per_page) {
+            it->skip -= per_page;
+            continue;
+        }
+
+        seg->data = page + 4 + it->skip;
+        seg->size = per_page - it->skip;
+        if (seg->size > it->remaining) {
+            seg->size = it->remaining;
+        }
+        it->skip = 0;
+        it->remaining -= seg->size;
+        return 1;
+    }
+}
+
+// copy a short payload range (numbers, header bytes) that may span pages
+static int payload_gather(const record_t *rec, uint64_t offset, uint8_t *buf,
+                          size_t size) {
+    payload_iter_t it;
+    payload_segment_t seg;
+    size_t done = 0;
+
+    if (payload_iter_init(&it, rec, offset, size) < 0) {
+        return -1;
+    }
+    while (done < size) {
+        if (payload_iter_next(&it, &seg) <= 0) {
+            return -1;
+        }
+        memcpy(buf + done, seg.data, seg.size);
+        done += seg.size;
+    }
+    return 0;
+}
+
+// serial types of a header larger than the local payload, read one varint
+// at a time through the overflow chain
+static size_t decode_spilled_header(const record_t *rec, size_t pos,
+                                    uint64_t header_size,
+                                    record_scratch_t *scratch,
+                                    size_t *content, int *truncated) {
+    size_t col_count = 0;
+
+    while (pos < header_size) {
+        if (col_count >= scratch->capacity) {
+            *truncated = 1;
+            break;
+        }
+
+        uint8_t buf[9];
+        size_t len = header_size - pos < 9 ? header_size - pos : 9;
+        size_t bytes_read;
+        if (payload_gather(rec, pos, buf, len) < 0) break;
+        uint64_t serial_type = read_varint(buf, &bytes_read, len);
+        if (bytes_read == 0) break;
+        pos += bytes_read;
+
+        scratch->serial_types[col_count] = serial_type;
+        scratch->offsets[col_count] = *content;
+        *content += get_serial_content_size(serial_type);
+        col_count++;
+    }
+    return col_count;
+}
+
+// Decodes the payload that starts at cell + offset, rec->payload_size
+// already set: local part, overflow page and the record header.
+static int decode_payload(database_t *db, uint8_t *cell, size_t remaining,
+                          size_t offset, uint8_t page_type,
+                          record_scratch_t *scratch, record_t *rec) {
+    size_t bytes_read;
+
+    if (remaining < offset + 1) return -1;
+    rec->payload = cell + offset;
+    rec->local_size = cell_local_payload(db, page_type, rec->payload_size);
+    rec->first_overflow = 0;
+    if (rec->local_size < rec->payload_size) {
+        if (remaining - offset < rec->local_size + 4) {
+            return -1;
+        }
+        rec->first_overflow = read_be32((uint8_t *)rec->payload + rec->local_size);
+    } else if (rec->local_size > remaining - offset) {
+        // payload claims more than the page holds, keep what is there
+        rec->local_size = remaining - offset;
+    }
+
+    uint8_t *payload = cell + offset;
+    size_t avail = rec->local_size;
+    uint64_t header_size = read_varint(payload, &bytes_read, avail);
+    if (bytes_read == 0 || header_size > rec->payload_size) {
+        return -1;
+    }
+
+    size_t pos = bytes_read;
+    size_t content = header_size;
+    size_t col_count = 0;
+    rec->truncated = 0;
+
+    if (header_size > avail) {
+        col_count = decode_spilled_header(rec, pos, header_size, scratch,
+                                          &content, &rec->truncated);
+    } else {
+        // decode the whole serial type array, then lay out the columns
+        col_count = read_varints(payload + pos, header_size - pos,
+                                 scratch->serial_types, scratch->capacity,
+                                 &bytes_read);
+        if (col_count == scratch->capacity && pos + bytes_read < header_size) {
+            rec->truncated = 1;
+        }
+        for (size_t i = 0; i < col_count; i++) {
+            scratch->offsets[i] = content;
+            content += get_serial_content_size(scratch->serial_types[i]);
+        }
+    }
+
+    rec->column_count = col_count;
+    rec->serial_types = scratch->serial_types;
+    rec->offsets = scratch->offsets;
+    return 0;
+}
+
+// cell_decode_table() without the --stats timer
+static int decode_table_cell(database_t *db, const uint8_t *page_data,
+                             uint16_t cell_offset, record_scratch_t *scratch,
+                             record_t *rec) {
+    size_t page_size = db->header.page_size;
     if (cell_offset >= page_size) {
         return -1;
     }
-    
-    uint8_t *cell = page_data + cell_offset;
+
+    uint8_t *cell = (uint8_t *)page_data + cell_offset;
     size_t offset = 0;
     size_t bytes_read;
     size_t remaining = page_size - cell_offset;
-    
-    if (remaining < 1) return -1;
-    read_varint(cell + offset, &bytes_read, remaining - offset);
+
+    rec->db = db;
+    rec->payload_size = read_varint(cell + offset, &bytes_read, remaining - offset);
     if (bytes_read == 0) {
         return -1;
     }
     offset += bytes_read;
-    
+
     if (remaining < offset + 1) return -1;
-    uint64_t rowid = read_varint(cell + offset, &bytes_read, remaining - offset);
+    rec->rowid = (int64_t)read_varint(cell + offset, &bytes_read, remaining - offset);
     if (bytes_read == 0) {
         return -1;
     }
     offset += bytes_read;
-    
-    if (remaining < offset + 1) return -1;
-    size_t header_start = offset;
-    uint64_t header_size = read_varint(cell + offset, &bytes_read, remaining - offset);
-    if (bytes_read == 0 || header_size > remaining - offset) {
+
+    return decode_payload(db, cell, remaining, offset, PAGE_TYPE_LEAF_TABLE,
+                          scratch, rec);
+}
+
+// Decodes the cell at cell_offset of a leaf table page: payload size, rowid
+// and the record header. Serial types and column offsets go into the
+// caller's scratch, so no memory is allocated. Payload that does not fit in
+// the cell is left in its overflow pages and read on demand. Returns 0 on
+// success, -1 if the cell is malformed.
+int cell_decode_table(database_t *db, const uint8_t *page_data,
+                      uint16_t cell_offset, record_scratch_t *scratch,
+                      record_t *rec) {
+    STATS_BEGIN(start);
+    int rc = decode_table_cell(db, page_data, cell_offset, scratch, rec);
+    STATS_END(STATS_PHASE_DECODE, start);
+    STATS_ADD(STATS_CELLS, 1);
+    return rc;
+}
+
+// cell_decode_index() without the --stats timer
+static int decode_index_cell(database_t *db, const uint8_t *page_data,
+                             uint8_t page_type, uint16_t cell_offset,
+                             record_scratch_t *scratch, record_t *rec) {
+    size_t page_size = db->header.page_size;
+    size_t offset = page_type == PAGE_TYPE_INTERIOR_INDEX ? 4 : 0;
+    if ((size_t)cell_offset + offset >= page_size) {
+        return -1;
+    }
+
+    uint8_t *cell = (uint8_t *)page_data + cell_offset;
+    size_t bytes_read;
+    size_t remaining = page_size - cell_offset;
+
+    rec->db = db;
+    rec->rowid = 0;
+    rec->payload_size = read_varint(cell + offset, &bytes_read, remaining - offset);
+    if (bytes_read == 0) {
         return -1;
     }
     offset += bytes_read;
-    
-    // Use dynamic allocation with reallocation as needed
-    size_t capacity = 16;  // Start small
-    uint64_t *serial_types = malloc(sizeof(uint64_t) * capacity);
-    if (!serial_types) {
+
+    if (decode_payload(db, cell, remaining, offset, page_type, scratch, rec) < 0) {
         return -1;
     }
-    
-    size_t col_count = 0;
-    
-    while (offset < header_start + header_size && offset < remaining) {
-        // Reallocate if needed
-        if (col_count >= capacity) {
-            size_t new_capacity = capacity * 2;
-            uint64_t *new_serial_types = realloc(serial_types, sizeof(uint64_t) * new_capacity);
-            if (!new_serial_types) {
-                free(serial_types);
-                return -1;
-            }
-            serial_types = new_serial_types;
-            capacity = new_capacity;
+
+    record_value_t last;
+    if (rec->column_count > 0 && !rec->truncated &&
+        record_column(rec, rec->column_count - 1, &last) == 0 &&
+        last.type == VALUE_INTEGER) {
+        rec->rowid = last.integer;
+    }
+    return 0;
+}
+
+// Decodes the cell at cell_offset of an interior (0x02) or leaf (0x0A)
+// index page. Interior cells start with a 4-byte left child pointer, which
+// is skipped. The record holds the indexed columns followed by the rowid of
+// the table row; that last column is also stored in rec->rowid (0 if it is
+// not an integer). Returns 0 on success, -1 if the cell is malformed.
+int cell_decode_index(database_t *db, const uint8_t *page_data,
+                      uint8_t page_type, uint16_t cell_offset,
+                      record_scratch_t *scratch, record_t *rec) {
+    STATS_BEGIN(start);
+    int rc = decode_index_cell(db, page_data, page_type, cell_offset, scratch, rec);
+    STATS_END(STATS_PHASE_DECODE, start);
+    STATS_ADD(STATS_CELLS, 1);
+    return rc;
+}
+
+// Reads column i of a decoded record. Text and blob values stored in the
+// cell point into the page; values that continue into overflow pages get
+// data == NULL and are read with record_value_segments(). Returns 0 on
+// success, -1 if the value lies outside the payload.
+int record_column(const record_t *rec, size_t i, record_value_t *value) {
+    if (i >= rec->column_count) {
+        return -1;
+    }
+
+    uint64_t serial_type = rec->serial_types[i];
+    size_t size = get_serial_content_size(serial_type);
+    size_t offset = rec->offsets[i];
+    if (offset > rec->payload_size || size > rec->payload_size - offset) {
+        return -1;
+    }
+
+    int local = offset <= rec->local_size && size <= rec->local_size - offset;
+    const uint8_t *data = rec->payload + offset;
+    uint8_t number[8];
+    value->data = NULL;
+    value->size = 0;
+
+    // numbers straddling the end of the cell are gathered from the chain
+    if (!local && serial_type <= SERIAL_TYPE_FLOAT64 && size > 0) {
+        if (payload_gather(rec, offset, number, size) < 0) {
+            return -1;
         }
-        
-        serial_types[col_count] = read_varint(cell + offset, &bytes_read, remaining - offset);
-        if (bytes_read == 0) break;
-        offset += bytes_read;
-        col_count++;
+        data = number;
     }
-    
-    // print rowid
-    printf("rowid: %llu | ", (unsigned long long)rowid);
-    
-    // read and print values
-    for (size_t i = 0; i < col_count; i++) {
-        uint64_t serial_type = serial_types[i];
-        size_t content_size = get_serial_content_size(serial_type);
-        
-        if (i > 0) printf(", ");
-        
-        if (offset + content_size > remaining) {
-            printf("(truncated)");
-            break;
+
+    if (serial_type == SERIAL_TYPE_NULL) {
+        value->type = VALUE_NULL;
+    } else if (serial_type == SERIAL_TYPE_ZERO || serial_type == SERIAL_TYPE_ONE) {
+        value->type = VALUE_INTEGER;
+        value->integer = serial_type == SERIAL_TYPE_ONE;
+    } else if (serial_type >= SERIAL_TYPE_INT8 && serial_type <= SERIAL_TYPE_INT64) {
+        value->type = VALUE_INTEGER;
+        value->integer = read_int_value(data, size);
+    } else if (serial_type == SERIAL_TYPE_FLOAT64) {
+        value->type = VALUE_FLOAT;
+        value->real = read_float_value(data);
+    } else if (serial_type >= 12) {
+        value->type = serial_type % 2 ? VALUE_TEXT : VALUE_BLOB;
+        value->data = local ? data : NULL;
+        value->size = size;
+    } else {
+        // reserved serial types 10 and 11
+        return -1;
+    }
+    return 0;
+}
+
+// Prepares it to return the content of column i as (pointer, length)
+// segments into the mapping, for values of any size. Returns 0 on success,
+// -1 if the column is out of range.
+int record_value_segments(const record_t *rec, size_t i, payload_iter_t *it) {
+    if (i >= rec->column_count) {
+        return -1;
+    }
+    return payload_iter_init(it, rec, rec->offsets[i],
+                             get_serial_content_size(rec->serial_types[i]));
+}
+
+// storage class order used when comparing values of different types
+static int value_class(value_type_t type) {
+    switch (type) {
+        case VALUE_NULL: return 0;
+        case VALUE_INTEGER:
+        case VALUE_FLOAT: return 1;
+        case VALUE_TEXT: return 2;
+        default: return 3;
+    }
+}
+
+// integer against real without losing precision on either side
+static int compare_int_float(int64_t i, double r) {
+    if (r != r) return 1;
+    if (r < -9223372036854775808.0) return 1;
+    if (r >= 9223372036854775808.0) return -1;
+    int64_t y = (int64_t)r;
+    if (i != y) return i < y ? -1 : 1;
+    double s = (double)i;
+    if (s != r) return s < r ? -1 : 1;
+    return 0;
+}
+
+// memcmp order then length, with the column read segment by segment so
+// overflowed values are compared in place
+static int compare_bytes(const record_t *rec, size_t i, const record_value_t *col,
+                         const record_value_t *key, int *result) {
+    if (col->data) {
+        size_t n = col->size < key->size ? col->size : key->size;
+        int c = n ? memcmp(col->data, key->data, n) : 0;
+        *result = c ? c : (col->size > key->size) - (col->size < key->size);
+        return 0;
+    }
+
+    payload_iter_t it;
+    payload_segment_t seg;
+    size_t done = 0;
+    int rc;
+    if (record_value_segments(rec, i, &it) < 0) {
+        return -1;
+    }
+    while ((rc = payload_iter_next(&it, &seg)) > 0) {
+        size_t n = seg.size;
+        if (n > key->size - done) {
+            n = key->size - done;
         }
-        
-        if (serial_type == SERIAL_TYPE_NULL) {
-            printf("NULL");
-        } else if (serial_type == SERIAL_TYPE_ZERO) {
-            printf("0");
-        } else if (serial_type == SERIAL_TYPE_ONE) {
-            printf("1");
-        } else if (serial_type >= SERIAL_TYPE_INT8 && serial_type <= SERIAL_TYPE_INT64) {
-            int64_t value = read_int_value(cell + offset, content_size);
-            printf("%lld", (long long)value);
-            offset += content_size;
-        } else if (serial_type >= 13 && serial_type % 2 == 1) {
-            // text
-            printf("\"");
-            for (size_t j = 0; j < content_size; j++) {
-                printf("%c", cell[offset + j]);
-            }
-            printf("\"");
-            offset += content_size;
-        } else if (serial_type >= 12 && serial_type % 2 == 0) {
-            // blob
-            printf("BLOB(%zu bytes)", content_size);
-            offset += content_size;
-        } else {
-            printf("(unknown)");
-            offset += content_size;
+        int c = n ? memcmp(seg.data, key->data + done, n) : 0;
+        if (c) {
+            *result = c;
+            return 0;
+        }
+        done += n;
+        if (n < seg.size) {
+            *result = 1;
+            return 0;
         }
     }
-    
-    free(serial_types);
-    printf("\n");
+    if (rc < 0) {
+        return -1;
+    }
+    *result = (col->size > key->size) - (col->size < key->size);
     return 0;
 }
 
-int parse_cell_json(uint8_t *page_data, uint16_t cell_offset, size_t page_size) {
-    if (cell_offset >= page_size) return -1;
-    
-    uint8_t *cell = page_data + cell_offset;
-    size_t offset = 0;
-    size_t bytes_read;
-    size_t remaining = page_size - cell_offset;
-    
-    if (remaining < 1) return -1;
-    read_varint(cell + offset, &bytes_read, remaining - offset);
-    if (bytes_read == 0) return -1;
-    offset += bytes_read;
-    
-    if (remaining < offset + 1) return -1;
-    uint64_t rowid = read_varint(cell + offset, &bytes_read, remaining - offset);
-    if (bytes_read == 0) return -1;
-    offset += bytes_read;
-    
-    if (remaining < offset + 1) return -1;
-    size_t header_start = offset;
-    uint64_t header_size = read_varint(cell + offset, &bytes_read, remaining - offset);
-    if (bytes_read == 0 || header_size > remaining - offset) return -1;
-    offset += bytes_read;
-    
-    size_t capacity = 16;
-    uint64_t *serial_types = malloc(sizeof(uint64_t) * capacity);
-    if (!serial_types) return -1;
-    
-    size_t col_count = 0;
-    while (offset < header_start + header_size && offset < remaining) {
-        if (col_count >= capacity) {
-            size_t new_capacity = capacity * 2;
-            uint64_t *new_serial_types = realloc(serial_types, sizeof(uint64_t) * new_capacity);
-            if (!new_serial_types) { free(serial_types); return -1; }
-            serial_types = new_serial_types;
-            capacity = new_capacity;
-        }
-        serial_types[col_count] = read_varint(cell + offset, &bytes_read, remaining - offset);
-        if (bytes_read == 0) break;
-        offset += bytes_read;
-        col_count++;
+// Compares value, column i of rec as returned by record_column(), with key
+// using SQLite's rules: NULL < numbers < text < blob, numbers by value
+// across integer and real, text and blob bytewise (BINARY collation) with
+// the shorter value first on a common prefix. Overflowed values are read
+// in place. Sets *result to <0, 0 or >0 and returns 0, or -1 if the value
+// cannot be read.
+int record_value_compare(const record_t *rec, size_t i, const record_value_t *value,
+                         const record_value_t *key, int *result) {
+    int value_cls = value_class(value->type), key_cls = value_class(key->type);
+    if (value_cls != key_cls) {
+        *result = value_cls < key_cls ? -1 : 1;
+    } else if (value->type == VALUE_NULL) {
+        *result = 0;
+    } else if (value->type == VALUE_INTEGER && key->type == VALUE_INTEGER) {
+        *result = (value->integer > key->integer) - (value->integer < key->integer);
+    } else if (value->type == VALUE_FLOAT && key->type == VALUE_FLOAT) {
+        *result = (value->real > key->real) - (value->real < key->real);
+    } else if (value->type == VALUE_INTEGER) {
+        *result = compare_int_float(value->integer, key->real);
+    } else if (value->type == VALUE_FLOAT) {
+        *result = -compare_int_float(key->integer, value->real);
+    } else {
+        return compare_bytes(rec, i, value, key, result);
     }
-    
-    // JSON Output
-    printf("{\"rowid\": %llu, \"values\": [", (unsigned long long)rowid);
-    
-    for (size_t i = 0; i < col_count; i++) {
-        if (i > 0) printf(", ");
-        
-        uint64_t serial_type = serial_types[i];
-        size_t content_size = get_serial_content_size(serial_type);
-        
-        if (offset + content_size > remaining) {
-            printf("\"(truncated)\"");
-            break;
+    return 0;
+}
+
+static int prefix_equal(const uint8_t *a, const uint8_t *b, size_t n, int nocase) {
+    if (!nocase) {
+        return memcmp(a, b, n) == 0;
+    }
+    for (size_t k = 0; k < n; k++) {
+        uint8_t x = a[k], y = b[k];
+        if (x >= 'A' && x <= 'Z') x += 'a' - 'A';
+        if (y >= 'A' && y <= 'Z') y += 'a' - 'A';
+        if (x != y) return 0;
+    }
+    return 1;
+}
+
+// Writes an integer or real value as SQLite converts it to text: "%lld",
+// or 15 significant digits with a ".0" added to a real that shows no
+// fraction (3.0, 1.0e+20). Returns the length, 0 for other types.
+size_t record_number_text(const record_value_t *value, char *buf, size_t size) {
+    int n;
+    if (value->type == VALUE_INTEGER) {
+        n = snprintf(buf, size, "%lld", (long long)value->integer);
+    } else if (value->type == VALUE_FLOAT) {
+        if (value->real - value->real != 0) {
+            n = snprintf(buf, size, "%s", value->real < 0 ? "-Inf" : "Inf");
+        } else {
+            n = snprintf(buf, size, "%.15g", value->real);
+            char *e = strchr(buf, 'e');
+            if (!strchr(buf, '.') && n >= 0 && (size_t)n + 2 < size) {
+                size_t at = e ? (size_t)(e - buf) : (size_t)n;
+                memmove(buf + at + 2, buf + at, (size_t)n - at + 1);
+                memcpy(buf + at, ".0", 2);
+                n += 2;
+            }
+        }
+    } else {
+        return 0;
+    }
+    return n > 0 && (size_t)n < size ? (size_t)n : 0;
+}
+
+// Tests whether value, column i of rec as returned by record_column(),
+// starts with the len bytes at prefix; nocase folds ASCII letters as LIKE
+// does. Numbers are compared in their text form, as SQLite does, NULL
+// never matches. Only the bytes of the prefix are read, also from
+// overflow pages. Returns 1 on a match, 0 otherwise and -1 if the value
+// cannot be read.
+int record_value_prefix(const record_t *rec, size_t i, const record_value_t *value,
+                        const uint8_t *prefix, size_t len, int nocase) {
+    if (value->type == VALUE_INTEGER || value->type == VALUE_FLOAT) {
+        char buf[32];
+        size_t n = record_number_text(value, buf, sizeof(buf));
+        return n >= len && prefix_equal((const uint8_t *)buf, prefix, len, nocase);
+    }
+    if ((value->type != VALUE_TEXT && value->type != VALUE_BLOB) ||
+        value->size < len) {
+        return 0;
+    }
+    if (value->data) {
+        return prefix_equal(value->data, prefix, len, nocase);
+    }
+
+    payload_iter_t it;
+    payload_segment_t seg;
+    size_t done = 0;
+    int rc;
+    if (record_value_segments(rec, i, &it) < 0) {
+        return -1;
+    }
+    while (done < len && (rc = payload_iter_next(&it, &seg)) > 0) {
+        size_t n = seg.size < len - done ? seg.size : len - done;
+        if (!prefix_equal(seg.data, prefix + done, n, nocase)) {
+            return 0;
         }
-        
-        if (serial_type == SERIAL_TYPE_NULL) {
-            printf("null");
-        } else if (serial_type == SERIAL_TYPE_ZERO) {
-            printf("0");
-        } else if (serial_type == SERIAL_TYPE_ONE) {
-            printf("1");
-        } else if (serial_type >= SERIAL_TYPE_INT8 && serial_type <= SERIAL_TYPE_INT64) {
-             int64_t value = read_int_value(cell + offset, content_size);
-             printf("%lld", (long long)value);
-             offset += content_size;
-        } else if (serial_type >= 13 && serial_type % 2 == 1) {
-             json_print_text_chk(cell + offset, content_size);
-             offset += content_size;
-        } else if (serial_type >= 12 && serial_type % 2 == 0) {
-             printf("\"BLOB(%zu bytes)\"", content_size); // representing blob as string description for now 
-             offset += content_size;
+        done += n;
+    }
+    return done == len ? 1 : -1;
+}
+
+// Compares the first nkey columns of a record with a key tuple, column by
+// column as record_value_compare(). A record with fewer columns than the
+// key sorts first. Sets *result to <0, 0 or >0 and returns 0, or -1 if a
+// column cannot be read.
+int record_compare(const record_t *rec, const record_value_t *key, size_t nkey,
+                   int *result) {
+    for (size_t i = 0; i < nkey; i++) {
+        record_value_t col;
+        int c;
+
+        if (i >= rec->column_count) {
+            *result = -1;
+            return 0;
+        }
+        if (record_column(rec, i, &col) < 0 ||
+            record_value_compare(rec, i, &col, &key[i], &c) < 0) {
+            return -1;
+        }
+        if (c != 0) {
+            *result = c;
+            return 0;
+        }
+    }
+    *result = 0;
+    return 0;
+}
+
+// Positions a cursor before the first cell of a leaf table page. Returns 0
+// on success, -1 if the page cannot be read or is not a leaf table page.
+int cell_cursor_open(cell_cursor_t *cur, database_t *db, uint32_t page_num,
+                     record_scratch_t *scratch) {
+    memset(cur, 0, sizeof(*cur));
+    if (db_get_page(db, page_num, &cur->page) < 0 ||
+        cur->page.page_type != PAGE_TYPE_LEAF_TABLE) {
+        return -1;
+    }
+    cur->db = db;
+    cur->page_data = db_page_data(db, page_num);
+    cur->scratch = scratch;
+    return 0;
+}
+
+// Decodes the next cell into cur->record. Returns 1 when a row is
+// available, 0 at the end of the page and -1 for a malformed cell (the
+// cursor still advances past it).
+int cell_cursor_next(cell_cursor_t *cur) {
+    if (cur->next_cell >= cur->page.cell_count) {
+        return 0;
+    }
+
+    uint16_t cell_offset = page_cell_pointer(&cur->page, cur->next_cell++);
+    if (cell_decode_table(cur->db, cur->page_data, cell_offset,
+                          cur->scratch, &cur->record) < 0) {
+        return -1;
+    }
+    return 1;
+}
+
+// print a text value segment by segment, escaped for JSON if asked
+static int print_segments(out_t *out, const record_t *rec, size_t i, int json) {
+    payload_iter_t it;
+    payload_segment_t seg;
+    json_text_t text = {0};
+    int rc;
+
+    if (record_value_segments(rec, i, &it) < 0) {
+        return -1;
+    }
+    while ((rc = payload_iter_next(&it, &seg)) > 0) {
+        if (json) {
+            json_text_body(out, &text, seg.data, seg.size);
         } else {
-             printf("\"(unknown)\"");
-             offset += content_size;
+            out_write(out, seg.data, seg.size);
+        }
+    }
+    if (json) {
+        json_text_end(out, &text);
+    }
+    return rc;
+}
+
+// Prints one value of a record as the dumps show it, escaped for JSON if
+// asked. value is column i of rec as returned by record_column(), or a
+// value held in memory (data set) such as a column default.
+void print_value(out_t *out, const record_t *rec, size_t i,
+                 const record_value_t *value, int json) {
+    switch (value->type) {
+        case VALUE_NULL:
+            out_str(out, json ? "null" : "NULL");
+            break;
+        case VALUE_INTEGER:
+            out_i64(out, value->integer);
+            break;
+        case VALUE_FLOAT:
+            // JSON has no representation for NaN or infinities
+            if (json && (value->real != value->real || value->real - value->real != 0)) {
+                out_str(out, "null");
+            } else {
+                out_double(out, value->real);
+            }
+            break;
+        case VALUE_TEXT:
+            out_char(out, '"');
+            if (value->data && json) {
+                json_text_t text = {0};
+                json_text_body(out, &text, value->data, value->size);
+                json_text_end(out, &text);
+            } else if (value->data) {
+                out_write(out, value->data, value->size);
+            } else if (print_segments(out, rec, i, json) < 0 && !json) {
+                out_str(out, "(truncated)");
+            }
+            out_char(out, '"');
+            break;
+        case VALUE_BLOB:
+            // representing blob as string description for now
+            out_str(out, json ? "\"BLOB(" : "BLOB(");
+            out_u64(out, value->size);
+            out_str(out, json ? " bytes)\"" : " bytes)");
+            break;
+    }
+}
+
+// Prints the values of a record as a comma separated list (a JSON array
+// body in JSON mode), stopping at the first column that cannot be read.
+static void print_values(out_t *out, const record_t *rec, int json) {
+    for (size_t i = 0; i < rec->column_count; i++) {
+        record_value_t value;
+
+        if (i > 0) out_str(out, ", ");
+
+        if (record_column(rec, i, &value) < 0) {
+            if (rec->serial_types[i] == SERIAL_TYPE_INTERNAL1 ||
+                rec->serial_types[i] == SERIAL_TYPE_INTERNAL2) {
+                out_str(out, json ? "\"(unknown)\"" : "(unknown)");
+                continue;
+            }
+            out_str(out, json ? "\"(truncated)\"" : "(truncated)");
+            break;
         }
+        print_value(out, rec, i, &value, json);
+    }
+    if (rec->truncated) out_str(out, json ? ", \"(truncated)\"" : ", (truncated)");
+}
+
+void print_record(out_t *out, const record_t *rec) {
+    out_str(out, "rowid: ");
+    out_i64(out, rec->rowid);
+    out_str(out, " | ");
+    print_values(out, rec, 0);
+    out_char(out, '\n');
+}
+
+void print_record_json(out_t *out, const record_t *rec) {
+    out_str(out, "{\"rowid\": ");
+    out_i64(out, rec->rowid);
+    out_str(out, ", \"values\": [");
+    print_values(out, rec, 1);
+    out_str(out, "]}");
+}
+
+int parse_cell(out_t *out, database_t *db, uint8_t *page_data,
+               uint16_t cell_offset) {
+    uint64_t serial_types[RECORD_MAX_COLUMNS];
+    size_t offsets[RECORD_MAX_COLUMNS];
+    record_scratch_t scratch = { serial_types, offsets, RECORD_MAX_COLUMNS };
+    record_t rec;
+
+    if (cell_decode_table(db, page_data, cell_offset, &scratch, &rec) < 0) {
+        return -1;
+    }
+    print_record(out, &rec);
+    return 0;
+}
+
+int parse_cell_json(out_t *out, database_t *db, uint8_t *page_data,
+                    uint16_t cell_offset) {
+    uint64_t serial_types[RECORD_MAX_COLUMNS];
+    size_t offsets[RECORD_MAX_COLUMNS];
+    record_scratch_t scratch = { serial_types, offsets, RECORD_MAX_COLUMNS };
+    record_t rec;
+
+    if (cell_decode_table(db, page_data, cell_offset, &scratch, &rec) < 0) {
+        return -1;
     }
-    
-    printf("]}");
-    
-    free(serial_types);
+    print_record_json(out, &rec);
     return 0;
 }
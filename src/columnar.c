@@ -0,0 +1,590 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../include/columnar.h"
+#include "../include/btree.h"
+#include "../include/cell.h"
+#include "../include/output.h"
+#include "../include/schema.h"
+
+/*
+ * Columnar export.
+ *
+ * Rows are decoded leaf by leaf into one builder per output column:
+ * int64 or float64 values, or int64 offsets plus bytes for text and blobs,
+ * and a validity bitmap. Every batch_rows rows the builders are written
+ * out as one batch, each buffer aligned to COLUMNAR_ALIGN, and reset. A
+ * footer written at the end describes the columns and where each batch's
+ * buffers are, so a reader can mmap the file and use the buffers in place.
+ *
+ * Column types come from the declared type affinity. Columns without a
+ * declared type take the type of their first non-NULL value. Values that
+ * cannot be represented exactly in the column type are exported as NULL
+ * and counted.
+ */
+
+typedef struct {
+    const char *name;
+    uint32_t type;          // COLUMNAR_*, 0 while still being inferred
+    uint32_t flags;
+    long source;            // record column, -1 for the rowid
+    record_value_t fallback;    // DEFAULT for rows written before ADD COLUMN
+    char *fallback_text;
+    uint8_t *validity;
+    uint64_t null_count;
+    uint64_t *values;       // int64 or float64 bits
+    int64_t *offsets;       // text and blob: batch_rows + 1 entries
+    uint8_t *data;
+    size_t data_len;
+    size_t data_cap;
+} column_builder_t;
+
+// where the buffers of one column of one batch are in the file
+typedef struct {
+    uint64_t null_count;
+    uint64_t validity_offset;   // 0 when there are no NULLs
+    uint64_t values_offset;
+    uint64_t values_size;
+    uint64_t data_offset;       // text and blob only
+    uint64_t data_size;
+} buffer_desc_t;
+
+typedef struct {
+    out_t out;
+    uint64_t pos;               // bytes written so far
+    column_builder_t *columns;
+    size_t column_count;
+    size_t batch_rows;
+    size_t rows;                // rows in the current batch
+    uint64_t total_rows;        // rows in finished batches
+    uint64_t lossy;
+    buffer_desc_t *descs;       // column_count per finished batch
+    uint64_t *batch_rows_done;  // row count per finished batch
+    size_t batch_count;
+    size_t batch_capacity;
+    size_t pending_types;       // columns whose type is still unknown
+    size_t scanned;
+    int failed;
+    record_scratch_t scratch;
+} columnar_export_t;
+
+static void emit(columnar_export_t *exp, const void *data, size_t len) {
+    out_write(&exp->out, data, len);
+    exp->pos += len;
+}
+
+static void emit_u32(columnar_export_t *exp, uint32_t v) {
+    emit(exp, &v, sizeof(v));
+}
+
+static void emit_u64(columnar_export_t *exp, uint64_t v) {
+    emit(exp, &v, sizeof(v));
+}
+
+// zero bytes up to the next COLUMNAR_ALIGN boundary
+static void emit_pad(columnar_export_t *exp) {
+    static const uint8_t zeros[COLUMNAR_ALIGN];
+    size_t rem = (size_t)(exp->pos % COLUMNAR_ALIGN);
+    if (rem) {
+        emit(exp, zeros, COLUMNAR_ALIGN - rem);
+    }
+}
+
+static int is_var_width(uint32_t type) {
+    return type == COLUMNAR_UTF8 || type == COLUMNAR_BINARY;
+}
+
+static int data_reserve(column_builder_t *c, size_t extra) {
+    if (c->data_len + extra <= c->data_cap) {
+        return 0;
+    }
+    size_t cap = c->data_cap ? c->data_cap : 4096;
+    while (cap < c->data_len + extra) {
+        cap *= 2;
+    }
+    uint8_t *data = realloc(c->data, cap);
+    if (!data) {
+        return -1;
+    }
+    c->data = data;
+    c->data_cap = cap;
+    return 0;
+}
+
+// copies a text or blob value, following overflow pages if needed
+static int append_bytes(column_builder_t *c, const record_t *rec,
+                        const record_value_t *v) {
+    if (data_reserve(c, v->size) < 0) {
+        return -1;
+    }
+    if (v->data) {
+        memcpy(c->data + c->data_len, v->data, v->size);
+        c->data_len += v->size;
+        return 0;
+    }
+
+    payload_iter_t it;
+    payload_segment_t seg;
+    size_t start = c->data_len;
+    if (record_value_segments(rec, (size_t)c->source, &it) < 0) {
+        return -1;
+    }
+    while (payload_iter_next(&it, &seg) > 0) {
+        memcpy(c->data + c->data_len, seg.data, seg.size);
+        c->data_len += seg.size;
+    }
+    // a broken chain leaves the value short: keep the offsets consistent
+    if (c->data_len - start != v->size) {
+        c->data_len = start;
+        return 1;
+    }
+    return 0;
+}
+
+// Stores value v as row r of column c. Returns 1 if it was stored, 0 if it
+// is exported as NULL, -1 on allocation failure.
+static int append_value(column_builder_t *c, size_t r, const record_t *rec,
+                        const record_value_t *v) {
+    int valid = 0;
+    if (c->values) {
+        c->values[r] = 0;
+    }
+
+    switch (c->type) {
+    case COLUMNAR_INT64:
+        if (v->type == VALUE_INTEGER) {
+            c->values[r] = (uint64_t)v->integer;
+            valid = 1;
+        } else if (v->type == VALUE_FLOAT && v->real >= -9223372036854775808.0 &&
+                   v->real < 9223372036854775808.0 &&
+                   v->real == (double)(int64_t)v->real) {
+            c->values[r] = (uint64_t)(int64_t)v->real;
+            valid = 1;
+        }
+        break;
+    case COLUMNAR_FLOAT64:
+        if (v->type == VALUE_INTEGER || v->type == VALUE_FLOAT) {
+            double d = v->type == VALUE_INTEGER ? (double)v->integer : v->real;
+            memcpy(&c->values[r], &d, sizeof(d));
+            valid = 1;
+        }
+        break;
+    case COLUMNAR_UTF8:
+    case COLUMNAR_BINARY:
+        if (v->type == VALUE_TEXT ||
+            (v->type == VALUE_BLOB && c->type == COLUMNAR_BINARY)) {
+            int rc = append_bytes(c, rec, v);
+            if (rc < 0) return -1;
+            valid = rc == 0;
+        } else if (c->type == COLUMNAR_UTF8 &&
+                   (v->type == VALUE_INTEGER || v->type == VALUE_FLOAT)) {
+            char buf[32];
+            int n = v->type == VALUE_INTEGER
+                ? snprintf(buf, sizeof(buf), "%lld", (long long)v->integer)
+                : snprintf(buf, sizeof(buf), "%.17g", v->real);
+            if (data_reserve(c, (size_t)n) < 0) return -1;
+            memcpy(c->data + c->data_len, buf, (size_t)n);
+            c->data_len += (size_t)n;
+            valid = 1;
+        }
+        c->offsets[r + 1] = (int64_t)c->data_len;
+        break;
+    }
+
+    if (valid) {
+        c->validity[r / 8] |= (uint8_t)(1u << (r % 8));
+    } else {
+        c->null_count++;
+    }
+    return valid;
+}
+
+static void builder_reset(columnar_export_t *exp, column_builder_t *c) {
+    memset(c->validity, 0, (exp->batch_rows + 7) / 8);
+    c->null_count = 0;
+    c->data_len = 0;
+    if (c->offsets) {
+        c->offsets[0] = 0;
+    }
+}
+
+static int builder_alloc(columnar_export_t *exp, column_builder_t *c) {
+    c->validity = malloc((exp->batch_rows + 7) / 8);
+    if (is_var_width(c->type)) {
+        c->offsets = malloc((exp->batch_rows + 1) * sizeof(int64_t));
+        if (!c->offsets) return -1;
+    } else {
+        c->values = malloc(exp->batch_rows * sizeof(uint64_t));
+        if (!c->values) return -1;
+    }
+    if (!c->validity) return -1;
+    builder_reset(exp, c);
+    return 0;
+}
+
+// writes the rows collected so far as one batch
+static int flush_batch(columnar_export_t *exp) {
+    size_t rows = exp->rows;
+    if (rows == 0) {
+        return 0;
+    }
+    if (exp->batch_count == exp->batch_capacity) {
+        size_t cap = exp->batch_capacity ? exp->batch_capacity * 2 : 16;
+        buffer_desc_t *descs = realloc(exp->descs,
+                                       sizeof(buffer_desc_t) * cap * exp->column_count);
+        if (!descs) return -1;
+        exp->descs = descs;
+        uint64_t *counts = realloc(exp->batch_rows_done, sizeof(uint64_t) * cap);
+        if (!counts) return -1;
+        exp->batch_rows_done = counts;
+        exp->batch_capacity = cap;
+    }
+
+    buffer_desc_t *descs = exp->descs + exp->batch_count * exp->column_count;
+    for (size_t i = 0; i < exp->column_count; i++) {
+        column_builder_t *c = &exp->columns[i];
+        buffer_desc_t *d = &descs[i];
+        memset(d, 0, sizeof(*d));
+
+        d->null_count = c->null_count;
+        if (c->null_count > 0) {
+            emit_pad(exp);
+            d->validity_offset = exp->pos;
+            emit(exp, c->validity, (rows + 7) / 8);
+        }
+        emit_pad(exp);
+        d->values_offset = exp->pos;
+        if (is_var_width(c->type)) {
+            d->values_size = (rows + 1) * sizeof(int64_t);
+            emit(exp, c->offsets, d->values_size);
+            emit_pad(exp);
+            d->data_offset = exp->pos;
+            d->data_size = c->data_len;
+            emit(exp, c->data, c->data_len);
+        } else {
+            d->values_size = rows * sizeof(uint64_t);
+            emit(exp, c->values, d->values_size);
+        }
+        builder_reset(exp, c);
+    }
+
+    exp->batch_rows_done[exp->batch_count++] = rows;
+    exp->total_rows += rows;
+    exp->rows = 0;
+    return exp->out.error ? -1 : 0;
+}
+
+static int export_leaf(database_t *db, uint32_t page_num,
+                       btree_page_header_t *page, void *ctx) {
+    (void)page;
+    columnar_export_t *exp = ctx;
+    cell_cursor_t cur;
+
+    if (cell_cursor_open(&cur, db, page_num, &exp->scratch) < 0) {
+        return 0;
+    }
+
+    int rc;
+    while ((rc = cell_cursor_next(&cur)) != 0) {
+        if (rc < 0) continue;
+        const record_t *rec = &cur.record;
+        size_t r = exp->rows;
+
+        for (size_t i = 0; i < exp->column_count; i++) {
+            column_builder_t *c = &exp->columns[i];
+            record_value_t v = { .type = VALUE_NULL };
+            if (c->source < 0) {
+                v.type = VALUE_INTEGER;
+                v.integer = rec->rowid;
+            } else if ((size_t)c->source >= rec->column_count) {
+                // a row older than an ALTER TABLE ADD COLUMN has fewer values
+                v = c->fallback;
+            } else if (record_column(rec, (size_t)c->source, &v) < 0) {
+                v.type = VALUE_NULL;
+            }
+            int stored = append_value(c, r, rec, &v);
+            if (stored < 0) {
+                exp->failed = 1;
+                return 1;
+            }
+            if (stored == 0 && v.type != VALUE_NULL) {
+                exp->lossy++;
+            }
+        }
+
+        if (++exp->rows == exp->batch_rows && flush_batch(exp) < 0) {
+            exp->failed = 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// settles the type of untyped columns from their first non-NULL value
+static int infer_leaf(database_t *db, uint32_t page_num,
+                      btree_page_header_t *page, void *ctx) {
+    (void)page;
+    columnar_export_t *exp = ctx;
+    cell_cursor_t cur;
+
+    if (cell_cursor_open(&cur, db, page_num, &exp->scratch) < 0) {
+        return 0;
+    }
+    while (cell_cursor_next(&cur) > 0) {
+        for (size_t i = 0; i < exp->column_count; i++) {
+            column_builder_t *c = &exp->columns[i];
+            record_value_t v = c->fallback;
+            if (c->type != 0 ||
+                ((size_t)c->source < cur.record.column_count &&
+                 record_column(&cur.record, (size_t)c->source, &v) < 0)) {
+                continue;
+            }
+            switch (v.type) {
+            case VALUE_INTEGER: c->type = COLUMNAR_INT64; break;
+            case VALUE_FLOAT: c->type = COLUMNAR_FLOAT64; break;
+            case VALUE_TEXT: c->type = COLUMNAR_UTF8; break;
+            case VALUE_BLOB: c->type = COLUMNAR_BINARY; break;
+            default: continue;
+            }
+            exp->pending_types--;
+        }
+        if (exp->pending_types == 0 || ++exp->scanned >= exp->batch_rows) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static uint32_t affinity_type(column_affinity_t affinity) {
+    switch (affinity) {
+    case AFFINITY_INTEGER: return COLUMNAR_INT64;
+    case AFFINITY_REAL:
+    case AFFINITY_NUMERIC: return COLUMNAR_FLOAT64;
+    case AFFINITY_TEXT: return COLUMNAR_UTF8;
+    default: return 0;
+    }
+}
+
+// output columns: the table's stored columns, with a leading "rowid"
+// column unless one of them is an INTEGER PRIMARY KEY
+static int plan_columns(columnar_export_t *exp, const table_columns_t *cols) {
+    int has_alias = 0;
+    for (size_t i = 0; i < cols->count; i++) {
+        has_alias |= cols->columns[i].rowid_alias;
+    }
+
+    exp->columns = calloc(cols->count + 1, sizeof(column_builder_t));
+    if (!exp->columns) {
+        return -1;
+    }
+    if (!has_alias) {
+        column_builder_t *c = &exp->columns[exp->column_count++];
+        c->name = "rowid";
+        c->type = COLUMNAR_INT64;
+        c->flags = COLUMNAR_FLAG_ROWID;
+        c->source = -1;
+    }
+
+    long source = 0;
+    for (size_t i = 0; i < cols->count; i++) {
+        const table_column_t *col = &cols->columns[i];
+        if (!col->stored) {
+            continue;
+        }
+        column_builder_t *c = &exp->columns[exp->column_count++];
+        c->name = col->name;
+        c->source = source++;
+        c->fallback.type = VALUE_NULL;
+        if (col->default_value &&
+            sql_literal_value(col->default_value, &c->fallback, &c->fallback_text) < 0) {
+            return -1;
+        }
+        if (col->rowid_alias) {
+            c->type = COLUMNAR_INT64;
+            c->flags = COLUMNAR_FLAG_ROWID;
+            c->source = -1;
+        } else {
+            c->type = affinity_type(col->affinity);
+            exp->pending_types += c->type == 0;
+        }
+    }
+    return 0;
+}
+
+// Footer: column entries, then per batch its row count and a buffer entry
+// per column, then the column names.
+static void write_footer(columnar_export_t *exp) {
+    uint64_t names_offset = exp->column_count * COLUMNAR_COLUMN_ENTRY_SIZE +
+                            exp->batch_count * (COLUMNAR_BATCH_ENTRY_SIZE +
+                            exp->column_count * COLUMNAR_BUFFER_ENTRY_SIZE);
+    uint64_t first_row = 0;
+
+    for (size_t i = 0; i < exp->column_count; i++) {
+        const column_builder_t *c = &exp->columns[i];
+        uint32_t len = (uint32_t)strlen(c->name);
+        emit_u32(exp, c->type);
+        emit_u32(exp, c->flags);
+        emit_u32(exp, (uint32_t)names_offset);
+        emit_u32(exp, len);
+        names_offset += len + 1;
+    }
+    for (size_t b = 0; b < exp->batch_count; b++) {
+        emit_u64(exp, first_row);
+        emit_u64(exp, exp->batch_rows_done[b]);
+        first_row += exp->batch_rows_done[b];
+        for (size_t i = 0; i < exp->column_count; i++) {
+            const buffer_desc_t *d = &exp->descs[b * exp->column_count + i];
+            emit_u64(exp, d->null_count);
+            emit_u64(exp, d->validity_offset);
+            emit_u64(exp, d->values_offset);
+            emit_u64(exp, d->values_size);
+            emit_u64(exp, d->data_offset);
+            emit_u64(exp, d->data_size);
+        }
+    }
+    for (size_t i = 0; i < exp->column_count; i++) {
+        emit(exp, exp->columns[i].name, strlen(exp->columns[i].name) + 1);
+    }
+}
+
+static int write_header(int fd, const columnar_export_t *exp,
+                        uint64_t footer_offset, uint64_t footer_size) {
+    uint8_t header[COLUMNAR_HEADER_SIZE] = {0};
+    uint32_t version = COLUMNAR_VERSION;
+    uint32_t columns = (uint32_t)exp->column_count;
+    uint32_t batches = (uint32_t)exp->batch_count;
+    uint32_t batch_rows = (uint32_t)exp->batch_rows;
+
+    memcpy(header, COLUMNAR_MAGIC, 8);
+    memcpy(header + 8, &version, 4);
+    memcpy(header + 12, &columns, 4);
+    memcpy(header + 16, &exp->total_rows, 8);
+    memcpy(header + 24, &batches, 4);
+    memcpy(header + 28, &batch_rows, 4);
+    memcpy(header + 32, &footer_offset, 8);
+    memcpy(header + 40, &footer_size, 8);
+    return pwrite(fd, header, sizeof(header), 0) == (ssize_t)sizeof(header) ? 0 : -1;
+}
+
+static void free_export(columnar_export_t *exp) {
+    for (size_t i = 0; i < exp->column_count; i++) {
+        free(exp->columns[i].validity);
+        free(exp->columns[i].values);
+        free(exp->columns[i].offsets);
+        free(exp->columns[i].data);
+        free(exp->columns[i].fallback_text);
+    }
+    free(exp->columns);
+    free(exp->descs);
+    free(exp->batch_rows_done);
+}
+
+// Writes the rows of a table to `path` in the columnar layout. The header
+// is written last, so an interrupted export never looks valid. Returns 0
+// and the row count in *rows_out, or -1 with a message on stderr.
+int export_columnar(database_t *db, schema_t *schema, const char *table_name,
+                    const char *path, uint64_t *rows_out) {
+    uint16_t probe = 1;
+    if (*(uint8_t *)&probe != 1) {
+        fprintf(stderr, "columnar export needs a little-endian host\n");
+        return -1;
+    }
+    if (db->header.db_text_encoding > 1) {
+        fprintf(stderr, "columnar export supports UTF-8 databases only\n");
+        return -1;
+    }
+
+    schema_entry_t *table = schema_find(schema, "table", table_name);
+    if (!table || table->rootpage == 0) {
+        fprintf(stderr, "table not found: %s\n", table_name);
+        return -1;
+    }
+    table_columns_t cols;
+    if (schema_table_columns(table, &cols) < 0) {
+        fprintf(stderr, "cannot read the columns of %s\n", table_name);
+        return -1;
+    }
+    if (cols.without_rowid) {
+        fprintf(stderr, "%s: WITHOUT ROWID tables are not supported\n", table_name);
+        free_table_columns(&cols);
+        return -1;
+    }
+
+    uint64_t serial_types[RECORD_MAX_COLUMNS];
+    size_t offsets[RECORD_MAX_COLUMNS];
+    columnar_export_t exp = {
+        .scratch = { serial_types, offsets, RECORD_MAX_COLUMNS },
+    };
+    int rc = -1;
+    int fd = -1;
+
+    if (plan_columns(&exp, &cols) < 0) {
+        perror("malloc");
+        goto done;
+    }
+    exp.batch_rows = COLUMNAR_BATCH_BYTES / (exp.column_count * sizeof(uint64_t));
+    if (exp.batch_rows > COLUMNAR_BATCH_ROWS) exp.batch_rows = COLUMNAR_BATCH_ROWS;
+    exp.batch_rows -= exp.batch_rows % 64;
+    if (exp.batch_rows < 64) exp.batch_rows = 64;
+
+    if (exp.pending_types > 0) {
+        btree_walk_table(db, (uint32_t)table->rootpage, infer_leaf, &exp);
+    }
+    for (size_t i = 0; i < exp.column_count; i++) {
+        if (exp.columns[i].type == 0) {
+            exp.columns[i].type = COLUMNAR_BINARY;
+        }
+        if (builder_alloc(&exp, &exp.columns[i]) < 0) {
+            perror("malloc");
+            goto done;
+        }
+    }
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || out_open_fd(&exp.out, fd) < 0) {
+        perror(path);
+        goto done;
+    }
+    static const uint8_t blank[COLUMNAR_HEADER_SIZE];
+    emit(&exp, blank, sizeof(blank));
+
+    if (btree_walk_table(db, (uint32_t)table->rootpage, export_leaf, &exp) < 0 ||
+        exp.failed || flush_batch(&exp) < 0) {
+        fprintf(stderr, "%s: export failed\n", path);
+        goto done;
+    }
+
+    emit_pad(&exp);
+    uint64_t footer_offset = exp.pos;
+    write_footer(&exp);
+    if (out_flush(&exp.out) < 0 ||
+        write_header(fd, &exp, footer_offset, exp.pos - footer_offset) < 0) {
+        perror(path);
+        goto done;
+    }
+
+    if (exp.lossy > 0) {
+        fprintf(stderr, "%llu values did not fit their column type and were "
+                "exported as NULL\n", (unsigned long long)exp.lossy);
+    }
+    *rows_out = exp.total_rows;
+    rc = 0;
+
+done:
+    if (fd >= 0) {
+        out_close(&exp.out);
+        if (close(fd) < 0 && rc == 0) {
+            perror(path);
+            rc = -1;
+        }
+        if (rc < 0) {
+            unlink(path);
+        }
+    }
+    free_export(&exp);
+    free_table_columns(&cols);
+    return rc;
+}
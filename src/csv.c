@@ -0,0 +1,66 @@
+#include <string.h>
+#include "../include/csv.h"
+
+/*
+ * CSV fields as RFC 4180 writes them: a field holding a comma, a quote or
+ * a line break is put in double quotes with its quotes doubled, anything
+ * else is copied as it is. Fields are scanned 16 bytes per step for those
+ * four bytes, so the common case is one scan and one memcpy.
+ */
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Length of the leading run of data without a comma, quote, CR or LF.
+size_t csv_scan(const uint8_t *data, size_t len) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, comma), _mm_cmpeq_epi8(v, quote)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+        int mask = _mm_movemask_epi8(special);
+        if (mask) {
+            return i + (size_t)__builtin_ctz((unsigned)mask);
+        }
+    }
+#endif
+    while (i < len && data[i] != ',' && data[i] != '"' &&
+           data[i] != '\r' && data[i] != '\n') {
+        i++;
+    }
+    return i;
+}
+
+// Writes the inside of a quoted field, doubling its quotes. A value read
+// in segments is written with one call per segment.
+void csv_quoted_body(out_t *out, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        const uint8_t *q = memchr(data, '"', len);
+        size_t run = q ? (size_t)(q - data) + 1 : len;
+        out_write(out, data, run);
+        if (q) out_char(out, '"');
+        data += run;
+        len -= run;
+    }
+}
+
+// Writes one field, quoted only if it has to be.
+void csv_print_field(out_t *out, const uint8_t *data, size_t len) {
+    size_t clean = csv_scan(data, len);
+    if (clean == len) {
+        out_write(out, data, len);
+        return;
+    }
+    out_char(out, '"');
+    out_write(out, data, clean);
+    csv_quoted_body(out, data + clean, len - clean);
+    out_char(out, '"');
+}
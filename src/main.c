@@ -1,154 +1,946 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
-#include "../include/serializer.h"
-#include "../include/parser.h"
+#include "../include/analyze.h"
+#include "../include/batch.h"
+#include "../include/btree.h"
 #include "../include/cell.h"
-#include "../include/schema.h"
+#include "../include/columnar.h"
 #include "../include/constants.h"
+#include "../include/pager.h"
+#include "../include/parser.h"
+#include "../include/pipeline.h"
+#include "../include/pool.h"
+#include "../include/query.h"
+#include "../include/schema.h"
+#include "../include/serializer.h"
+#include "../include/sidecar.h"
+#include "../include/stats.h"
+#include "../include/watch.h"
+
+// one "name: value" line of the text dump
+static void print_field(out_t *out, const char *name, uint64_t value) {
+    out_str(out, name);
+    out_str(out, ": ");
+    out_u64(out, value);
+    out_char(out, '\n');
+}
+
+static void print_hex_bytes(out_t *out, const uint8_t *data, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++) {
+        char byte[3] = { hex[data[i] >> 4], hex[data[i] & 15], ' ' };
+        out_write(out, byte, sizeof(byte));
+    }
+    out_char(out, '\n');
+}
+
+void print_db_header(out_t *out, db_header_t *header) {
+    out_str(out, "magic: ");
+    print_hex_bytes(out, header->magic, 16);
+    print_field(out, "page size", header->page_size);
+    print_field(out, "file format write", header->file_format_write);
+    print_field(out, "file format read", header->file_format_read);
+    print_field(out, "reserved space", header->reserved_space);
+    print_field(out, "max embed payload frac", header->max_embed_payload_frac);
+    print_field(out, "min embed payload frac", header->min_embed_payload_frac);
+    print_field(out, "leaf payload frac", header->leaf_payload_frac);
+    print_field(out, "file change counter", header->file_change_counter);
+    out_str(out, "database size: ");
+    out_u64(out, header->header_db_size);
+    out_str(out, " pages\n");
+    print_field(out, "first freelist trunk", header->first_freelist_trunk);
+    print_field(out, "total freelist pages", header->total_freelist_trunk);
+    print_field(out, "schema cookie", header->schema_cookie);
+    print_field(out, "schema format number", header->schema_format_number);
+    print_field(out, "default page cache size", header->default_page_cache_size);
+    print_field(out, "page number largest root", header->page_number_largest_root);
+    print_field(out, "text encoding", header->db_text_encoding);
+    print_field(out, "user version", header->user_version);
+    print_field(out, "incremental vacuum mode", header->incremental_version_mode);
+    print_field(out, "application id", header->application_id);
+    out_str(out, "reserved expansion: ");
+    print_hex_bytes(out, header->reserved_expansion, 20);
+    print_field(out, "version valid for", header->version_valid_for);
+    print_field(out, "sqlite version number", header->sqlite_version_number);
+}
 
-void print_db_header(db_header_t *header) {
-    printf("magic: ");
-    for (int i = 0; i < 16; i++) {
-        printf("%02x ", header->magic[i]);
-    }
-    printf("\n");
-    printf("page size: %u\n", header->page_size);
-    printf("file format write: %u\n", header->file_format_write);
-    printf("file format read: %u\n", header->file_format_read);
-    printf("reserved space: %u\n", header->reserved_space);
-    printf("max embed payload frac: %u\n", header->max_embed_payload_frac);
-    printf("min embed payload frac: %u\n", header->min_embed_payload_frac);
-    printf("leaf payload frac: %u\n", header->leaf_payload_frac);
-    printf("file change counter: %u\n", header->file_change_counter);
-    printf("database size: %u pages\n", header->header_db_size);
-    printf("first freelist trunk: %u\n", header->first_freelist_trunk);
-    printf("total freelist pages: %u\n", header->total_freelist_trunk);
-    printf("schema cookie: %u\n", header->schema_cookie);
-    printf("schema format number: %u\n", header->schema_format_number);
-    printf("default page cache size: %u\n", header->default_page_cache_size);
-    printf("page number largest root: %u\n", header->page_number_largest_root);
-    printf("text encoding: %u\n", header->db_text_encoding);
-    printf("user version: %u\n", header->user_version);
-    printf("incremental vacuum mode: %u\n", header->incremental_version_mode);
-    printf("application id: %u\n", header->application_id);
-    printf("reserved expansion: ");
-    for (int i = 0; i < 20; i++) {
-        printf("%02x ", header->reserved_expansion[i]);
-    }
-    printf("\n");
-    printf("version valid for: %u\n", header->version_valid_for);
-    printf("sqlite version number: %u\n", header->sqlite_version_number);
-}
-
-void print_page_header(btree_page_header_t *page, int page_num) {
-    printf("\n=== Page %d Header ===\n", page_num);
-    printf("page type: 0x%02x\n", page->page_type);
-    printf("first freeblock: %u\n", page->first_freeblock);
-    printf("cell count: %u\n", page->cell_count);
-    printf("cell content start: %u\n", page->cell_content_start);
-    printf("fragmented free bytes: %u\n", page->fragmented_free_bytes);
+void print_page_header(out_t *out, btree_page_header_t *page, int page_num) {
+    static const char hex[] = "0123456789abcdef";
+    char type[5] = { '0', 'x', hex[page->page_type >> 4], hex[page->page_type & 15], '\n' };
+    
+    out_str(out, "\n=== Page ");
+    out_i64(out, page_num);
+    out_str(out, " Header ===\npage type: ");
+    out_write(out, type, sizeof(type));
+    print_field(out, "first freeblock", page->first_freeblock);
+    print_field(out, "cell count", page->cell_count);
+    print_field(out, "cell content start", page->cell_content_start);
+    print_field(out, "fragmented free bytes", page->fragmented_free_bytes);
     
     if (page->page_type == PAGE_TYPE_INTERIOR_INDEX ||
         page->page_type == PAGE_TYPE_INTERIOR_TABLE) {
-        printf("rightmost pointer: %u\n", page->rightmost_pointer);
+        print_field(out, "rightmost pointer", page->rightmost_pointer);
     }
     
-    if (page->cell_count > 0 && page->cell_pointers) {
-        printf("cell pointers: ");
+    if (page->cell_count > 0) {
+        out_str(out, "cell pointers: ");
         for (uint16_t i = 0; i < page->cell_count; i++) {
-            printf("%u ", page->cell_pointers[i]);
+            out_u64(out, page_cell_pointer(page, i));
+            out_char(out, ' ');
         }
-        printf("\n");
+        out_char(out, '\n');
     }
 }
 
-int main(int argc, char **argv) {
-    if (argc < 2 || argc > 3) {
-        printf("usage: %s <file.db> [--json]\n", argv[0]);
-        return 1;
+// most --key values accepted for one index seek
+#define CLI_MAX_KEYS 64
+// most --where predicates of one dump
+#define CLI_MAX_WHERE 64
+// pages a worker renders at a time in a threaded full dump
+#define DUMP_BATCH_PAGES 64
+// --watch poll period unless --interval is given
+#define WATCH_DEFAULT_INTERVAL_MS 1000
+
+// --stats report formats
+#define CLI_STATS_TEXT 1
+#define CLI_STATS_JSON 2
+
+typedef struct {
+    char *filename;
+    char *batch;
+    char *table_name;
+    char *index_name;
+    record_value_t keys[CLI_MAX_KEYS];
+    size_t key_count;
+    char *columns;
+    char *where[CLI_MAX_WHERE];
+    size_t where_count;
+    int json_mode;
+    query_format_t format;
+    int threads;
+    int queue_depth;
+    int watch;
+    int interval_ms;
+    int cache;
+    int analyze;
+    int stats;
+    int has_rowid;
+    int64_t rowid;
+    int has_range;
+    int64_t rowid_lo;
+    int64_t rowid_hi;
+    char *export_table;
+    char *export_path;
+    db_options_t db;
+} cli_options_t;
+
+typedef struct {
+    out_t *out;
+    query_format_t format;
+    size_t rows;
+    int bounded;
+    int64_t lo;
+    int64_t hi;
+    const query_t *query;
+    record_scratch_t scratch;
+} table_dump_t;
+
+static void print_table_row(table_dump_t *dump, const record_t *rec) {
+    if (!query_match(dump->query, rec)) {
+        return;
     }
+    if (dump->format == QUERY_JSON) {
+        out_str(dump->out, dump->rows > 0 ? ",\n    " : "    ");
+    }
+    print_record_query(dump->out, dump->query, rec, dump->format);
+    dump->rows++;
+}
+
+static int print_table_leaf(database_t *db, uint32_t page_num,
+                            btree_page_header_t *page, void *ctx) {
+    (void)page;
+    table_dump_t *dump = ctx;
+    cell_cursor_t cur;
     
-    char *filename = argv[1];
-    int json_mode = 0;
+    if (cell_cursor_open(&cur, db, page_num, &dump->scratch) < 0) {
+        return 0;
+    }
     
-    if (argc == 3) {
-        if (strcmp(argv[2], "--json") == 0) {
-            json_mode = 1;
-        } else if (strcmp(argv[1], "--json") == 0) {
-            json_mode = 1;
-            filename = argv[2];
-        } else {
-            printf("usage: %s <file.db> [--json]\n", argv[0]);
+    int rc;
+    while ((rc = cell_cursor_next(&cur)) != 0) {
+        if (rc < 0) continue;
+        if (dump->bounded) {
+            if (cur.record.rowid < dump->lo) continue;
+            if (cur.record.rowid > dump->hi) return 1;
+        }
+        print_table_row(dump, &cur.record);
+    }
+    return 0;
+}
+
+static int print_index_row(database_t *db, const record_t *rec, void *ctx) {
+    (void)db;
+    print_table_row(ctx, rec);
+    return 0;
+}
+
+// Prints the rows of one table in rowid order by walking its b-tree from
+// the schema rootpage, without touching pages of other tables. With
+// --rowid only the path from the root to that row's leaf is read, with
+// --rowid-range only the subtrees overlapping the range. With --index the
+// rows come from seeking that index for the --key values, in index order.
+// --where drops the rows that do not match and --columns picks the values
+// printed; record headers are then only decoded as far as the last column
+// either of them reads. --format csv or ndjson prints one line per row
+// with nothing around the rows but the CSV header, and reports errors on
+// stderr only.
+static int dump_table(out_t *out, database_t *db, const cli_options_t *cli) {
+    int json_mode = cli->format == QUERY_JSON;
+    int streaming = cli->format == QUERY_CSV || cli->format == QUERY_NDJSON;
+    schema_t *schema = parse_schema(db);
+    schema_entry_t *index = NULL;
+    const char *table_name = cli->table_name;
+    
+    if (cli->index_name) {
+        index = schema_find(schema, "index", cli->index_name);
+        if (!index || index->rootpage == 0) {
+            if (streaming) {
+                fprintf(stderr, "index not found: %s\n", cli->index_name);
+            } else if (json_mode) {
+                out_str(out, "{\"error\": \"index not found\"}");
+            } else {
+                out_str(out, "index not found: ");
+                out_str(out, cli->index_name);
+                out_char(out, '\n');
+            }
+            free_schema(schema);
             return 1;
         }
+        table_name = index->tbl_name;
     }
     
-    database_t *db = parse_database(filename);
-    if (!db) {
-        if (json_mode) printf("{\"error\": \"failed to parse database\"}");
-        else printf("failed to parse database\n");
+    schema_entry_t *entry = schema_find(schema, "table", table_name);
+    if (!entry || entry->rootpage == 0) {
+        if (streaming) {
+            fprintf(stderr, "table not found: %s\n", table_name);
+        } else if (json_mode) {
+            out_str(out, "{\"error\": \"table not found\"}");
+        } else {
+            out_str(out, "table not found: ");
+            out_str(out, table_name);
+            out_char(out, '\n');
+        }
+        free_schema(schema);
         return 1;
     }
     
-    if (memcmp(db->header.magic, SQLITE_MAGIC, 16) != 0) {
-        if (json_mode) printf("{\"error\": \"invalid sqlite file\"}");
-        else printf("invalid sqlite file\n");
-        free_database(db);
+    query_t query;
+    // the streaming formats name every column unless told otherwise
+    const char *columns = cli->columns;
+    if (!columns && streaming) {
+        columns = "*";
+    }
+    if (query_prepare(&query, entry, columns, cli->where, cli->where_count) < 0) {
+        if (json_mode) out_str(out, "{\"error\": \"invalid query\"}");
+        free_schema(schema);
         return 1;
     }
     
+    uint64_t serial_types[RECORD_MAX_COLUMNS];
+    size_t offsets[RECORD_MAX_COLUMNS];
+    table_dump_t dump = {
+        .out = out,
+        .format = cli->format,
+        .query = &query,
+        .scratch = { serial_types, offsets, RECORD_MAX_COLUMNS },
+    };
+    if (query.needed < dump.scratch.capacity) {
+        dump.scratch.capacity = query.needed;
+    }
+    if (cli->format == QUERY_CSV) {
+        print_csv_header(out, &query);
+    } else if (json_mode) {
+        out_str(out, "{\n\"table\": ");
+        json_print_string(out, entry->name);
+        if (query.select_count > 0) {
+            out_str(out, ",\n\"columns\": [");
+            for (size_t i = 0; i < query.select_count; i++) {
+                if (i > 0) out_str(out, ", ");
+                json_print_string(out, query.select[i].name);
+            }
+            out_char(out, ']');
+        }
+        out_str(out, ",\n\"rows\": [\n");
+    } else if (!streaming) {
+        out_str(out, "=== Table ");
+        out_str(out, entry->name);
+        out_str(out, " ===\n");
+    }
+    
+    int rc;
+    if (index) {
+        rc = lookup_index(db, schema, index, cli->keys, cli->key_count,
+                          &dump.scratch, print_index_row, &dump);
+    } else if (cli->has_rowid) {
+        record_t rec;
+        rc = lookup_rowid(db, entry, cli->rowid, &dump.scratch, &rec);
+        if (rc > 0) {
+            print_table_row(&dump, &rec);
+        } else if (rc == 0 && cli->format == QUERY_TEXT) {
+            out_str(out, "row not found: ");
+            out_i64(out, cli->rowid);
+            out_char(out, '\n');
+        }
+    } else if (cli->has_range) {
+        dump.bounded = 1;
+        dump.lo = cli->rowid_lo;
+        dump.hi = cli->rowid_hi;
+        rc = btree_walk_table_range(db, (uint32_t)entry->rootpage, dump.lo, dump.hi,
+                                    print_table_leaf, &dump);
+    } else {
+        rc = btree_walk_table(db, (uint32_t)entry->rootpage, print_table_leaf, &dump);
+    }
+    
+    if (json_mode) out_str(out, "\n  ]\n}");
+    free_query(&query);
+    free_schema(schema);
+    return rc < 0 ? 1 : 0;
+}
+
+// Writes a table to a columnar file (--export-columnar) and reports the
+// row count.
+static int export_table(out_t *out, database_t *db, const cli_options_t *cli) {
+    schema_t *schema = parse_schema(db);
+    uint64_t rows = 0;
+    
+    if (export_columnar(db, schema, cli->export_table, cli->export_path, &rows) < 0) {
+        if (cli->json_mode) out_str(out, "{\"error\": \"export failed\"}");
+        free_schema(schema);
+        return 1;
+    }
+    if (cli->json_mode) {
+        out_str(out, "{\"table\": ");
+        json_print_string(out, cli->export_table);
+        out_str(out, ", \"file\": ");
+        json_print_string(out, cli->export_path);
+        out_str(out, ", \"rows\": ");
+        out_u64(out, rows);
+        out_str(out, "}\n");
+    } else {
+        out_str(out, "exported ");
+        out_u64(out, rows);
+        out_str(out, " rows of ");
+        out_str(out, cli->export_table);
+        out_str(out, " to ");
+        out_str(out, cli->export_path);
+        out_char(out, '\n');
+    }
+    free_schema(schema);
+    return 0;
+}
+
+// Prints page `pgno` (1-based) of the full dump; a JSON page after the
+// first is preceded by a comma. Returns -1 if the page cannot be decoded,
+// which ends the dump.
+static int dump_page(out_t *out, database_t *db, uint32_t pgno, int json_mode,
+                     int first) {
+    btree_page_header_t page;
+    if (db_get_page(db, pgno, &page) < 0) {
+        return -1;
+    }
+    btree_page_header_t *page_header = &page;
+    uint8_t *page_base_ptr = db_page_data(db, pgno);
+
+    if (json_mode) {
+        if (!first) out_str(out, ",\n");
+        serialize_page_header(out, page_header, pgno);
+
+        // Cells
+        if (page_header->page_type == PAGE_TYPE_LEAF_TABLE) {
+            for (uint16_t j = 0; j < page_header->cell_count; j++) {
+                if (j > 0) out_str(out, ", ");
+                parse_cell_json(out, db, page_base_ptr, page_cell_pointer(page_header, j));
+            }
+        }
+        out_str(out, "]\n    }"); // End cells array and page object
+    } else {
+        print_page_header(out, page_header, pgno);
+        if (page_header->page_type == PAGE_TYPE_LEAF_TABLE) {
+            out_str(out, "\nCells:\n");
+            for (uint16_t j = 0; j < page_header->cell_count; j++) {
+                parse_cell(out, db, page_base_ptr, page_cell_pointer(page_header, j));
+            }
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    database_t *db;
+    int json_mode;
+} page_dump_t;
+
+// pipeline_render_fn: prints one batch of DUMP_BATCH_PAGES pages
+static int dump_page_batch(void *ctx, size_t batch, int worker, out_t *out) {
+    (void)worker;
+    page_dump_t *dump = ctx;
+    uint32_t count = dump->db->header.header_db_size;
+    uint32_t first = (uint32_t)(batch * DUMP_BATCH_PAGES);
+    uint32_t last = count - first > DUMP_BATCH_PAGES ? first + DUMP_BATCH_PAGES
+                                                     : count;
+    for (uint32_t i = first; i < last; i++) {
+        if (dump_page(out, dump->db, i + 1, dump->json_mode, i == 0) < 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Prints the whole file. With threads > 1 the pages are rendered in
+// batches on worker threads and written in page order, holding at most
+// `depth` rendered batches; the page directory must be loaded already.
+static void dump_database(out_t *out, database_t *db, int json_mode,
+                          int threads, size_t depth) {
     if (json_mode) {
-        printf("{\n");
-        serialize_db_header(&db->header);
-        printf(",\n");
+        out_str(out, "{\n");
+        serialize_db_header(out, &db->header);
+        out_str(out, ",\n");
     } else {
-        print_db_header(&db->header);
+        print_db_header(out, &db->header);
     }
     
     schema_t *schema = parse_schema(db);
     if (json_mode) {
-        serialize_schema(schema);
-        printf(",\n");
+        serialize_schema(out, schema);
+        out_str(out, ",\n");
     } else if (schema) {
-        print_schema(schema);
+        print_schema(out, schema);
     }
     if (schema) free_schema(schema);
     
-    if (json_mode) printf("\"pages\": [\n");
+    if (json_mode) out_str(out, "\"pages\": [\n");
     
     // parse and print all pages
-    for (uint32_t i = 0; i < db->header.header_db_size; i++) {
-        size_t page_start = db->header.page_size * i;
-        btree_page_header_t *page_header = &db->page_headers[i];
-        
-        if (json_mode) {
-            if (i > 0) printf(",\n");
-            serialize_page_header(page_header, i + 1);
-            
-            // Cells
-            if (page_header->page_type == PAGE_TYPE_LEAF_TABLE) {
-                uint8_t *page_base_ptr = (uint8_t *)db->file_data + page_start;
-                for (uint16_t j = 0; j < page_header->cell_count; j++) {
-                    if (j > 0) printf(", ");
-                    parse_cell_json(page_base_ptr, page_header->cell_pointers[j], db->header.page_size);
-                }
+    uint32_t count = db->header.header_db_size;
+    page_dump_t dump = { .db = db, .json_mode = json_mode };
+    size_t batches = ((size_t)count + DUMP_BATCH_PAGES - 1) / DUMP_BATCH_PAGES;
+    if (threads < 2 ||
+        pipeline_run(out, batches, threads, depth, dump_page_batch, &dump) < 0) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (dump_page(out, db, i + 1, json_mode, i == 0) < 0) {
+                break;
             }
-            printf("]\n    }"); // End cells array and page object
-        } else {
-            print_page_header(page_header, i + 1);
-            if (page_header->page_type == PAGE_TYPE_LEAF_TABLE) {
-                printf("\nCells:\n");
-                uint8_t *page_base_ptr = (uint8_t *)db->file_data + page_start;
-                for (uint16_t j = 0; j < page_header->cell_count; j++) {
-                    parse_cell(page_base_ptr, page_header->cell_pointers[j], db->header.page_size);
-                }
+            db_release_pages(db);
+        }
+    }
+    
+    if (json_mode) out_str(out, "\n  ]\n}"); // End pages array and root object
+}
+
+static volatile sig_atomic_t watch_stop;
+
+static void on_watch_signal(int sig) {
+    (void)sig;
+    watch_stop = 1;
+}
+
+// Prints what the last poll found: the changed page numbers, then each of
+// them that decodes as a b-tree page as in the full dump (leaf table pages
+// with their rows).
+static void print_watch_delta(out_t *out, const watch_t *w, uint64_t change,
+                              int json_mode) {
+    uint32_t removed = w->old_page_count > w->page_count ?
+                       w->old_page_count - w->page_count : 0;
+    if (json_mode) {
+        out_str(out, "{\"change\": ");
+        out_u64(out, change);
+        out_str(out, ", \"change_counter\": ");
+        out_u64(out, w->change_counter);
+        out_str(out, ", \"page_count\": ");
+        out_u64(out, w->page_count);
+        out_str(out, ", \"removed\": ");
+        out_u64(out, removed);
+        out_str(out, ", \"changed\": [");
+        for (size_t i = 0; i < w->changed_count; i++) {
+            if (i > 0) out_str(out, ", ");
+            out_u64(out, w->changed[i]);
+        }
+        out_str(out, "], \"pages\": [\n");
+    } else {
+        out_str(out, "=== change ");
+        out_u64(out, change);
+        out_str(out, ": ");
+        out_u64(out, w->changed_count);
+        out_str(out, " pages changed, ");
+        out_u64(out, removed);
+        out_str(out, " removed, ");
+        out_u64(out, w->page_count);
+        out_str(out, " pages ===\nchanged:");
+        for (size_t i = 0; i < w->changed_count; i++) {
+            out_char(out, ' ');
+            out_u64(out, w->changed[i]);
+        }
+        out_char(out, '\n');
+    }
+    int first = 1;
+    for (size_t i = 0; i < w->changed_count; i++) {
+        if (dump_page(out, w->db, w->changed[i], json_mode, first) == 0) {
+            first = 0;
+        }
+    }
+    out_str(out, json_mode ? "\n]}\n" : "\n");
+}
+
+// Follows the database until interrupted, printing a delta after every
+// poll that found changed pages. Takes ownership of db.
+static int watch_database(out_t *out, database_t *db, const cli_options_t *cli) {
+    watch_t w;
+    if (watch_open(&w, cli->filename, db, &cli->db, cli->threads) < 0) {
+        free_database(db);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_watch_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (cli->json_mode) {
+        out_str(out, "{\"watching\": ");
+        json_print_string(out, cli->filename);
+        out_str(out, ", \"page_count\": ");
+        out_u64(out, w.page_count);
+        out_str(out, "}\n");
+    } else {
+        out_str(out, "watching ");
+        out_str(out, cli->filename);
+        out_str(out, ": ");
+        out_u64(out, w.page_count);
+        out_str(out, " pages\n");
+    }
+
+    int rc = 0;
+    uint64_t changes = 0;
+    struct timespec interval = {
+        .tv_sec = cli->interval_ms / 1000,
+        .tv_nsec = (long)(cli->interval_ms % 1000) * 1000000,
+    };
+    while (!watch_stop && out_flush(out) == 0) {
+        nanosleep(&interval, NULL);
+        if (watch_stop) {
+            break;
+        }
+        int found = watch_poll(&w);
+        if (found < 0) {
+            rc = 1;
+            break;
+        }
+        if (found > 0) {
+            print_watch_delta(out, &w, ++changes, cli->json_mode);
+        }
+    }
+    watch_close(&w);
+    return rc;
+}
+
+// Prints where the pages and bytes of the file go (--analyze), walking
+// the b-trees on every core unless --threads says otherwise.
+static int analyze_file(out_t *out, database_t *db, const cli_options_t *cli) {
+    schema_t *schema = parse_schema(db);
+    analyze_result_t result;
+    int threads = cli->threads > 0 ? cli->threads : pool_cpu_count();
+    if (analyze_database(db, schema, threads, &result) < 0) {
+        perror("malloc");
+        free_schema(schema);
+        return 1;
+    }
+    analyze_print(out, db, &result, cli->json_mode);
+    analyze_free(&result);
+    free_schema(schema);
+    return 0;
+}
+
+// Writes the --stats report to stderr, once all workers have exited.
+static void report_stats(const cli_options_t *cli) {
+    out_t err;
+    if (!cli->stats || out_open_fd(&err, STDERR_FILENO) < 0) {
+        return;
+    }
+    STATS_REPORT(&err, cli->stats == CLI_STATS_JSON);
+    out_close(&err);
+}
+
+// Summarizes every file of cli->batch, one NDJSON line each, and reports
+// the throughput on stderr. Returns the exit code.
+static int run_batch(out_t *out, const cli_options_t *cli) {
+    char **paths;
+    size_t count;
+    if (batch_list_files(cli->batch, &paths, &count) < 0) {
+        return 1;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    batch_result_t result;
+    int threads = cli->threads > 0 ? cli->threads : pool_cpu_count();
+    int rc = batch_run(out, paths, count, &cli->db, threads, &result);
+    if (out_flush(out) < 0) {
+        perror("write");
+        rc = -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    batch_free_files(paths, count);
+    if (rc < 0) {
+        return 1;
+    }
+
+    double seconds = (double)(end.tv_sec - start.tv_sec) +
+                     (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "%zu files (%zu with errors) in %.3f s, %.1f files/s\n",
+            result.files, result.failed, seconds,
+            seconds > 0 ? (double)result.files / seconds : 0.0);
+    return result.failed > 0 ? 1 : 0;
+}
+
+static void print_usage(const char *prog) {
+    printf("usage: %s <file.db> [--json] [--threads N [--queue-depth N]] [--zero-copy] [--no-wal] [--cache]\n"
+           "       %*s [--io mmap|pread|uring [--page-cache N]] [--max-resident SIZE]\n"
+           "       %*s [--watch [--interval MS]] [--stats text|json]\n"
+           "       %*s --batch DIR|LIST|- [--threads N] [--io ...]\n"
+           "       %*s --analyze [--json] [--threads N] [--io ...]\n"
+           "       %*s [--table NAME [--rowid N | --rowid-range LO:HI]]\n"
+           "       %*s [--index NAME [--key VALUE]...]\n"
+           "       %*s [--columns A,B,...] [--where EXPR]... [--format csv|ndjson]\n"
+           "       %*s [--export-columnar TABLE OUT]\n",
+           prog, (int)strlen(prog), "", (int)strlen(prog), "",
+           (int)strlen(prog), "", (int)strlen(prog), "",
+           (int)strlen(prog), "", (int)strlen(prog), "",
+           (int)strlen(prog), "", (int)strlen(prog), "");
+}
+
+static int parse_count(const char *arg, long max, int *out) {
+    char *end;
+    long n = strtol(arg, &end, 10);
+    if (*end != '\0' || n < 1 || n > max) {
+        return -1;
+    }
+    *out = (int)n;
+    return 0;
+}
+
+// A byte count with an optional K, M or G suffix (powers of 1024).
+static int parse_size(const char *arg, size_t *out) {
+    char *end;
+    unsigned long long n = strtoull(arg, &end, 10);
+    int shift = 0;
+    if (*end == 'K' || *end == 'k') shift = 10;
+    else if (*end == 'M' || *end == 'm') shift = 20;
+    else if (*end == 'G' || *end == 'g') shift = 30;
+    if (shift > 0) end++;
+    if (end == arg || *end != '\0' || arg[0] == '-' || n == 0 ||
+        n > (SIZE_MAX >> shift)) {
+        return -1;
+    }
+    *out = (size_t)n << shift;
+    return 0;
+}
+
+// A rowid spelled by the bytes from arg up to stop: digits with an
+// optional sign, within the range of a 64-bit integer.
+static int parse_rowid(const char *arg, const char *stop, int64_t *out) {
+    char *end;
+    errno = 0;
+    long long n = strtoll(arg, &end, 10);
+    if (end == arg || end != stop || errno == ERANGE) {
+        return -1;
+    }
+    *out = n;
+    return 0;
+}
+
+// "LO:HI" with either side optional, e.g. "100:" for rowids from 100 up
+static int parse_rowid_range(const char *arg, int64_t *lo, int64_t *hi) {
+    const char *colon = strchr(arg, ':');
+    if (!colon) {
+        return -1;
+    }
+    
+    *lo = INT64_MIN;
+    *hi = INT64_MAX;
+    if (colon != arg && parse_rowid(arg, colon, lo) < 0) {
+        return -1;
+    }
+    if (colon[1] != '\0' &&
+        parse_rowid(colon + 1, colon + 1 + strlen(colon + 1), hi) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// A --key value: NULL, an integer or real literal, or text. Quote text
+// that looks like a number ('42') to compare it as text.
+static void parse_key(char *arg, record_value_t *value) {
+    size_t len = strlen(arg);
+    char *end;
+    
+    memset(value, 0, sizeof(*value));
+    if (len >= 2 && arg[0] == '\'' && arg[len - 1] == '\'') {
+        value->type = VALUE_TEXT;
+        value->data = (const uint8_t *)arg + 1;
+        value->size = len - 2;
+        return;
+    }
+    if (strcmp(arg, "NULL") == 0) {
+        value->type = VALUE_NULL;
+        return;
+    }
+    
+    value->integer = strtoll(arg, &end, 10);
+    if (len > 0 && *end == '\0') {
+        value->type = VALUE_INTEGER;
+        return;
+    }
+    value->real = strtod(arg, &end);
+    if (len > 0 && *end == '\0' && strspn(arg, "0123456789+-.eE") == len) {
+        value->type = VALUE_FLOAT;
+        return;
+    }
+    value->type = VALUE_TEXT;
+    value->data = (const uint8_t *)arg;
+    value->size = len;
+}
+
+static int parse_args(int argc, char **argv, cli_options_t *cli) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            cli->json_mode = 1;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            if (parse_count(argv[++i], 1024, &cli->threads) < 0) return -1;
+        } else if (strcmp(argv[i], "--queue-depth") == 0 && i + 1 < argc) {
+            if (parse_count(argv[++i], 65536, &cli->queue_depth) < 0) return -1;
+        } else if (strcmp(argv[i], "--zero-copy") == 0) {
+            cli->db.zero_copy = 1;
+        } else if (strcmp(argv[i], "--no-wal") == 0) {
+            cli->db.no_wal = 1;
+        } else if (strcmp(argv[i], "--io") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "mmap") == 0) {
+                cli->db.io = DB_IO_MMAP;
+            } else if (strcmp(argv[i], "pread") == 0) {
+                cli->db.io = DB_IO_PREAD;
+            } else if (strcmp(argv[i], "uring") == 0) {
+                cli->db.io = DB_IO_URING;
+            } else {
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--page-cache") == 0 && i + 1 < argc) {
+            int pages;
+            if (parse_count(argv[++i], 1 << 30, &pages) < 0) return -1;
+            cli->db.cache_pages = (size_t)pages;
+        } else if (strcmp(argv[i], "--max-resident") == 0 && i + 1 < argc) {
+            if (parse_size(argv[++i], &cli->db.max_resident) < 0) return -1;
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            cli->cache = 1;
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "text") == 0) {
+                cli->stats = CLI_STATS_TEXT;
+            } else if (strcmp(argv[i], "json") == 0) {
+                cli->stats = CLI_STATS_JSON;
+            } else {
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--analyze") == 0) {
+            cli->analyze = 1;
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            cli->batch = argv[++i];
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            cli->watch = 1;
+        } else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            if (parse_count(argv[++i], 86400000, &cli->interval_ms) < 0) return -1;
+        } else if (strcmp(argv[i], "--table") == 0 && i + 1 < argc) {
+            cli->table_name = argv[++i];
+        } else if (strcmp(argv[i], "--rowid") == 0 && i + 1 < argc) {
+            const char *arg = argv[++i];
+            if (parse_rowid(arg, arg + strlen(arg), &cli->rowid) < 0) return -1;
+            cli->has_rowid = 1;
+        } else if (strcmp(argv[i], "--rowid-range") == 0 && i + 1 < argc) {
+            if (parse_rowid_range(argv[++i], &cli->rowid_lo, &cli->rowid_hi) < 0) {
+                return -1;
+            }
+            cli->has_range = 1;
+        } else if (strcmp(argv[i], "--index") == 0 && i + 1 < argc) {
+            cli->index_name = argv[++i];
+        } else if (strcmp(argv[i], "--key") == 0 && i + 1 < argc) {
+            if (cli->key_count == CLI_MAX_KEYS) return -1;
+            parse_key(argv[++i], &cli->keys[cli->key_count++]);
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "csv") == 0) {
+                cli->format = QUERY_CSV;
+            } else if (strcmp(argv[i], "ndjson") == 0) {
+                cli->format = QUERY_NDJSON;
+            } else {
+                return -1;
             }
+        } else if (strcmp(argv[i], "--columns") == 0 && i + 1 < argc) {
+            cli->columns = argv[++i];
+        } else if (strcmp(argv[i], "--where") == 0 && i + 1 < argc) {
+            if (cli->where_count == CLI_MAX_WHERE) return -1;
+            cli->where[cli->where_count++] = argv[++i];
+        } else if (strcmp(argv[i], "--export-columnar") == 0 && i + 2 < argc) {
+            cli->export_table = argv[++i];
+            cli->export_path = argv[++i];
+        } else if (argv[i][0] != '-' && !cli->filename) {
+            cli->filename = argv[i];
+        } else {
+            return -1;
+        }
+    }
+    
+    if (!cli->filename == !cli->batch || (cli->has_rowid && cli->has_range) ||
+        ((cli->has_rowid || cli->has_range) && !cli->table_name) ||
+        (cli->key_count > 0 && !cli->index_name) ||
+        (cli->index_name && cli->table_name) ||
+        ((cli->columns || cli->where_count > 0 || cli->format != QUERY_TEXT) &&
+         !cli->table_name && !cli->index_name) ||
+        (cli->format != QUERY_TEXT && cli->json_mode) ||
+        (cli->export_table && (cli->table_name || cli->index_name)) ||
+        (cli->watch && (cli->table_name || cli->index_name || cli->export_table)) ||
+        (cli->interval_ms > 0 && !cli->watch) || (cli->cache && cli->watch) ||
+        (cli->queue_depth > 0 && cli->threads < 2) ||
+        (cli->stats && cli->watch) ||
+        (cli->db.io != DB_IO_MMAP && cli->watch) ||
+        (cli->db.cache_pages > 0 && cli->db.io == DB_IO_MMAP) ||
+        (cli->db.max_resident > 0 &&
+         (cli->db.io != DB_IO_MMAP || cli->cache || cli->watch)) ||
+        (cli->batch && (cli->table_name || cli->index_name || cli->export_table ||
+                        cli->watch || cli->cache || cli->json_mode)) ||
+        (cli->analyze && (cli->table_name || cli->index_name || cli->export_table ||
+                          cli->watch || cli->cache || cli->batch))) {
+        return -1;
+    }
+    if (cli->db.max_resident > 0) {
+        // map the file a window at a time instead of all at once
+        cli->db.io = DB_IO_WINDOW;
+    }
+    if (cli->analyze) {
+        // each page is read once, and zero-copy pages can be decoded by
+        // several workers at once
+        cli->db.zero_copy = 1;
+    }
+    if (cli->watch) {
+        // re-decoded pages then need no arena space
+        cli->db.zero_copy = 1;
+        if (cli->interval_ms == 0) {
+            cli->interval_ms = WATCH_DEFAULT_INTERVAL_MS;
         }
     }
+    if (cli->json_mode) {
+        cli->format = QUERY_JSON;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    STATS_START();
+    cli_options_t cli = {0};
+    if (parse_args(argc, argv, &cli) < 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+#ifndef LITEREADER_STATS
+    if (cli.stats) {
+        fprintf(stderr, "--stats needs an instrumented build (make STATS=1)\n");
+        return 1;
+    }
+#endif
+    int json_mode = cli.json_mode;
     
-    if (json_mode) printf("\n  ]\n}"); // End pages array and root object
+    out_t out;
+    if (out_open_fd(&out, STDOUT_FILENO) < 0) {
+        perror("malloc");
+        return 1;
+    }
+    if (cli.batch) {
+        int rc = run_batch(&out, &cli);
+        out_close(&out);
+        report_stats(&cli);
+        return rc;
+    }
     
+    database_t *db = parse_database_ex(cli.filename, &cli.db);
+    if (!db) {
+        out_str(&out, json_mode ? "{\"error\": \"failed to parse database\"}"
+                                : "failed to parse database\n");
+        out_close(&out);
+        return 1;
+    }
+    
+    if (memcmp(db->header.magic, SQLITE_MAGIC, 16) != 0) {
+        out_str(&out, json_mode ? "{\"error\": \"invalid sqlite file\"}"
+                                : "invalid sqlite file\n");
+        out_close(&out);
+        free_database(db);
+        return 1;
+    }
+    
+    // map <file>.litereader-idx, rebuilding it if the database changed;
+    // without it everything is decoded on demand as usual
+    if (cli.cache) {
+        sidecar_attach(db, cli.filename, cli.threads > 0 ? cli.threads
+                                                         : pool_cpu_count());
+    }
+
+    // tell the kernel (and the pager) how the pages will be visited: point
+    // lookups touch one path per tree, scans every leaf of a table, the
+    // full dump every page in file order
+    int rc = 0;
+    if (cli.export_table) {
+        db_set_access(db, DB_ACCESS_TREE);
+        rc = export_table(&out, db, &cli);
+    } else if (cli.table_name || cli.index_name) {
+        db_set_access(db, cli.has_rowid || cli.index_name ? DB_ACCESS_POINT
+                                                          : DB_ACCESS_TREE);
+        rc = dump_table(&out, db, &cli);
+    } else if (cli.analyze) {
+        db_set_access(db, DB_ACCESS_TREE);
+        rc = analyze_file(&out, db, &cli);
+    } else if (cli.watch) {
+        rc = watch_database(&out, db, &cli);
+        db = NULL;
+    } else {
+        // a pager is not shared between threads, so only the mapping is
+        // dumped in parallel
+        int threads = cli.db.io == DB_IO_MMAP ? cli.threads : 0;
+        db_set_access(db, DB_ACCESS_SEQUENTIAL);
+        // decode the whole page directory up front on several cores; the
+        // dump below then only reads cached headers
+        if (threads > 0) {
+            db_load_all_pages(db, threads);
+        }
+        size_t depth = cli.queue_depth > 0 ? (size_t)cli.queue_depth
+                                           : 2 * (size_t)threads;
+        dump_database(&out, db, json_mode, threads, depth);
+    }
+    
+    // pages the memory cap kept out are missing from the output
+    if (db && db->pager && pager_exhausted(db->pager)) {
+        rc = 1;
+    }
+    if (out_flush(&out) < 0) {
+        perror("write");
+        rc = 1;
+    }
+    out_close(&out);
     free_database(db);
-    return 0;
+    report_stats(&cli);
+    return rc;
 }
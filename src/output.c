@@ -0,0 +1,359 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../include/output.h"
+#include "../include/stats.h"
+
+// Sets up a sink that writes to fd through a buffer of OUT_BUFFER_SIZE
+// bytes. Returns 0 on success, -1 if the buffer cannot be allocated.
+int out_open_fd(out_t *out, int fd) {
+    out->fd = fd;
+    out->len = 0;
+    out->error = 0;
+    out->buf = malloc(OUT_BUFFER_SIZE);
+    out->cap = out->buf ? OUT_BUFFER_SIZE : 0;
+    return out->buf ? 0 : -1;
+}
+
+// Sets up a sink that renders into memory. out->buf and out->len hold the
+// output so far; the buffer is released by out_close().
+int out_open_mem(out_t *out, size_t initial) {
+    out->fd = -1;
+    out->len = 0;
+    out->error = 0;
+    out->buf = malloc(initial ? initial : 1);
+    out->cap = out->buf ? (initial ? initial : 1) : 0;
+    return out->buf ? 0 : -1;
+}
+
+static int write_all(int fd, const char *data, size_t len) {
+    STATS_BEGIN(start);
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            STATS_END(STATS_PHASE_OUTPUT, start);
+            return -1;
+        }
+        STATS_ADD(STATS_BYTES_OUT, (uint64_t)n);
+        data += n;
+        len -= (size_t)n;
+    }
+    STATS_END(STATS_PHASE_OUTPUT, start);
+    return 0;
+}
+
+// Writes buffered output of a descriptor sink. Memory sinks keep their
+// contents. Returns 0, or -1 once any write has failed.
+int out_flush(out_t *out) {
+    if (out->fd >= 0 && out->len > 0 && !out->error) {
+        if (write_all(out->fd, out->buf, out->len) < 0) {
+            out->error = 1;
+        }
+    }
+    if (out->fd >= 0) {
+        out->len = 0;
+    }
+    return out->error ? -1 : 0;
+}
+
+// Flushes and releases the sink.
+void out_close(out_t *out) {
+    out_flush(out);
+    free(out->buf);
+    out->buf = NULL;
+    out->len = out->cap = 0;
+}
+
+// Called by out_write() when data does not fit: a descriptor sink flushes
+// (and writes large blocks directly), a memory sink grows.
+void out_write_slow(out_t *out, const void *data, size_t len) {
+    if (out->error) {
+        return;
+    }
+
+    if (out->fd >= 0) {
+        out_flush(out);
+        if (len >= out->cap) {
+            if (!out->error && write_all(out->fd, data, len) < 0) {
+                out->error = 1;
+            }
+            return;
+        }
+    } else {
+        size_t cap = out->cap ? out->cap : 64;
+        while (cap - out->len < len) {
+            cap *= 2;
+        }
+        char *buf = realloc(out->buf, cap);
+        if (!buf) {
+            out->error = 1;
+            return;
+        }
+        out->buf = buf;
+        out->cap = cap;
+    }
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+}
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// Decimal formatting without printf, two digits per step from the end.
+void out_u64(out_t *out, uint64_t value) {
+    char buf[20];
+    char *p = buf + sizeof(buf);
+
+    while (value >= 100) {
+        unsigned pair = (unsigned)(value % 100) * 2;
+        value /= 100;
+        *--p = digit_pairs[pair + 1];
+        *--p = digit_pairs[pair];
+    }
+    if (value >= 10) {
+        *--p = digit_pairs[value * 2 + 1];
+        *--p = digit_pairs[value * 2];
+    } else {
+        *--p = (char)('0' + value);
+    }
+    out_write(out, p, (size_t)(buf + sizeof(buf) - p));
+}
+
+void out_i64(out_t *out, int64_t value) {
+    if (value < 0) {
+        out_char(out, '-');
+        out_u64(out, 0 - (uint64_t)value);
+    } else {
+        out_u64(out, (uint64_t)value);
+    }
+}
+
+#if LDBL_MANT_DIG == 64
+/*
+ * %.15g and %.17g without printf for doubles between about 1e-13 and
+ * 1e41. The value is scaled by an exact power of ten in 80-bit long
+ * double, so the digits carry one rounding error of at most 2^-64 of the
+ * value. Results close enough to a rounding boundary for that error to
+ * matter, and everything out of range, go to snprintf.
+ */
+static const long double pow10_ld[28] = {
+    1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L,
+    1e10L, 1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L,
+    1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L,
+};
+
+static const uint64_t pow10_u64[18] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull,
+    10000000ull, 100000000ull, 1000000000ull, 10000000000ull,
+    100000000000ull, 1000000000000ull, 10000000000000ull,
+    100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+    100000000000000000ull,
+};
+
+// value * 10^shift, exact but for the final rounding
+static int scale_pow10(double value, int shift, long double *x) {
+    if (shift < -27 || shift > 27) {
+        return -1;
+    }
+    *x = shift >= 0 ? (long double)value * pow10_ld[shift]
+                    : (long double)value / pow10_ld[-shift];
+    return 0;
+}
+
+// The first digits significant digits of a positive value, rounded to
+// nearest, as an integer; *exp10 is the decimal exponent of the first
+// digit and *x the scaled value. Returns -1 if the rounding is in doubt.
+static int leading_digits(double value, int digits, int *exp10,
+                          long double *x, uint64_t *n) {
+    for (int tries = 0; tries < 3; tries++) {
+        if (scale_pow10(value, digits - 1 - *exp10, x) < 0) {
+            return -1;
+        }
+        if (*x < (long double)pow10_u64[digits - 1]) {
+            (*exp10)--;
+            continue;
+        }
+        if (*x >= (long double)pow10_u64[digits]) {
+            (*exp10)++;
+            continue;
+        }
+        uint64_t whole = (uint64_t)*x;
+        long double frac = *x - (long double)whole;
+        long double margin = *x * 0x1p-62L;
+        if (frac > 0.5L - margin && frac < 0.5L + margin) {
+            return -1;
+        }
+        *n = whole + (frac > 0.5L);
+        // 9.99...95 rounding up to the next power of ten is left to
+        // snprintf
+        return *n == pow10_u64[digits] ? -1 : 0;
+    }
+    return -1;
+}
+
+// Writes n (digits long, exponent exp10) as %g does: trailing zeros
+// dropped, exponential form below 1e-4 or from 10^digits up.
+static size_t format_g(char *buf, uint64_t n, int digits, int exp10) {
+    char d[20];
+    int len = digits;
+    while (len > 1 && n % 10 == 0) {
+        n /= 10;
+        len--;
+    }
+    for (int i = len - 1; i >= 0; i--) {
+        d[i] = (char)('0' + n % 10);
+        n /= 10;
+    }
+
+    char *p = buf;
+    if (exp10 < -4 || exp10 >= digits) {
+        *p++ = d[0];
+        if (len > 1) {
+            *p++ = '.';
+            memcpy(p, d + 1, (size_t)len - 1);
+            p += len - 1;
+        }
+        *p++ = 'e';
+        *p++ = exp10 < 0 ? '-' : '+';
+        int e = exp10 < 0 ? -exp10 : exp10;
+        if (e >= 100) *p++ = (char)('0' + e / 100);
+        *p++ = (char)('0' + e / 10 % 10);
+        *p++ = (char)('0' + e % 10);
+    } else if (exp10 < 0) {
+        *p++ = '0';
+        *p++ = '.';
+        for (int i = -1; i > exp10; i--) *p++ = '0';
+        memcpy(p, d, (size_t)len);
+        p += len;
+    } else {
+        int whole = exp10 + 1;
+        for (int i = 0; i < whole; i++) *p++ = i < len ? d[i] : '0';
+        if (len > whole) {
+            *p++ = '.';
+            memcpy(p, d + whole, (size_t)(len - whole));
+            p += len - whole;
+        }
+    }
+    return (size_t)(p - buf);
+}
+
+// Fast path of out_double() for a positive normal value. Returns the
+// length written to buf, or 0 to leave the value to snprintf.
+static size_t format_double_fast(char *buf, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int exp2 = (int)(bits >> 52) - 1023;
+    if (exp2 <= -1023 || exp2 >= 1024) {
+        return 0;
+    }
+
+    // floor(exp2 * log10(2)), at most one below the decimal exponent
+    int exp10 = (exp2 * 78913) >> 18;
+    long double x;
+    uint64_t n;
+    if (leading_digits(value, 15, &exp10, &x, &n) < 0) {
+        return 0;
+    }
+
+    // %.15g reads back as value if n is within half a gap of the scaled
+    // value; the gap below a power of two is half as wide
+    if (exp2 - 52 <= -1023) {
+        return 0;
+    }
+    uint64_t ulp_bits = (uint64_t)(exp2 - 52 + 1023) << 52;
+    double ulp;
+    memcpy(&ulp, &ulp_bits, sizeof(ulp));
+    long double half_gap;
+    if (scale_pow10(ulp / 2, 14 - exp10, &half_gap) < 0) {
+        return 0;
+    }
+    long double dist = (long double)n - x;
+    if (dist < 0) {
+        dist = -dist;
+        if ((bits & ((1ull << 52) - 1)) == 0) half_gap /= 2;
+    }
+    long double margin = x * 0x1p-61L;
+    if (dist > half_gap - margin && dist < half_gap + margin) {
+        return 0;
+    }
+    if (dist < half_gap) {
+        return format_g(buf, n, 15, exp10);
+    }
+
+    if (leading_digits(value, 17, &exp10, &x, &n) < 0) {
+        return 0;
+    }
+    return format_g(buf, n, 17, exp10);
+}
+#endif
+
+// Shortest of %.15g and %.17g that reads back as the same double.
+void out_double(out_t *out, double value) {
+    char buf[32];
+#if LDBL_MANT_DIG == 64
+    char *p = buf;
+    double magnitude = value;
+    if (signbit(value)) {
+        *p++ = '-';
+        magnitude = -value;
+    }
+    if (magnitude == 0) {
+        *p++ = '0';
+        out_write(out, buf, (size_t)(p - buf));
+        return;
+    }
+    size_t len = magnitude == magnitude ? format_double_fast(p, magnitude) : 0;
+    if (len > 0) {
+        out_write(out, buf, (size_t)(p - buf) + len);
+        return;
+    }
+#endif
+    int n = snprintf(buf, sizeof(buf), "%.15g", value);
+    if (strtod(buf, NULL) != value) {
+        n = snprintf(buf, sizeof(buf), "%.17g", value);
+    }
+    out_write(out, buf, (size_t)n);
+}
+
+// printf into the sink, for the few places that need a format.
+void out_printf(out_t *out, const char *fmt, ...) {
+    char buf[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        return;
+    }
+    if ((size_t)n < sizeof(buf)) {
+        out_write(out, buf, (size_t)n);
+        return;
+    }
+
+    char *big = malloc((size_t)n + 1);
+    if (!big) {
+        out->error = 1;
+        return;
+    }
+    va_start(ap, fmt);
+    vsnprintf(big, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    out_write(out, big, (size_t)n);
+    free(big);
+}
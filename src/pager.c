@@ -0,0 +1,745 @@
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include "../include/pager.h"
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+/*
+ * Page cache for reading a database without mapping it.
+ *
+ * Pages are read with pread() into frames of a fixed capacity, evicting the
+ * least recently used frame on a miss. Callers keep page pointers while
+ * they decode a cell (a record's overflow chain can hold many at once), so
+ * every frame used since the last pager_release() is pinned: when all of
+ * them are, the cache grows past its capacity instead of evicting, and
+ * shrinks back at the next release. Walks release between leaves and the
+ * full dump between pages, so the cache holds at most the capacity or the
+ * pages of one leaf and its overflow chains, whichever is larger.
+ *
+ * Two kinds of read-ahead fill frames before they are asked for: a miss
+ * during a sequential scan reads the following pages with one preadv(),
+ * and with the io_uring backend pager_prefetch() submits the reads of a
+ * list of pages (the children of an interior page) in one batch and waits
+ * for them together. The cache is not thread-safe.
+ *
+ * The window backend keeps the same list, but a frame is a read-only
+ * mapping of PAGER_WINDOW_BYTES of the file rather than a page buffer, and
+ * the capacity is a hard cap: a miss with every window pinned fails
+ * instead of mapping another. Evicted windows are unmapped, so resident
+ * memory stays below the cap whatever the size of the file.
+ */
+
+#define NO_FRAME UINT32_MAX
+// pages read by one sequential read-ahead
+#define PAGER_READAHEAD 32
+// submission queue size, and most reads in flight at once
+#define PAGER_RING_ENTRIES 64
+// windows shrink (down to one page) until the cap holds this many
+#define PAGER_MIN_WINDOWS 8
+
+typedef struct {
+    uint8_t *data;              // NULL on the spare list or if not mapped
+    uint32_t page_num;          // 0 while the frame holds no page (for
+                                // windows, the window number)
+    uint32_t used;              // epoch of the last access, 0 if read ahead
+    uint32_t prev, next;        // LRU list, most recent first
+    uint32_t hash_next;         // bucket chain, or spare list link
+} pager_frame_t;
+
+#if defined(__linux__)
+typedef struct {
+    int fd;
+    void *sq_map, *cq_map;
+    size_t sq_map_size, cq_map_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+} pager_ring_t;
+#endif
+
+struct pager {
+    int fd;
+    uint32_t page_size;
+    size_t file_size;
+    size_t capacity;            // frames kept once nothing is pinned
+    pager_frame_t *frames;
+    uint32_t frame_count;       // slots in frames, spare ones included
+    uint32_t frame_alloc;
+    uint32_t live;              // frames with a buffer
+    uint32_t spare;             // first slot without a buffer
+    uint32_t *buckets;
+    uint32_t bucket_mask;
+    uint32_t head, tail;        // LRU ends
+    uint32_t epoch;
+    int sequential;             // read ahead on misses
+    size_t window_bytes;        // bytes per window, 0 for page frames
+    uint32_t window_pages;
+    int advice;                 // posix_madvise() advice for new windows
+    int exhausted;              // a miss found every window pinned
+#if defined(__linux__)
+    pager_ring_t ring;
+    int has_ring;
+#endif
+};
+
+static uint32_t page_hash(uint32_t page_num, uint32_t mask) {
+    return (page_num * 0x9E3779B1u) & mask;
+}
+
+static uint32_t hash_find(const pager_t *p, uint32_t page_num) {
+    uint32_t f = p->buckets[page_hash(page_num, p->bucket_mask)];
+    while (f != NO_FRAME && p->frames[f].page_num != page_num) {
+        f = p->frames[f].hash_next;
+    }
+    return f;
+}
+
+static void hash_insert(pager_t *p, uint32_t f) {
+    uint32_t *bucket = &p->buckets[page_hash(p->frames[f].page_num, p->bucket_mask)];
+    p->frames[f].hash_next = *bucket;
+    *bucket = f;
+}
+
+static void hash_remove(pager_t *p, uint32_t f) {
+    uint32_t *link = &p->buckets[page_hash(p->frames[f].page_num, p->bucket_mask)];
+    while (*link != f) {
+        link = &p->frames[*link].hash_next;
+    }
+    *link = p->frames[f].hash_next;
+}
+
+// Doubles the buckets once there are more frames than buckets, so chains
+// stay short while a pinned working set grows the cache.
+static void hash_grow(pager_t *p) {
+    uint32_t count = (p->bucket_mask + 1) * 2;
+    uint32_t *buckets = malloc(sizeof(uint32_t) * count);
+    if (!buckets) {
+        return;
+    }
+    free(p->buckets);
+    p->buckets = buckets;
+    p->bucket_mask = count - 1;
+    memset(buckets, 0xff, sizeof(uint32_t) * count);
+    for (uint32_t f = p->head; f != NO_FRAME; f = p->frames[f].next) {
+        if (p->frames[f].page_num != 0) {
+            hash_insert(p, f);
+        }
+    }
+}
+
+static void lru_unlink(pager_t *p, uint32_t f) {
+    pager_frame_t *fr = &p->frames[f];
+    if (fr->prev != NO_FRAME) p->frames[fr->prev].next = fr->next;
+    else p->head = fr->next;
+    if (fr->next != NO_FRAME) p->frames[fr->next].prev = fr->prev;
+    else p->tail = fr->prev;
+}
+
+static void lru_push_front(pager_t *p, uint32_t f) {
+    pager_frame_t *fr = &p->frames[f];
+    fr->prev = NO_FRAME;
+    fr->next = p->head;
+    if (p->head != NO_FRAME) p->frames[p->head].prev = f;
+    else p->tail = f;
+    p->head = f;
+}
+
+static void lru_push_back(pager_t *p, uint32_t f) {
+    pager_frame_t *fr = &p->frames[f];
+    fr->next = NO_FRAME;
+    fr->prev = p->tail;
+    if (p->tail != NO_FRAME) p->frames[p->tail].next = f;
+    else p->head = f;
+    p->tail = f;
+}
+
+// bytes mapped for window `window` (1-based), cut at the end of the file
+static size_t window_length(const pager_t *p, uint32_t window) {
+    size_t offset = p->window_bytes * (window - 1);
+    return p->window_bytes < p->file_size - offset ? p->window_bytes
+                                                   : p->file_size - offset;
+}
+
+// Unmaps the window frame f holds. A sequential scan will not come back
+// to it, so its pages also leave the page cache.
+static void window_unmap(pager_t *p, uint32_t f) {
+    pager_frame_t *fr = &p->frames[f];
+    munmap(fr->data, window_length(p, fr->page_num));
+    if (p->sequential) {
+        posix_fadvise(p->fd, (off_t)(p->window_bytes * (fr->page_num - 1)),
+                      (off_t)p->window_bytes, POSIX_FADV_DONTNEED);
+    }
+    fr->data = NULL;
+}
+
+// Drops the page (or window) frame f holds; it stays on the LRU list.
+static void frame_evict(pager_t *p, uint32_t f) {
+    hash_remove(p, f);
+    if (p->window_bytes) {
+        window_unmap(p, f);
+    }
+    p->frames[f].page_num = 0;
+}
+
+// A frame with a fresh buffer (none for a window), from the spare list or
+// a new slot.
+static uint32_t frame_new(pager_t *p) {
+    uint8_t *data = NULL;
+    if (!p->window_bytes) {
+        data = malloc(p->page_size);
+        if (!data) {
+            return NO_FRAME;
+        }
+    }
+    uint32_t f = p->spare;
+    if (f != NO_FRAME) {
+        p->spare = p->frames[f].hash_next;
+    } else {
+        if (p->frame_count == p->frame_alloc) {
+            uint32_t alloc = p->frame_alloc * 2;
+            pager_frame_t *frames = realloc(p->frames, sizeof(pager_frame_t) * alloc);
+            if (!frames) {
+                free(data);
+                return NO_FRAME;
+            }
+            p->frames = frames;
+            p->frame_alloc = alloc;
+        }
+        f = p->frame_count++;
+    }
+    p->frames[f].data = data;
+    p->frames[f].page_num = 0;
+    p->live++;
+    if (p->live > p->bucket_mask + 1) {
+        hash_grow(p);
+    }
+    return f;
+}
+
+// Takes a frame to read a page into, unlinked from the LRU list: an empty
+// one (they sit at the tail), a new one while below capacity, else the
+// least recently used one if it is not pinned. Otherwise a new frame if
+// `may_grow`, NO_FRAME if not or if out of memory.
+static uint32_t frame_acquire(pager_t *p, int may_grow) {
+    uint32_t f = p->tail;
+    if (f != NO_FRAME && (p->frames[f].page_num == 0 ||
+                          (p->live >= p->capacity && p->frames[f].used != p->epoch))) {
+        lru_unlink(p, f);
+        if (p->frames[f].page_num != 0) {
+            frame_evict(p, f);
+        }
+        return f;
+    }
+    if (p->live >= p->capacity && !may_grow) {
+        return NO_FRAME;
+    }
+    return frame_new(p);
+}
+
+// Puts a frame holding page_num (0 after a failed read) back on the list:
+// first, pinned if `used` is the epoch, or last and unpinned if empty.
+static void frame_install(pager_t *p, uint32_t f, uint32_t page_num, uint32_t used) {
+    p->frames[f].page_num = page_num;
+    p->frames[f].used = page_num != 0 ? used : 0;
+    if (page_num != 0) {
+        hash_insert(p, f);
+        lru_push_front(p, f);
+    } else {
+        lru_push_back(p, f);
+    }
+}
+
+static int page_in_file(const pager_t *p, uint32_t page_num) {
+    return page_num > 0 &&
+           (size_t)p->page_size * page_num <= p->file_size;
+}
+
+// Reads `len` bytes at `offset` of the file. Returns 0 on success, -1 on
+// an error or a short file.
+int pager_read_at(pager_t *p, size_t offset, uint8_t *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = pread(p->fd, buf, len, (off_t)offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        buf += n;
+        offset += (size_t)n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Reads page_num and the uncached pages following it (up to
+// PAGER_READAHEAD, stopping at the first cached one) with one preadv().
+// The pages read ahead are not pinned.
+static void read_ahead(pager_t *p, uint32_t page_num) {
+    struct iovec iov[PAGER_READAHEAD];
+    uint32_t frames[PAGER_READAHEAD];
+    size_t count = 0;
+
+    while (count < PAGER_READAHEAD && page_in_file(p, page_num + count) &&
+           (count == 0 || hash_find(p, page_num + count) == NO_FRAME)) {
+        uint32_t f = frame_acquire(p, count == 0);
+        if (f == NO_FRAME) {
+            break;
+        }
+        frames[count] = f;
+        iov[count].iov_base = p->frames[f].data;
+        iov[count].iov_len = p->page_size;
+        count++;
+    }
+
+    // a short read leaves the pages it did not reach empty
+    size_t done = 0;
+    off_t offset = (off_t)p->page_size * (page_num - 1);
+    ssize_t n;
+    do {
+        n = preadv(p->fd, iov, (int)count, offset);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) {
+        done = (size_t)n / p->page_size;
+    }
+    for (size_t i = count; i-- > 0;) {
+        frame_install(p, frames[i], i < done ? page_num + (uint32_t)i : 0,
+                      i == 0 ? p->epoch : 0);
+    }
+}
+
+// Returns page_num from its window, mapping the window on a miss. During
+// a sequential scan the windows behind it are unmapped first, so only the
+// ones in use stay resident.
+static uint8_t *window_get(pager_t *p, uint32_t page_num) {
+    if (!page_in_file(p, page_num)) {
+        return NULL;
+    }
+    uint32_t window = (page_num - 1) / p->window_pages + 1;
+    size_t offset = (size_t)p->page_size * ((page_num - 1) % p->window_pages);
+    uint32_t f = hash_find(p, window);
+    if (f != NO_FRAME) {
+        if (f != p->head) {
+            lru_unlink(p, f);
+            lru_push_front(p, f);
+        }
+        p->frames[f].used = p->epoch;
+        return p->frames[f].data + offset;
+    }
+
+    if (p->sequential) {
+        for (uint32_t t = p->tail; t != NO_FRAME;) {
+            uint32_t prev = p->frames[t].prev;
+            if (p->frames[t].page_num != 0 && p->frames[t].used != p->epoch) {
+                frame_evict(p, t);
+                lru_unlink(p, t);
+                lru_push_back(p, t);
+            }
+            t = prev;
+        }
+    }
+    f = frame_acquire(p, 0);
+    if (f == NO_FRAME) {
+        if (!p->exhausted) {
+            fprintf(stderr, "Error: all %zu windows of %zu KiB in use, "
+                    "raise the memory cap\n", p->capacity, p->window_bytes / 1024);
+            p->exhausted = 1;
+        }
+        return NULL;
+    }
+    size_t len = window_length(p, window);
+    void *data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, p->fd,
+                      (off_t)(p->window_bytes * (window - 1)));
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        frame_install(p, f, 0, 0);
+        return NULL;
+    }
+    posix_madvise(data, len, p->advice);
+    p->frames[f].data = data;
+    frame_install(p, f, window, p->epoch);
+    return (uint8_t *)data + offset;
+}
+
+// Returns the cached copy of page `page_num` (1-based), reading it on a
+// miss. The pointer stays valid until the next pager_release(). NULL if
+// the page cannot be read.
+uint8_t *pager_get(pager_t *p, uint32_t page_num) {
+    if (p->window_bytes) {
+        return window_get(p, page_num);
+    }
+    uint32_t f = hash_find(p, page_num);
+    if (f == NO_FRAME) {
+        if (!page_in_file(p, page_num)) {
+            return NULL;
+        }
+        if (p->sequential) {
+            read_ahead(p, page_num);
+            f = hash_find(p, page_num);
+            return f != NO_FRAME ? p->frames[f].data : NULL;
+        }
+        f = frame_acquire(p, 1);
+        if (f == NO_FRAME) {
+            return NULL;
+        }
+        int rc = pager_read_at(p, (size_t)p->page_size * (page_num - 1),
+                               p->frames[f].data, p->page_size);
+        frame_install(p, f, rc == 0 ? page_num : 0, p->epoch);
+        return rc == 0 ? p->frames[f].data : NULL;
+    }
+
+    if (f != p->head) {
+        lru_unlink(p, f);
+        lru_push_front(p, f);
+    }
+    p->frames[f].used = p->epoch;
+    return p->frames[f].data;
+}
+
+// Unpins every page handed out so far; their pointers must not be used
+// after this. Frames past the capacity are freed, least recently used
+// first.
+void pager_release(pager_t *p) {
+    if (++p->epoch == 0) {
+        for (uint32_t f = p->head; f != NO_FRAME; f = p->frames[f].next) {
+            p->frames[f].used = 0;
+        }
+        p->epoch = 1;
+    }
+    while (p->live > p->capacity) {
+        uint32_t f = p->tail;
+        lru_unlink(p, f);
+        if (p->frames[f].page_num != 0) {
+            hash_remove(p, f);
+        }
+        free(p->frames[f].data);
+        p->frames[f].data = NULL;
+        p->frames[f].hash_next = p->spare;
+        p->spare = f;
+        p->live--;
+    }
+}
+
+#if defined(__linux__)
+static int ring_setup(pager_ring_t *r) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(r, 0, sizeof(*r));
+    r->fd = (int)syscall(__NR_io_uring_setup, PAGER_RING_ENTRIES, &params);
+    if (r->fd < 0) {
+        return -1;
+    }
+
+    r->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    r->cq_map_size = params.cq_off.cqes +
+                     params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_map_size > r->sq_map_size) {
+            r->sq_map_size = r->cq_map_size;
+        }
+        r->cq_map_size = 0;
+    }
+    r->sq_map = mmap(NULL, r->sq_map_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    r->cq_map = r->sq_map;
+    if (r->sq_map != MAP_FAILED && r->cq_map_size > 0) {
+        r->cq_map = mmap(NULL, r->cq_map_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    }
+    r->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = MAP_FAILED;
+    if (r->sq_map != MAP_FAILED && r->cq_map != MAP_FAILED) {
+        r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    }
+    if (r->sqes == MAP_FAILED) {
+        if (r->cq_map != MAP_FAILED && r->cq_map_size > 0) {
+            munmap(r->cq_map, r->cq_map_size);
+        }
+        if (r->sq_map != MAP_FAILED) {
+            munmap(r->sq_map, r->sq_map_size);
+        }
+        close(r->fd);
+        return -1;
+    }
+
+    uint8_t *sq = r->sq_map, *cq = r->cq_map;
+    r->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + params.sq_off.array);
+    r->cq_head = (unsigned *)(cq + params.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+static void ring_close(pager_ring_t *r) {
+    munmap(r->sqes, r->sqes_size);
+    if (r->cq_map_size > 0) {
+        munmap(r->cq_map, r->cq_map_size);
+    }
+    munmap(r->sq_map, r->sq_map_size);
+    close(r->fd);
+}
+
+// Reads the pages into frames[], submitting them together and waiting
+// for all of them. Each frame is installed unpinned, or empty if its read
+// failed.
+static void ring_read(pager_t *p, const uint32_t *pages, const uint32_t *frames,
+                      unsigned count) {
+    pager_ring_t *r = &p->ring;
+    unsigned tail = *r->sq_tail;
+    for (unsigned i = 0; i < count; i++) {
+        unsigned index = (tail + i) & *r->sq_mask;
+        struct io_uring_sqe *sqe = &r->sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = p->fd;
+        sqe->addr = (uint64_t)(uintptr_t)p->frames[frames[i]].data;
+        sqe->len = p->page_size;
+        sqe->off = (uint64_t)p->page_size * (pages[i] - 1);
+        sqe->user_data = i;
+        r->sq_array[index] = index;
+    }
+    __atomic_store_n(r->sq_tail, tail + count, __ATOMIC_RELEASE);
+
+    int ok[PAGER_RING_ENTRIES] = {0};
+    unsigned submitted = 0, reaped = 0;
+    while (reaped < count) {
+        int n = (int)syscall(__NR_io_uring_enter, r->fd, count - submitted,
+                             count - reaped, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (n < 0 && errno != EINTR) {
+            break;
+        }
+        if (n > 0) {
+            submitted += (unsigned)n;
+        }
+        unsigned head = *r->cq_head;
+        unsigned ready = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != ready; head++) {
+            const struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            if (cqe->user_data < count) {
+                ok[cqe->user_data] = cqe->res == (int)p->page_size;
+            }
+            reaped++;
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    // a failed enter leaves reads in flight; wait until they are done with
+    // the frames before handing them out
+    if (reaped < count) {
+        while (reaped < submitted) {
+            if (syscall(__NR_io_uring_enter, r->fd, 0, 1,
+                        IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+                break;
+            }
+            unsigned head = *r->cq_head;
+            unsigned ready = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+            reaped += ready - head;
+            __atomic_store_n(r->cq_head, ready, __ATOMIC_RELEASE);
+        }
+        memset(ok, 0, sizeof(ok));
+    }
+    for (unsigned i = count; i-- > 0;) {
+        frame_install(p, frames[i], ok[i] ? pages[i] : 0, 0);
+    }
+}
+#endif
+
+// Reads ahead those of `pages` that are not cached yet, with the io_uring
+// backend only. Frames are only taken from pages that are not pinned, and
+// at most half the capacity is filled this way, so nothing read here
+// pushes out the rest of the batch before it is used.
+void pager_prefetch(pager_t *p, const uint32_t *pages, size_t count) {
+#if defined(__linux__)
+    if (!p->has_ring) {
+        return;
+    }
+    uint32_t batch[PAGER_RING_ENTRIES];
+    uint32_t frames[PAGER_RING_ENTRIES];
+    size_t limit = p->capacity / 2;
+    unsigned n = 0;
+    for (size_t i = 0; i < count && limit > 0; i++) {
+        if (!page_in_file(p, pages[i]) || hash_find(p, pages[i]) != NO_FRAME) {
+            continue;
+        }
+        uint32_t f = frame_acquire(p, 0);
+        if (f == NO_FRAME) {
+            break;
+        }
+        // the frame is back on the list before the next one is taken, so
+        // a page listed twice is only read once
+        batch[n] = pages[i];
+        frames[n] = f;
+        p->frames[f].page_num = pages[i];
+        hash_insert(p, f);
+        n++;
+        limit--;
+        if (n == PAGER_RING_ENTRIES) {
+            for (unsigned j = 0; j < n; j++) hash_remove(p, frames[j]);
+            ring_read(p, batch, frames, n);
+            n = 0;
+        }
+    }
+    if (n > 0) {
+        for (unsigned j = 0; j < n; j++) hash_remove(p, frames[j]);
+        ring_read(p, batch, frames, n);
+    }
+#else
+    (void)p;
+    (void)pages;
+    (void)count;
+#endif
+}
+
+// Whether a miss found every window pinned, so some page was not read.
+int pager_exhausted(const pager_t *p) {
+    return p->exhausted;
+}
+
+// Whether pager_prefetch() does anything.
+int pager_can_prefetch(const pager_t *p) {
+#if defined(__linux__)
+    return p->has_ring;
+#else
+    (void)p;
+    return 0;
+#endif
+}
+
+// Tunes the cache and the kernel's read-ahead to the coming scan.
+void pager_advise(pager_t *p, db_access_t access) {
+    p->sequential = access == DB_ACCESS_SEQUENTIAL;
+    p->advice = access == DB_ACCESS_SEQUENTIAL ? POSIX_MADV_SEQUENTIAL :
+                access == DB_ACCESS_POINT ? POSIX_MADV_RANDOM : POSIX_MADV_NORMAL;
+    int advice = access == DB_ACCESS_SEQUENTIAL ? POSIX_FADV_SEQUENTIAL :
+                 access == DB_ACCESS_POINT ? POSIX_FADV_RANDOM : POSIX_FADV_NORMAL;
+    posix_fadvise(p->fd, 0, 0, advice);
+}
+
+// An empty cache of `capacity` frames. Takes ownership of fd.
+static pager_t *pager_new(int fd, uint32_t page_size, size_t file_size,
+                          size_t capacity) {
+    pager_t *p = calloc(1, sizeof(pager_t));
+    if (!p) {
+        close(fd);
+        return NULL;
+    }
+    p->fd = fd;
+    p->page_size = page_size;
+    p->file_size = file_size;
+    p->capacity = capacity;
+    p->frame_alloc = 64;
+    p->frames = malloc(sizeof(pager_frame_t) * p->frame_alloc);
+    uint32_t buckets = 64;
+    while (buckets < p->capacity && buckets < (1u << 30)) {
+        buckets *= 2;
+    }
+    p->buckets = malloc(sizeof(uint32_t) * buckets);
+    if (!p->frames || !p->buckets) {
+        pager_close(p);
+        return NULL;
+    }
+    memset(p->buckets, 0xff, sizeof(uint32_t) * buckets);
+    p->bucket_mask = buckets - 1;
+    p->head = p->tail = p->spare = NO_FRAME;
+    p->epoch = 1;
+    p->advice = POSIX_MADV_NORMAL;
+    return p;
+}
+
+// Takes ownership of fd. With DB_IO_URING a ring is set up for
+// read-ahead; where that fails the pager works as with DB_IO_PREAD.
+// Returns NULL if out of memory.
+pager_t *pager_open(int fd, uint32_t page_size, size_t file_size, db_io_t io,
+                    size_t capacity) {
+    pager_t *p = pager_new(fd, page_size, file_size,
+                           capacity > 0 ? capacity : PAGER_DEFAULT_PAGES);
+    if (!p) {
+        return NULL;
+    }
+#if defined(__linux__)
+    if (io == DB_IO_URING) {
+        p->has_ring = ring_setup(&p->ring) == 0;
+    }
+#endif
+    if (io == DB_IO_URING && !pager_can_prefetch(p)) {
+        fprintf(stderr, "Warning: io_uring unavailable, reading with pread\n");
+    }
+    return p;
+}
+
+// Opens the window backend: as many windows as fit in `max_resident`
+// bytes. Windows are PAGER_WINDOW_BYTES, or smaller (down
+// to one page or one memory page) if the cap would otherwise hold fewer
+// than PAGER_MIN_WINDOWS. Takes ownership of fd. Returns NULL if the page
+// size cannot be mapped on its own, the cap holds fewer than two windows,
+// or out of memory.
+pager_t *pager_open_window(int fd, uint32_t page_size, size_t file_size,
+                           size_t max_resident) {
+    size_t smallest = (size_t)sysconf(_SC_PAGESIZE);
+    if (smallest < page_size) {
+        smallest = page_size;
+    }
+    if ((page_size & (page_size - 1)) != 0) {
+        fprintf(stderr, "Error: page size %u cannot be mapped in windows\n",
+                page_size);
+        close(fd);
+        return NULL;
+    }
+    size_t window = PAGER_WINDOW_BYTES;
+    while (window > smallest &&
+           window * PAGER_MIN_WINDOWS > max_resident) {
+        window /= 2;
+    }
+    size_t capacity = max_resident / window;
+    if (capacity < 2) {
+        fprintf(stderr, "Error: memory cap below %zu KiB\n", 2 * window / 1024);
+        close(fd);
+        return NULL;
+    }
+
+    pager_t *p = pager_new(fd, page_size, file_size, capacity);
+    if (!p) {
+        return NULL;
+    }
+    p->window_bytes = window;
+    p->window_pages = (uint32_t)(window / page_size);
+    return p;
+}
+
+void pager_close(pager_t *p) {
+    if (!p) {
+        return;
+    }
+#if defined(__linux__)
+    if (p->has_ring) {
+        ring_close(&p->ring);
+    }
+#endif
+    for (uint32_t f = 0; f < p->frame_count; f++) {
+        if (!p->window_bytes) {
+            free(p->frames[f].data);
+        } else if (p->frames[f].data) {
+            munmap(p->frames[f].data, window_length(p, p->frames[f].page_num));
+        }
+    }
+    free(p->frames);
+    free(p->buckets);
+    close(p->fd);
+    free(p);
+}
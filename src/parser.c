@@ -1,4 +1,6 @@
 // src/parser.c
+#define _POSIX_C_SOURCE 200809L
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,9 +10,132 @@
 #include <sys/stat.h>
 #include "../include/parser.h"
 #include "../include/constants.h"
+#include "../include/pager.h"
+#include "../include/pool.h"
+#include "../include/stats.h"
 #include "../include/utils.h"
+#include "../include/wal.h"
+
+#define PAGE_LOAD_CHUNK 1024
+#define ARENA_BLOCK_CELLS (512 * 1024)
+
+
+static int dir_init(page_directory_t *dir, uint32_t page_count, int zero_copy) {
+    memset(dir, 0, sizeof(*dir));
+    dir->zero_copy = zero_copy;
+
+    // carve every dense array out of one zeroed block, widest first
+    size_t n = page_count;
+    size_t ptr_bytes = zero_copy ? 0 : sizeof(uint16_t *) * n;
+    size_t total = ptr_bytes + sizeof(uint32_t) * n + sizeof(uint16_t) * 3 * n +
+                   sizeof(uint8_t) * 3 * n;
+    if (total == 0) {
+        return 0;
+    }
+
+    // calloc() of a large block is backed by untouched zero pages, so
+    // memory is only committed for the slots that are actually visited
+    uint8_t *block = calloc(1, total);
+    if (!block) {
+        return -1;
+    }
+    dir->block = block;
+
+    uint8_t *p = block;
+    if (!zero_copy) {
+        dir->cell_pointers = (uint16_t **)p;
+        p += ptr_bytes;
+    }
+    dir->rightmost_pointers = (uint32_t *)p;
+    p += sizeof(uint32_t) * n;
+    dir->first_freeblocks = (uint16_t *)p;
+    p += sizeof(uint16_t) * n;
+    dir->cell_counts = (uint16_t *)p;
+    p += sizeof(uint16_t) * n;
+    dir->content_starts = (uint16_t *)p;
+    p += sizeof(uint16_t) * n;
+    dir->page_types = p;
+    p += n;
+    dir->frag_free_bytes = p;
+    p += n;
+    dir->loaded = p;
+    return 0;
+}
+
+static void dir_free(page_directory_t *dir) {
+    arena_block_t *b = dir->arena;
+    while (b) {
+        arena_block_t *next = b->next;
+        free(b);
+        b = next;
+    }
+    free(dir->block);
+    memset(dir, 0, sizeof(*dir));
+}
+
+// Reserves `count` contiguous cell pointer slots. Blocks are never
+// reallocated, so pointers handed out earlier stay valid.
+static uint16_t *arena_alloc(page_directory_t *dir, size_t count) {
+    arena_block_t *b = dir->arena;
+    if (!b || b->capacity - b->used < count) {
+        size_t capacity = count > ARENA_BLOCK_CELLS ? count : ARENA_BLOCK_CELLS;
+        b = malloc(sizeof(arena_block_t) + sizeof(uint16_t) * capacity);
+        if (!b) {
+            return NULL;
+        }
+        b->used = 0;
+        b->capacity = capacity;
+        b->next = dir->arena;
+        dir->arena = b;
+    }
+    uint16_t *slots = b->data + b->used;
+    b->used += count;
+    return slots;
+}
+
+// Decodes the 100-byte database header at `ptr`. With a WAL the page count
+// is the one of its last commit.
+static void read_db_header(database_t *db, uint8_t *ptr) {
+    memcpy(db->header.magic, ptr + OFFSET_MAGIC, 16);
+    db->header.page_size = read_be16(ptr + OFFSET_PAGE_SIZE);
+    db->header.file_format_write = ptr[OFFSET_FILE_FORMAT_WRITE_VERSION];
+    db->header.file_format_read = ptr[OFFSET_FILE_FORMAT_READ];
+    db->header.reserved_space = ptr[OFFSET_RESERVED_SPACE];
+    db->header.max_embed_payload_frac = ptr[OFFSET_MAX_EMBED_PAYLOAD_FRAC];
+    db->header.min_embed_payload_frac = ptr[OFFSET_MIN_EMBED_PAYLOAD_FRAC];
+    db->header.leaf_payload_frac = ptr[OFFSET_LEAF_PAYLOAD_FRAC];
+    db->header.file_change_counter = read_be32(ptr + OFFSET_FILE_CHANGE_COUNTER);
+    db->header.header_db_size = read_be32(ptr + OFFSET_HEADER_DB_SIZE);
+    db->header.first_freelist_trunk = read_be32(ptr + OFFSET_FIRST_FREELIST_TRUNK);
+    db->header.total_freelist_trunk = read_be32(ptr + OFFSET_TOTAL_FREELIST_PAGES);
+    db->header.schema_cookie = read_be32(ptr + OFFSET_SCHEMA_COOKIE);
+    db->header.schema_format_number = read_be32(ptr + OFFSET_SCHEMA_FORMAT_NUMBER);
+    db->header.default_page_cache_size = read_be32(ptr + OFFSET_DEFAULT_PAGE_CACHE_SIZE);
+    db->header.page_number_largest_root = read_be32(ptr + OFFSET_PAGE_NUMBER_LARGEST_ROOT);
+    db->header.db_text_encoding = read_be32(ptr + OFFSET_DB_TEXT_ENCODING);
+    db->header.user_version = read_be32(ptr + OFFSET_USER_VERSION);
+    db->header.incremental_version_mode = read_be32(ptr + OFFSET_INCREMENTAL_VACCUM_MODE);
+    db->header.application_id = read_be32(ptr + OFFSET_APPLICATION_ID);
+    memcpy(db->header.reserved_expansion, ptr + OFFSET_RESERVED_EXPANSION, 20);
+    db->header.version_valid_for = read_be32(ptr + OFFSET_VERSION_VALID_FOR);
+    db->header.sqlite_version_number = read_be32(ptr + OFFSET_SQLITE_VERSION_NUMBER);
+    if (db->wal.frames > 0) {
+        db->header.header_db_size = db->wal.db_size;
+    }
+}
 
 database_t* parse_database(const char *filename) {
+    return parse_database_ex(filename, NULL);
+}
+
+
+database_t* parse_database_ex(const char *filename, const db_options_t *opts) {
+    db_options_t defaults = {0};
+    if (!opts) {
+        opts = &defaults;
+    }
+
+    STATS_BEGIN(open_start);
     int fd = open(filename, O_RDONLY);
     if (fd < 0) {
         perror("open");
@@ -24,129 +149,547 @@ database_t* parse_database(const char *filename) {
         return NULL;
     }
 
-    void *file_data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    if (file_data == MAP_FAILED) {
-        perror("mmap");
+    if (st.st_size < 0x64) {
+        fprintf(stderr, "Error: file too small for database header\n");
         close(fd);
         return NULL;
     }
 
-    close(fd); // can close fd after mmap
+    // the pread and io_uring backends read the header like any other bytes
+    // and keep fd for the pager
+    uint8_t header[0x64];
+    void *file_data = NULL;
+    if (opts->io == DB_IO_MMAP) {
+        file_data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (file_data == MAP_FAILED) {
+            perror("mmap");
+            close(fd);
+            return NULL;
+        }
+        close(fd); // can close fd after mmap
+        memcpy(header, file_data, sizeof(header));
+    } else if (pread(fd, header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        perror("read");
+        close(fd);
+        return NULL;
+    }
 
-    database_t *db = malloc(sizeof(database_t));
+    database_t *db = calloc(1, sizeof(database_t));
     if (!db) {
-        munmap(file_data, st.st_size);
+        if (file_data) munmap(file_data, st.st_size);
+        else close(fd);
         return NULL;
     }
 
     db->file_data = file_data;
     db->file_size = st.st_size;
 
+    // committed pages in <db>-wal take the place of their main file copies,
+    // the database header included
+    uint8_t *header_ptr = header;
+    if (opts->no_wal) {
+        memset(&db->wal, 0, sizeof(db->wal));
+    } else if (wal_open(&db->wal, filename,
+                        read_be16(header_ptr + OFFSET_PAGE_SIZE)) < 0) {
+        goto fail;
+    }
+    const uint8_t *wal_first = wal_page(&db->wal, 1);
+    if (wal_first) {
+        header_ptr = (uint8_t *)wal_first;
+    }
+
+    STATS_END(STATS_PHASE_MMAP, open_start);
+
     // parse database header
-    uint8_t *header_ptr = (uint8_t *)file_data;
-    
-    memcpy(db->header.magic, header_ptr + OFFSET_MAGIC, 16);
-    db->header.page_size = read_be16(header_ptr + OFFSET_PAGE_SIZE);
-    db->header.file_format_write = header_ptr[OFFSET_FILE_FORMAT_WRITE_VERSION];
-    db->header.file_format_read = header_ptr[OFFSET_FILE_FORMAT_READ];
-    db->header.reserved_space = header_ptr[OFFSET_RESERVED_SPACE];
-    db->header.max_embed_payload_frac = header_ptr[OFFSET_MAX_EMBED_PAYLOAD_FRAC];
-    db->header.min_embed_payload_frac = header_ptr[OFFSET_MIN_EMBED_PAYLOAD_FRAC];
-    db->header.leaf_payload_frac = header_ptr[OFFSET_LEAF_PAYLOAD_FRAC];
-    db->header.file_change_counter = read_be32(header_ptr + OFFSET_FILE_CHANGE_COUNTER);
-    db->header.header_db_size = read_be32(header_ptr + OFFSET_HEADER_DB_SIZE);
-    db->header.first_freelist_trunk = read_be32(header_ptr + OFFSET_FIRST_FREELIST_TRUNK);
-    db->header.total_freelist_trunk = read_be32(header_ptr + OFFSET_TOTAL_FREELIST_PAGES);
-    db->header.schema_cookie = read_be32(header_ptr + OFFSET_SCHEMA_COOKIE);
-    db->header.schema_format_number = read_be32(header_ptr + OFFSET_SCHEMA_FORMAT_NUMBER);
-    db->header.default_page_cache_size = read_be32(header_ptr + OFFSET_DEFAULT_PAGE_CACHE_SIZE);
-    db->header.page_number_largest_root = read_be32(header_ptr + OFFSET_PAGE_NUMBER_LARGEST_ROOT);
-    db->header.db_text_encoding = read_be32(header_ptr + OFFSET_DB_TEXT_ENCODING);
-    db->header.user_version = read_be32(header_ptr + OFFSET_USER_VERSION);
-    db->header.incremental_version_mode = read_be32(header_ptr + OFFSET_INCREMENTAL_VACCUM_MODE);
-    db->header.application_id = read_be32(header_ptr + OFFSET_APPLICATION_ID);
-    memcpy(db->header.reserved_expansion, header_ptr + OFFSET_RESERVED_EXPANSION, 20);
-    db->header.version_valid_for = read_be32(header_ptr + OFFSET_VERSION_VALID_FOR);
-    db->header.sqlite_version_number = read_be32(header_ptr + OFFSET_SQLITE_VERSION_NUMBER);
-
-    // allocate page_headers array
+    STATS_BEGIN(header_start);
+    read_db_header(db, header_ptr);
+
+    // page headers are decoded lazily by db_get_page(); only reserve the
+    // directory here so that opening a database costs O(1) in its size.
+    // Pages the log added past the end of the main file are checked on
+    // access instead.
     uint32_t page_count = db->header.header_db_size;
-    db->page_headers = malloc(sizeof(btree_page_header_t) * page_count);
-    if (!db->page_headers) {
-        munmap(file_data, st.st_size);
-        free(db);
+    if (page_count > 0 && db->wal.frames == 0 &&
+        (size_t)db->header.page_size * page_count > (size_t)st.st_size) {
+        fprintf(stderr, "Error: page %u offset out of bounds\n", page_count - 1);
+        goto fail;
+    }
+
+    if (!file_data) {
+        // frames hold one page each, so pages must at least hold the
+        // database header (65536, stored as 1, is not supported)
+        if (db->header.page_size < 512) {
+            fprintf(stderr, "Error: unsupported page size %u\n",
+                    db->header.page_size);
+            goto fail;
+        }
+        if (opts->io == DB_IO_WINDOW) {
+            db->pager = pager_open_window(fd, db->header.page_size, st.st_size,
+                                          opts->max_resident);
+        } else {
+            db->pager = pager_open(fd, db->header.page_size, st.st_size,
+                                   opts->io, opts->cache_pages);
+        }
+        fd = -1;
+        if (!db->pager) {
+            goto fail;
+        }
+    }
+
+    // cached pages are only valid until the next release, so their cell
+    // pointers are always decoded into the arena. Windows keep no
+    // directory at all: it and the arena grow with the pages visited.
+    db->windowed = opts->io == DB_IO_WINDOW;
+    int zero_copy = db->windowed || (opts->zero_copy && !db->pager);
+    if (dir_init(&db->pages, db->windowed ? 0 : page_count, zero_copy) < 0) {
+        goto fail;
+    }
+    STATS_END(STATS_PHASE_HEADER, header_start);
+
+    return db;
+
+fail:
+    wal_close(&db->wal);
+    pager_close(db->pager);
+    if (file_data) munmap(file_data, st.st_size);
+    if (fd >= 0 && !file_data) close(fd);
+    free(db);
+    return NULL;
+}
+
+// Returns a pointer to the first byte of page `page_num` (1-based), or NULL
+// if the page lies outside the file. Cell pointers are relative to this.
+// A page committed to the WAL resolves to its latest frame.
+uint8_t* db_page_data(database_t *db, uint32_t page_num) {
+    if (!db || page_num == 0 || page_num > db->header.header_db_size) {
         return NULL;
     }
+    const uint8_t *logged = wal_page(&db->wal, page_num);
+    if (logged) {
+        return (uint8_t *)logged;
+    }
+
+    size_t page_offset = (size_t)db->header.page_size * (page_num - 1);
+    if (page_offset + db->header.page_size > db->file_size) {
+        return NULL;
+    }
+    if (db->pager) {
+        return pager_get(db->pager, page_num);
+    }
+    return (uint8_t *)db->file_data + page_offset;
+}
+
+// Ends the lifetime of every page pointer db_page_data() returned so far
+// when pages are read through a pager, which may then reuse their frames.
+// Only call it where no page data is referenced.
+void db_release_pages(database_t *db) {
+    if (db->pager) {
+        pager_release(db->pager);
+    }
+}
+
+// Sets the kernel's read-ahead policy for the scan about to start (and the
+// pager's). Table scans keep the default: most of a table lies in runs of
+// adjacent pages that the kernel's read-around already fetches. With
+// io_uring, b-tree walks also read the children of interior pages ahead.
+void db_set_access(database_t *db, db_access_t access) {
+    if (db->pager) {
+        pager_advise(db->pager, access);
+        db->prefetch = access == DB_ACCESS_TREE && pager_can_prefetch(db->pager);
+        return;
+    }
+    int advice = access == DB_ACCESS_SEQUENTIAL ? POSIX_MADV_SEQUENTIAL :
+                 access == DB_ACCESS_POINT ? POSIX_MADV_RANDOM : POSIX_MADV_NORMAL;
+    posix_madvise(db->file_data, db->file_size, advice);
+}
+
+static int compare_pages(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Starts reading `pages` (sorted in place, in file order) before they are
+// asked for. Pages held by the WAL are skipped. Only a pager reads ahead.
+void db_prefetch_pages(database_t *db, uint32_t *pages, size_t count) {
+    if (!db->pager) {
+        return;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (pages[i] > 0 && pages[i] <= db->header.header_db_size &&
+            !wal_page(&db->wal, pages[i])) {
+            pages[n++] = pages[i];
+        }
+    }
+    qsort(pages, n, sizeof(uint32_t), compare_pages);
+    pager_prefetch(db->pager, pages, n);
+}
+
+static int is_interior(uint8_t page_type) {
+    return page_type == PAGE_TYPE_INTERIOR_INDEX ||
+           page_type == PAGE_TYPE_INTERIOR_TABLE;
+}
+
+// start of the raw cell pointer array of a page
+static uint8_t *cell_ptr_array(database_t *db, uint32_t index) {
+    // page 1 b-tree header follows the database header
+    uint8_t *page_ptr = db_page_data(db, index + 1) + ((index == 0) ? 0x64 : 0);
+    return page_ptr + (is_interior(db->pages.page_types[index]) ? 12 : 8);
+}
+
+// Reads the fixed header fields of a page into `page`, its cell pointers
+// left in the page data (cell_pointers NULL).
+static int read_page_fields(database_t *db, uint32_t index,
+                            btree_page_header_t *page) {
+    uint8_t *page_base = db_page_data(db, index + 1);
+    if (!page_base) {
+        fprintf(stderr, "Error: page %u offset out of bounds\n", index);
+        return -1;
+    }
+    uint8_t *page_ptr = page_base + ((index == 0) ? 0x64 : 0);
+
+    page->page_type = page_ptr[OFFSET_BTREE_PAGE_TYPE];
+    page->first_freeblock = read_be16(page_ptr + OFFSET_BTREE_FIRST_FREEBLOCK);
+    page->cell_count = read_be16(page_ptr + OFFSET_BTREE_CELL_COUNT);
+    page->cell_content_start = read_be16(page_ptr + OFFSET_BTREE_CELL_CONTENT_START);
+    page->fragmented_free_bytes = page_ptr[OFFSET_BTREE_FRAG_FREE_BYTES];
+    page->rightmost_pointer = is_interior(page->page_type) ?
+        read_be32(page_ptr + OFFSET_BTREE_RIGHTMOST_POINTER) : 0;
+    page->cell_pointers = NULL;
+    page->cell_ptr_array = page_ptr + (is_interior(page->page_type) ? 12 : 8);
 
-    // parse all page headers
-    for (uint32_t i = 0; i < page_count; i++) {
-        size_t page_offset = (i == 0) ? 0x64 : (db->header.page_size * i);
-        
-        // Validate page offset
-        if (page_offset >= (size_t)st.st_size || page_offset + db->header.page_size > (size_t)st.st_size) {
-            fprintf(stderr, "Error: page %u offset out of bounds\n", i);
-            for (uint32_t k = 0; k < i; k++) {
-                free(db->page_headers[k].cell_pointers);
+    // non b-tree pages (overflow, freelist) decode as garbage counts;
+    // like the eager parser, only refuse to read past the end of the file
+    // (or of the WAL for a logged page)
+    size_t array_end = (size_t)(page->cell_ptr_array - page_base) +
+                       (size_t)page->cell_count * 2;
+    size_t available = db->file_size - (size_t)db->header.page_size * index;
+    if (wal_page(&db->wal, index + 1)) {
+        available = (size_t)((uint8_t *)db->wal.data + db->wal.size - page_base);
+    }
+    if (array_end > available) {
+        fprintf(stderr, "Error: page %u cell pointer array out of bounds\n", index);
+        return -1;
+    }
+
+    // past its page it can also run past the window holding it; such an
+    // array is copied out of the file and lasts until the next one
+    if (db->windowed && array_end > db->header.page_size &&
+        !wal_page(&db->wal, index + 1)) {
+        size_t len = (size_t)page->cell_count * 2;
+        if (!db->spill) {
+            db->spill = malloc(sizeof(uint16_t) * UINT16_MAX);
+        }
+        if (!db->spill ||
+            pager_read_at(db->pager, (size_t)db->header.page_size * index +
+                          (size_t)(page->cell_ptr_array - page_base),
+                          db->spill, len) < 0) {
+            fprintf(stderr, "Error: page %u cell pointer array unreadable\n", index);
+            return -1;
+        }
+        page->cell_ptr_array = db->spill;
+    }
+    return 0;
+}
+
+// decode the fixed header fields of a page into its directory slot
+static int decode_page_fields(database_t *db, uint32_t index) {
+    page_directory_t *dir = &db->pages;
+    btree_page_header_t page;
+    if (read_page_fields(db, index, &page) < 0) {
+        return -1;
+    }
+    dir->page_types[index] = page.page_type;
+    dir->first_freeblocks[index] = page.first_freeblock;
+    dir->cell_counts[index] = page.cell_count;
+    dir->content_starts[index] = page.cell_content_start;
+    dir->frag_free_bytes[index] = page.fragmented_free_bytes;
+    dir->rightmost_pointers[index] = page.rightmost_pointer;
+    return 0;
+}
+
+static void fill_cell_pointers(database_t *db, uint32_t index, uint16_t *dst) {
+    uint8_t *src = cell_ptr_array(db, index);
+    uint16_t count = db->pages.cell_counts[index];
+
+    // a garbage count can run the array past its page, into bytes a pager
+    // has not read; those come from the file as they would from the mapping
+    uint8_t *spill = NULL;
+    size_t start = (size_t)(src - db_page_data(db, index + 1));
+    if (db->pager && !wal_page(&db->wal, index + 1) &&
+        start + (size_t)count * 2 > db->header.page_size) {
+        spill = malloc((size_t)count * 2);
+        if (!spill || pager_read_at(db->pager,
+                                    (size_t)db->header.page_size * index + start,
+                                    spill, (size_t)count * 2) < 0) {
+            memset(dst, 0, sizeof(uint16_t) * count);
+            free(spill);
+            return;
+        }
+        src = spill;
+    }
+    for (uint16_t j = 0; j < count; j++) {
+        dst[j] = read_be16(src + (j * 2));
+    }
+    free(spill);
+}
+
+static int decode_page_header(database_t *db, uint32_t index) {
+    page_directory_t *dir = &db->pages;
+    if (decode_page_fields(db, index) < 0) {
+        return -1;
+    }
+
+    if (!dir->zero_copy) {
+        uint16_t *slots = NULL;
+        if (dir->cell_counts[index] > 0) {
+            slots = arena_alloc(dir, dir->cell_counts[index]);
+            if (!slots) {
+                return -1;
             }
-            free(db->page_headers);
-            munmap(file_data, st.st_size);
-            free(db);
-            return NULL;
+            fill_cell_pointers(db, index, slots);
+        }
+        dir->cell_pointers[index] = slots;
+    }
+
+    dir->loaded[index] = SLOT_LOADED;
+    return 0;
+}
+
+// Fills `page` with the header of page `page_num` (1-based), decoding it
+// into the directory on first access. In windowed mode it is decoded on
+// every access instead, and its cell_ptr_array only lasts until the next
+// db_release_pages(). Returns 0 on success, -1 if the page cannot be
+// decoded.
+int db_get_page(database_t *db, uint32_t page_num, btree_page_header_t *page) {
+    if (!db || page_num == 0 || page_num > db->header.header_db_size) {
+        return -1;
+    }
+    if (db->windowed) {
+        int rc = read_page_fields(db, page_num - 1, page);
+        if (rc == 0) {
+            STATS_PAGE(page->page_type);
+        }
+        return rc;
+    }
+
+    page_directory_t *dir = &db->pages;
+    uint32_t index = page_num - 1;
+    uint8_t state = dir->loaded[index];
+    // a pager cannot back the raw array of a page the sidecar kept no
+    // cell pointers for, so such pages are decoded as without a sidecar
+    if (state == SLOT_CACHED && db->pager &&
+        db->sidecar.cell_offsets[index] == UINT64_MAX &&
+        dir->cell_counts[index] > 0) {
+        state = SLOT_EMPTY;
+    }
+    if (state != SLOT_LOADED && state != SLOT_CACHED) {
+        if (decode_page_header(db, index) < 0) {
+            return -1;
+        }
+        state = SLOT_LOADED;
+    }
+
+    page->page_type = dir->page_types[index];
+    page->first_freeblock = dir->first_freeblocks[index];
+    page->cell_count = dir->cell_counts[index];
+    page->cell_content_start = dir->content_starts[index];
+    page->fragmented_free_bytes = dir->frag_free_bytes[index];
+    page->rightmost_pointer = dir->rightmost_pointers[index];
+    if (dir->zero_copy) {
+        page->cell_pointers = NULL;
+    } else if (state == SLOT_CACHED) {
+        // offsets are checked here rather than when the sidecar is mapped
+        // (UINT64_MAX marks pages kept without them)
+        uint64_t offset = db->sidecar.cell_offsets[index];
+        uint64_t total = db->sidecar.cell_total;
+        page->cell_pointers =
+            (page->cell_count > total || offset > total - page->cell_count) ?
+            NULL : (uint16_t *)db->sidecar.cells + offset;
+    } else {
+        page->cell_pointers = dir->cell_pointers[index];
+    }
+    page->cell_ptr_array = cell_ptr_array(db, index);
+    STATS_PAGE(page->page_type);
+    return 0;
+}
+
+typedef struct {
+    database_t *db;
+    atomic_int failed;
+} page_load_ctx_t;
+
+// pass 1: header fields of every unloaded page
+static void load_fields_range(void *arg, size_t begin, size_t end, int worker) {
+    (void)worker;
+    page_load_ctx_t *ctx = arg;
+    page_directory_t *dir = &ctx->db->pages;
+    for (size_t i = begin; i < end; i++) {
+        if (dir->loaded[i] != SLOT_EMPTY) {
+            continue;
+        }
+        if (decode_page_fields(ctx->db, (uint32_t)i) < 0) {
+            atomic_store(&ctx->failed, 1);
+        } else {
+            dir->loaded[i] = dir->zero_copy ? SLOT_LOADED : SLOT_FIELDS;
         }
-        
-        uint8_t *page_ptr = (uint8_t *)file_data + page_offset;
-
-        db->page_headers[i].page_type = page_ptr[OFFSET_BTREE_PAGE_TYPE];
-        db->page_headers[i].first_freeblock = read_be16(page_ptr + OFFSET_BTREE_FIRST_FREEBLOCK);
-        db->page_headers[i].cell_count = read_be16(page_ptr + OFFSET_BTREE_CELL_COUNT);
-        db->page_headers[i].cell_content_start = read_be16(page_ptr + OFFSET_BTREE_CELL_CONTENT_START);
-        db->page_headers[i].fragmented_free_bytes = page_ptr[OFFSET_BTREE_FRAG_FREE_BYTES];
-
-        if (db->page_headers[i].page_type == PAGE_TYPE_INTERIOR_INDEX ||
-            db->page_headers[i].page_type == PAGE_TYPE_INTERIOR_TABLE) {
-            db->page_headers[i].rightmost_pointer = read_be32(page_ptr + OFFSET_BTREE_RIGHTMOST_POINTER);
-        }
-
-        // allocate and parse cell pointers
-        if (db->page_headers[i].cell_count > 0) {
-            db->page_headers[i].cell_pointers = malloc(sizeof(uint16_t) * db->page_headers[i].cell_count);
-            if (!db->page_headers[i].cell_pointers) {
-                for (uint32_t k = 0; k < i; k++) {
-                    free(db->page_headers[k].cell_pointers);
-                }
-                free(db->page_headers);
-                munmap(file_data, st.st_size);
-                free(db);
-                return NULL;
+        db_release_pages(ctx->db);
+    }
+}
+
+// pass 2: cell pointers into the slots reserved for each page
+static void load_pointers_range(void *arg, size_t begin, size_t end, int worker) {
+    (void)worker;
+    page_load_ctx_t *ctx = arg;
+    page_directory_t *dir = &ctx->db->pages;
+    for (size_t i = begin; i < end; i++) {
+        if (dir->loaded[i] == SLOT_FIELDS) {
+            if (dir->cell_pointers[i]) {
+                fill_cell_pointers(ctx->db, (uint32_t)i, dir->cell_pointers[i]);
             }
+            dir->loaded[i] = SLOT_LOADED;
+            db_release_pages(ctx->db);
+        }
+    }
+}
 
-            uint8_t header_size = (db->page_headers[i].page_type == PAGE_TYPE_INTERIOR_INDEX ||
-                                   db->page_headers[i].page_type == PAGE_TYPE_INTERIOR_TABLE) ? 12 : 8;
+// Decodes every page header not yet loaded, splitting the page range into
+// chunks spread over `threads` workers. Each page is written by exactly one
+// worker, so the directory needs no locking. Cell pointers are decoded in a
+// second pass, into one arena block sized from the cell counts of the
+// first. A pager is not shared between threads, so pages read through one
+// are loaded on the calling thread, and windowed mode has no directory to
+// fill. Returns 0 on success, -1 if any page
+// failed to decode (the other pages are still loaded).
+int db_load_all_pages(database_t *db, int threads) {
+    if (!db) {
+        return -1;
+    }
+    if (db->windowed) {
+        return 0;   // nothing is kept
+    }
+    if (db->pager) {
+        threads = 1;
+    }
 
-            uint8_t *cell_ptr_array = page_ptr + header_size;
+    page_directory_t *dir = &db->pages;
+    uint32_t page_count = db->header.header_db_size;
+    page_load_ctx_t ctx = { .db = db };
+    atomic_init(&ctx.failed, 0);
+    if (pool_run(page_count, PAGE_LOAD_CHUNK, threads,
+                 load_fields_range, &ctx) < 0) {
+        return -1;
+    }
 
-            for (uint16_t j = 0; j < db->page_headers[i].cell_count; j++) {
-                db->page_headers[i].cell_pointers[j] = read_be16(cell_ptr_array + (j * 2));
+    if (!dir->zero_copy) {
+        size_t total = 0;
+        for (uint32_t i = 0; i < page_count; i++) {
+            if (dir->loaded[i] == SLOT_FIELDS) {
+                total += dir->cell_counts[i];
             }
-        } else {
-            db->page_headers[i].cell_pointers = NULL;
+        }
+
+        uint16_t *slots = total > 0 ? arena_alloc(dir, total) : NULL;
+        if (total > 0 && !slots) {
+            return -1;
+        }
+        for (uint32_t i = 0; i < page_count; i++) {
+            if (dir->loaded[i] == SLOT_FIELDS) {
+                dir->cell_pointers[i] = dir->cell_counts[i] > 0 ? slots : NULL;
+                slots += dir->cell_counts[i];
+            }
+        }
+
+        if (pool_run(page_count, PAGE_LOAD_CHUNK, threads,
+                     load_pointers_range, &ctx) < 0) {
+            return -1;
         }
     }
+    return atomic_load(&ctx.failed) ? -1 : 0;
+}
 
-    return db;
+// Replaces the page directory with `arrays`, which live in the sidecar
+// mapping already set in db->sidecar. Slots the sidecar left empty are
+// decoded on demand as usual. Returns -1 in windowed mode or if out of
+// memory (the directory is then unchanged).
+int db_adopt_directory(database_t *db, const page_directory_t *arrays) {
+    uint16_t **pointers = NULL;
+    if (db->windowed) {
+        return -1;
+    }
+    uint32_t count = db->header.header_db_size;
+    if (!db->pages.zero_copy && count > 0) {
+        pointers = calloc(count, sizeof(uint16_t *));
+        if (!pointers) {
+            return -1;
+        }
+    }
+
+    int zero_copy = db->pages.zero_copy;
+    dir_free(&db->pages);
+    db->pages = *arrays;
+    db->pages.zero_copy = zero_copy;
+    db->pages.cell_pointers = pointers;
+    db->pages.arena = NULL;
+    db->pages.block = pointers;
+    return 0;
+}
+
+// Drops the cached header of page `page_num` so the next db_get_page()
+// decodes it again. In zero-copy mode nothing else refers to it; otherwise
+// its old cell pointers stay in the arena until free_database().
+void db_forget_page(database_t *db, uint32_t page_num) {
+    if (db && !db->windowed && page_num > 0 &&
+        page_num <= db->header.header_db_size) {
+        db->pages.loaded[page_num - 1] = SLOT_EMPTY;
+    }
+}
+
+// Indexes transactions a writer committed to the WAL since the database
+// was opened or last refreshed, and re-reads the header and page count.
+// Frames [*first, db->wal.frames) are the new ones; the caller forgets
+// the pages they hold. A change of page count resets the whole directory.
+// Returns 0 on success, 1 if the database must be reopened (the log was
+// restarted or removed), -1 on error.
+int db_refresh_wal(database_t *db, const char *filename, uint32_t *first) {
+    int rc = wal_extend(&db->wal, filename, db->header.page_size, first);
+    if (rc != 0 || db->wal.frames == *first) {
+        return rc;
+    }
+
+    uint32_t old_count = db->header.header_db_size;
+    const uint8_t *logged = wal_page(&db->wal, 1);
+    if (!logged) {
+        logged = db->pager ? pager_get(db->pager, 1) : db->file_data;
+    }
+    if (!logged) {
+        return -1;
+    }
+    read_db_header(db, (uint8_t *)logged);
+    if (db->header.header_db_size != old_count) {
+        int zero_copy = db->pages.zero_copy;
+        dir_free(&db->pages);
+        if (dir_init(&db->pages, db->header.header_db_size, zero_copy) < 0) {
+            // keep db consistent: nothing can be read until it is reopened
+            db->header.header_db_size = 0;
+            return -1;
+        }
+    }
+    return 0;
 }
 
 void free_database(database_t *db) {
     if (db) {
-        if (db->page_headers) {
-            for (uint32_t i = 0; i < db->header.header_db_size; i++) {
-                free(db->page_headers[i].cell_pointers);
-            }
+        dir_free(&db->pages);
+        wal_close(&db->wal);
+        if (db->sidecar.map) {
+            munmap(db->sidecar.map, db->sidecar.size);
         }
-        free(db->page_headers);
         if (db->file_data) {
             munmap(db->file_data, db->file_size);
         }
+        pager_close(db->pager);
+        free(db->spill);
         free(db);
     }
 }
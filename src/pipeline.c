@@ -0,0 +1,179 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdlib.h>
+#include "../include/pipeline.h"
+
+/*
+ * Ordered parallel rendering.
+ *
+ * Workers take batch numbers in increasing order and render each one into
+ * slot (batch % depth) of a ring of memory sinks; the calling thread writes
+ * the slots to the destination strictly in batch order and hands them back.
+ * A worker that gets ahead by a full ring waits for its slot, so at most
+ * `depth` rendered batches are held at any time whatever the input size.
+ * Slot buffers are kept between batches and only grow to the largest batch
+ * they have rendered.
+ */
+
+// initial size of a slot buffer
+#define PIPELINE_SLOT_SIZE (64 * 1024)
+
+typedef struct {
+    out_t out;
+    int ready;      // rendered, waiting for the writer
+    int stop;       // the render asked to end the output here
+} pipeline_slot_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pipeline_slot_t *slots;
+    size_t depth;
+    size_t batches;
+    size_t next;        // next batch a worker takes
+    size_t written;     // batches handed to the destination
+    int done;           // the writer stopped, no more batches are wanted
+    pipeline_render_fn render;
+    void *ctx;
+} pipeline_t;
+
+typedef struct {
+    pipeline_t *pipeline;
+    int index;
+} pipeline_worker_t;
+
+static void *worker_main(void *arg) {
+    pipeline_worker_t *w = arg;
+    pipeline_t *p = w->pipeline;
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->done && p->next < p->batches) {
+        size_t batch = p->next++;
+        // the slot is free once the batch a ring ahead has been written
+        while (!p->done && batch >= p->written + p->depth) {
+            pthread_cond_wait(&p->changed, &p->lock);
+        }
+        if (p->done) {
+            break;
+        }
+        pipeline_slot_t *slot = &p->slots[batch % p->depth];
+        pthread_mutex_unlock(&p->lock);
+
+        slot->out.len = 0;
+        slot->out.error = 0;
+        int stop = p->render(p->ctx, batch, w->index, &slot->out) > 0;
+
+        pthread_mutex_lock(&p->lock);
+        slot->stop = stop;
+        slot->ready = 1;
+        pthread_cond_broadcast(&p->changed);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+// Renders batches [0, batches) on `threads` worker threads and writes them
+// to `out` in order, holding at most `depth` rendered batches. Output ends
+// early after a batch whose render returned a positive value. A batch that
+// ran out of memory marks `out` failed like any other lost output. Returns
+// -1 without writing anything if the workers could not be set up.
+int pipeline_run(out_t *out, size_t batches, int threads, size_t depth,
+                 pipeline_render_fn render, void *ctx) {
+    if (batches == 0) {
+        return 0;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    if ((size_t)threads > batches) {
+        threads = (int)batches;
+    }
+    if (depth < (size_t)threads) {
+        depth = (size_t)threads;
+    }
+    if (depth > batches) {
+        depth = batches;
+    }
+
+    pipeline_t p = {
+        .depth = depth,
+        .batches = batches,
+        .render = render,
+        .ctx = ctx,
+    };
+    p.slots = calloc(depth, sizeof(pipeline_slot_t));
+    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+    pipeline_worker_t *workers = malloc(sizeof(pipeline_worker_t) * threads);
+    if (!p.slots || !tids || !workers) {
+        free(p.slots);
+        free(tids);
+        free(workers);
+        return -1;
+    }
+    size_t opened = 0;
+    while (opened < depth && out_open_mem(&p.slots[opened].out,
+                                          PIPELINE_SLOT_SIZE) == 0) {
+        opened++;
+    }
+    int started = 0;
+    if (opened == depth) {
+        pthread_mutex_init(&p.lock, NULL);
+        pthread_cond_init(&p.changed, NULL);
+        while (started < threads) {
+            workers[started].pipeline = &p;
+            workers[started].index = started;
+            if (pthread_create(&tids[started], NULL, worker_main,
+                               &workers[started]) != 0) {
+                break;
+            }
+            started++;
+        }
+    }
+
+    int rc = started > 0 ? 0 : -1;
+    if (started > 0) {
+        pthread_mutex_lock(&p.lock);
+        while (p.written < batches) {
+            pipeline_slot_t *slot = &p.slots[p.written % depth];
+            while (!slot->ready) {
+                pthread_cond_wait(&p.changed, &p.lock);
+            }
+            pthread_mutex_unlock(&p.lock);
+
+            int stop = slot->stop;
+            if (slot->out.error) {
+                out->error = 1;
+                stop = 1;
+            } else {
+                out_write(out, slot->out.buf, slot->out.len);
+            }
+
+            pthread_mutex_lock(&p.lock);
+            slot->ready = 0;
+            p.written++;
+            if (stop) {
+                break;
+            }
+            pthread_cond_broadcast(&p.changed);
+        }
+        p.done = 1;
+        pthread_cond_broadcast(&p.changed);
+        pthread_mutex_unlock(&p.lock);
+
+        for (int i = 0; i < started; i++) {
+            pthread_join(tids[i], NULL);
+        }
+    }
+    if (opened == depth) {
+        pthread_mutex_destroy(&p.lock);
+        pthread_cond_destroy(&p.changed);
+    }
+
+    for (size_t i = 0; i < opened; i++) {
+        free(p.slots[i].out.buf);
+    }
+    free(p.slots);
+    free(tids);
+    free(workers);
+    return rc;
+}
@@ -0,0 +1,192 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../include/pool.h"
+
+/*
+ * Work-stealing scheduler over a range of chunk indices.
+ *
+ * Every worker owns a deque of chunks packed into one 64-bit word as
+ * (next << 32 | end). The owner pops from the front (next), thieves take
+ * the back half (end) of a victim's remaining range. Both sides update the
+ * word with compare-and-swap, so a chunk is handed out exactly once without
+ * locks. Chunks are never created during a run, so a worker can exit as soon
+ * as a full sweep over the other deques finds nothing left to steal.
+ */
+
+#define POOL_CACHE_LINE 64
+
+typedef struct {
+    _Atomic uint64_t range;
+    char pad[POOL_CACHE_LINE - sizeof(uint64_t)];
+} pool_deque_t;
+
+typedef struct {
+    pool_deque_t *deques;
+    int threads;
+    size_t count;
+    size_t chunk_size;
+    pool_range_fn fn;
+    void *ctx;
+} pool_t;
+
+typedef struct {
+    pool_t *pool;
+    int worker;
+} pool_worker_t;
+
+static inline uint64_t pack_range(uint32_t next, uint32_t end) {
+    return ((uint64_t)next << 32) | end;
+}
+
+static inline uint32_t range_next(uint64_t r) { return (uint32_t)(r >> 32); }
+static inline uint32_t range_end(uint64_t r) { return (uint32_t)r; }
+
+// take one chunk from the front of our own deque
+static int pop_own(pool_deque_t *dq, uint32_t *chunk) {
+    uint64_t r = atomic_load_explicit(&dq->range, memory_order_acquire);
+    while (range_next(r) < range_end(r)) {
+        uint64_t want = pack_range(range_next(r) + 1, range_end(r));
+        if (atomic_compare_exchange_weak(&dq->range, &r, want)) {
+            *chunk = range_next(r);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// move the back half of a victim's remaining range into our (empty) deque
+static int steal(pool_deque_t *victim, pool_deque_t *own) {
+    uint64_t r = atomic_load_explicit(&victim->range, memory_order_acquire);
+    while (range_next(r) < range_end(r)) {
+        uint32_t left = range_end(r) - range_next(r);
+        uint32_t take = (left + 1) / 2;
+        uint32_t split = range_end(r) - take;
+        uint64_t want = pack_range(range_next(r), split);
+        if (atomic_compare_exchange_weak(&victim->range, &r, want)) {
+            atomic_store_explicit(&own->range, pack_range(split, split + take),
+                                  memory_order_release);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void run_chunk(pool_t *pool, uint32_t chunk, int worker) {
+    size_t begin = (size_t)chunk * pool->chunk_size;
+    size_t end = begin + pool->chunk_size;
+    if (end > pool->count) {
+        end = pool->count;
+    }
+    pool->fn(pool->ctx, begin, end, worker);
+}
+
+static void *worker_main(void *arg) {
+    pool_worker_t *w = arg;
+    pool_t *pool = w->pool;
+    pool_deque_t *own = &pool->deques[w->worker];
+    uint32_t chunk;
+
+    for (;;) {
+        while (pop_own(own, &chunk)) {
+            run_chunk(pool, chunk, w->worker);
+        }
+
+        int stolen = 0;
+        for (int i = 1; i < pool->threads && !stolen; i++) {
+            int victim = (w->worker + i) % pool->threads;
+            stolen = steal(&pool->deques[victim], own);
+        }
+        if (!stolen) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+// Runs fn over [0, count) split into chunks of chunk_size items, using up to
+// `threads` workers (the caller acts as worker 0). Returns 0 on success, -1
+// if the range is too large or no worker could be started.
+int pool_run(size_t count, size_t chunk_size, int threads,
+             pool_range_fn fn, void *ctx) {
+    if (count == 0) {
+        return 0;
+    }
+    if (chunk_size == 0) {
+        chunk_size = 1;
+    }
+
+    size_t chunks = (count + chunk_size - 1) / chunk_size;
+    if (chunks > UINT32_MAX) {
+        return -1;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    if ((size_t)threads > chunks) {
+        threads = (int)chunks;
+    }
+
+    if (threads == 1) {
+        for (size_t begin = 0; begin < count; begin += chunk_size) {
+            size_t end = begin + chunk_size < count ? begin + chunk_size : count;
+            fn(ctx, begin, end, 0);
+        }
+        return 0;
+    }
+
+    pool_t pool = {
+        .threads = threads,
+        .count = count,
+        .chunk_size = chunk_size,
+        .fn = fn,
+        .ctx = ctx,
+    };
+    pool.deques = aligned_alloc(POOL_CACHE_LINE, sizeof(pool_deque_t) * threads);
+    pool_worker_t *workers = malloc(sizeof(pool_worker_t) * threads);
+    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+    if (!pool.deques || !workers || !tids) {
+        free(pool.deques);
+        free(workers);
+        free(tids);
+        return -1;
+    }
+
+    // deal the chunks out evenly, stealing fixes any imbalance
+    for (int i = 0; i < threads; i++) {
+        uint32_t begin = (uint32_t)(chunks * i / threads);
+        uint32_t end = (uint32_t)(chunks * (i + 1) / threads);
+        atomic_init(&pool.deques[i].range, pack_range(begin, end));
+        workers[i].pool = &pool;
+        workers[i].worker = i;
+    }
+
+    int started = 1;
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&tids[i], NULL, worker_main, &workers[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    // workers that failed to start leave their chunks to be stolen
+    worker_main(&workers[0]);
+
+    for (int i = 1; i < started; i++) {
+        pthread_join(tids[i], NULL);
+    }
+
+    free(pool.deques);
+    free(workers);
+    free(tids);
+    return 0;
+}
+
+// Number of online CPUs, at least 1.
+int pool_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
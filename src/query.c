@@ -0,0 +1,590 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/query.h"
+#include "../include/constants.h"
+#include "../include/csv.h"
+#include "../include/schema.h"
+#include "../include/serializer.h"
+
+static const char *skip_spaces(const char *p) {
+    while (*p == ' ' || *p == '\t' || *p == '\n') p++;
+    return p;
+}
+
+static int is_name_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_' || c == '$' || (c & 0x80);
+}
+
+static int word_is(const char *p, size_t len, const char *word) {
+    if (strlen(word) != len) return 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = (p[i] >= 'a' && p[i] <= 'z') ? (char)(p[i] - ('a' - 'A')) : p[i];
+        if (c != word[i]) return 0;
+    }
+    return 1;
+}
+
+// Reads a column name, bare or quoted as "name", `name` or [name], into a
+// new string. Returns the position after it, or NULL if there is none.
+static const char *read_name(const char *p, char **name) {
+    size_t len = 0;
+    p = skip_spaces(p);
+    *name = malloc(strlen(p) + 1);
+    if (!*name) return NULL;
+
+    if (*p == '"' || *p == '`' || *p == '[') {
+        char close = *p == '[' ? ']' : *p;
+        for (p++; *p; p++) {
+            if (*p == close && (close == ']' || p[1] != close)) break;
+            if (*p == close) p++;       // doubled quote
+            (*name)[len++] = *p;
+        }
+        if (*p != close) len = 0;
+        p++;
+    } else {
+        while (is_name_char(*p)) (*name)[len++] = *p++;
+    }
+    (*name)[len] = '\0';
+    if (len == 0) {
+        free(*name);
+        *name = NULL;
+        return NULL;
+    }
+    return p;
+}
+
+// Finds name among the table's columns and works out where records hold
+// it: the record index counts the stored columns before it, and an
+// INTEGER PRIMARY KEY (or rowid, oid, _rowid_ unless a column has that
+// name) is the rowid.
+static int resolve_column(const table_columns_t *cols, char *name,
+                          query_column_t *col) {
+    memset(col, 0, sizeof(*col));
+    col->name = name;
+    col->fallback.type = VALUE_NULL;
+
+    long i = schema_find_column(cols, name);
+    size_t len = strlen(name);
+    if (i < 0) {
+        if (word_is(name, len, "ROWID") || word_is(name, len, "OID") ||
+            word_is(name, len, "_ROWID_")) {
+            col->source = QUERY_ROWID;
+            col->affinity = AFFINITY_INTEGER;
+            return 0;
+        }
+        fprintf(stderr, "no such column: %s\n", name);
+        return -1;
+    }
+
+    const table_column_t *decl = &cols->columns[i];
+    if (!decl->stored) {
+        fprintf(stderr, "column %s is generated and not stored\n", name);
+        return -1;
+    }
+    col->affinity = decl->affinity;
+    if (decl->rowid_alias) {
+        col->source = QUERY_ROWID;
+        return 0;
+    }
+    for (long c = 0; c < i; c++) {
+        col->source += cols->columns[c].stored;
+    }
+    if (decl->default_value &&
+        sql_literal_value(decl->default_value, &col->fallback, &col->fallback_text) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Converts the literal of a comparison as storing it in the column would:
+// numbers become text in a TEXT column, and text that reads as a number
+// becomes that number in an INTEGER, REAL or NUMERIC column.
+static int apply_affinity(query_term_t *term) {
+    record_value_t *v = &term->value;
+    column_affinity_t affinity = term->column.affinity;
+
+    if (affinity == AFFINITY_TEXT &&
+        (v->type == VALUE_INTEGER || v->type == VALUE_FLOAT)) {
+        char buf[32];
+        size_t n = record_number_text(v, buf, sizeof(buf));
+        term->text = malloc(n + 1);
+        if (!term->text) return -1;
+        memcpy(term->text, buf, n + 1);
+        v->type = VALUE_TEXT;
+        v->data = (const uint8_t *)term->text;
+        v->size = n;
+    } else if ((affinity == AFFINITY_INTEGER || affinity == AFFINITY_REAL ||
+                affinity == AFFINITY_NUMERIC) && v->type == VALUE_TEXT) {
+        record_value_t number;
+        char *unused = NULL;
+        term->text[v->size] = '\0';
+        if (strspn(term->text, "0123456789+-.eE") == v->size &&
+            sql_literal_value(term->text, &number, &unused) == 0 &&
+            (number.type == VALUE_INTEGER || number.type == VALUE_FLOAT)) {
+            *v = number;
+        }
+        free(unused);
+    }
+    return 0;
+}
+
+// The prefix of a LIKE 'abc%' or GLOB 'abc*' pattern; other patterns are
+// not supported.
+static int prefix_pattern(query_term_t *term) {
+    const char *special = term->op == QUERY_PREFIX ? "*?[" : "%_";
+    record_value_t *v = &term->value;
+
+    if (v->type != VALUE_TEXT || v->size == 0 ||
+        v->data[v->size - 1] != special[0]) {
+        return -1;
+    }
+    for (size_t i = 0; i + 1 < v->size; i++) {
+        if (strchr(special, v->data[i])) return -1;
+    }
+    v->size--;
+    return 0;
+}
+
+// Parses one --where predicate: NAME OP LITERAL with OP one of =, ==, !=,
+// <>, <, <=, >, >=, or NAME IS [NOT] NULL, NAME LIKE 'prefix%' and
+// NAME GLOB 'prefix*'.
+static int parse_term(const table_columns_t *cols, const char *expr,
+                      query_term_t *term) {
+    static const struct { const char *sym; query_op_t op; } ops[] = {
+        { "==", QUERY_EQ }, { "!=", QUERY_NE }, { "<>", QUERY_NE },
+        { "<=", QUERY_LE }, { ">=", QUERY_GE }, { "=", QUERY_EQ },
+        { "<", QUERY_LT }, { ">", QUERY_GT },
+    };
+    char *name;
+    const char *p = read_name(expr, &name);
+
+    memset(term, 0, sizeof(*term));
+    if (!p) {
+        fprintf(stderr, "bad --where: %s\n", expr);
+        return -1;
+    }
+    if (resolve_column(cols, name, &term->column) < 0) {
+        return -1;
+    }
+
+    p = skip_spaces(p);
+    size_t word = 0;
+    while (is_name_char(p[word])) word++;
+
+    int found = 0;
+    if (word_is(p, word, "IS")) {
+        p = skip_spaces(p + word);
+        term->op = QUERY_IS_NULL;
+        if (word_is(p, 3, "NOT") && !is_name_char(p[3])) {
+            p = skip_spaces(p + 3);
+            term->op = QUERY_NOT_NULL;
+        }
+        found = word_is(p, 4, "NULL") && *skip_spaces(p + 4) == '\0';
+        if (found) return 0;
+    } else if (word_is(p, word, "LIKE") || word_is(p, word, "GLOB")) {
+        term->op = p[0] == 'G' || p[0] == 'g' ? QUERY_PREFIX : QUERY_PREFIX_NOCASE;
+        p += word;
+        found = 1;
+    } else {
+        for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]) && !found; i++) {
+            size_t len = strlen(ops[i].sym);
+            if (strncmp(p, ops[i].sym, len) == 0) {
+                term->op = ops[i].op;
+                p += len;
+                found = 1;
+            }
+        }
+    }
+
+    // the literal is the rest of the expression
+    p = skip_spaces(p);
+    size_t len = strlen(p);
+    while (len > 0 && (p[len - 1] == ' ' || p[len - 1] == '\t')) len--;
+    char *literal = malloc(len + 1);
+    if (!literal) return -1;
+    memcpy(literal, p, len);
+    literal[len] = '\0';
+    int rc = found ? sql_literal_value(literal, &term->value, &term->text) : 1;
+    free(literal);
+    if (rc < 0) {
+        return -1;
+    }
+    if (rc > 0) {
+        fprintf(stderr, "bad --where: %s\n", expr);
+        return -1;
+    }
+
+    if (term->op == QUERY_PREFIX || term->op == QUERY_PREFIX_NOCASE) {
+        if (prefix_pattern(term) < 0) {
+            fprintf(stderr, "only prefix patterns are supported: %s\n", expr);
+            return -1;
+        }
+        return 0;
+    }
+    return apply_affinity(term);
+}
+
+static void note_needed(query_t *query, const query_column_t *col) {
+    if (col->source != QUERY_ROWID && (size_t)col->source + 1 > query->needed) {
+        query->needed = (size_t)col->source + 1;
+    }
+}
+
+static char *copy_string(const char *str) {
+    size_t len = strlen(str);
+    char *copy = malloc(len + 1);
+    if (copy) memcpy(copy, str, len + 1);
+    return copy;
+}
+
+// "*": the rowid, unless an INTEGER PRIMARY KEY holds it, then every
+// stored column in declaration order
+static int select_all(query_t *query, const table_columns_t *cols) {
+    int has_alias = 0;
+    for (size_t i = 0; i < cols->count; i++) {
+        has_alias |= cols->columns[i].rowid_alias;
+    }
+
+    query->select = calloc(cols->count + 1, sizeof(query_column_t));
+    if (!query->select) return -1;
+    for (size_t i = has_alias; i <= cols->count; i++) {
+        const char *name = i == 0 ? "rowid" : cols->columns[i - 1].name;
+        if (i > 0 && !cols->columns[i - 1].stored) continue;
+        char *copy = copy_string(name);
+        if (!copy) return -1;
+        query_column_t *col = &query->select[query->select_count++];
+        if (resolve_column(cols, copy, col) < 0) return -1;
+        note_needed(query, col);
+    }
+    return 0;
+}
+
+static int select_list(query_t *query, const table_columns_t *cols,
+                       const char *columns) {
+    query->select = calloc(strlen(columns) / 2 + 1, sizeof(query_column_t));
+    if (!query->select) return -1;
+
+    const char *p = columns;
+    for (;;) {
+        char *name;
+        p = read_name(p, &name);
+        if (!p) break;
+        query_column_t *col = &query->select[query->select_count++];
+        if (resolve_column(cols, name, col) < 0) return -1;
+        note_needed(query, col);
+        p = skip_spaces(p);
+        if (*p == '\0') return 0;
+        if (*p++ != ',') break;
+    }
+    fprintf(stderr, "bad --columns: %s\n", columns);
+    return -1;
+}
+
+// "name": as an NDJSON row prints it before each value
+static int make_json_key(query_column_t *col) {
+    out_t key;
+    if (out_open_mem(&key, 64) < 0) return -1;
+    json_print_string(&key, col->name);
+    out_char(&key, ':');
+    col->key = malloc(key.len);
+    if (col->key && !key.error) {
+        memcpy(col->key, key.buf, key.len);
+        col->key_len = key.len;
+    }
+    int rc = col->key && !key.error ? 0 : -1;
+    out_close(&key);
+    return rc;
+}
+
+// Resolves a --columns list against the CREATE TABLE statement of table:
+// "a,b,c", "*" for the rowid and every column, or NULL to print whole
+// records. where holds the --where predicates. needed is set to the number
+// of leading record columns the query reads, so that callers can stop
+// decoding record headers there. Returns 0 on success, -1 with a message
+// on stderr otherwise.
+int query_prepare(query_t *query, const schema_entry_t *table,
+                  const char *columns, char *const *where, size_t where_count) {
+    table_columns_t cols;
+
+    memset(query, 0, sizeof(*query));
+    int parsed = schema_table_columns(table, &cols) == 0;
+    if (parsed && cols.without_rowid) {
+        // rows live in an index b-tree, keyed by the primary key
+        fprintf(stderr, "%s: WITHOUT ROWID tables are not supported\n",
+                table->name);
+        free_table_columns(&cols);
+        return -1;
+    }
+    if (!columns && where_count == 0) {
+        // whole records, the columns are not needed
+        if (parsed) free_table_columns(&cols);
+        query->needed = RECORD_MAX_COLUMNS;
+        return 0;
+    }
+    if (!parsed) {
+        fprintf(stderr, "cannot read the columns of %s\n", table->name);
+        return -1;
+    }
+
+    int rc = 0;
+    if (!columns) {
+        query->needed = RECORD_MAX_COLUMNS;
+    } else if (strcmp(columns, "*") == 0) {
+        rc = select_all(query, &cols);
+    } else {
+        rc = select_list(query, &cols, columns);
+    }
+    for (size_t i = 0; rc == 0 && i < query->select_count; i++) {
+        rc = make_json_key(&query->select[i]);
+    }
+
+    if (rc == 0 && where_count > 0) {
+        query->terms = calloc(where_count, sizeof(query_term_t));
+        rc = query->terms ? 0 : -1;
+    }
+    for (size_t i = 0; rc == 0 && i < where_count; i++) {
+        rc = parse_term(&cols, where[i], &query->terms[query->term_count++]);
+        note_needed(query, &query->terms[i].column);
+    }
+
+    free_table_columns(&cols);
+    if (rc < 0) {
+        free_query(query);
+    }
+    return rc;
+}
+
+// column col of rec, or its default for rows stored before it was added
+static int read_column(const query_column_t *col, const record_t *rec,
+                       record_value_t *value) {
+    if (col->source == QUERY_ROWID) {
+        memset(value, 0, sizeof(*value));
+        value->type = VALUE_INTEGER;
+        value->integer = rec->rowid;
+        return 0;
+    }
+    if ((size_t)col->source >= rec->column_count) {
+        *value = col->fallback;
+        return rec->truncated ? -1 : 0;
+    }
+    return record_column(rec, (size_t)col->source, value);
+}
+
+// Evaluates the predicates on the record as stored: values are compared
+// in place, text and blobs in the mapping without copying, and evaluation
+// stops at the first term that fails. Returns 1 if all terms hold.
+int query_match(const query_t *query, const record_t *rec) {
+    for (size_t i = 0; i < query->term_count; i++) {
+        const query_term_t *term = &query->terms[i];
+        size_t source = (size_t)term->column.source;
+        record_value_t value;
+        int c;
+
+        if (read_column(&term->column, rec, &value) < 0) {
+            return 0;
+        }
+        switch (term->op) {
+            case QUERY_IS_NULL:
+                if (value.type != VALUE_NULL) return 0;
+                continue;
+            case QUERY_NOT_NULL:
+                if (value.type == VALUE_NULL) return 0;
+                continue;
+            case QUERY_PREFIX:
+            case QUERY_PREFIX_NOCASE:
+                // SQLite stores a whole REAL as an integer, the text is "3.0"
+                if (term->column.affinity == AFFINITY_REAL &&
+                    value.type == VALUE_INTEGER) {
+                    value.type = VALUE_FLOAT;
+                    value.real = (double)value.integer;
+                }
+                if (record_value_prefix(rec, source, &value, term->value.data,
+                                        term->value.size,
+                                        term->op == QUERY_PREFIX_NOCASE) <= 0) {
+                    return 0;
+                }
+                continue;
+            default:
+                break;
+        }
+
+        // comparisons with NULL are never true
+        if (value.type == VALUE_NULL || term->value.type == VALUE_NULL ||
+            record_value_compare(rec, source, &value, &term->value, &c) < 0) {
+            return 0;
+        }
+        switch (term->op) {
+            case QUERY_EQ: if (c != 0) return 0; break;
+            case QUERY_NE: if (c == 0) return 0; break;
+            case QUERY_LT: if (c >= 0) return 0; break;
+            case QUERY_LE: if (c > 0) return 0; break;
+            case QUERY_GT: if (c <= 0) return 0; break;
+            default: if (c < 0) return 0; break;
+        }
+    }
+    return 1;
+}
+
+// blob as lowercase hex digits, read segment by segment
+static void print_hex(out_t *out, const record_t *rec, size_t i,
+                      const record_value_t *value) {
+    static const char hex[] = "0123456789abcdef";
+    payload_segment_t seg = { value->data, value->size };
+    payload_iter_t it;
+    char buf[256];
+
+    if (!value->data && record_value_segments(rec, i, &it) < 0) {
+        return;
+    }
+    while (value->data || payload_iter_next(&it, &seg) > 0) {
+        for (size_t k = 0; k < seg.size; k += sizeof(buf) / 2) {
+            size_t n = seg.size - k < sizeof(buf) / 2 ? seg.size - k : sizeof(buf) / 2;
+            for (size_t j = 0; j < n; j++) {
+                buf[2 * j] = hex[seg.data[k + j] >> 4];
+                buf[2 * j + 1] = hex[seg.data[k + j] & 15];
+            }
+            out_write(out, buf, 2 * n);
+        }
+        if (value->data) break;
+    }
+}
+
+// text as a CSV field; a value in overflow pages is quoted without
+// looking at it first
+static void print_csv_text(out_t *out, const record_t *rec, size_t i,
+                           const record_value_t *value) {
+    payload_iter_t it;
+    payload_segment_t seg;
+
+    if (value->data) {
+        csv_print_field(out, value->data, value->size);
+        return;
+    }
+    out_char(out, '"');
+    if (record_value_segments(rec, i, &it) == 0) {
+        while (payload_iter_next(&it, &seg) > 0) {
+            csv_quoted_body(out, seg.data, seg.size);
+        }
+    }
+    out_char(out, '"');
+}
+
+// One value of a CSV or NDJSON row. NULL is an empty CSV field, blobs are
+// hex digits (a JSON string in NDJSON).
+static void print_export_value(out_t *out, const record_t *rec, size_t i,
+                               const record_value_t *value, query_format_t format) {
+    switch (value->type) {
+        case VALUE_NULL:
+            if (format == QUERY_NDJSON) out_write(out, "null", 4);
+            break;
+        case VALUE_TEXT:
+            if (format == QUERY_CSV) {
+                print_csv_text(out, rec, i, value);
+            } else {
+                print_value(out, rec, i, value, 1);
+            }
+            break;
+        case VALUE_BLOB:
+            if (format == QUERY_NDJSON) out_char(out, '"');
+            print_hex(out, rec, i, value);
+            if (format == QUERY_NDJSON) out_char(out, '"');
+            break;
+        default:
+            print_value(out, rec, i, value, format == QUERY_NDJSON);
+            break;
+    }
+}
+
+// A row of the streaming exports: comma separated fields for CSV, one
+// object keyed by column name for NDJSON. Values that cannot be read are
+// left empty (null).
+static void print_export_row(out_t *out, const query_t *query, const record_t *rec,
+                             query_format_t format) {
+    int ndjson = format == QUERY_NDJSON;
+    if (ndjson) out_char(out, '{');
+    for (size_t i = 0; i < query->select_count; i++) {
+        const query_column_t *col = &query->select[i];
+        record_value_t value;
+
+        if (i > 0) out_char(out, ',');
+        if (ndjson) out_write(out, col->key, col->key_len);
+        if (read_column(col, rec, &value) < 0) {
+            value.type = VALUE_NULL;
+        }
+        print_export_value(out, rec, (size_t)col->source, &value, format);
+    }
+    if (ndjson) out_char(out, '}');
+    out_char(out, '\n');
+}
+
+// The CSV header line: the names of the selected columns.
+void print_csv_header(out_t *out, const query_t *query) {
+    for (size_t i = 0; i < query->select_count; i++) {
+        const char *name = query->select[i].name;
+        if (i > 0) out_char(out, ',');
+        csv_print_field(out, (const uint8_t *)name, strlen(name));
+    }
+    out_char(out, '\n');
+}
+
+// Prints a record in the given format. Text and JSON look like
+// print_record() and print_record_json(), with only the selected columns
+// when there is a --columns list; CSV and NDJSON print the selected
+// columns as one line.
+void print_record_query(out_t *out, const query_t *query, const record_t *rec,
+                        query_format_t format) {
+    int json = format == QUERY_JSON;
+    if (format == QUERY_CSV || format == QUERY_NDJSON) {
+        print_export_row(out, query, rec, format);
+        return;
+    }
+    if (query->select_count == 0) {
+        if (json) {
+            print_record_json(out, rec);
+        } else {
+            print_record(out, rec);
+        }
+        return;
+    }
+
+    out_str(out, json ? "{\"rowid\": " : "rowid: ");
+    out_i64(out, rec->rowid);
+    out_str(out, json ? ", \"values\": [" : " | ");
+    for (size_t i = 0; i < query->select_count; i++) {
+        const query_column_t *col = &query->select[i];
+        record_value_t value;
+
+        if (i > 0) out_str(out, ", ");
+        if (read_column(col, rec, &value) < 0) {
+            int unknown = (size_t)col->source < rec->column_count &&
+                (rec->serial_types[col->source] == SERIAL_TYPE_INTERNAL1 ||
+                 rec->serial_types[col->source] == SERIAL_TYPE_INTERNAL2);
+            out_str(out, json ? (unknown ? "\"(unknown)\"" : "\"(truncated)\"")
+                              : (unknown ? "(unknown)" : "(truncated)"));
+            continue;
+        }
+        print_value(out, rec, (size_t)col->source, &value, json);
+    }
+    out_str(out, json ? "]}" : "\n");
+}
+
+static void free_column(query_column_t *col) {
+    free(col->name);
+    free(col->key);
+    free(col->fallback_text);
+}
+
+void free_query(query_t *query) {
+    for (size_t i = 0; i < query->select_count; i++) {
+        free_column(&query->select[i]);
+    }
+    for (size_t i = 0; i < query->term_count; i++) {
+        free_column(&query->terms[i].column);
+        free(query->terms[i].text);
+    }
+    free(query->select);
+    free(query->terms);
+    memset(query, 0, sizeof(*query));
+}
@@ -2,182 +2,120 @@
 #include <stdlib.h>
 #include <string.h>
 #include "../include/schema.h"
-#include "../include/utils.h"
+#include "../include/btree.h"
+#include "../include/cell.h"
+#include "../include/parser.h"
 #include "../include/constants.h"
+#include "../include/stats.h"
 
-static size_t get_serial_content_size(uint64_t serial_type) {
-    if (serial_type >= 12) {
-        if (serial_type % 2 == 0) {
-            return (serial_type - 12) / 2;
-        } else {
-            return (serial_type - 13) / 2;
-        }
+static char* read_text_column(const record_t *rec, size_t i) {
+    record_value_t value;
+    if (record_column(rec, i, &value) < 0 || value.type != VALUE_TEXT) {
+        return NULL;
     }
     
-    switch (serial_type) {
-        case SERIAL_TYPE_NULL: return 0;
-        case SERIAL_TYPE_INT8: return 1;
-        case SERIAL_TYPE_INT16: return 2;
-        case SERIAL_TYPE_INT24: return 3;
-        case SERIAL_TYPE_INT32: return 4;
-        case SERIAL_TYPE_INT48: return 6;
-        case SERIAL_TYPE_INT64: return 8;
-        case SERIAL_TYPE_FLOAT64: return 8;
-        case SERIAL_TYPE_ZERO: return 0;
-        case SERIAL_TYPE_ONE: return 0;
-        default: return 0;
-    }
-}
-
-static int64_t read_int_value(uint8_t *data, size_t size) {
-    int64_t value = 0;
-    for (size_t i = 0; i < size; i++) {
-        value = (value << 8) | data[i];
-    }
+    char *str = malloc(value.size + 1);
+    if (!str) return NULL;
     
-    // sign extend for negative values
-    if (size < 8 && (data[0] & 0x80)) {
-        for (size_t i = size; i < 8; i++) {
-            value |= ((int64_t)0xFF << (i * 8));
-        }
+    // long CREATE statements spill into overflow pages
+    payload_iter_t it;
+    payload_segment_t seg;
+    size_t len = 0;
+    record_value_segments(rec, i, &it);
+    while (payload_iter_next(&it, &seg) > 0) {
+        memcpy(str + len, seg.data, seg.size);
+        len += seg.size;
     }
-    
-    return value;
-}
-
-static char* read_text_value(uint8_t *data, size_t size) {
-    char *str = malloc(size + 1);
-    if (!str) return NULL;
-    memcpy(str, data, size);
-    str[size] = '\0';
+    str[len] = '\0';
     return str;
 }
 
-static int parse_schema_cell(uint8_t *page_data, uint16_t cell_offset, 
-                             size_t page_size, schema_entry_t *entry) {
-    if (cell_offset >= page_size) {
-        return -1;
-    }
-    
-    uint8_t *cell = page_data + cell_offset;
-    size_t offset = 0;
-    size_t bytes_read;
-    size_t remaining = page_size - cell_offset;
-    
-    if (remaining < 1) return -1;
-    read_varint(cell + offset, &bytes_read, remaining - offset);
-    if (bytes_read == 0) return -1;
-    offset += bytes_read;
-    
-    if (remaining < offset + 1) return -1;
-    read_varint(cell + offset, &bytes_read, remaining - offset);
-    if (bytes_read == 0) return -1;
-    offset += bytes_read;
-    
-    if (remaining < offset + 1) return -1;
-    size_t header_start = offset;
-    uint64_t header_size = read_varint(cell + offset, &bytes_read, remaining - offset);
-    if (bytes_read == 0 || header_size > remaining - offset) return -1;
-    offset += bytes_read;
-    
+static int parse_schema_cell(database_t *db, uint8_t *page_data,
+                             uint16_t cell_offset, schema_entry_t *entry) {
     // schema has 5 columns: type, name, tbl_name, rootpage, sql
     uint64_t serial_types[5];
-    size_t col_count = 0;
+    size_t offsets[5];
+    record_scratch_t scratch = { serial_types, offsets, 5 };
+    record_t rec;
     
-    while (offset < header_start + header_size && col_count < 5) {
-        serial_types[col_count] = read_varint(cell + offset, &bytes_read, remaining - offset);
-        if (bytes_read == 0) break;
-        offset += bytes_read;
-        col_count++;
-    }
-    
-    if (col_count < 5) return -1;
-    
-    offset = header_start + header_size;
-    
-    size_t content_size = get_serial_content_size(serial_types[0]);
-    if (serial_types[0] >= 13 && serial_types[0] % 2 == 1) {
-        entry->type = read_text_value(cell + offset, content_size);
-    } else {
-        entry->type = NULL;
-    }
-    offset += content_size;
-    
-    // read name
-    content_size = get_serial_content_size(serial_types[1]);
-    if (serial_types[1] >= 13 && serial_types[1] % 2 == 1) {
-        entry->name = read_text_value(cell + offset, content_size);
-    } else {
-        entry->name = NULL;
+    if (cell_decode_table(db, page_data, cell_offset, &scratch, &rec) < 0 ||
+        rec.column_count < 5) {
+        return -1;
     }
-    offset += content_size;
     
-    // read tbl_name
-    content_size = get_serial_content_size(serial_types[2]);
-    if (serial_types[2] >= 13 && serial_types[2] % 2 == 1) {
-        entry->tbl_name = read_text_value(cell + offset, content_size);
-    } else {
-        entry->tbl_name = NULL;
-    }
-    offset += content_size;
+    entry->type = read_text_column(&rec, 0);
+    entry->name = read_text_column(&rec, 1);
+    entry->tbl_name = read_text_column(&rec, 2);
     
-    // read rootpage
-    content_size = get_serial_content_size(serial_types[3]);
-    if (serial_types[3] >= SERIAL_TYPE_INT8 && serial_types[3] <= SERIAL_TYPE_INT64) {
-        entry->rootpage = read_int_value(cell + offset, content_size);
-    } else if (serial_types[3] == SERIAL_TYPE_ZERO) {
-        entry->rootpage = 0;
-    } else if (serial_types[3] == SERIAL_TYPE_ONE) {
-        entry->rootpage = 1;
+    record_value_t rootpage;
+    if (record_column(&rec, 3, &rootpage) == 0 && rootpage.type == VALUE_INTEGER) {
+        entry->rootpage = rootpage.integer;
     } else {
         entry->rootpage = 0;
     }
-    offset += content_size;
     
-    // read sql 
-    content_size = get_serial_content_size(serial_types[4]);
-    if (serial_types[4] >= 13 && serial_types[4] % 2 == 1) {
-        entry->sql = read_text_value(cell + offset, content_size);
-    } else {
-        entry->sql = NULL;
-    }
+    entry->sql = read_text_column(&rec, 4);
+    return 0;
+}
+
+static int collect_schema_leaf(database_t *db, uint32_t page_num,
+                               btree_page_header_t *page, void *ctx) {
+    schema_t *schema = ctx;
+    uint8_t *page_data = db_page_data(db, page_num);
     
+    for (uint16_t i = 0; i < page->cell_count; i++) {
+        if (schema->count == schema->capacity) {
+            size_t new_capacity = schema->capacity ? schema->capacity * 2 : 16;
+            schema_entry_t *new_entries = realloc(schema->entries,
+                sizeof(schema_entry_t) * new_capacity);
+            if (!new_entries) return 1;
+            schema->entries = new_entries;
+            schema->capacity = new_capacity;
+        }
+        
+        schema_entry_t entry = {0};
+        if (parse_schema_cell(db, page_data, page_cell_pointer(page, i),
+                              &entry) == 0) {
+            schema->entries[schema->count++] = entry;
+        }
+    }
     return 0;
 }
 
+// sqlite_master is itself a table b-tree rooted at page 1; once it
+// outgrows one page the root becomes an interior page.
 schema_t* parse_schema(database_t *db) {
     if (!db || db->header.header_db_size == 0) {
         return NULL;
     }
     
-    btree_page_header_t *page = &db->page_headers[0];
-    
-    if (page->page_type != PAGE_TYPE_LEAF_TABLE) {
-        return NULL;
-    }
-    
-    schema_t *schema = malloc(sizeof(schema_t));
+    schema_t *schema = calloc(1, sizeof(schema_t));
     if (!schema) return NULL;
     
-    schema->capacity = page->cell_count;
-    schema->count = 0;
-    schema->entries = malloc(sizeof(schema_entry_t) * schema->capacity);
-    if (!schema->entries) {
-        free(schema);
+    STATS_BEGIN(start);
+    int rc = btree_walk_table(db, 1, collect_schema_leaf, schema);
+    STATS_END(STATS_PHASE_SCHEMA, start);
+    if (rc != 0) {
+        free_schema(schema);
         return NULL;
     }
     
-    uint8_t *page_data = (uint8_t *)db->file_data;
+    return schema;
+}
+
+// Returns the entry of the given type ("table", "index", ...) and name, or
+// NULL if there is none.
+schema_entry_t* schema_find(schema_t *schema, const char *type, const char *name) {
+    if (!schema) return NULL;
     
-    for (uint16_t i = 0; i < page->cell_count; i++) {
-        schema_entry_t entry = {0};
-        if (parse_schema_cell(page_data, page->cell_pointers[i], 
-                              db->header.page_size, &entry) == 0) {
-            schema->entries[schema->count++] = entry;
+    for (size_t i = 0; i < schema->count; i++) {
+        schema_entry_t *e = &schema->entries[i];
+        if (e->type && e->name && strcmp(e->type, type) == 0 &&
+            strcmp(e->name, name) == 0) {
+            return e;
         }
     }
-    
-    return schema;
+    return NULL;
 }
 
 void free_schema(schema_t *schema) {
@@ -193,17 +131,443 @@ void free_schema(schema_t *schema) {
     free(schema);
 }
 
-void print_schema(schema_t *schema) {
+void print_schema(out_t *out, schema_t *schema) {
     if (!schema) return;
     
-    printf("\n=== Database Schema ===\n");
+    out_str(out, "\n=== Database Schema ===\n");
     for (size_t i = 0; i < schema->count; i++) {
         schema_entry_t *e = &schema->entries[i];
-        printf("\n[%zu] %s: %s\n", i + 1, 
-               e->type ? e->type : "(null)",
-               e->name ? e->name : "(null)");
-        printf("    table: %s\n", e->tbl_name ? e->tbl_name : "(null)");
-        printf("    rootpage: %llu\n", (unsigned long long)e->rootpage);
-        printf("    sql: %s\n", e->sql ? e->sql : "(null)");
+        out_str(out, "\n[");
+        out_u64(out, i + 1);
+        out_str(out, "] ");
+        out_str(out, e->type ? e->type : "(null)");
+        out_str(out, ": ");
+        out_str(out, e->name ? e->name : "(null)");
+        out_str(out, "\n    table: ");
+        out_str(out, e->tbl_name ? e->tbl_name : "(null)");
+        out_str(out, "\n    rootpage: ");
+        out_u64(out, e->rootpage);
+        out_str(out, "\n    sql: ");
+        out_str(out, e->sql ? e->sql : "(null)");
+        out_char(out, '\n');
+    }
+}
+
+/*
+ * Column list of a CREATE TABLE statement.
+ *
+ * The statement is split into tokens (words, quoted names, string
+ * literals, single punctuation characters; comments and whitespace are
+ * skipped). Definitions are the comma-separated token runs inside the
+ * outermost parentheses. A definition starting with a table constraint
+ * keyword is not a column; anything else is a name, a declared type of
+ * any number of words and parenthesized sizes, then column constraints.
+ */
+
+typedef struct {
+    const char *start;
+    size_t len;
+    char kind;      // 'w' word, 'q' quoted name, 's' string literal, or the character
+} sql_token_t;
+
+static int is_word_char(unsigned char c) {
+    return c == '_' || c == '$' || c >= 0x80 || (c >= '0' && c <= '9') ||
+           (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// next token at *p, 0 at the end of the statement
+static int next_sql_token(const char **p, sql_token_t *tok) {
+    const char *s = *p;
+    for (;;) {
+        while (*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r' || *s == '\f') s++;
+        if (s[0] == '-' && s[1] == '-') {
+            while (*s && *s != '\n') s++;
+        } else if (s[0] == '/' && s[1] == '*') {
+            const char *end = strstr(s + 2, "*/");
+            s = end ? end + 2 : s + strlen(s);
+        } else {
+            break;
+        }
+    }
+    if (*s == '\0') {
+        return 0;
+    }
+    
+    tok->start = s;
+    if (*s == '"' || *s == '`' || *s == '[' || *s == '\'') {
+        char close = *s == '[' ? ']' : *s;
+        tok->kind = *s == '\'' ? 's' : 'q';
+        s++;
+        while (*s) {
+            if (*s == close) {
+                // a doubled quote is an escaped one
+                if (close != ']' && s[1] == close) {
+                    s += 2;
+                    continue;
+                }
+                s++;
+                break;
+            }
+            s++;
+        }
+    } else if ((*s >= '0' && *s <= '9') || (*s == '.' && s[1] >= '0' && s[1] <= '9')) {
+        // numeric literal, kept as one word: 2.5, .5, 1e-3, 0x1F
+        tok->kind = 'w';
+        while (is_word_char((unsigned char)*s) || *s == '.' ||
+               ((*s == '-' || *s == '+') && (s[-1] == 'e' || s[-1] == 'E'))) {
+            s++;
+        }
+    } else if (is_word_char((unsigned char)*s)) {
+        tok->kind = 'w';
+        while (is_word_char((unsigned char)*s)) s++;
+    } else {
+        tok->kind = *s++;
+    }
+    tok->len = (size_t)(s - tok->start);
+    *p = s;
+    return 1;
+}
+
+static int token_is(const sql_token_t *tok, const char *word) {
+    size_t len = strlen(word);
+    if (tok->kind != 'w' || tok->len != len) {
+        return 0;
+    }
+    for (size_t i = 0; i < len; i++) {
+        char c = tok->start[i];
+        if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+        if (c != word[i]) return 0;
+    }
+    return 1;
+}
+
+// name from a word or quoted token, with quotes removed
+static char* token_name(const sql_token_t *tok) {
+    char *name = malloc(tok->len + 1);
+    if (!name) return NULL;
+    
+    if (tok->kind != 'q' || tok->len < 2) {
+        memcpy(name, tok->start, tok->len);
+        name[tok->len] = '\0';
+        return name;
+    }
+    char close = tok->start[0] == '[' ? ']' : tok->start[0];
+    size_t n = 0;
+    for (size_t i = 1; i + 1 < tok->len; i++) {
+        name[n++] = tok->start[i];
+        if (tok->start[i] == close && close != ']') i++;
+    }
+    name[n] = '\0';
+    return name;
+}
+
+// SQL names compare case-insensitively, for ASCII letters only
+static int ascii_equal_nocase(const char *a, const char *b) {
+    for (; *a && *b; a++, b++) {
+        char ca = (*a >= 'a' && *a <= 'z') ? (char)(*a - ('a' - 'A')) : *a;
+        char cb = (*b >= 'a' && *b <= 'z') ? (char)(*b - ('a' - 'A')) : *b;
+        if (ca != cb) return 0;
+    }
+    return *a == *b;
+}
+
+static int is_column_constraint(const sql_token_t *tok) {
+    static const char *const words[] = {
+        "CONSTRAINT", "PRIMARY", "NOT", "NULL", "UNIQUE", "CHECK", "DEFAULT",
+        "COLLATE", "REFERENCES", "GENERATED", "AS",
+    };
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        if (token_is(tok, words[i])) return 1;
+    }
+    return 0;
+}
+
+static int is_table_constraint(const sql_token_t *tok) {
+    return token_is(tok, "CONSTRAINT") || token_is(tok, "PRIMARY") ||
+           token_is(tok, "UNIQUE") || token_is(tok, "CHECK") ||
+           token_is(tok, "FOREIGN");
+}
+
+// whether str contains word (upper case), ASCII letters folded
+static int contains_nocase(const char *str, const char *word) {
+    size_t len = strlen(word);
+    for (; *str; str++) {
+        size_t i = 0;
+        while (i < len) {
+            char c = str[i];
+            if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+            if (c != word[i]) break;
+            i++;
+        }
+        if (i == len) return 1;
+    }
+    return 0;
+}
+
+// Affinity of a declared type, by SQLite's rules: the first of INT,
+// CHAR/CLOB/TEXT, BLOB or no type, REAL/FLOA/DOUB that matches, otherwise
+// NUMERIC. The whole declared type is scanned, however long.
+column_affinity_t column_affinity(const char *decl_type) {
+    if (contains_nocase(decl_type, "INT")) return AFFINITY_INTEGER;
+    if (contains_nocase(decl_type, "CHAR") || contains_nocase(decl_type, "CLOB") ||
+        contains_nocase(decl_type, "TEXT")) {
+        return AFFINITY_TEXT;
+    }
+    if (decl_type[0] == '\0' || contains_nocase(decl_type, "BLOB")) {
+        return AFFINITY_BLOB;
+    }
+    if (contains_nocase(decl_type, "REAL") || contains_nocase(decl_type, "FLOA") ||
+        contains_nocase(decl_type, "DOUB")) {
+        return AFFINITY_REAL;
+    }
+    return AFFINITY_NUMERIC;
+}
+
+static int add_column(table_columns_t *cols, size_t *capacity, const char *sql,
+                      const sql_token_t *toks, size_t ntok) {
+    if (cols->count == *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 16;
+        table_column_t *columns = realloc(cols->columns,
+                                          sizeof(table_column_t) * new_capacity);
+        if (!columns) return -1;
+        cols->columns = columns;
+        *capacity = new_capacity;
+    }
+    
+    table_column_t *col = &cols->columns[cols->count];
+    memset(col, 0, sizeof(*col));
+    col->stored = 1;
+    col->name = token_name(&toks[0]);
+    
+    // the type runs up to the first constraint keyword outside parentheses
+    size_t i = 1;
+    int depth = 0;
+    while (i < ntok && (depth > 0 || !is_column_constraint(&toks[i]))) {
+        if (toks[i].kind == '(') depth++;
+        if (toks[i].kind == ')') depth--;
+        i++;
+    }
+    size_t type_len = 0;
+    const char *type_start = sql;
+    if (i > 1) {
+        type_start = toks[1].start;
+        type_len = (size_t)(toks[i - 1].start + toks[i - 1].len - type_start);
+    }
+    col->decl_type = malloc(type_len + 1);
+    if (!col->name || !col->decl_type) {
+        free(col->name);
+        free(col->decl_type);
+        return -1;
+    }
+    memcpy(col->decl_type, type_start, type_len);
+    col->decl_type[type_len] = '\0';
+    col->affinity = column_affinity(col->decl_type);
+    cols->count++;
+    
+    // constraints; words inside parentheses belong to expressions
+    // (CHECK(CAST(a AS TEXT) = a)) and are skipped
+    int integer_type = i == 2 && token_is(&toks[1], "INTEGER");
+    for (depth = 0; i < ntok; i++) {
+        if (toks[i].kind == '(') {
+            depth++;
+            continue;
+        }
+        if (toks[i].kind == ')') {
+            depth--;
+            continue;
+        }
+        if (depth > 0) {
+            continue;
+        }
+        if (token_is(&toks[i], "DEFAULT") && i + 1 < ntok && !col->default_value) {
+            // a literal, with an optional sign
+            size_t last = i + 1;
+            if ((toks[last].kind == '-' || toks[last].kind == '+') && last + 1 < ntok) {
+                last++;
+            }
+            size_t len = (size_t)(toks[last].start + toks[last].len - toks[i + 1].start);
+            col->default_value = malloc(len + 1);
+            if (!col->default_value) return -1;
+            memcpy(col->default_value, toks[i + 1].start, len);
+            col->default_value[len] = '\0';
+        } else if (token_is(&toks[i], "PRIMARY") && integer_type &&
+            !(i + 2 < ntok && token_is(&toks[i + 2], "DESC"))) {
+            col->rowid_alias = 1;
+        } else if (token_is(&toks[i], "AS") && i + 1 < ntok &&
+                   toks[i + 1].kind == '(') {
+            // generated column, [GENERATED ALWAYS] AS (expr): VIRTUAL
+            // unless declared STORED
+            col->stored = 0;
+        } else if (token_is(&toks[i], "STORED")) {
+            col->stored = 1;
+        } else if (token_is(&toks[i], "VIRTUAL")) {
+            col->stored = 0;
+        }
+    }
+    return 0;
+}
+
+// PRIMARY KEY (name) as a table constraint makes an INTEGER column the
+// rowid alias, as long as it names a single column
+static void apply_table_primary_key(table_columns_t *cols,
+                                    const sql_token_t *toks, size_t ntok) {
+    size_t i = 0;
+    while (i < ntok && !token_is(&toks[i], "PRIMARY")) i++;
+    if (i + 4 > ntok || toks[i + 2].kind != '(' ||
+        (toks[i + 4].kind != ')' &&
+         !(i + 5 < ntok && token_is(&toks[i + 4], "ASC") && toks[i + 5].kind == ')'))) {
+        return;
+    }
+    char *name = token_name(&toks[i + 3]);
+    if (!name) return;
+    for (size_t c = 0; c < cols->count; c++) {
+        if (ascii_equal_nocase(cols->columns[c].name, name) &&
+            ascii_equal_nocase(cols->columns[c].decl_type, "INTEGER")) {
+            cols->columns[c].rowid_alias = 1;
+        }
+    }
+    free(name);
+}
+
+// Parses the column definitions of a table's CREATE statement. Returns 0
+// on success, -1 if the entry has no usable CREATE TABLE (for example
+// CREATE TABLE ... AS SELECT) or on allocation failure.
+int schema_table_columns(const schema_entry_t *table, table_columns_t *cols) {
+    memset(cols, 0, sizeof(*cols));
+    if (!table || !table->sql) {
+        return -1;
+    }
+    
+    const char *p = table->sql;
+    sql_token_t tok;
+    while (next_sql_token(&p, &tok) && tok.kind != '(') {
+        if (token_is(&tok, "AS")) return -1;
+    }
+    if (tok.kind != '(') {
+        return -1;
+    }
+    
+    size_t capacity = 0;
+    size_t tok_capacity = 32;
+    sql_token_t *toks = malloc(sizeof(sql_token_t) * tok_capacity);
+    size_t ntok = 0;
+    int depth = 0;
+    int rc = 0;
+    if (!toks) return -1;
+    
+    for (;;) {
+        if (!next_sql_token(&p, &tok)) {
+            rc = -1;
+            break;
+        }
+        int end = depth == 0 && (tok.kind == ',' || tok.kind == ')');
+        if (end) {
+            if (ntok > 0 && is_table_constraint(&toks[0])) {
+                apply_table_primary_key(cols, toks, ntok);
+            } else if (ntok > 0 && add_column(cols, &capacity, table->sql,
+                                              toks, ntok) < 0) {
+                rc = -1;
+                break;
+            }
+            ntok = 0;
+            if (tok.kind == ')') break;
+            continue;
+        }
+        
+        if (tok.kind == '(') depth++;
+        if (tok.kind == ')') depth--;
+        if (ntok == tok_capacity) {
+            tok_capacity *= 2;
+            sql_token_t *grown = realloc(toks, sizeof(sql_token_t) * tok_capacity);
+            if (!grown) {
+                rc = -1;
+                break;
+            }
+            toks = grown;
+        }
+        toks[ntok++] = tok;
+    }
+    free(toks);
+    
+    // table options after the column list
+    while (rc == 0 && next_sql_token(&p, &tok)) {
+        if (token_is(&tok, "WITHOUT")) {
+            cols->without_rowid = 1;
+        }
+    }
+    if (rc < 0 || cols->count == 0) {
+        free_table_columns(cols);
+        return -1;
+    }
+    return 0;
+}
+
+// Position of the column called name (compared as SQLite does, ignoring
+// ASCII case) in cols, or -1 if there is none.
+long schema_find_column(const table_columns_t *cols, const char *name) {
+    for (size_t i = 0; i < cols->count; i++) {
+        if (ascii_equal_nocase(cols->columns[i].name, name)) {
+            return (long)i;
+        }
+    }
+    return -1;
+}
+
+// Value of an SQL literal such as a DEFAULT clause: a number with an
+// optional sign, a quoted string, TRUE/FALSE or NULL. The bytes of a
+// string are unquoted into *text, which the caller frees. Returns 0 on
+// success, 1 if sql is not such a literal (value is then NULL) and -1 on
+// allocation failure.
+int sql_literal_value(const char *sql, record_value_t *value, char **text) {
+    size_t len = strlen(sql);
+    char *end;
+
+    memset(value, 0, sizeof(*value));
+    value->type = VALUE_NULL;
+    *text = NULL;
+    if (len >= 2 && sql[0] == '\'' && sql[len - 1] == '\'') {
+        *text = malloc(len);
+        if (!*text) return -1;
+        size_t n = 0;
+        for (size_t i = 1; i + 1 < len; i++) {
+            (*text)[n++] = sql[i];
+            if (sql[i] == '\'') i++;
+        }
+        value->type = VALUE_TEXT;
+        value->data = (const uint8_t *)*text;
+        value->size = n;
+        return 0;
+    }
+    if (ascii_equal_nocase(sql, "TRUE") || ascii_equal_nocase(sql, "FALSE")) {
+        value->type = VALUE_INTEGER;
+        value->integer = sql[0] == 'T' || sql[0] == 't';
+        return 0;
+    }
+    if (ascii_equal_nocase(sql, "NULL")) {
+        return 0;
+    }
+    if (len == 0 || strspn(sql, "0123456789+-.eE") != len) {
+        return 1;
+    }
+    value->integer = strtoll(sql, &end, 10);
+    if (*end == '\0') {
+        value->type = VALUE_INTEGER;
+        return 0;
+    }
+    value->real = strtod(sql, &end);
+    if (*end == '\0') {
+        value->type = VALUE_FLOAT;
+        return 0;
+    }
+    return 1;
+}
+
+void free_table_columns(table_columns_t *cols) {
+    for (size_t i = 0; i < cols->count; i++) {
+        free(cols->columns[i].name);
+        free(cols->columns[i].decl_type);
+        free(cols->columns[i].default_value);
     }
+    free(cols->columns);
+    memset(cols, 0, sizeof(*cols));
 }
@@ -1,95 +1,412 @@
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
+#include <stdatomic.h>
 #include "../include/serializer.h"
 
-void json_print_text_chk(const uint8_t *data, size_t len) {
+/*
+ * JSON string escaping with UTF-8 validation.
+ *
+ * A scan function returns the length of the leading run of bytes that
+ * need no escape (anything but '"', '\\' and bytes below 0x20) and
+ * whether the run holds bytes >= 0x80. Runs that are pure ASCII are
+ * written with one memcpy; runs with high bytes are first checked for
+ * valid UTF-8, eight ASCII bytes at a time between multibyte sequences.
+ * Every byte of an invalid sequence becomes U+FFFD, so the output is
+ * always valid JSON. The SSE2 and AVX2 scans test 16 or 32 bytes per
+ * step.
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JSON_SCAN_X86 1
+#endif
+
+typedef size_t (*json_scan_fn)(const uint8_t *data, size_t len, int *high);
+
+static const char utf8_replacement[3] = { (char)0xef, (char)0xbf, (char)0xbd };
+
+static size_t json_scan_scalar(const uint8_t *data, size_t len, int *high) {
+    size_t i = 0;
+    uint8_t seen = 0;
+    while (i < len && data[i] >= 0x20 && data[i] != '"' && data[i] != '\\') {
+        seen |= data[i];
+        i++;
+    }
+    *high |= seen >> 7;
+    return i;
+}
+
+#ifdef JSON_SCAN_X86
+// bytes below 0x20 are found with a signed compare after flipping the top
+// bit, which SSE2 and AVX2 lack as an unsigned compare
+__attribute__((target("sse2")))
+static size_t json_scan_sse2(const uint8_t *data, size_t len, int *high) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i flip = _mm_set1_epi8((char)0x80);
+    const __m128i space = _mm_set1_epi8((char)(0x20 ^ 0x80));
+    __m128i seen = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+            _mm_cmplt_epi8(_mm_xor_si128(v, flip), space));
+        int mask = _mm_movemask_epi8(special);
+        if (mask) {
+            size_t stop = (size_t)__builtin_ctz((unsigned)mask);
+            int before = _mm_movemask_epi8(_mm_or_si128(seen, v)) & ((1 << stop) - 1);
+            *high |= _mm_movemask_epi8(seen) != 0 || before != 0;
+            return i + stop;
+        }
+        seen = _mm_or_si128(seen, v);
+    }
+    *high |= _mm_movemask_epi8(seen) != 0;
+    return i + json_scan_scalar(data + i, len - i, high);
+}
+
+__attribute__((target("avx2")))
+static size_t json_scan_avx2(const uint8_t *data, size_t len, int *high) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i flip = _mm256_set1_epi8((char)0x80);
+    const __m256i space = _mm256_set1_epi8((char)(0x20 ^ 0x80));
+    __m256i seen = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i special = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                            _mm256_cmpeq_epi8(v, backslash)),
+            _mm256_cmpgt_epi8(space, _mm256_xor_si256(v, flip)));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(special);
+        if (mask) {
+            unsigned stop = (unsigned)__builtin_ctz(mask);
+            unsigned before = (unsigned)_mm256_movemask_epi8(v) &
+                              (stop ? 0xffffffffu >> (32 - stop) : 0);
+            *high |= _mm256_movemask_epi8(seen) != 0 || before != 0;
+            return i + stop;
+        }
+        seen = _mm256_or_si256(seen, v);
+    }
+    *high |= _mm256_movemask_epi8(seen) != 0;
+    // the tail runs legacy SSE code: clear the upper halves first or
+    // every short string pays an AVX to SSE transition
+    _mm256_zeroupper();
+    return i + json_scan_sse2(data + i, len - i, high);
+}
+#endif
+
+static _Atomic(json_scan_fn) json_scan;
+
+static json_scan_fn json_scan_impl(int impl) {
+    switch (impl) {
+        case JSON_SCAN_SCALAR:
+            return json_scan_scalar;
+#ifdef JSON_SCAN_X86
+        case JSON_SCAN_SSE2:
+            return __builtin_cpu_supports("sse2") ? json_scan_sse2 : NULL;
+        case JSON_SCAN_AVX2:
+            return __builtin_cpu_supports("avx2") ? json_scan_avx2 : NULL;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+// Picks the scan used by the escaper; JSON_SCAN_AUTO takes the widest the
+// CPU supports. Returns 0, or -1 if the CPU cannot run the requested one.
+int json_set_scan(int impl) {
+    json_scan_fn fn = NULL;
+    if (impl == JSON_SCAN_AUTO) {
+        fn = json_scan_impl(JSON_SCAN_AVX2);
+        if (!fn) fn = json_scan_impl(JSON_SCAN_SSE2);
+        if (!fn) fn = json_scan_impl(JSON_SCAN_SCALAR);
+    } else {
+        fn = json_scan_impl(impl);
+    }
+    if (!fn) {
+        return -1;
+    }
+    atomic_store_explicit(&json_scan, fn, memory_order_relaxed);
+    return 0;
+}
+
+static json_scan_fn current_scan(void) {
+    json_scan_fn fn = atomic_load_explicit(&json_scan, memory_order_relaxed);
+    if (!fn) {
+        json_set_scan(JSON_SCAN_AUTO);
+        fn = atomic_load_explicit(&json_scan, memory_order_relaxed);
+    }
+    return fn;
+}
+
+// Length of the UTF-8 sequence starting at data: the full length if it is
+// valid, 0 if it is invalid, or -(bytes) if it is a valid prefix cut off
+// by the end of the buffer.
+static int utf8_sequence(const uint8_t *data, size_t len) {
+    uint8_t c = data[0];
+    int need;
+    uint8_t lo = 0x80, hi = 0xbf;   // range of the second byte
+
+    if (c >= 0xc2 && c <= 0xdf) {
+        need = 2;
+    } else if (c >= 0xe0 && c <= 0xef) {
+        need = 3;
+        if (c == 0xe0) lo = 0xa0;   // overlong
+        if (c == 0xed) hi = 0x9f;   // surrogates
+    } else if (c >= 0xf0 && c <= 0xf4) {
+        need = 4;
+        if (c == 0xf0) lo = 0x90;   // overlong
+        if (c == 0xf4) hi = 0x8f;   // above U+10FFFF
+    } else {
+        return 0;
+    }
+
+    for (int i = 1; i < need; i++) {
+        if ((size_t)i >= len) {
+            return -i;
+        }
+        uint8_t b = data[i];
+        if (i == 1 ? (b < lo || b > hi) : (b & 0xc0) != 0x80) {
+            return 0;
+        }
+    }
+    return need;
+}
+
+// Length of the valid UTF-8 prefix of a run without escapes. Stretches of
+// ASCII are skipped eight bytes at a time.
+static size_t utf8_valid_prefix(const uint8_t *data, size_t len, int *partial) {
+    size_t i = 0;
+
+    *partial = 0;
+    while (i < len) {
+        if (i + 8 <= len) {
+            uint64_t word;
+            memcpy(&word, data + i, 8);
+            if ((word & 0x8080808080808080ull) == 0) {
+                i += 8;
+                continue;
+            }
+        }
+        if (data[i] < 0x80) {
+            i++;
+            continue;
+        }
+        int n = utf8_sequence(data + i, len - i);
+        if (n <= 0) {
+            *partial = n < 0;
+            return i;
+        }
+        i += (size_t)n;
+    }
+    return i;
+}
+
+static void json_escape_byte(out_t *out, uint8_t c) {
+    static const char hex[] = "0123456789abcdef";
+
+    if (c == '"') out_write(out, "\\\"", 2);
+    else if (c == '\\') out_write(out, "\\\\", 2);
+    else if (c == '\b') out_write(out, "\\b", 2);
+    else if (c == '\f') out_write(out, "\\f", 2);
+    else if (c == '\n') out_write(out, "\\n", 2);
+    else if (c == '\r') out_write(out, "\\r", 2);
+    else if (c == '\t') out_write(out, "\\t", 2);
+    else {
+        char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+        out_write(out, esc, sizeof(esc));
+    }
+}
+
+// finish a sequence carried over from the previous piece; returns the
+// number of bytes of data it consumed
+static size_t json_resume_utf8(out_t *out, json_text_t *st,
+                               const uint8_t *data, size_t len) {
+    uint8_t seq[4];
+    size_t have = st->pending_len;
+    size_t take = 0;
+
+    memcpy(seq, st->pending, have);
+    while (have < 4 && take < len) {
+        seq[have++] = data[take++];
+        int n = utf8_sequence(seq, have);
+        if (n > 0) {
+            out_write(out, seq, (size_t)n);
+            st->pending_len = 0;
+            return take;
+        }
+        if (n == 0) {
+            // the carried lead byte is invalid; the new bytes are
+            // handled again as the start of the text
+            out_write(out, utf8_replacement, 3);
+            for (size_t i = 1; i < st->pending_len; i++) {
+                out_write(out, utf8_replacement, 3);
+            }
+            st->pending_len = 0;
+            return 0;
+        }
+    }
+    // still incomplete: keep everything for the next piece
+    memcpy(st->pending, seq, have);
+    st->pending_len = (uint8_t)have;
+    return take;
+}
+
+// Escapes bytes for the inside of a JSON string, copying clean runs in
+// bulk and validating UTF-8 on the same pass. A value may be printed in
+// several pieces through one json_text_t; a sequence split between pieces
+// is joined, and json_text_end() replaces one left incomplete.
+void json_text_body(out_t *out, json_text_t *st, const uint8_t *data, size_t len) {
+    json_scan_fn scan = current_scan();
+    size_t i = 0;
+
+    if (st->pending_len > 0) {
+        i = json_resume_utf8(out, st, data, len);
+    }
+
+    while (i < len) {
+        int high = 0;
+        size_t run = scan(data + i, len - i, &high);
+
+        if (high) {
+            int partial;
+            size_t valid = utf8_valid_prefix(data + i, run, &partial);
+            if (valid < run) {
+                out_write(out, data + i, valid);
+                i += valid;
+                if (partial && i + (run - valid) == len) {
+                    // sequence continues in the next piece
+                    memcpy(st->pending, data + i, run - valid);
+                    st->pending_len = (uint8_t)(run - valid);
+                    return;
+                }
+                out_write(out, utf8_replacement, 3);
+                i++;
+                continue;
+            }
+        }
+
+        out_write(out, data + i, run);
+        i += run;
+        if (i < len) {
+            json_escape_byte(out, data[i]);
+            i++;
+        }
+    }
+}
+
+// Ends a value printed with json_text_body(): an incomplete trailing
+// sequence becomes U+FFFD.
+void json_text_end(out_t *out, json_text_t *st) {
+    for (size_t i = 0; i < st->pending_len; i++) {
+        out_write(out, utf8_replacement, 3);
+    }
+    st->pending_len = 0;
+}
+
+// Escapes one complete value for the inside of a JSON string.
+void json_print_text_body(out_t *out, const uint8_t *data, size_t len) {
+    json_text_t st = {0};
+    json_text_body(out, &st, data, len);
+    json_text_end(out, &st);
+}
+
+void json_print_text_chk(out_t *out, const uint8_t *data, size_t len) {
     if (!data) {
-        printf("null");
+        out_str(out, "null");
         return;
     }
     
-    printf("\"");
-    for (size_t i = 0; i < len; i++) {
-        uint8_t c = data[i];
-        if (c == '"') printf("\\\"");
-        else if (c == '\\') printf("\\\\");
-        else if (c == '\b') printf("\\b");
-        else if (c == '\f') printf("\\f");
-        else if (c == '\n') printf("\\n");
-        else if (c == '\r') printf("\\r");
-        else if (c == '\t') printf("\\t");
-        else if (c < 32) printf("\\u%04x", c);
-        else printf("%c", c);
-    }
-    printf("\"");
-}
-
-void json_print_string(const char *str) {
+    out_char(out, '"');
+    json_print_text_body(out, data, len);
+    out_char(out, '"');
+}
+
+void json_print_string(out_t *out, const char *str) {
     if (!str) {
-        printf("null");
+        out_str(out, "null");
         return;
     }
-    json_print_text_chk((const uint8_t*)str, strlen(str));
-}
-
-void serialize_db_header(db_header_t *header) {
-    printf("\"header\": {\n");
-    printf("    \"page_size\": %u,\n", header->page_size);
-    printf("    \"file_format_write\": %u,\n", header->file_format_write);
-    printf("    \"file_format_read\": %u,\n", header->file_format_read);
-    printf("    \"reserved_space\": %u,\n", header->reserved_space);
-    printf("    \"max_embed_payload_frac\": %u,\n", header->max_embed_payload_frac);
-    printf("    \"min_embed_payload_frac\": %u,\n", header->min_embed_payload_frac);
-    printf("    \"leaf_payload_frac\": %u,\n", header->leaf_payload_frac);
-    printf("    \"file_change_counter\": %u,\n", header->file_change_counter);
-    printf("    \"header_db_size\": %u,\n", header->header_db_size);
-    printf("    \"first_freelist_trunk\": %u,\n", header->first_freelist_trunk);
-    printf("    \"total_freelist_pages\": %u,\n", header->total_freelist_trunk);
-    printf("    \"schema_cookie\": %u,\n", header->schema_cookie);
-    printf("    \"schema_format_number\": %u,\n", header->schema_format_number);
-    printf("    \"default_page_cache_size\": %u,\n", header->default_page_cache_size);
-    printf("    \"page_number_largest_root\": %u,\n", header->page_number_largest_root);
-    printf("    \"db_text_encoding\": %u,\n", header->db_text_encoding);
-    printf("    \"user_version\": %u,\n", header->user_version);
-    printf("    \"incremental_vacuum_mode\": %u,\n", header->incremental_version_mode);
-    printf("    \"application_id\": %u,\n", header->application_id);
-    printf("    \"version_valid_for\": %u,\n", header->version_valid_for);
-    printf("    \"sqlite_version_number\": %u\n", header->sqlite_version_number);
-    printf("  }"); // End header
-}
-
-void serialize_schema(schema_t *schema) {
-    printf("\"schema\": [");
+    json_print_text_chk(out, (const uint8_t*)str, strlen(str));
+}
+
+// one "    \"name\": value" line of an object; last omits the comma
+static void json_field(out_t *out, const char *indent, const char *name,
+                       uint64_t value, int last) {
+    out_str(out, indent);
+    out_char(out, '"');
+    out_str(out, name);
+    out_str(out, "\": ");
+    out_u64(out, value);
+    out_str(out, last ? "\n" : ",\n");
+}
+
+void serialize_db_header(out_t *out, db_header_t *header) {
+    const char *in = "    ";
+    out_str(out, "\"header\": {\n");
+    json_field(out, in, "page_size", header->page_size, 0);
+    json_field(out, in, "file_format_write", header->file_format_write, 0);
+    json_field(out, in, "file_format_read", header->file_format_read, 0);
+    json_field(out, in, "reserved_space", header->reserved_space, 0);
+    json_field(out, in, "max_embed_payload_frac", header->max_embed_payload_frac, 0);
+    json_field(out, in, "min_embed_payload_frac", header->min_embed_payload_frac, 0);
+    json_field(out, in, "leaf_payload_frac", header->leaf_payload_frac, 0);
+    json_field(out, in, "file_change_counter", header->file_change_counter, 0);
+    json_field(out, in, "header_db_size", header->header_db_size, 0);
+    json_field(out, in, "first_freelist_trunk", header->first_freelist_trunk, 0);
+    json_field(out, in, "total_freelist_pages", header->total_freelist_trunk, 0);
+    json_field(out, in, "schema_cookie", header->schema_cookie, 0);
+    json_field(out, in, "schema_format_number", header->schema_format_number, 0);
+    json_field(out, in, "default_page_cache_size", header->default_page_cache_size, 0);
+    json_field(out, in, "page_number_largest_root", header->page_number_largest_root, 0);
+    json_field(out, in, "db_text_encoding", header->db_text_encoding, 0);
+    json_field(out, in, "user_version", header->user_version, 0);
+    json_field(out, in, "incremental_vacuum_mode", header->incremental_version_mode, 0);
+    json_field(out, in, "application_id", header->application_id, 0);
+    json_field(out, in, "version_valid_for", header->version_valid_for, 0);
+    json_field(out, in, "sqlite_version_number", header->sqlite_version_number, 1);
+    out_str(out, "  }"); // End header
+}
+
+void serialize_schema(out_t *out, schema_t *schema) {
+    out_str(out, "\"schema\": [");
     if (schema) {
         for (size_t i = 0; i < schema->count; i++) {
-            if (i > 0) printf(",");
+            if (i > 0) out_char(out, ',');
             schema_entry_t *e = &schema->entries[i];
-            printf("\n    {");
-            printf("\"type\": "); json_print_string(e->type); printf(",");
-            printf("\"name\": "); json_print_string(e->name); printf(",");
-            printf("\"tbl_name\": "); json_print_string(e->tbl_name); printf(",");
-            printf("\"rootpage\": %llu,", (unsigned long long)e->rootpage);
-            printf("\"sql\": "); json_print_string(e->sql);
-            printf("}");
+            out_str(out, "\n    {");
+            out_str(out, "\"type\": "); json_print_string(out, e->type); out_char(out, ',');
+            out_str(out, "\"name\": "); json_print_string(out, e->name); out_char(out, ',');
+            out_str(out, "\"tbl_name\": "); json_print_string(out, e->tbl_name); out_char(out, ',');
+            out_str(out, "\"rootpage\": "); out_u64(out, (uint64_t)e->rootpage); out_char(out, ',');
+            out_str(out, "\"sql\": "); json_print_string(out, e->sql);
+            out_char(out, '}');
         }
     }
-    printf("\n  ]"); // End schema
+    out_str(out, "\n  ]"); // End schema
 }
 
-void serialize_page_header(btree_page_header_t *page, int page_num) {
-    printf("    {\n");
-    printf("      \"page_num\": %d,\n", page_num);
-    printf("      \"header\": {\n");
-    printf("        \"page_type\": %u,\n", page->page_type);
-    printf("        \"first_freeblock\": %u,\n", page->first_freeblock);
-    printf("        \"cell_count\": %u,\n", page->cell_count);
-    printf("        \"cell_content_start\": %u,\n", page->cell_content_start);
-    printf("        \"fragmented_free_bytes\": %u", page->fragmented_free_bytes);
+void serialize_page_header(out_t *out, btree_page_header_t *page, int page_num) {
+    const char *in = "        ";
+    out_str(out, "    {\n");
+    out_str(out, "      \"page_num\": "); out_i64(out, page_num); out_str(out, ",\n");
+    out_str(out, "      \"header\": {\n");
+    json_field(out, in, "page_type", page->page_type, 0);
+    json_field(out, in, "first_freeblock", page->first_freeblock, 0);
+    json_field(out, in, "cell_count", page->cell_count, 0);
+    json_field(out, in, "cell_content_start", page->cell_content_start, 0);
+    out_str(out, "        \"fragmented_free_bytes\": ");
+    out_u64(out, page->fragmented_free_bytes);
     if (page->page_type == 0x02 || page->page_type == 0x05) {
-        printf(",\n        \"rightmost_pointer\": %u", page->rightmost_pointer);
+        out_str(out, ",\n        \"rightmost_pointer\": ");
+        out_u64(out, page->rightmost_pointer);
     }
-    printf("\n      },\n");
-    printf("      \"cells\": [");
+    out_str(out, "\n      },\n");
+    out_str(out, "      \"cells\": [");
     // Cells array will be populated by caller
 }
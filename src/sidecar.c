@@ -0,0 +1,441 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../include/sidecar.h"
+#include "../include/btree.h"
+#include "../include/constants.h"
+#include "../include/output.h"
+#include "../include/parser.h"
+#include "../include/schema.h"
+#include "../include/wal.h"
+
+/*
+ * Page metadata sidecar (<db>.litereader-idx).
+ *
+ * The file holds the page directory arrays exactly as parser.c keeps them,
+ * the cell pointers of every b-tree page, and the leaf pages and row count
+ * of every table. It is written in host byte order and mapped privately,
+ * so opening it is a header check and a handful of pointer assignments;
+ * the directory arrays point straight into the mapping. The header records
+ * the state of the database it describes (change counter, schema cookie,
+ * size, mtime and any WAL) and a mismatch rebuilds the file.
+ */
+
+#define SIDECAR_MAGIC "LRIDX\0\0\0"
+#define SIDECAR_VERSION 1
+#define SIDECAR_BYTE_ORDER 0x01020304u
+#define NO_CELLS UINT64_MAX
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    // state of the database the file was built from
+    uint64_t file_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint32_t change_counter;
+    uint32_t schema_cookie;
+    uint32_t page_size;
+    uint32_t page_count;
+    uint32_t wal_frames;
+    uint32_t table_count;
+    uint8_t wal_salt[8];
+    // section sizes
+    uint64_t cell_total;
+    uint64_t leaf_total;
+} sidecar_header_t;
+
+// byte offsets of the sections, each 8-byte aligned
+typedef struct {
+    size_t page_types;
+    size_t frag_free_bytes;
+    size_t loaded;
+    size_t first_freeblocks;
+    size_t cell_counts;
+    size_t content_starts;
+    size_t rightmost_pointers;
+    size_t cell_offsets;
+    size_t cells;
+    size_t tables;
+    size_t leaves;
+    size_t total;
+} sidecar_layout_t;
+
+static size_t align8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+static void plan_layout(const sidecar_header_t *h, sidecar_layout_t *l) {
+    size_t n = h->page_count;
+    size_t at = align8(sizeof(sidecar_header_t));
+    l->page_types = at;          at = align8(at + n);
+    l->frag_free_bytes = at;     at = align8(at + n);
+    l->loaded = at;              at = align8(at + n);
+    l->first_freeblocks = at;    at = align8(at + sizeof(uint16_t) * n);
+    l->cell_counts = at;         at = align8(at + sizeof(uint16_t) * n);
+    l->content_starts = at;      at = align8(at + sizeof(uint16_t) * n);
+    l->rightmost_pointers = at;  at = align8(at + sizeof(uint32_t) * n);
+    l->cell_offsets = at;        at = align8(at + sizeof(uint64_t) * n);
+    l->cells = at;               at = align8(at + sizeof(uint16_t) * h->cell_total);
+    l->tables = at;              at = align8(at + sizeof(sidecar_table_t) * h->table_count);
+    l->leaves = at;              at = align8(at + sizeof(uint32_t) * h->leaf_total);
+    l->total = at;
+}
+
+static int is_btree(uint8_t page_type) {
+    return page_type == PAGE_TYPE_INTERIOR_INDEX ||
+           page_type == PAGE_TYPE_INTERIOR_TABLE ||
+           page_type == PAGE_TYPE_LEAF_INDEX ||
+           page_type == PAGE_TYPE_LEAF_TABLE;
+}
+
+// key fields of the header for the database as it is now
+static void fill_key(sidecar_header_t *h, const database_t *db,
+                     const struct stat *st) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, SIDECAR_MAGIC, 8);
+    h->version = SIDECAR_VERSION;
+    h->byte_order = SIDECAR_BYTE_ORDER;
+    h->file_size = (uint64_t)st->st_size;
+    h->mtime_sec = st->st_mtim.tv_sec;
+    h->mtime_nsec = st->st_mtim.tv_nsec;
+    h->change_counter = db->header.file_change_counter;
+    h->schema_cookie = db->header.schema_cookie;
+    h->page_size = db->header.page_size;
+    h->page_count = db->header.header_db_size;
+    h->wal_frames = db->wal.frames;
+    if (db->wal.frames > 0) {
+        memcpy(h->wal_salt, db->wal.header + 16, 8);
+    }
+}
+
+static char *sidecar_path(const char *db_path) {
+    size_t len = strlen(db_path);
+    char *path = malloc(len + sizeof(SIDECAR_SUFFIX));
+    if (path) {
+        memcpy(path, db_path, len);
+        memcpy(path + len, SIDECAR_SUFFIX, sizeof(SIDECAR_SUFFIX));
+    }
+    return path;
+}
+
+// Maps the sidecar at `path` and makes it the page directory of db if it
+// describes the database as it is now. Returns 1 if attached, 0 if the file
+// is missing or stale, -1 on error.
+static int load(database_t *db, const char *path, const sidecar_header_t *key) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(sidecar_header_t)) {
+        close(fd);
+        return 0;
+    }
+    sidecar_header_t h;
+    if (pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) ||
+        memcmp(&h, key, offsetof(sidecar_header_t, table_count)) != 0 ||
+        memcmp(h.wal_salt, key->wal_salt, 8) != 0) {
+        close(fd);
+        return 0;
+    }
+    sidecar_layout_t l;
+    plan_layout(&h, &l);
+    if (l.total != (size_t)st.st_size) {
+        close(fd);
+        return 0;
+    }
+
+    // writable copy-on-write, so pages decoded later can update their slot
+    uint8_t *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                        fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap sidecar");
+        return -1;
+    }
+
+    const sidecar_table_t *tables = (const sidecar_table_t *)(map + l.tables);
+    for (uint32_t i = 0; i < h.table_count; i++) {
+        if (tables[i].first_leaf > h.leaf_total ||
+            tables[i].leaf_count > h.leaf_total - tables[i].first_leaf) {
+            munmap(map, st.st_size);
+            return 0;
+        }
+    }
+
+    page_directory_t dir;
+    memset(&dir, 0, sizeof(dir));
+    dir.page_types = map + l.page_types;
+    dir.frag_free_bytes = map + l.frag_free_bytes;
+    dir.loaded = map + l.loaded;
+    dir.first_freeblocks = (uint16_t *)(map + l.first_freeblocks);
+    dir.cell_counts = (uint16_t *)(map + l.cell_counts);
+    dir.content_starts = (uint16_t *)(map + l.content_starts);
+    dir.rightmost_pointers = (uint32_t *)(map + l.rightmost_pointers);
+    if (db_adopt_directory(db, &dir) < 0) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    if (db->sidecar.map) {
+        munmap(db->sidecar.map, db->sidecar.size);
+    }
+    db->sidecar.map = map;
+    db->sidecar.size = st.st_size;
+    db->sidecar.cell_offsets = (const uint64_t *)(map + l.cell_offsets);
+    db->sidecar.cells = (const uint16_t *)(map + l.cells);
+    db->sidecar.cell_total = h.cell_total;
+    db->sidecar.tables = tables;
+    db->sidecar.table_count = h.table_count;
+    db->sidecar.leaves = (const uint32_t *)(map + l.leaves);
+    return 1;
+}
+
+typedef struct {
+    uint32_t *leaves;
+    size_t count;
+    size_t capacity;
+    uint64_t rows;
+} leaf_list_t;
+
+static int collect_leaf(database_t *db, uint32_t page_num,
+                        btree_page_header_t *page, void *ctx) {
+    (void)db;
+    leaf_list_t *list = ctx;
+    if (list->count == list->capacity) {
+        size_t cap = list->capacity ? list->capacity * 2 : 1024;
+        uint32_t *grown = realloc(list->leaves, sizeof(uint32_t) * cap);
+        if (!grown) {
+            return 1;
+        }
+        list->leaves = grown;
+        list->capacity = cap;
+    }
+    list->leaves[list->count++] = page_num;
+    list->rows += page->cell_count;
+    return 0;
+}
+
+static int compare_tables(const void *a, const void *b) {
+    uint32_t x = ((const sidecar_table_t *)a)->root_page;
+    uint32_t y = ((const sidecar_table_t *)b)->root_page;
+    return (x > y) - (x < y);
+}
+
+// Walks sqlite_master and every rowid table, recording their leaves.
+// Tables whose tree cannot be walked are left out.
+static int collect_tables(database_t *db, sidecar_table_t **tables,
+                          uint32_t *table_count, leaf_list_t *leaves) {
+    schema_t *schema = parse_schema(db);
+    size_t max = 1 + (schema ? schema->count : 0);
+    *tables = malloc(sizeof(sidecar_table_t) * max);
+    if (!*tables) {
+        free_schema(schema);
+        return -1;
+    }
+
+    uint32_t count = 0;
+    for (size_t i = 0; i < max; i++) {
+        uint32_t root = 1;
+        if (i > 0) {
+            const schema_entry_t *e = &schema->entries[i - 1];
+            if (strcmp(e->type, "table") != 0 || e->rootpage == 0 ||
+                e->rootpage > db->header.header_db_size) {
+                continue;
+            }
+            root = (uint32_t)e->rootpage;
+        }
+        btree_page_header_t page;
+        if (db_get_page(db, root, &page) < 0 ||
+            (page.page_type != PAGE_TYPE_LEAF_TABLE &&
+             page.page_type != PAGE_TYPE_INTERIOR_TABLE)) {
+            continue;   // WITHOUT ROWID tables are index b-trees
+        }
+
+        size_t first = leaves->count;
+        leaves->rows = 0;
+        if (btree_walk_table(db, root, collect_leaf, leaves) != 0) {
+            leaves->count = first;
+            continue;
+        }
+        (*tables)[count].root_page = root;
+        (*tables)[count].leaf_count = (uint32_t)(leaves->count - first);
+        (*tables)[count].first_leaf = first;
+        (*tables)[count].rows = leaves->rows;
+        count++;
+    }
+    free_schema(schema);
+
+    qsort(*tables, count, sizeof(sidecar_table_t), compare_tables);
+    *table_count = count;
+    return 0;
+}
+
+static void write_padding(out_t *out, size_t len) {
+    static const uint8_t zeros[8];
+    out_write(out, zeros, align8(len) - len);
+}
+
+// Decodes the whole directory and the table leaf lists and writes them to
+// `path`, through a temporary file renamed into place. Returns 0 on
+// success, -1 on error.
+static int build(database_t *db, const char *path, sidecar_header_t *h,
+                 int threads) {
+    // pages that fail to decode stay empty in the sidecar too
+    db_load_all_pages(db, threads);
+
+    sidecar_table_t *tables;
+    leaf_list_t leaves = {0};
+    if (collect_tables(db, &tables, &h->table_count, &leaves) < 0) {
+        return -1;
+    }
+    h->leaf_total = leaves.count;
+
+    page_directory_t *dir = &db->pages;
+    size_t n = h->page_count;
+    uint64_t *cell_offsets = malloc(sizeof(uint64_t) * (n ? n : 1));
+    uint8_t *loaded = malloc(n ? n : 1);
+    if (!cell_offsets || !loaded) {
+        free(cell_offsets);
+        free(loaded);
+        free(tables);
+        free(leaves.leaves);
+        return -1;
+    }
+    h->cell_total = 0;
+    for (size_t i = 0; i < n; i++) {
+        int valid = dir->loaded[i] == SLOT_LOADED || dir->loaded[i] == SLOT_CACHED;
+        loaded[i] = valid ? SLOT_CACHED : SLOT_EMPTY;
+        if (valid && is_btree(dir->page_types[i])) {
+            cell_offsets[i] = h->cell_total;
+            h->cell_total += dir->cell_counts[i];
+        } else {
+            cell_offsets[i] = NO_CELLS;
+        }
+    }
+
+    size_t len = strlen(path);
+    char *tmp = malloc(len + 32);
+    int fd = -1;
+    if (tmp) {
+        snprintf(tmp, len + 32, "%s.%ld.tmp", path, (long)getpid());
+        // O_EXCL: never write through a file or symlink already there;
+        // if the name is taken the sidecar is just not written
+        fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    }
+    out_t out;
+    int rc = -1;
+    if (fd >= 0 && out_open_fd(&out, fd) == 0) {
+        out_write(&out, h, sizeof(*h));
+        write_padding(&out, sizeof(*h));
+        out_write(&out, dir->page_types, n);
+        write_padding(&out, n);
+        out_write(&out, dir->frag_free_bytes, n);
+        write_padding(&out, n);
+        out_write(&out, loaded, n);
+        write_padding(&out, n);
+        out_write(&out, dir->first_freeblocks, sizeof(uint16_t) * n);
+        write_padding(&out, sizeof(uint16_t) * n);
+        out_write(&out, dir->cell_counts, sizeof(uint16_t) * n);
+        write_padding(&out, sizeof(uint16_t) * n);
+        out_write(&out, dir->content_starts, sizeof(uint16_t) * n);
+        write_padding(&out, sizeof(uint16_t) * n);
+        out_write(&out, dir->rightmost_pointers, sizeof(uint32_t) * n);
+        write_padding(&out, sizeof(uint32_t) * n);
+        out_write(&out, cell_offsets, sizeof(uint64_t) * n);
+        for (size_t i = 0; i < n; i++) {
+            if (cell_offsets[i] == NO_CELLS) {
+                continue;
+            }
+            btree_page_header_t page;
+            db_get_page(db, (uint32_t)i + 1, &page);
+            for (uint16_t j = 0; j < page.cell_count; j++) {
+                uint16_t offset = page_cell_pointer(&page, j);
+                out_write(&out, &offset, sizeof(offset));
+            }
+        }
+        write_padding(&out, sizeof(uint16_t) * h->cell_total);
+        out_write(&out, tables, sizeof(sidecar_table_t) * h->table_count);
+        write_padding(&out, sizeof(sidecar_table_t) * h->table_count);
+        out_write(&out, leaves.leaves, sizeof(uint32_t) * leaves.count);
+        write_padding(&out, sizeof(uint32_t) * leaves.count);
+        rc = out_flush(&out);
+        out_close(&out);
+    }
+    if (fd >= 0) {
+        if (close(fd) < 0 || (rc == 0 && rename(tmp, path) < 0)) {
+            rc = -1;
+        }
+        if (rc < 0) {
+            unlink(tmp);
+        }
+    }
+    if (rc < 0) {
+        fprintf(stderr, "Warning: cannot write %s\n", path);
+    }
+
+    free(tmp);
+    free(cell_offsets);
+    free(loaded);
+    free(tables);
+    free(leaves.leaves);
+    return rc;
+}
+
+// Attaches <db_path>.litereader-idx to db, rebuilding it first (with
+// `threads` decoding threads) if it is missing or was built from another
+// state of the database. Returns 1 if an up to date sidecar was mapped, 0
+// if it was rebuilt and mapped, -1 if none could be used; db works the same
+// in every case. Windowed mode keeps no directory, so it never uses one.
+int sidecar_attach(database_t *db, const char *db_path, int threads) {
+    struct stat st;
+    if (db->windowed || stat(db_path, &st) < 0) {
+        return -1;
+    }
+    char *path = sidecar_path(db_path);
+    if (!path) {
+        return -1;
+    }
+
+    sidecar_header_t key;
+    fill_key(&key, db, &st);
+    int rc = load(db, path, &key);
+    if (rc == 0) {
+        rc = build(db, path, &key, threads) == 0 && load(db, path, &key) == 1 ?
+             0 : -1;
+    }
+    free(path);
+    return rc;
+}
+
+// Leaf pages of the table rooted at root_page in key order, and its row
+// count, from the attached sidecar. NULL if there is none or it does not
+// cover the table.
+const uint32_t *sidecar_table_leaves(const database_t *db, uint32_t root_page,
+                                     size_t *count, uint64_t *rows) {
+    const sidecar_table_t *tables = db->sidecar.tables;
+    size_t lo = 0, hi = db->sidecar.table_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (tables[mid].root_page < root_page) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == db->sidecar.table_count || tables[lo].root_page != root_page) {
+        return NULL;
+    }
+    *count = tables[lo].leaf_count;
+    if (rows) {
+        *rows = tables[lo].rows;
+    }
+    return db->sidecar.leaves + tables[lo].first_leaf;
+}
@@ -0,0 +1,189 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include "../include/stats.h"
+
+/*
+ * --stats instrumentation, only built with -DLITEREADER_STATS.
+ *
+ * Counters and phase timers live in a thread-local block, so the hot
+ * paths add to them without atomics. A thread registers its block on
+ * first use and a thread-specific data destructor adds it to the process
+ * totals under a lock when the thread exits; the report sums the totals
+ * and the calling thread's block. Allocations are counted by wrapping
+ * malloc, calloc, realloc and aligned_alloc at link time (-Wl,--wrap),
+ * which sees the calls litereader's code makes but not those inside libc
+ * (strdup, stdio).
+ */
+
+#ifdef LITEREADER_STATS
+
+_Thread_local stats_block_t stats_local;
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+static stats_block_t totals;
+static uint64_t started;
+
+static void block_add(stats_block_t *dst, const stats_block_t *src) {
+    for (int i = 0; i < STATS_COUNTERS; i++) {
+        dst->counters[i] += src->counters[i];
+    }
+    for (int i = 0; i < STATS_PHASES; i++) {
+        dst->phase_ns[i] += src->phase_ns[i];
+    }
+}
+
+// runs in an exiting thread, its block still valid
+static void merge_block(void *block) {
+    pthread_mutex_lock(&totals_lock);
+    block_add(&totals, block);
+    pthread_mutex_unlock(&totals_lock);
+}
+
+static void create_key(void) {
+    pthread_key_create(&key, merge_block);
+}
+
+// Arranges for the calling thread's block to reach the totals when the
+// thread exits.
+void stats_register(void) {
+    stats_local.registered = 1;
+    pthread_once(&key_once, create_key);
+    pthread_setspecific(key, &stats_local);
+}
+
+uint64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Starts the wall clock of the report.
+void stats_start(void) {
+    started = stats_now();
+}
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__real_aligned_alloc(size_t alignment, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    stats_add(STATS_ALLOCS, 1);
+    stats_add(STATS_ALLOC_BYTES, size);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    stats_add(STATS_ALLOCS, 1);
+    stats_add(STATS_ALLOC_BYTES, count * size);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    stats_add(STATS_ALLOCS, 1);
+    stats_add(STATS_ALLOC_BYTES, size);
+    return __real_realloc(ptr, size);
+}
+
+void *__wrap_aligned_alloc(size_t alignment, size_t size) {
+    stats_add(STATS_ALLOCS, 1);
+    stats_add(STATS_ALLOC_BYTES, size);
+    return __real_aligned_alloc(alignment, size);
+}
+
+static const char *const phase_names[STATS_PHASES] = {
+    "mmap", "header", "schema", "decode", "output"
+};
+
+static const char *const page_names[] = {
+    "leaf_table", "interior_table", "leaf_index", "interior_index", "other"
+};
+
+static uint64_t timeval_ns(struct timeval tv) {
+    return (uint64_t)tv.tv_sec * 1000000000u + (uint64_t)tv.tv_usec * 1000u;
+}
+
+static void print_ms(out_t *out, const char *label, uint64_t ns) {
+    out_printf(out, "%-22s %.3f ms\n", label, (double)ns / 1e6);
+}
+
+// Writes the counters of every thread that has exited and of the calling
+// one, with the wall time since stats_start() and the process resource
+// usage (page faults, CPU time, peak RSS), as text or one JSON object.
+// Other threads must have been joined.
+void stats_report(out_t *out, int json) {
+    uint64_t wall = stats_now() - started;
+    stats_block_t sum = {0};
+    pthread_mutex_lock(&totals_lock);
+    block_add(&sum, &totals);
+    pthread_mutex_unlock(&totals_lock);
+    block_add(&sum, &stats_local);
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) < 0) {
+        memset(&ru, 0, sizeof(ru));
+    }
+    const uint64_t *c = sum.counters;
+    uint64_t pages = 0;
+    for (int i = STATS_PAGES_LEAF_TABLE; i <= STATS_PAGES_OTHER; i++) {
+        pages += c[i];
+    }
+
+    if (json) {
+        out_str(out, "{\"wall_ns\":");
+        out_u64(out, wall);
+        out_str(out, ",\"phases_ns\":{");
+        for (int i = 0; i < STATS_PHASES; i++) {
+            out_printf(out, "%s\"%s\":", i > 0 ? "," : "", phase_names[i]);
+            out_u64(out, sum.phase_ns[i]);
+        }
+        out_str(out, "},\"pages\":{");
+        for (int i = STATS_PAGES_LEAF_TABLE; i <= STATS_PAGES_OTHER; i++) {
+            out_printf(out, "%s\"%s\":", i > 0 ? "," : "", page_names[i]);
+            out_u64(out, c[i]);
+        }
+        out_str(out, "},\"cells\":"); out_u64(out, c[STATS_CELLS]);
+        out_str(out, ",\"varints\":"); out_u64(out, c[STATS_VARINTS]);
+        out_str(out, ",\"bytes_out\":"); out_u64(out, c[STATS_BYTES_OUT]);
+        out_str(out, ",\"allocations\":"); out_u64(out, c[STATS_ALLOCS]);
+        out_str(out, ",\"allocated_bytes\":"); out_u64(out, c[STATS_ALLOC_BYTES]);
+        out_str(out, ",\"minor_faults\":"); out_u64(out, (uint64_t)ru.ru_minflt);
+        out_str(out, ",\"major_faults\":"); out_u64(out, (uint64_t)ru.ru_majflt);
+        out_str(out, ",\"user_ns\":"); out_u64(out, timeval_ns(ru.ru_utime));
+        out_str(out, ",\"sys_ns\":"); out_u64(out, timeval_ns(ru.ru_stime));
+        out_str(out, ",\"max_rss_kb\":"); out_u64(out, (uint64_t)ru.ru_maxrss);
+        out_str(out, "}\n");
+        return;
+    }
+
+    out_str(out, "=== Stats ===\n");
+    print_ms(out, "Wall time:", wall);
+    for (int i = 0; i < STATS_PHASES; i++) {
+        char label[32];
+        snprintf(label, sizeof(label), "  %s:", phase_names[i]);
+        print_ms(out, label, sum.phase_ns[i]);
+    }
+    print_ms(out, "User CPU:", timeval_ns(ru.ru_utime));
+    print_ms(out, "System CPU:", timeval_ns(ru.ru_stime));
+    out_printf(out, "%-22s %llu\n", "Pages visited:", (unsigned long long)pages);
+    for (int i = STATS_PAGES_LEAF_TABLE; i <= STATS_PAGES_OTHER; i++) {
+        out_printf(out, "  %-20s %llu\n", page_names[i], (unsigned long long)c[i]);
+    }
+    out_printf(out, "%-22s %llu\n", "Cells decoded:", (unsigned long long)c[STATS_CELLS]);
+    out_printf(out, "%-22s %llu\n", "Varints read:", (unsigned long long)c[STATS_VARINTS]);
+    out_printf(out, "%-22s %llu\n", "Bytes emitted:", (unsigned long long)c[STATS_BYTES_OUT]);
+    out_printf(out, "%-22s %llu (%llu bytes)\n", "Allocations:",
+               (unsigned long long)c[STATS_ALLOCS],
+               (unsigned long long)c[STATS_ALLOC_BYTES]);
+    out_printf(out, "%-22s %ld minor, %ld major\n", "Page faults:",
+               ru.ru_minflt, ru.ru_majflt);
+    out_printf(out, "%-22s %ld KiB\n", "Max RSS:", ru.ru_maxrss);
+}
+
+#endif
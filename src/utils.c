@@ -1,16 +1,28 @@
+#include "../include/stats.h"
 #include "../include/utils.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 uint16_t read_be16(uint8_t *ptr) {
     return (ptr[0] << 8) | ptr[1];
 }
 
 uint32_t read_be32(uint8_t *ptr) {
-    return (ptr[0] << 24) | (ptr[1] << 16) | (ptr[2] << 8) | ptr[3];
+    return ((uint32_t)ptr[0] << 24) | (ptr[1] << 16) | (ptr[2] << 8) | ptr[3];
 }
 
 uint64_t read_varint(uint8_t *data, size_t *bytes_read, size_t max_len) {
     uint64_t result = 0;
     int limit = (max_len < 9) ? max_len : 9;
+    STATS_ADD(STATS_VARINTS, 1);
+
+    // most varints (serial types, small sizes) are a single byte
+    if (limit > 0 && data[0] < 0x80) {
+        *bytes_read = 1;
+        return data[0];
+    }
     
     for (int i = 0; i < limit; i++) {
         if (i == 8) {
@@ -33,3 +45,65 @@ uint64_t read_varint(uint8_t *data, size_t *bytes_read, size_t max_len) {
     *bytes_read = 9;
     return result;
 }
+
+// Decodes up to max consecutive varints from data[0..len) into values, as
+// found in a record header's serial type array. Returns the number decoded
+// and stores the bytes they took in *consumed. Like read_varint() reporting
+// bytes_read == 0, a varint cut off by len is not decoded: the batch stops
+// in front of it.
+//
+// Sixteen bytes at a time, the continuation bits are gathered into a mask
+// (SSE2 movemask); the run of single-byte varints in front of the first
+// set bit is widened in one go. One- and two-byte varints after it are
+// decoded without branching on the byte values, longer ones go through
+// read_varint().
+size_t read_varints(const uint8_t *data, size_t len, uint64_t *values,
+                    size_t max, size_t *consumed) {
+    size_t pos = 0;
+    size_t n = 0;
+
+    while (n < max && pos < len) {
+#if defined(__SSE2__)
+        if (len - pos >= 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(data + pos));
+            unsigned mask = (unsigned)_mm_movemask_epi8(v);
+            size_t run = mask ? (size_t)__builtin_ctz(mask) : 16;
+            if (run > max - n) {
+                run = max - n;
+            }
+            for (size_t k = 0; k < run; k++) {
+                values[n + k] = data[pos + k];
+            }
+            n += run;
+            pos += run;
+            STATS_ADD(STATS_VARINTS, run);
+            if (n == max || pos == len) {
+                break;
+            }
+        }
+#endif
+        if (len - pos >= 2) {
+            uint64_t b0 = data[pos];
+            uint64_t b1 = data[pos + 1];
+            if ((b0 & b1 & 0x80) == 0) {
+                uint64_t two = b0 >> 7;
+                uint64_t wide = ((b0 & 0x7f) << 7) | b1;
+                values[n++] = two ? wide : b0;
+                pos += 1 + two;
+                STATS_ADD(STATS_VARINTS, 1);
+                continue;
+            }
+        }
+
+        size_t bytes_read;
+        uint64_t value = read_varint((uint8_t *)data + pos, &bytes_read, len - pos);
+        if (bytes_read == 0) {
+            break;
+        }
+        values[n++] = value;
+        pos += bytes_read;
+    }
+
+    *consumed = pos;
+    return n;
+}
@@ -0,0 +1,286 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../include/wal.h"
+#include "../include/utils.h"
+
+/*
+ * Write-ahead log overlay.
+ *
+ * A -wal file is a 32-byte header followed by frames of a 24-byte frame
+ * header and one page image. A frame is valid when its salts match the
+ * header's and its checksum, chained from the previous frame, matches; a
+ * frame with a non-zero database size ends a transaction. The log is read
+ * in one pass that stops at the first invalid frame, and each transaction's
+ * frames are added to a hash index when its commit frame is reached, so
+ * later frames replace earlier images of the same page and a torn tail is
+ * never visible.
+ */
+
+#define WAL_MAGIC 0x377f0682u       // low bit set: big-endian checksums
+#define WAL_VERSION 3007000u
+
+#define OFFSET_WAL_MAGIC 0
+#define OFFSET_WAL_VERSION 4
+#define OFFSET_WAL_PAGE_SIZE 8
+#define OFFSET_WAL_SALT 16
+#define OFFSET_WAL_CHECKSUM 24
+
+#define OFFSET_FRAME_PAGE 0
+#define OFFSET_FRAME_DB_SIZE 4
+#define OFFSET_FRAME_SALT 8
+#define OFFSET_FRAME_CHECKSUM 16
+
+static inline uint32_t read_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// SQLite's WAL checksum over `len` bytes (a multiple of 8), continuing
+// from s[0], s[1]
+static void wal_checksum(const uint8_t *data, size_t len, int big_endian,
+                         uint32_t s[2]) {
+    uint32_t s0 = s[0], s1 = s[1];
+    if (big_endian) {
+        for (size_t i = 0; i < len; i += 8) {
+            s0 += read_be32((uint8_t *)data + i) + s1;
+            s1 += read_be32((uint8_t *)data + i + 4) + s0;
+        }
+    } else {
+        for (size_t i = 0; i < len; i += 8) {
+            s0 += read_le32(data + i) + s1;
+            s1 += read_le32(data + i + 4) + s0;
+        }
+    }
+    s[0] = s0;
+    s[1] = s1;
+}
+
+static uint8_t *frame_at(const wal_t *wal, uint32_t frame) {
+    return (uint8_t *)wal->data + WAL_HEADER_SIZE +
+           (size_t)frame * (WAL_FRAME_HEADER_SIZE + wal->page_size);
+}
+
+static void index_insert(wal_t *wal, uint32_t page_num, uint32_t frame) {
+    for (uint32_t h = wal_hash(page_num, wal->mask);; h = (h + 1) & wal->mask) {
+        wal_slot_t *slot = &wal->slots[h];
+        if (slot->page_num == 0 || slot->page_num == page_num) {
+            slot->page_num = page_num;
+            slot->frame = frame;
+            return;
+        }
+    }
+}
+
+// Sizes the index for every whole frame in the mapping, keeping it at
+// most half full so probes stay short. Returns -1 if out of memory.
+static int index_reserve(wal_t *wal, size_t max_frames) {
+    uint32_t slots = 16;
+    while (slots < 2 * max_frames) {
+        slots *= 2;
+    }
+    if (wal->slots && slots <= wal->mask + 1) {
+        return 0;
+    }
+
+    wal_slot_t *old = wal->slots;
+    uint32_t old_count = old ? wal->mask + 1 : 0;
+    wal->slots = calloc(slots, sizeof(wal_slot_t));
+    if (!wal->slots) {
+        wal->slots = old;
+        return -1;
+    }
+    wal->mask = slots - 1;
+    for (uint32_t i = 0; i < old_count; i++) {
+        if (old[i].page_num != 0) {
+            index_insert(wal, old[i].page_num, old[i].frame);
+        }
+    }
+    free(old);
+    return 0;
+}
+
+// Scans the frames after the last commit and indexes those that a valid
+// commit frame now ends. Returns -1 if out of memory.
+static int index_frames(wal_t *wal) {
+    const uint8_t *header = wal->header;
+    size_t frame_size = WAL_FRAME_HEADER_SIZE + (size_t)wal->page_size;
+    size_t max_frames = (wal->size - WAL_HEADER_SIZE) / frame_size;
+    if (max_frames > UINT32_MAX / 2) {
+        max_frames = UINT32_MAX / 2;
+    }
+    if (max_frames <= wal->frames) {
+        return 0;
+    }
+    if (index_reserve(wal, max_frames) < 0) {
+        return -1;
+    }
+
+    uint32_t s[2] = { wal->checksum[0], wal->checksum[1] };
+    for (uint32_t i = wal->frames; i < max_frames; i++) {
+        uint8_t *frame = frame_at(wal, i);
+        if (memcmp(frame + OFFSET_FRAME_SALT, header + OFFSET_WAL_SALT, 8) != 0) {
+            break;
+        }
+        wal_checksum(frame, 8, wal->big_endian, s);
+        wal_checksum(frame + WAL_FRAME_HEADER_SIZE, wal->page_size,
+                     wal->big_endian, s);
+        if (s[0] != read_be32(frame + OFFSET_FRAME_CHECKSUM) ||
+            s[1] != read_be32(frame + OFFSET_FRAME_CHECKSUM + 4) ||
+            read_be32(frame + OFFSET_FRAME_PAGE) == 0) {
+            break;
+        }
+
+        uint32_t db_size = read_be32(frame + OFFSET_FRAME_DB_SIZE);
+        if (db_size != 0) {
+            for (uint32_t j = wal->frames; j <= i; j++) {
+                index_insert(wal, wal_frame_page(wal, j), j);
+            }
+            wal->frames = i + 1;
+            wal->db_size = db_size;
+            wal->checksum[0] = s[0];
+            wal->checksum[1] = s[1];
+        }
+    }
+    return 0;
+}
+
+// Validates the header and indexes every committed frame. Returns 0 (also
+// when nothing is committed), -1 if out of memory.
+static int wal_index(wal_t *wal, uint32_t page_size) {
+    uint8_t *header = wal->header;
+    memcpy(header, wal->data, WAL_HEADER_SIZE);
+    uint32_t magic = read_be32(header + OFFSET_WAL_MAGIC);
+    wal->big_endian = magic & 1;
+
+    if ((magic & ~1u) != WAL_MAGIC ||
+        read_be32(header + OFFSET_WAL_VERSION) != WAL_VERSION) {
+        fprintf(stderr, "Warning: ignoring WAL with a bad header\n");
+        return 0;
+    }
+    wal_checksum(header, OFFSET_WAL_CHECKSUM, wal->big_endian, wal->checksum);
+    if (wal->checksum[0] != read_be32(header + OFFSET_WAL_CHECKSUM) ||
+        wal->checksum[1] != read_be32(header + OFFSET_WAL_CHECKSUM + 4)) {
+        fprintf(stderr, "Warning: ignoring WAL with a bad header checksum\n");
+        return 0;
+    }
+    if (read_be32(header + OFFSET_WAL_PAGE_SIZE) != page_size) {
+        fprintf(stderr, "Warning: ignoring WAL with a different page size\n");
+        return 0;
+    }
+
+    wal->page_size = page_size;
+    return index_frames(wal);
+}
+
+static int map_wal(const char *db_path, void **data, size_t *size) {
+    size_t len = strlen(db_path);
+    char *path = malloc(len + 5);
+    if (!path) {
+        return -1;
+    }
+    memcpy(path, db_path, len);
+    memcpy(path + len, "-wal", 5);
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            *data = NULL;
+            *size = 0;
+            return 0;
+        }
+        perror("open wal");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("fstat wal");
+        close(fd);
+        return -1;
+    }
+    *data = NULL;
+    *size = st.st_size;
+    if ((size_t)st.st_size < WAL_HEADER_SIZE) {
+        close(fd);
+        return 0;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap wal");
+        return -1;
+    }
+    *data = map;
+    return 0;
+}
+
+// Maps `<db_path>-wal` and indexes its committed frames. A missing, empty
+// or invalid log leaves `wal` empty. Returns 0 on success, -1 if the log
+// exists but cannot be read.
+int wal_open(wal_t *wal, const char *db_path, uint32_t page_size) {
+    memset(wal, 0, sizeof(*wal));
+    if (map_wal(db_path, &wal->data, &wal->size) < 0) {
+        return -1;
+    }
+    if (!wal->data) {
+        return 0;
+    }
+
+    if (wal_index(wal, page_size) < 0) {
+        wal_close(wal);
+        return -1;
+    }
+    if (wal->frames == 0) {
+        wal_close(wal);
+    }
+    return 0;
+}
+
+// Picks up transactions appended to the log since it was opened or last
+// extended. Frames [*first, wal->frames) are the newly committed ones.
+// Returns 0 on success, 1 if the log was restarted, truncated or removed
+// (the indexed frames may be gone; the database must be reopened), -1 on
+// error.
+int wal_extend(wal_t *wal, const char *db_path, uint32_t page_size,
+               uint32_t *first) {
+    *first = wal->frames;
+    if (!wal->data) {
+        // nothing was committed at open; index the log from the start
+        return wal_open(wal, db_path, page_size);
+    }
+
+    void *data;
+    size_t size;
+    if (map_wal(db_path, &data, &size) < 0) {
+        return -1;
+    }
+    // a restarted log has new salts; the old mapping already shows them,
+    // so compare with the copy taken when the log was indexed
+    if (!data || size < wal->size ||
+        memcmp(data, wal->header, WAL_HEADER_SIZE) != 0) {
+        if (data) {
+            munmap(data, size);
+        }
+        return 1;
+    }
+
+    munmap(wal->data, wal->size);
+    wal->data = data;
+    wal->size = size;
+    return index_frames(wal);
+}
+
+void wal_close(wal_t *wal) {
+    if (wal->data) {
+        munmap(wal->data, wal->size);
+    }
+    free(wal->slots);
+    memset(wal, 0, sizeof(*wal));
+}
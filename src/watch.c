@@ -0,0 +1,282 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../include/watch.h"
+#include "../include/constants.h"
+#include "../include/parser.h"
+#include "../include/pool.h"
+#include "../include/utils.h"
+#include "../include/wal.h"
+
+/*
+ * Watch mode: follow a database across writes without parsing it again.
+ *
+ * A poll reads the 100-byte header and stats the file and its -wal. If
+ * neither changed it returns; this is the common case and costs three
+ * system calls. When the log grew under the same salts, only the newly
+ * committed frames are indexed and only the pages they hold are checked.
+ * Any other change (a rollback-mode write, a checkpoint that restarted
+ * or removed the log, a replaced file) reopens the database and checks
+ * every page. A checked page counts as changed only if its content hash
+ * differs from the last pass, and only changed pages are decoded again.
+ */
+
+#define WATCH_HASH_CHUNK 1024
+
+// 64-bit hash of a page, four independent lanes of 8 bytes per step
+static uint64_t page_hash(const uint8_t *data, size_t len) {
+    const uint64_t k = 0x9E3779B97F4A7C15ull;
+    uint64_t h[4] = { k, k + 1, k + 2, k + 3 };
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        for (int j = 0; j < 4; j++) {
+            uint64_t v;
+            memcpy(&v, data + i + 8 * j, 8);
+            h[j] = (h[j] ^ v) * 0xff51afd7ed558ccdull;
+            h[j] ^= h[j] >> 29;
+        }
+    }
+    uint64_t r = len;
+    for (int j = 0; j < 4; j++) {
+        r = (r ^ h[j]) * 0xc4ceb9fe1a85ec53ull;
+        r ^= r >> 32;
+    }
+    for (; i < len; i++) {
+        r = (r ^ data[i]) * 0x100000001b3ull;
+    }
+    return r;
+}
+
+// current content hash of a page, 0 if it cannot be read
+static uint64_t hash_page(database_t *db, uint32_t page_num) {
+    const uint8_t *data = db_page_data(db, page_num);
+    return data ? page_hash(data, db->header.page_size) : 0;
+}
+
+static void hash_range(void *ctx, size_t begin, size_t end, int worker) {
+    (void)worker;
+    watch_t *w = ctx;
+    for (size_t i = begin; i < end; i++) {
+        w->hashes[i] = hash_page(w->db, (uint32_t)i + 1);
+    }
+}
+
+static int push_changed(watch_t *w, uint32_t page_num) {
+    if (w->changed_count == w->changed_cap) {
+        size_t cap = w->changed_cap ? w->changed_cap * 2 : 64;
+        uint32_t *grown = realloc(w->changed, sizeof(uint32_t) * cap);
+        if (!grown) {
+            return -1;
+        }
+        w->changed = grown;
+        w->changed_cap = cap;
+    }
+    w->changed[w->changed_count++] = page_num;
+    return 0;
+}
+
+static int compare_pages(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Resizes the hash array to the current page count; new pages get hash 0
+// so that they show up as changed.
+static int resize_hashes(watch_t *w) {
+    uint32_t count = w->db->header.header_db_size;
+    if (count != w->page_count) {
+        uint64_t *grown = realloc(w->hashes, sizeof(uint64_t) * (count ? count : 1));
+        if (!grown) {
+            return -1;
+        }
+        w->hashes = grown;
+        if (count > w->page_count) {
+            memset(w->hashes + w->page_count, 0,
+                   sizeof(uint64_t) * (count - w->page_count));
+        }
+        w->page_count = count;
+    }
+    return 0;
+}
+
+// Rehashes one page; records it and drops its cached header if it changed.
+static int check_page(watch_t *w, uint32_t page_num) {
+    if (page_num == 0 || page_num > w->page_count) {
+        return 0;
+    }
+    uint64_t h = hash_page(w->db, page_num);
+    if (h == w->hashes[page_num - 1]) {
+        return 0;
+    }
+    w->hashes[page_num - 1] = h;
+    db_forget_page(w->db, page_num);
+    return push_changed(w, page_num);
+}
+
+// Reopens the database and checks every page against the last pass.
+static int reload(watch_t *w) {
+    database_t *db = parse_database_ex(w->path, &w->opts);
+    if (!db) {
+        return -1;
+    }
+    free_database(w->db);
+    w->db = db;
+
+    uint64_t *old = w->hashes;
+    uint32_t old_count = w->page_count;
+    uint32_t count = db->header.header_db_size;
+    w->hashes = malloc(sizeof(uint64_t) * (count ? count : 1));
+    if (!w->hashes) {
+        w->hashes = old;
+        return -1;
+    }
+    w->page_count = count;
+    if (pool_run(count, WATCH_HASH_CHUNK, w->threads, hash_range, w) < 0) {
+        hash_range(w, 0, count, 0);
+    }
+    int rc = 0;
+    for (uint32_t i = 0; i < count && rc == 0; i++) {
+        if (i >= old_count || old[i] != w->hashes[i]) {
+            rc = push_changed(w, i + 1);
+        }
+    }
+    free(old);
+    return rc;
+}
+
+// Stats the file and its log and reads the file header. Returns 1 if the
+// file changed since the last call, 0 if not, -1 on error; sets
+// *log_changed for the log.
+static int probe(watch_t *w, int *log_changed) {
+    struct stat st, wst;
+    if (stat(w->path, &st) < 0) {
+        perror("watch");
+        return -1;
+    }
+    // a replaced file needs a new descriptor for the header reads
+    if (w->fd < 0 || st.st_ino != w->file_stat.st_ino) {
+        int fd = open(w->path, O_RDONLY);
+        if (fd < 0) {
+            perror("watch");
+            return -1;
+        }
+        if (w->fd >= 0) {
+            close(w->fd);
+        }
+        w->fd = fd;
+    }
+    uint8_t header[100];
+    if (pread(w->fd, header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        fprintf(stderr, "Error: cannot read the database header\n");
+        return -1;
+    }
+    int wal_exists = !w->opts.no_wal && stat(w->wal_path, &wst) == 0;
+    uint32_t counter = read_be32(header + OFFSET_FILE_CHANGE_COUNTER);
+
+    int changed = counter != w->change_counter ||
+                  st.st_ino != w->file_stat.st_ino ||
+                  st.st_size != w->file_stat.st_size ||
+                  st.st_mtim.tv_sec != w->file_stat.st_mtim.tv_sec ||
+                  st.st_mtim.tv_nsec != w->file_stat.st_mtim.tv_nsec;
+    *log_changed = wal_exists != w->wal_exists ||
+                   (wal_exists &&
+                    (wst.st_ino != w->wal_stat.st_ino ||
+                     wst.st_size != w->wal_stat.st_size ||
+                     wst.st_mtim.tv_sec != w->wal_stat.st_mtim.tv_sec ||
+                     wst.st_mtim.tv_nsec != w->wal_stat.st_mtim.tv_nsec));
+
+    w->change_counter = counter;
+    w->file_stat = st;
+    w->wal_exists = wal_exists;
+    if (wal_exists) {
+        w->wal_stat = wst;
+    }
+    return changed;
+}
+
+// Starts watching the database `db`, opened from `path` with `opts`; the
+// watch owns it from here on. Every page is hashed once, on `threads`
+// threads. Returns 0 on success, -1 on error (db is left to the caller).
+int watch_open(watch_t *w, const char *path, database_t *db,
+               const db_options_t *opts, int threads) {
+    memset(w, 0, sizeof(*w));
+    w->path = path;
+    w->opts = *opts;
+    w->threads = threads > 0 ? threads : 1;
+
+    size_t len = strlen(path);
+    w->wal_path = malloc(len + 5);
+    if (!w->wal_path) {
+        return -1;
+    }
+    memcpy(w->wal_path, path, len);
+    memcpy(w->wal_path + len, "-wal", 5);
+
+    w->fd = -1;
+    int log_changed;
+    w->db = db;
+    if (probe(w, &log_changed) < 0 || resize_hashes(w) < 0) {
+        if (w->fd >= 0) {
+            close(w->fd);
+        }
+        free(w->wal_path);
+        return -1;
+    }
+    if (pool_run(w->page_count, WATCH_HASH_CHUNK, w->threads, hash_range, w) < 0) {
+        hash_range(w, 0, w->page_count, 0);
+    }
+    return 0;
+}
+
+// Brings the watch up to date with the file. Returns 1 if pages changed
+// (the delta is in w->changed and w->old_page_count), 0 if nothing did,
+// -1 on error.
+int watch_poll(watch_t *w) {
+    w->changed_count = 0;
+    w->old_page_count = w->page_count;
+
+    int log_changed;
+    int changed = probe(w, &log_changed);
+    if (changed < 0) {
+        return -1;
+    }
+    if (!changed && !log_changed) {
+        return 0;
+    }
+
+    int rc = 1;
+    uint32_t first = 0;
+    if (!changed && w->wal_exists) {
+        rc = db_refresh_wal(w->db, w->path, &first);
+    }
+    if (rc == 0) {
+        // the log grew: only the pages of newly committed frames can differ
+        if (resize_hashes(w) < 0) {
+            return -1;
+        }
+        for (uint32_t i = first; i < w->db->wal.frames; i++) {
+            if (check_page(w, wal_frame_page(&w->db->wal, i)) < 0) {
+                return -1;
+            }
+        }
+        qsort(w->changed, w->changed_count, sizeof(uint32_t), compare_pages);
+    } else if (rc < 0 || reload(w) < 0) {
+        return -1;
+    }
+    return w->changed_count > 0 || w->page_count < w->old_page_count;
+}
+
+void watch_close(watch_t *w) {
+    free_database(w->db);
+    if (w->fd >= 0) {
+        close(w->fd);
+    }
+    free(w->hashes);
+    free(w->changed);
+    free(w->wal_path);
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+}
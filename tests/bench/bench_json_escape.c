@@ -0,0 +1,106 @@
+// JSON string escaping throughput, scalar scan against SSE2 and AVX2.
+//
+// usage: bench_json_escape [MiB]. Escapes generated text of three kinds
+// (plain ASCII, text with many escapes, mixed UTF-8) into a memory sink
+// with every scan the CPU supports and prints MB/s of input.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "../../include/output.h"
+#include "../../include/serializer.h"
+
+#define PIECE 4096
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t next_rand(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (uint32_t)*state;
+}
+
+// fills buf with words from `alphabet` (UTF-8 strings), one in `every`
+// replaced by a character that needs escaping
+static void fill(uint8_t *buf, size_t len, const char *const *alphabet,
+                 size_t count, unsigned every) {
+    static const char escapes[] = "\"\\\n\t";
+    uint64_t state = 0x2545f4914f6cdd1dull;
+    size_t i = 0;
+
+    while (i < len) {
+        uint32_t r = next_rand(&state);
+        if (every && r % every == 0) {
+            buf[i++] = (uint8_t)escapes[(r >> 8) % 4];
+            continue;
+        }
+        const char *s = alphabet[(r >> 8) % count];
+        while (*s && i < len) {
+            buf[i++] = (uint8_t)*s++;
+        }
+    }
+    // do not end inside a multibyte sequence
+    while (len > 0 && (buf[len - 1] & 0x80)) {
+        buf[--len] = ' ';
+    }
+}
+
+static void run(const char *name, const uint8_t *data, size_t len) {
+    static const char *const impl_names[] = { NULL, "scalar", "sse2", "avx2" };
+    out_t out;
+
+    printf("%-8s", name);
+    for (int impl = JSON_SCAN_SCALAR; impl <= JSON_SCAN_AVX2; impl++) {
+        if (json_set_scan(impl) < 0) {
+            printf("  %6s      n/a", impl_names[impl]);
+            continue;
+        }
+        out_open_mem(&out, len * 2);
+        double best = 0;
+        for (int rep = 0; rep < 5; rep++) {
+            out.len = 0;
+            double start = now_sec();
+            for (size_t off = 0; off < len; off += PIECE) {
+                size_t n = len - off < PIECE ? len - off : PIECE;
+                json_print_text_body(&out, data + off, n);
+            }
+            double mbs = len / (now_sec() - start) / 1e6;
+            if (mbs > best) best = mbs;
+        }
+        out_close(&out);
+        printf("  %6s %8.0f", impl_names[impl], best);
+    }
+    printf("  MB/s\n");
+}
+
+int main(int argc, char **argv) {
+    static const char *const ascii[] = {
+        "the ", "quick ", "brown ", "fox ", "jumps ", "over ", "lazy ", "dog. ",
+    };
+    static const char *const mixed[] = {
+        "caf\xc3\xa9 ", "\xe2\x82\xac", "price ", "\xe4\xb8\xad\xe6\x96\x87 ",
+        "\xf0\x9f\x98\x80", "text ", "na\xc3\xafve ", "ok ",
+    };
+    size_t len = (size_t)(argc > 1 ? atoi(argv[1]) : 64) << 20;
+    uint8_t *buf = malloc(len);
+    if (!buf || len == 0) {
+        fprintf(stderr, "usage: %s [MiB]\n", argv[0]);
+        return 1;
+    }
+
+    fill(buf, len, ascii, 8, 0);
+    run("ascii", buf, len);
+    fill(buf, len, ascii, 8, 16);
+    run("escapes", buf, len);
+    fill(buf, len, mixed, 8, 0);
+    run("utf8", buf, len);
+
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,102 @@
+// Point lookup latency by table size.
+//
+// usage: bench_lookup <file.db>... (each with a table `t` keyed 1..N, see
+// make_lookup_dbs.sh). For every file it times random lookup_rowid() calls
+// and prints the row count, the tree height and the mean time per lookup.
+// The time should grow with the height only, not with the row count.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "../../include/parser.h"
+#include "../../include/schema.h"
+#include "../../include/btree.h"
+#include "../../include/utils.h"
+#include "../../include/constants.h"
+
+#define LOOKUPS 200000
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// follows rightmost pointers to the last leaf: tree height and largest rowid
+static int tree_shape(database_t *db, uint32_t root, int *height, int64_t *max_rowid) {
+    uint32_t page_num = root;
+    btree_page_header_t page;
+
+    *height = 1;
+    while (db_get_page(db, page_num, &page) == 0 &&
+           page.page_type == PAGE_TYPE_INTERIOR_TABLE) {
+        page_num = page.rightmost_pointer;
+        (*height)++;
+    }
+    if (page.page_type != PAGE_TYPE_LEAF_TABLE || page.cell_count == 0) {
+        return -1;
+    }
+
+    uint8_t *data = db_page_data(db, page_num);
+    uint16_t offset = page_cell_pointer(&page, page.cell_count - 1);
+    size_t n;
+    read_varint(data + offset, &n, db->header.page_size - offset);
+    *max_rowid = (int64_t)read_varint(data + offset + n, &n,
+                                      db->header.page_size - offset - n);
+    return 0;
+}
+
+static int bench_file(const char *path) {
+    database_t *db = parse_database(path);
+    if (!db) {
+        return -1;
+    }
+    schema_t *schema = parse_schema(db);
+    schema_entry_t *table = schema_find(schema, "table", "t");
+    int height;
+    int64_t max_rowid;
+    if (!table || tree_shape(db, (uint32_t)table->rootpage, &height, &max_rowid) < 0) {
+        fprintf(stderr, "%s: no table t\n", path);
+        free_schema(schema);
+        free_database(db);
+        return -1;
+    }
+
+    uint64_t serial_types[RECORD_MAX_COLUMNS];
+    size_t offsets[RECORD_MAX_COLUMNS];
+    record_scratch_t scratch = { serial_types, offsets, RECORD_MAX_COLUMNS };
+    record_t rec;
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    long found = 0;
+
+    double start = now_ns();
+    for (int i = 0; i < LOOKUPS; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        int64_t rowid = 1 + (int64_t)(state % (uint64_t)max_rowid);
+        found += lookup_rowid(db, table, rowid, &scratch, &rec) == 1;
+    }
+    double elapsed = now_ns() - start;
+
+    printf("%12lld rows  height %d  %8.1f ns/lookup  (%ld/%d found)\n",
+           (long long)max_rowid, height, elapsed / LOOKUPS, found, LOOKUPS);
+
+    free_schema(schema);
+    free_database(db);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <file.db>...\n", argv[0]);
+        return 1;
+    }
+    int rc = 0;
+    for (int i = 1; i < argc; i++) {
+        if (bench_file(argv[i]) < 0) {
+            rc = 1;
+        }
+    }
+    return rc;
+}
@@ -0,0 +1,192 @@
+// Throughput benchmark over whole databases.
+//
+// usage: bench_suite <file.db>...
+//
+// Each file is measured in a child process of its own, so peak RSS is per
+// file. The phases are timed separately: mapping and parsing the header,
+// reading the schema, decoding every record of every table (all columns),
+// and rendering those records as text and as JSON into a memory sink. The
+// results go to stdout as one JSON document so that runs can be compared
+// with a script.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "../../include/parser.h"
+#include "../../include/schema.h"
+#include "../../include/btree.h"
+#include "../../include/cell.h"
+#include "../../include/output.h"
+
+typedef struct {
+    record_scratch_t scratch;
+    out_t out;
+    int mode;               // 0 decode only, 1 text, 2 JSON
+    uint64_t pages;
+    uint64_t rows;
+    uint64_t bytes;         // rendered output
+    uint64_t checksum;      // keeps decoding from being optimised away
+} bench_walk_t;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int bench_leaf(database_t *db, uint32_t page_num,
+                      btree_page_header_t *page, void *ctx) {
+    (void)page;
+    bench_walk_t *w = ctx;
+    cell_cursor_t cur;
+
+    if (cell_cursor_open(&cur, db, page_num, &w->scratch) < 0) {
+        return 0;
+    }
+    w->pages++;
+
+    int rc;
+    while ((rc = cell_cursor_next(&cur)) != 0) {
+        if (rc < 0) continue;
+        const record_t *rec = &cur.record;
+        w->rows++;
+        if (w->mode == 0) {
+            for (size_t i = 0; i < rec->column_count; i++) {
+                record_value_t v;
+                if (record_column(rec, i, &v) == 0) {
+                    w->checksum += v.type == VALUE_INTEGER ? (uint64_t)v.integer : v.size;
+                }
+            }
+        } else if (w->mode == 1) {
+            print_record(&w->out, rec);
+        } else {
+            print_record_json(&w->out, rec);
+            out_char(&w->out, '\n');
+        }
+    }
+
+    // count and drop what the page rendered so memory stays flat
+    w->bytes += w->out.len;
+    w->out.len = 0;
+    return 0;
+}
+
+// walks every table of the schema in the given mode, returns seconds
+static double walk_tables(database_t *db, schema_t *schema, bench_walk_t *w,
+                          int mode) {
+    w->mode = mode;
+    w->pages = w->rows = w->bytes = 0;
+    double start = now_sec();
+    for (size_t i = 0; i < schema->count; i++) {
+        schema_entry_t *e = &schema->entries[i];
+        if (strcmp(e->type, "table") == 0 && e->rootpage > 0) {
+            btree_walk_table(db, (uint32_t)e->rootpage, bench_leaf, w);
+        }
+    }
+    return now_sec() - start;
+}
+
+static double per_sec(double n, double sec) {
+    return sec > 0 ? n / sec : 0;
+}
+
+// measures one file and prints its JSON object; runs in the child
+static int bench_file(const char *path) {
+    static uint64_t serial_types[RECORD_MAX_COLUMNS];
+    static size_t offsets[RECORD_MAX_COLUMNS];
+    bench_walk_t w = { .scratch = { serial_types, offsets, RECORD_MAX_COLUMNS } };
+
+    double t0 = now_sec();
+    database_t *db = parse_database(path);
+    double t_header = now_sec() - t0;
+    if (!db) {
+        return -1;
+    }
+
+    t0 = now_sec();
+    schema_t *schema = parse_schema(db);
+    double t_schema = now_sec() - t0;
+    if (!schema || out_open_mem(&w.out, OUT_BUFFER_SIZE) < 0) {
+        free_database(db);
+        return -1;
+    }
+
+    double t_decode = walk_tables(db, schema, &w, 0);
+    uint64_t pages = w.pages;
+    uint64_t rows = w.rows;
+    double t_text = walk_tables(db, schema, &w, 1);
+    uint64_t text_bytes = w.bytes;
+    double t_json = walk_tables(db, schema, &w, 2);
+    uint64_t json_bytes = w.bytes;
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+
+    printf("    {\n");
+    printf("      \"file\": \"%s\",\n", path);
+    printf("      \"file_bytes\": %zu,\n", db->file_size);
+    printf("      \"page_size\": %u,\n", db->header.page_size);
+    printf("      \"pages\": %u,\n", db->header.header_db_size);
+    printf("      \"leaf_pages\": %llu,\n", (unsigned long long)pages);
+    printf("      \"rows\": %llu,\n", (unsigned long long)rows);
+    printf("      \"phases_ms\": {\"header\": %.3f, \"schema\": %.3f, "
+           "\"decode\": %.3f, \"output_text\": %.3f, \"output_json\": %.3f},\n",
+           t_header * 1e3, t_schema * 1e3, t_decode * 1e3, t_text * 1e3,
+           t_json * 1e3);
+    printf("      \"pages_per_s\": %.0f,\n", per_sec((double)pages, t_decode));
+    printf("      \"rows_per_s\": %.0f,\n", per_sec((double)rows, t_decode));
+    printf("      \"output_text_bytes\": %llu,\n", (unsigned long long)text_bytes);
+    printf("      \"output_text_mb_per_s\": %.1f,\n",
+           per_sec(text_bytes / 1e6, t_text));
+    printf("      \"output_json_bytes\": %llu,\n", (unsigned long long)json_bytes);
+    printf("      \"output_json_mb_per_s\": %.1f,\n",
+           per_sec(json_bytes / 1e6, t_json));
+    printf("      \"peak_rss_kb\": %ld,\n", ru.ru_maxrss);
+    printf("      \"checksum\": %llu\n", (unsigned long long)w.checksum);
+    printf("    }");
+
+    out_close(&w.out);
+    free_schema(schema);
+    free_database(db);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <file.db>...\n", argv[0]);
+        return 1;
+    }
+
+    int rc = 0;
+    int printed = 0;
+    printf("{\n  \"timestamp\": %lld,\n  \"results\": [\n", (long long)time(NULL));
+    for (int i = 1; i < argc; i++) {
+        if (printed) {
+            printf(",\n");
+        }
+        fflush(stdout);
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            int child_rc = bench_file(argv[i]);
+            fflush(stdout);
+            _exit(child_rc < 0 ? 1 : 0);
+        }
+        int status = 0;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+            !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "%s: benchmark failed\n", argv[i]);
+            // keep the document valid
+            printf("    {\"file\": \"%s\", \"error\": true}", argv[i]);
+            rc = 1;
+        }
+        printed = 1;
+    }
+    printf("\n  ]\n}\n");
+    return rc;
+}
@@ -0,0 +1,772 @@
+// Synthetic database generator for the benchmark suite.
+//
+// usage: gen_db <out.db> [options]
+//
+//   --rows N              rows to write (default 100000)
+//   --size N[KMG]         stop once the file reaches this size instead
+//   --page-size N         512 .. 65536, a power of two (default 4096)
+//   --columns SPEC        column types, e.g. "int,text*3,real,blob,null"
+//                         (default "int,text,real")
+//   --text-size MIN:MAX   length of text and blob values (default 8:64)
+//   --overflow PCT        percent of rows whose first text/blob value
+//                         spills into overflow pages (default 0)
+//   --overflow-size N     length of those values (default 4 pages)
+//   --leaf-rows N         at most N rows per leaf page
+//   --fanout N            at most N children per interior page (>= 3)
+//   --table NAME          table name (default "t")
+//   --seed N              random seed
+//
+// The file is written front to back in one pass, so it can grow to tens
+// of GB with memory bounded by one page plus the list of leaf pages. Leaf
+// pages and overflow chains are written as rows are produced, the interior
+// levels of the b-tree once all leaves exist, and page 1 (header and
+// sqlite_master) last. The result passes sqlite3's PRAGMA integrity_check.
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "../../include/constants.h"
+
+#define MAX_COLUMNS 2000
+#define TEXT_POOL_SIZE (1 << 20)
+
+typedef enum { COL_INT, COL_TEXT, COL_REAL, COL_BLOB, COL_NULL } col_type_t;
+
+typedef struct {
+    const char *path;
+    uint64_t rows;
+    uint64_t max_bytes;
+    uint32_t page_size;
+    col_type_t columns[MAX_COLUMNS];
+    size_t column_count;
+    size_t text_min;
+    size_t text_max;
+    unsigned overflow_pct;
+    size_t overflow_size;
+    uint32_t leaf_rows;
+    uint32_t fanout;
+    const char *table;
+    uint64_t seed;
+} gen_options_t;
+
+// child pointer of the level above: page number and largest rowid below it
+typedef struct {
+    uint32_t page;
+    int64_t max_rowid;
+} child_t;
+
+typedef struct {
+    child_t *items;
+    size_t count;
+    size_t capacity;
+} child_list_t;
+
+typedef struct {
+    FILE *fp;
+    uint32_t page_size;
+    uint32_t next_page;     // number the next written page gets
+    uint8_t *page;          // leaf page being filled
+    uint16_t cell_count;
+    size_t content_start;
+    size_t header_offset;   // 100 on page 1
+    uint8_t *payload;
+    size_t payload_cap;
+    uint64_t state;
+    char *text_pool;
+} gen_t;
+
+static uint64_t next_rand(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void put_be16(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void put_be32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static size_t varint_len(uint64_t v) {
+    size_t n = 1;
+    if (v > 0x00ffffffffffffffull) {
+        return 9;
+    }
+    while (v > 0x7f) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static size_t put_varint(uint8_t *p, uint64_t v) {
+    if (v > 0x00ffffffffffffffull) {
+        p[8] = (uint8_t)v;
+        v >>= 8;
+        for (int i = 7; i >= 0; i--) {
+            p[i] = (uint8_t)((v & 0x7f) | 0x80);
+            v >>= 7;
+        }
+        return 9;
+    }
+    size_t n = varint_len(v);
+    for (size_t i = n; i-- > 0;) {
+        p[i] = (uint8_t)((v & 0x7f) | (i == n - 1 ? 0 : 0x80));
+        v >>= 7;
+    }
+    return n;
+}
+
+static size_t usable(const gen_t *g) {
+    return g->page_size;
+}
+
+static int write_page(gen_t *g, const uint8_t *data) {
+    if (fwrite(data, g->page_size, 1, g->fp) != 1) {
+        perror("write");
+        return -1;
+    }
+    g->next_page++;
+    return 0;
+}
+
+// bytes of a payload kept in a table leaf cell, as in SQLite's btree.c
+static size_t local_payload(const gen_t *g, uint64_t payload_size) {
+    size_t u = usable(g);
+    size_t max_local = u - 35;
+    size_t min_local = (u - 12) * 32 / 255 - 23;
+    if (payload_size <= max_local) {
+        return payload_size;
+    }
+    size_t k = min_local + (payload_size - min_local) % (u - 4);
+    return k <= max_local ? k : min_local;
+}
+
+// writes the part of a payload past `local` as an overflow chain and
+// returns its first page
+static int write_overflow(gen_t *g, const uint8_t *data, size_t len,
+                          uint32_t *first) {
+    size_t per_page = usable(g) - 4;
+    uint8_t *buf = calloc(1, g->page_size);
+    if (!buf) {
+        return -1;
+    }
+    *first = g->next_page;
+    while (len > 0) {
+        size_t n = len < per_page ? len : per_page;
+        memset(buf, 0, g->page_size);
+        put_be32(buf, len > n ? g->next_page + 1 : 0);
+        memcpy(buf + 4, data, n);
+        if (write_page(g, buf) < 0) {
+            free(buf);
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    free(buf);
+    return 0;
+}
+
+static void leaf_reset(gen_t *g, size_t header_offset) {
+    memset(g->page, 0, g->page_size);
+    g->header_offset = header_offset;
+    g->cell_count = 0;
+    g->content_start = usable(g);
+}
+
+static void leaf_finish(gen_t *g) {
+    uint8_t *h = g->page + g->header_offset;
+    h[OFFSET_BTREE_PAGE_TYPE] = PAGE_TYPE_LEAF_TABLE;
+    put_be16(h + OFFSET_BTREE_CELL_COUNT, g->cell_count);
+    put_be16(h + OFFSET_BTREE_CELL_CONTENT_START,
+             g->content_start == 65536 ? 0 : (uint32_t)g->content_start);
+}
+
+// free bytes between the cell pointer array and the cell content
+static size_t leaf_free(const gen_t *g) {
+    size_t used = g->header_offset + 8 + 2 * (size_t)g->cell_count;
+    return g->content_start - used;
+}
+
+// Adds a row with payload g->payload[0..size) to the leaf being filled.
+// Returns 1 if it did not fit (the caller flushes the leaf and retries),
+// 0 on success, -1 on error. Any row fits an empty leaf other than page 1.
+static int leaf_add(gen_t *g, int64_t rowid, size_t size, uint32_t leaf_rows) {
+    size_t local = local_payload(g, size);
+    size_t cell_size = varint_len(size) + varint_len((uint64_t)rowid) + local +
+                       (local < size ? 4 : 0);
+    if (cell_size + 2 > leaf_free(g) ||
+        (leaf_rows && g->cell_count >= leaf_rows)) {
+        return 1;
+    }
+
+    uint32_t first = 0;
+    if (local < size && write_overflow(g, g->payload + local, size - local, &first) < 0) {
+        return -1;
+    }
+    g->content_start -= cell_size;
+    uint8_t *cell = g->page + g->content_start;
+    size_t off = put_varint(cell, size);
+    off += put_varint(cell + off, (uint64_t)rowid);
+    memcpy(cell + off, g->payload, local);
+    if (local < size) {
+        put_be32(cell + off + local, first);
+    }
+    put_be16(g->page + g->header_offset + 8 + 2 * (size_t)g->cell_count,
+             (uint32_t)g->content_start);
+    g->cell_count++;
+    return 0;
+}
+
+static int payload_reserve(gen_t *g, size_t size) {
+    if (size <= g->payload_cap) {
+        return 0;
+    }
+    size_t cap = g->payload_cap ? g->payload_cap : 4096;
+    while (cap < size) {
+        cap *= 2;
+    }
+    uint8_t *p = realloc(g->payload, cap);
+    if (!p) {
+        return -1;
+    }
+    g->payload = p;
+    g->payload_cap = cap;
+    return 0;
+}
+
+static uint64_t int_serial_type(int64_t v, size_t *size) {
+    static const size_t sizes[] = { 0, 1, 2, 3, 4, 6, 8 };
+    uint64_t type;
+    if (v == 0 || v == 1) {
+        *size = 0;
+        return v == 0 ? SERIAL_TYPE_ZERO : SERIAL_TYPE_ONE;
+    }
+    if (v >= -128 && v <= 127) type = 1;
+    else if (v >= -32768 && v <= 32767) type = 2;
+    else if (v >= -8388608 && v <= 8388607) type = 3;
+    else if (v >= INT32_MIN && v <= INT32_MAX) type = 4;
+    else if (v >= -140737488355328LL && v <= 140737488355327LL) type = 5;
+    else type = 6;
+    *size = sizes[type];
+    return type;
+}
+
+// size of a record header whose serial types take `types` bytes; the
+// leading size varint counts itself
+static size_t record_header_size(size_t types) {
+    size_t size = types + 1;
+    while (varint_len(size) != size - types) {
+        size = types + varint_len(size);
+    }
+    return size;
+}
+
+static void put_be_int(uint8_t *p, uint64_t v, size_t size) {
+    for (size_t i = size; i-- > 0;) {
+        p[i] = (uint8_t)v;
+        v >>= 8;
+    }
+}
+
+// Builds the record for one generated row in g->payload and returns its
+// size, 0 on allocation failure.
+static size_t build_record(gen_t *g, const gen_options_t *opt, int big) {
+    uint64_t types[MAX_COLUMNS];
+    int64_t ints[MAX_COLUMNS];
+    size_t sizes[MAX_COLUMNS];
+    size_t header = 0;
+    size_t body = 0;
+    int big_done = 0;
+
+    for (size_t i = 0; i < opt->column_count; i++) {
+        uint64_t r = next_rand(&g->state);
+        switch (opt->columns[i]) {
+        case COL_INT:
+            // spread values over all integer widths
+            ints[i] = (int64_t)(r >> (r & 63));
+            types[i] = int_serial_type(ints[i], &sizes[i]);
+            break;
+        case COL_REAL:
+            types[i] = SERIAL_TYPE_FLOAT64;
+            sizes[i] = 8;
+            break;
+        case COL_TEXT:
+        case COL_BLOB: {
+            size_t len = opt->text_min +
+                         (size_t)(r % (opt->text_max - opt->text_min + 1));
+            if (big && !big_done) {
+                len = opt->overflow_size;
+                big_done = 1;
+            }
+            sizes[i] = len;
+            types[i] = (opt->columns[i] == COL_TEXT ? 13 : 12) + 2 * (uint64_t)len;
+            break;
+        }
+        case COL_NULL:
+            types[i] = SERIAL_TYPE_NULL;
+            sizes[i] = 0;
+            break;
+        }
+        header += varint_len(types[i]);
+        body += sizes[i];
+    }
+
+    size_t header_size = record_header_size(header);
+    if (payload_reserve(g, header_size + body) < 0) {
+        return 0;
+    }
+
+    uint8_t *p = g->payload;
+    size_t off = put_varint(p, header_size);
+    for (size_t i = 0; i < opt->column_count; i++) {
+        off += put_varint(p + off, types[i]);
+    }
+    for (size_t i = 0; i < opt->column_count; i++) {
+        uint64_t r = next_rand(&g->state);
+        switch (opt->columns[i]) {
+        case COL_INT:
+            put_be_int(p + off, (uint64_t)ints[i], sizes[i]);
+            break;
+        case COL_REAL: {
+            double d = (double)(r >> 11) / 1024.0;
+            uint64_t bits;
+            memcpy(&bits, &d, 8);
+            put_be_int(p + off, bits, 8);
+            break;
+        }
+        case COL_TEXT:
+        case COL_BLOB: {
+            size_t done = 0;
+            while (done < sizes[i]) {
+                size_t start = (size_t)(r % (TEXT_POOL_SIZE / 2));
+                size_t n = sizes[i] - done;
+                if (n > TEXT_POOL_SIZE / 2) {
+                    n = TEXT_POOL_SIZE / 2;
+                }
+                memcpy(p + off + done, g->text_pool + start, n);
+                done += n;
+                r = next_rand(&g->state);
+            }
+            break;
+        }
+        case COL_NULL:
+            break;
+        }
+        off += sizes[i];
+    }
+    return off;
+}
+
+static int child_push(child_list_t *list, uint32_t page, int64_t max_rowid) {
+    if (list->count == list->capacity) {
+        size_t cap = list->capacity ? list->capacity * 2 : 1024;
+        child_t *items = realloc(list->items, cap * sizeof(child_t));
+        if (!items) {
+            return -1;
+        }
+        list->items = items;
+        list->capacity = cap;
+    }
+    list->items[list->count].page = page;
+    list->items[list->count].max_rowid = max_rowid;
+    list->count++;
+    return 0;
+}
+
+// Writes one level of interior pages over `level` and returns the level
+// above it in `parent`. Children are dealt out evenly so no page is left
+// with a single child.
+static int write_interior_level(gen_t *g, const child_list_t *level,
+                                uint32_t fanout, child_list_t *parent) {
+    size_t key_len = varint_len((uint64_t)level->items[level->count - 1].max_rowid);
+    size_t cap = (usable(g) - 12) / (4 + key_len + 2) + 1;
+    if (fanout && fanout < cap) {
+        cap = fanout;
+    }
+    size_t pages = (level->count + cap - 1) / cap;
+    uint8_t *buf = malloc(g->page_size);
+    if (!buf) {
+        return -1;
+    }
+
+    size_t next = 0;
+    for (size_t p = 0; p < pages; p++) {
+        size_t n = level->count / pages + (p < level->count % pages);
+        const child_t *kids = level->items + next;
+        size_t content = usable(g);
+
+        memset(buf, 0, g->page_size);
+        buf[OFFSET_BTREE_PAGE_TYPE] = PAGE_TYPE_INTERIOR_TABLE;
+        for (size_t i = 0; i + 1 < n; i++) {
+            uint8_t cell[13];
+            put_be32(cell, kids[i].page);
+            size_t len = 4 + put_varint(cell + 4, (uint64_t)kids[i].max_rowid);
+            content -= len;
+            memcpy(buf + content, cell, len);
+            put_be16(buf + 12 + 2 * i, (uint32_t)content);
+        }
+        put_be16(buf + OFFSET_BTREE_CELL_COUNT, (uint32_t)(n - 1));
+        put_be16(buf + OFFSET_BTREE_CELL_CONTENT_START,
+                 content == 65536 ? 0 : (uint32_t)content);
+        put_be32(buf + OFFSET_BTREE_RIGHTMOST_POINTER, kids[n - 1].page);
+
+        if (child_push(parent, g->next_page, kids[n - 1].max_rowid) < 0 ||
+            write_page(g, buf) < 0) {
+            free(buf);
+            return -1;
+        }
+        next += n;
+    }
+    free(buf);
+    return 0;
+}
+
+static const char *column_decl(col_type_t type) {
+    switch (type) {
+    case COL_INT: return " INTEGER";
+    case COL_TEXT: return " TEXT";
+    case COL_REAL: return " REAL";
+    case COL_BLOB: return " BLOB";
+    default: return "";
+    }
+}
+
+// record for the table's sqlite_master row, built in g->payload
+static size_t build_master_record(gen_t *g, const gen_options_t *opt,
+                                  uint32_t root, size_t pad) {
+    size_t sql_cap = 64 + strlen(opt->table) + opt->column_count * 20 + pad;
+    char *sql = malloc(sql_cap);
+    if (!sql) {
+        return 0;
+    }
+    size_t len = (size_t)snprintf(sql, sql_cap, "CREATE TABLE %s (", opt->table);
+    for (size_t i = 0; i < opt->column_count; i++) {
+        len += (size_t)snprintf(sql + len, sql_cap - len, "%sc%zu%s",
+                                i ? ", " : "", i, column_decl(opt->columns[i]));
+    }
+    len += (size_t)snprintf(sql + len, sql_cap - len, ")");
+    memset(sql + len, ' ', pad);
+    len += pad;
+
+    const char *texts[4] = { "table", opt->table, opt->table, sql };
+    size_t lens[4] = { 5, strlen(opt->table), strlen(opt->table), len };
+    size_t root_size;
+    uint64_t root_type = int_serial_type(root, &root_size);
+    uint64_t types[5] = { 13 + 2 * lens[0], 13 + 2 * lens[1], 13 + 2 * lens[2],
+                          root_type, 13 + 2 * lens[3] };
+    size_t header = 0;
+    for (int i = 0; i < 5; i++) {
+        header += varint_len(types[i]);
+    }
+    size_t header_size = record_header_size(header);
+    size_t total = header_size + lens[0] + lens[1] + lens[2] + root_size + lens[3];
+    if (payload_reserve(g, total) < 0) {
+        free(sql);
+        return 0;
+    }
+
+    uint8_t *p = g->payload;
+    size_t off = put_varint(p, header_size);
+    for (int i = 0; i < 5; i++) {
+        off += put_varint(p + off, types[i]);
+    }
+    for (int i = 0; i < 3; i++) {
+        memcpy(p + off, texts[i], lens[i]);
+        off += lens[i];
+    }
+    put_be_int(p + off, root, root_size);
+    off += root_size;
+    memcpy(p + off, sql, len);
+    off += len;
+    free(sql);
+    return off;
+}
+
+static void write_db_header(uint8_t *h, uint32_t page_size, uint32_t pages) {
+    memcpy(h + OFFSET_MAGIC, "SQLite format 3", 16);
+    put_be16(h + OFFSET_PAGE_SIZE, page_size == 65536 ? 1 : page_size);
+    h[OFFSET_FILE_FORMAT_WRITE_VERSION] = 1;
+    h[OFFSET_FILE_FORMAT_READ] = 1;
+    h[OFFSET_MAX_EMBED_PAYLOAD_FRAC] = 64;
+    h[OFFSET_MIN_EMBED_PAYLOAD_FRAC] = 32;
+    h[OFFSET_LEAF_PAYLOAD_FRAC] = 32;
+    put_be32(h + OFFSET_FILE_CHANGE_COUNTER, 1);
+    put_be32(h + OFFSET_HEADER_DB_SIZE, pages);
+    put_be32(h + OFFSET_SCHEMA_COOKIE, 1);
+    put_be32(h + OFFSET_SCHEMA_FORMAT_NUMBER, 4);
+    put_be32(h + OFFSET_DB_TEXT_ENCODING, 1);
+    put_be32(h + OFFSET_VERSION_VALID_FOR, 1);
+    put_be32(h + OFFSET_SQLITE_VERSION_NUMBER, 3045000);
+}
+
+static int generate(const gen_options_t *opt) {
+    gen_t g = { .page_size = opt->page_size, .next_page = 1,
+                .state = opt->seed ? opt->seed : 0x2545f4914f6cdd1dull };
+    child_list_t level = { 0 };
+    child_list_t parent = { 0 };
+    int rc = -1;
+    int has_text = 0;
+
+    for (size_t i = 0; i < opt->column_count; i++) {
+        has_text |= opt->columns[i] == COL_TEXT || opt->columns[i] == COL_BLOB;
+    }
+    if (opt->overflow_pct && !has_text) {
+        fprintf(stderr, "gen_db: --overflow needs a text or blob column\n");
+        return -1;
+    }
+
+    g.fp = fopen(opt->path, "wb");
+    g.page = malloc(g.page_size);
+    g.text_pool = malloc(TEXT_POOL_SIZE);
+    if (!g.fp || !g.page || !g.text_pool) {
+        perror(opt->path);
+        goto done;
+    }
+    setvbuf(g.fp, NULL, _IOFBF, 1 << 20);
+    for (size_t i = 0; i < TEXT_POOL_SIZE; i++) {
+        uint64_t r = next_rand(&g.state);
+        g.text_pool[i] = r % 6 == 0 ? ' ' : (char)('a' + r % 26);
+    }
+
+    // page 1 is rewritten at the end
+    memset(g.page, 0, g.page_size);
+    if (write_page(&g, g.page) < 0) {
+        goto done;
+    }
+
+    leaf_reset(&g, 0);
+    int64_t rowid = 0;
+    uint64_t limit = opt->max_bytes ? UINT64_MAX : opt->rows;
+    while ((uint64_t)rowid < limit) {
+        if (opt->max_bytes &&
+            (uint64_t)g.next_page * g.page_size >= opt->max_bytes) {
+            break;
+        }
+        int big = opt->overflow_pct &&
+                  next_rand(&g.state) % 100 < opt->overflow_pct;
+        size_t size = build_record(&g, opt, big);
+        if (size == 0) {
+            perror("gen_db");
+            goto done;
+        }
+        rowid++;
+        int added = leaf_add(&g, rowid, size, opt->leaf_rows);
+        if (added == 1) {
+            leaf_finish(&g);
+            if (child_push(&level, g.next_page, rowid - 1) < 0 ||
+                write_page(&g, g.page) < 0) {
+                goto done;
+            }
+            leaf_reset(&g, 0);
+            added = leaf_add(&g, rowid, size, opt->leaf_rows);
+        }
+        if (added != 0) {
+            goto done;
+        }
+    }
+    leaf_finish(&g);
+    if (child_push(&level, g.next_page, rowid) < 0 || write_page(&g, g.page) < 0) {
+        goto done;
+    }
+
+    int depth = 1;
+    while (level.count > 1) {
+        parent.count = 0;
+        if (write_interior_level(&g, &level, opt->fanout, &parent) < 0) {
+            goto done;
+        }
+        child_list_t t = level;
+        level = parent;
+        parent = t;
+        depth++;
+    }
+    uint32_t root = level.items[0].page;
+
+    // page 1: header and sqlite_master, whose overflow (a long CREATE
+    // TABLE) goes after the table. Page 1 has 100 bytes less room, so a
+    // statement whose local part would not fit is padded with spaces
+    // until the split between cell and overflow pages changes.
+    int added = 1;
+    for (size_t pad = 0; added == 1 && pad <= g.page_size; pad++) {
+        size_t size = build_master_record(&g, opt, root, pad);
+        if (size == 0) {
+            perror("gen_db");
+            goto done;
+        }
+        leaf_reset(&g, 100);
+        added = leaf_add(&g, 1, size, 0);
+    }
+    if (added != 0) {
+        goto done;
+    }
+    leaf_finish(&g);
+    write_db_header(g.page, g.page_size, g.next_page - 1);
+    if (fflush(g.fp) != 0 || fseeko(g.fp, 0, SEEK_SET) != 0 ||
+        fwrite(g.page, g.page_size, 1, g.fp) != 1) {
+        perror(opt->path);
+        goto done;
+    }
+
+    fprintf(stderr, "%s: %lld rows, %u pages of %u bytes, depth %d\n",
+            opt->path, (long long)rowid, g.next_page - 1, g.page_size, depth);
+    rc = 0;
+
+done:
+    if (g.fp && fclose(g.fp) != 0 && rc == 0) {
+        perror(opt->path);
+        rc = -1;
+    }
+    free(g.page);
+    free(g.payload);
+    free(g.text_pool);
+    free(level.items);
+    free(parent.items);
+    return rc;
+}
+
+static int parse_u64(const char *s, uint64_t *out) {
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (end == s) {
+        return -1;
+    }
+    switch (*end) {
+    case 'K': case 'k': v <<= 10; end++; break;
+    case 'M': case 'm': v <<= 20; end++; break;
+    case 'G': case 'g': v <<= 30; end++; break;
+    default: break;
+    }
+    if (*end != '\0') {
+        return -1;
+    }
+    *out = v;
+    return 0;
+}
+
+static int parse_columns(const char *spec, gen_options_t *opt) {
+    static const struct { const char *name; col_type_t type; } names[] = {
+        { "int", COL_INT }, { "text", COL_TEXT }, { "real", COL_REAL },
+        { "blob", COL_BLOB }, { "null", COL_NULL },
+    };
+    opt->column_count = 0;
+    while (*spec) {
+        size_t len = strcspn(spec, ",*");
+        size_t i;
+        for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+            if (strlen(names[i].name) == len && strncmp(spec, names[i].name, len) == 0) {
+                break;
+            }
+        }
+        if (i == sizeof(names) / sizeof(names[0])) {
+            return -1;
+        }
+        spec += len;
+        unsigned long repeat = 1;
+        if (*spec == '*') {
+            char *end;
+            repeat = strtoul(spec + 1, &end, 10);
+            spec = end;
+        }
+        if (repeat == 0 || opt->column_count + repeat > MAX_COLUMNS) {
+            return -1;
+        }
+        while (repeat--) {
+            opt->columns[opt->column_count++] = names[i].type;
+        }
+        if (*spec == ',') {
+            spec++;
+        } else if (*spec) {
+            return -1;
+        }
+    }
+    return opt->column_count > 0 ? 0 : -1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s <out.db> [--rows N] [--size N[KMG]] [--page-size N]\n"
+            "       [--columns SPEC] [--text-size MIN:MAX] [--overflow PCT]\n"
+            "       [--overflow-size N] [--leaf-rows N] [--fanout N]\n"
+            "       [--table NAME] [--seed N]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    static gen_options_t opt = {
+        .rows = 100000, .page_size = 4096, .text_min = 8, .text_max = 64,
+        .table = "t",
+    };
+    if (argc < 2 || argv[1][0] == '-') {
+        usage(argv[0]);
+        return 1;
+    }
+    opt.path = argv[1];
+    parse_columns("int,text,real", &opt);
+
+    for (int i = 2; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        uint64_t n;
+        int ok = val != NULL;
+
+        if (ok && strcmp(arg, "--rows") == 0) {
+            ok = parse_u64(val, &opt.rows) == 0;
+        } else if (ok && strcmp(arg, "--size") == 0) {
+            ok = parse_u64(val, &opt.max_bytes) == 0 && opt.max_bytes > 0;
+        } else if (ok && strcmp(arg, "--page-size") == 0) {
+            ok = parse_u64(val, &n) == 0 && n >= 512 && n <= 65536 && (n & (n - 1)) == 0;
+            opt.page_size = (uint32_t)n;
+        } else if (ok && strcmp(arg, "--columns") == 0) {
+            ok = parse_columns(val, &opt) == 0;
+        } else if (ok && strcmp(arg, "--text-size") == 0) {
+            char *end;
+            opt.text_min = strtoul(val, &end, 10);
+            opt.text_max = opt.text_min;
+            if (*end == ':') {
+                opt.text_max = strtoul(end + 1, &end, 10);
+            }
+            ok = *end == '\0' && opt.text_min <= opt.text_max &&
+                 opt.text_max <= TEXT_POOL_SIZE * 64;
+        } else if (ok && strcmp(arg, "--overflow") == 0) {
+            ok = parse_u64(val, &n) == 0 && n <= 100;
+            opt.overflow_pct = (unsigned)n;
+        } else if (ok && strcmp(arg, "--overflow-size") == 0) {
+            ok = parse_u64(val, &n) == 0 && n > 0 && n < (1u << 30);
+            opt.overflow_size = (size_t)n;
+        } else if (ok && strcmp(arg, "--leaf-rows") == 0) {
+            ok = parse_u64(val, &n) == 0 && n > 0 && n < 65536;
+            opt.leaf_rows = (uint32_t)n;
+        } else if (ok && strcmp(arg, "--fanout") == 0) {
+            ok = parse_u64(val, &n) == 0 && n >= 3 && n < 65536;
+            opt.fanout = (uint32_t)n;
+        } else if (ok && strcmp(arg, "--table") == 0) {
+            ok = strlen(val) > 0 && strlen(val) < 128 &&
+                 strspn(val, "abcdefghijklmnopqrstuvwxyz_0123456789") == strlen(val);
+            opt.table = val;
+        } else if (ok && strcmp(arg, "--seed") == 0) {
+            ok = parse_u64(val, &opt.seed) == 0;
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            fprintf(stderr, "gen_db: bad option %s\n", arg);
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+    if (opt.overflow_size == 0) {
+        opt.overflow_size = 4 * (size_t)opt.page_size;
+    }
+    return generate(&opt) < 0 ? 1 : 0;
+}
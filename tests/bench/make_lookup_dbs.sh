@@ -0,0 +1,25 @@
+#!/bin/sh
+# Builds the databases for bench-lookup: one table `t` per file with
+# 10^3 .. 10^N rows of similar width, so only the tree height changes.
+set -e
+
+out=${1:-bench-data}
+max=${2:-7}
+mkdir -p "$out"
+
+n=1000
+i=3
+while [ "$i" -le "$max" ]; do
+    db="$out/lookup_$n.db"
+    if [ ! -f "$db" ]; then
+        sqlite3 "$db" >/dev/null <<SQL
+PRAGMA journal_mode = OFF;
+CREATE TABLE t (a INTEGER, b TEXT);
+WITH RECURSIVE r(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM r WHERE x < $n)
+INSERT INTO t (rowid, a, b) SELECT x, x * 7, printf('row-%08d', x) FROM r;
+SQL
+    fi
+    echo "$db"
+    n=$((n * 10))
+    i=$((i + 1))
+done
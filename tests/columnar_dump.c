@@ -0,0 +1,165 @@
+// Reads a file written by --export-columnar and prints it as CSV, the way
+// `--table NAME --format csv` prints the table, so `make test` can check
+// that an export reads back to the same rows.
+//
+// usage: columnar_dump <file.col>
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../include/columnar.h"
+#include "../include/csv.h"
+#include "../include/output.h"
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+} file_t;
+
+static uint32_t le32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+}
+
+static uint64_t le64(const uint8_t *p) {
+    return (uint64_t)le32(p) | (uint64_t)le32(p + 4) << 32;
+}
+
+// the len bytes at offset, or NULL if they are not all in the file
+static const uint8_t *at(const file_t *f, uint64_t offset, uint64_t len) {
+    if (offset > f->size || len > f->size - offset) {
+        return NULL;
+    }
+    return f->data + offset;
+}
+
+static void print_hex(out_t *out, const uint8_t *data, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++) {
+        out_char(out, hex[data[i] >> 4]);
+        out_char(out, hex[data[i] & 15]);
+    }
+}
+
+// Prints row `row` of one column of a batch; buf is its 48-byte buffer
+// descriptor. Returns -1 if a buffer lies outside the file.
+static int print_cell(out_t *out, const file_t *f, uint32_t type,
+                      const uint8_t *buf, uint64_t rows, uint64_t row) {
+    uint64_t nulls = le64(buf);
+    if (nulls > 0) {
+        const uint8_t *validity = at(f, le64(buf + 8), (rows + 7) / 8);
+        if (!validity) return -1;
+        if (!(validity[row / 8] & (1u << (row % 8)))) {
+            return 0;
+        }
+    }
+    const uint8_t *values = at(f, le64(buf + 16), le64(buf + 24));
+    if (!values || le64(buf + 24) < (rows + (type >= COLUMNAR_UTF8)) * 8) {
+        return -1;
+    }
+    const uint8_t *v = values + row * 8;
+    if (type == COLUMNAR_INT64) {
+        out_i64(out, (int64_t)le64(v));
+    } else if (type == COLUMNAR_FLOAT64) {
+        uint64_t bits = le64(v);
+        double real;
+        memcpy(&real, &bits, sizeof(real));
+        out_double(out, real);
+    } else {
+        uint64_t start = le64(v);
+        uint64_t end = le64(v + 8);
+        const uint8_t *data = at(f, le64(buf + 32), le64(buf + 40));
+        if (!data || start > end || end > le64(buf + 40)) return -1;
+        if (type == COLUMNAR_UTF8) {
+            csv_print_field(out, data + start, (size_t)(end - start));
+        } else {
+            print_hex(out, data + start, (size_t)(end - start));
+        }
+    }
+    return 0;
+}
+
+static int dump(out_t *out, const file_t *f) {
+    const uint8_t *h = at(f, 0, COLUMNAR_HEADER_SIZE);
+    if (!h || memcmp(h, COLUMNAR_MAGIC, 8) != 0 ||
+        le32(h + 8) != COLUMNAR_VERSION) {
+        return -1;
+    }
+    uint32_t ncols = le32(h + 12);
+    uint32_t nbatches = le32(h + 24);
+    uint64_t footer_at = le64(h + 32);
+    size_t batch_size = COLUMNAR_BATCH_ENTRY_SIZE +
+                        (size_t)ncols * COLUMNAR_BUFFER_ENTRY_SIZE;
+    const uint8_t *footer = at(f, footer_at, le64(h + 40));
+    if (!footer || le64(h + 40) < (uint64_t)ncols * COLUMNAR_COLUMN_ENTRY_SIZE +
+                                  (uint64_t)nbatches * batch_size) {
+        return -1;
+    }
+
+    for (uint32_t c = 0; c < ncols; c++) {
+        const uint8_t *col = footer + (size_t)c * COLUMNAR_COLUMN_ENTRY_SIZE;
+        const uint8_t *name = at(f, footer_at + le32(col + 8), le32(col + 12));
+        if (!name) return -1;
+        if (c > 0) out_char(out, ',');
+        csv_print_field(out, name, le32(col + 12));
+    }
+    out_char(out, '\n');
+
+    const uint8_t *batches = footer + (size_t)ncols * COLUMNAR_COLUMN_ENTRY_SIZE;
+    uint64_t total = 0;
+    for (uint32_t b = 0; b < nbatches; b++) {
+        const uint8_t *batch = batches + (size_t)b * batch_size;
+        uint64_t rows = le64(batch + 8);
+        if (le64(batch) != total) return -1;
+        for (uint64_t r = 0; r < rows; r++) {
+            for (uint32_t c = 0; c < ncols; c++) {
+                uint32_t type = le32(footer + (size_t)c * COLUMNAR_COLUMN_ENTRY_SIZE);
+                const uint8_t *buf = batch + COLUMNAR_BATCH_ENTRY_SIZE +
+                                     (size_t)c * COLUMNAR_BUFFER_ENTRY_SIZE;
+                if (c > 0) out_char(out, ',');
+                if (print_cell(out, f, type, buf, rows, r) < 0) return -1;
+            }
+            out_char(out, '\n');
+        }
+        total += rows;
+    }
+    return total == le64(h + 16) ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <file.col>\n", argv[0]);
+        return 1;
+    }
+    int fd = open(argv[1], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    file_t f = { mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0),
+                 (size_t)st.st_size };
+    close(fd);
+    if (f.data == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    out_t out;
+    if (out_open_fd(&out, STDOUT_FILENO) < 0) {
+        return 1;
+    }
+    int rc = dump(&out, &f);
+    if (rc < 0) {
+        fprintf(stderr, "%s: malformed columnar file\n", argv[1]);
+    }
+    if (out_flush(&out) < 0) {
+        rc = -1;
+    }
+    out_close(&out);
+    munmap((void *)f.data, f.size);
+    return rc < 0 ? 1 : 0;
+}
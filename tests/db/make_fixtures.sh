@@ -0,0 +1,120 @@
+#!/bin/sh
+# Rebuilds the fixtures `make test` runs against (needs sqlite3). The
+# generated files are checked in, so this is only needed to change them;
+# the expected outputs in tests/expected must then be regenerated too.
+#
+#   query.db           table `people` over several 1 KiB pages: NULLs,
+#                      negative integers, whole and fractional REALs,
+#                      text that needs CSV quoting, and a column without
+#                      affinity holding every storage class; table
+#                      `checked` whose constraints hold AS and type names
+#                      inside expressions, next to generated columns;
+#                      WITHOUT ROWID table `keyed`; table `long_types`
+#                      whose type names give their affinity past byte 64
+#   features.db        1 KiB pages for the checks of the whole-file modes:
+#                      table `big` with text and blobs spilling into
+#                      overflow chains, table `items` with two indexes
+#                      and duplicate keys, and free pages from a dropped
+#                      table
+#   wal.db, wal.db-wal table `t` with 100 rows checkpointed into the
+#                      database; the -wal holds one committed transaction
+#                      (50 inserts, an update and a delete) and the pages
+#                      of an uncommitted one spilled from a small cache
+set -e
+
+dir=$(dirname "$0")
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+rm -f "$dir/query.db"
+sqlite3 "$dir/query.db" >/dev/null <<SQL
+PRAGMA page_size = 1024;
+PRAGMA journal_mode = OFF;
+CREATE TABLE people (id INTEGER PRIMARY KEY, name TEXT, age INTEGER,
+                     score REAL, note);
+WITH RECURSIVE r(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM r WHERE x < 300)
+INSERT INTO people
+SELECT x,
+       CASE x % 5 WHEN 0 THEN 'alice' WHEN 1 THEN 'Bob' WHEN 2 THEN 'o"neil'
+                  WHEN 3 THEN 'smith, jr' ELSE 'Eve' END || x,
+       CASE WHEN x % 37 = 0 THEN NULL ELSE (x * 7) % 90 - 5 END,
+       CASE WHEN x % 41 = 0 THEN NULL
+            WHEN x % 3 = 0 THEN x % 50
+            ELSE round(x * 1.37, 2) END,
+       CASE x % 5 WHEN 0 THEN NULL WHEN 1 THEN x WHEN 2 THEN x / 4.0
+                  WHEN 3 THEN 'n' || x
+                  ELSE unhex(printf('%02x1f', x % 256)) END
+FROM r;
+CREATE TABLE checked (id INTEGER PRIMARY KEY,
+                      a TEXT CHECK(CAST(a AS TEXT) = a),
+                      b INTEGER DEFAULT (CAST('7' AS INTEGER)),
+                      g INTEGER GENERATED ALWAYS AS (b * 2) VIRTUAL,
+                      c BLOB,
+                      s AS (b + 1) STORED);
+WITH RECURSIVE r(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM r WHERE x < 200)
+INSERT INTO checked (id, a, b, c)
+SELECT x, 'a' || x, x % 10, unhex(printf('%04x', x)) FROM r;
+CREATE TABLE keyed (k TEXT PRIMARY KEY, v INTEGER) WITHOUT ROWID;
+WITH RECURSIVE r(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM r WHERE x < 200)
+INSERT INTO keyed SELECT printf('key-%03d', x), x FROM r;
+CREATE TABLE long_types (
+    id INTEGER PRIMARY KEY,
+    t NATIONAL UNSIGNED EXTENDED PRECISION OVERSIZED FIELD LABEL WITH VARYING CHARACTER(255),
+    r UNSIGNED EXTENDED PRECISION OVERSIZED MEASUREMENT FIELD LABELLED LONG DOUBLE);
+WITH RECURSIVE r(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM r WHERE x < 50)
+INSERT INTO long_types SELECT x, x % 7, x % 4 + 0.25 FROM r;
+SQL
+
+rm -f "$dir/features.db"
+sqlite3 "$dir/features.db" >/dev/null <<SQL
+PRAGMA page_size = 1024;
+PRAGMA journal_mode = OFF;
+CREATE TABLE big (id INTEGER PRIMARY KEY, title TEXT, body TEXT, data BLOB);
+WITH RECURSIVE r(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM r WHERE x < 60)
+INSERT INTO big
+SELECT x, 'title "' || x || '", part ' || (x % 3),
+       CASE WHEN x % 9 = 0 THEN NULL
+            ELSE substr(replace(printf('%0*d', (x * 397) % 3000 + 10, 0), '0',
+                                'ab, "c" \ d' || char(10)),
+                        1, (x * 397) % 3000 + 10) END,
+       CASE WHEN x % 7 = 0 THEN NULL
+            ELSE unhex(substr(replace(printf('%0*d', (x * 211) % 2500, 0), '0',
+                                      '00ff7f80c3'),
+                              1, 2 * ((x * 211) % 2500))) END
+FROM r;
+CREATE TABLE items (id INTEGER PRIMARY KEY, sku TEXT, qty INTEGER, price REAL,
+                    note TEXT);
+WITH RECURSIVE r(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM r WHERE x < 2000)
+INSERT INTO items
+SELECT x, printf('SKU-%04d', (x * 7919) % 700), x % 50, (x % 400) * 0.25 + 0.125,
+       CASE WHEN x % 11 = 0 THEN NULL ELSE 'note ' || x END
+FROM r;
+CREATE INDEX items_sku ON items (sku);
+CREATE INDEX items_qty_price ON items (qty, price);
+CREATE TABLE scratch (a, b);
+WITH RECURSIVE r(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM r WHERE x < 300)
+INSERT INTO scratch SELECT x, printf('%0100d', x) FROM r;
+DROP TABLE scratch;
+SQL
+
+sqlite3 "$tmp/wal.db" >/dev/null <<SQL
+PRAGMA page_size = 1024;
+PRAGMA journal_mode = WAL;
+PRAGMA wal_autocheckpoint = 0;
+PRAGMA cache_size = 10;
+CREATE TABLE t (a INTEGER, b TEXT);
+WITH RECURSIVE r(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM r WHERE x < 100)
+INSERT INTO t (rowid, a, b) SELECT x, x * 3, printf('base-%03d', x) FROM r;
+PRAGMA wal_checkpoint(TRUNCATE);
+BEGIN;
+WITH RECURSIVE r(x) AS (SELECT 101 UNION ALL SELECT x + 1 FROM r WHERE x < 150)
+INSERT INTO t (rowid, a, b) SELECT x, x * 3, printf('wal-%03d', x) FROM r;
+UPDATE t SET b = 'updated' WHERE rowid = 7;
+DELETE FROM t WHERE rowid = 8;
+COMMIT;
+BEGIN;
+WITH RECURSIVE r(x) AS (SELECT 151 UNION ALL SELECT x + 1 FROM r WHERE x < 650)
+INSERT INTO t (rowid, a, b) SELECT x, x * 3, printf('uncommitted-%0200d', x)
+FROM r;
+.shell cp "$tmp/wal.db" "$tmp/wal.db-wal" "$dir/"
+SQL
@@ -0,0 +1,441 @@
+#!/bin/sh
+# `make test`: runs fixed queries against the fixtures in tests/db and
+# diffs each output with tests/expected/NAME.out. With --update the
+# expected files are rewritten instead, after a deliberate change in the
+# output. Other checks compare two outputs with each other, or with
+# what sqlite3 prints for the same rows when it is installed.
+
+dir=$(dirname "$0")
+bin=${LITEREADER:-bin/litereader}
+columnar_dump=${COLUMNAR_DUMP:-bin/columnar_dump}
+db=$dir/db
+update=0
+if [ "$1" = "--update" ]; then
+    update=1
+fi
+failed=0
+passed=0
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+fail() {
+    echo "FAIL: $1"
+    failed=$((failed + 1))
+}
+
+# check NAME ARGS...: output of `litereader ARGS...` against NAME.out
+check() {
+    name=$1
+    shift
+    expected=$dir/expected/$name.out
+    if [ "$update" -eq 1 ]; then
+        "$bin" "$@" > "$expected" 2>&1
+    elif "$bin" "$@" 2>&1 | diff -u "$expected" -; then
+        passed=$((passed + 1))
+    else
+        fail "$name"
+    fi
+}
+
+# rows N ARGS...: `litereader ARGS... --format csv` writes N rows
+rows() {
+    want=$1
+    shift
+    got=$("$bin" "$@" --format csv | tail -n +2 | wc -l)
+    if [ "$update" -eq 1 ]; then
+        return
+    elif [ "$got" -eq "$want" ]; then
+        passed=$((passed + 1))
+    else
+        fail "$* has $got rows, not $want"
+    fi
+}
+
+# fails ARGS...: `litereader ARGS...` is rejected
+fails() {
+    if [ "$update" -eq 1 ]; then
+        return
+    elif "$bin" "$@" > /dev/null 2>&1; then
+        fail "$* was accepted"
+    else
+        passed=$((passed + 1))
+    fi
+}
+
+# run NAME ARGS...: keeps the output of `litereader ARGS...` as NAME
+run() {
+    name=$1
+    shift
+    "$bin" "$@" > "$tmp/$name" 2>&1
+}
+
+# sql NAME DB QUERY: keeps sqlite3's CSV output of QUERY as NAME
+sql() {
+    sqlite3 -readonly -csv -header "$2" "$3" | tr -d '\r' > "$tmp/$1"
+}
+
+# items_sql NAME WHERE ORDER: features.db's items rows as --format ndjson
+# writes them
+items_sql() {
+    sqlite3 -readonly "$features" "SELECT json_object('id', id, 'sku', sku,
+        'qty', qty, 'price', price, 'note', note) FROM items
+        WHERE $2 ORDER BY $3" > "$tmp/$1"
+}
+
+# same A B: the outputs kept as A and B are byte for byte equal
+same() {
+    if [ "$update" -eq 1 ]; then
+        return
+    elif [ ! -s "$tmp/$1" ]; then
+        fail "$1 is empty"
+    elif cmp -s "$tmp/$1" "$tmp/$2"; then
+        passed=$((passed + 1))
+    else
+        fail "$1 and $2 differ"
+        diff -u "$tmp/$1" "$tmp/$2" | head -20
+    fi
+}
+
+# same_rows WHERE: the rowids of query.db's people matching WHERE, as
+# litereader and sqlite3 see them
+same_rows() {
+    ours=$("$bin" "$db/query.db" --table people --columns id \
+           --where "$1" --format csv | tail -n +2)
+    theirs=$(sqlite3 -readonly "$db/query.db" \
+             "SELECT id FROM people WHERE $1 ORDER BY id")
+    if [ -z "$theirs" ]; then
+        fail "sqlite3 selects no rows for $1"
+    elif [ "$ours" = "$theirs" ]; then
+        passed=$((passed + 1))
+    else
+        fail "rows for $1 differ from sqlite3"
+    fi
+}
+
+# pages_accounted DB: the pages of the objects `--analyze` lists add up to
+# its b-tree and overflow pages, and with the freelist, pointer map and
+# lock byte pages to the page count, none left unaccounted
+pages_accounted() {
+    got=$("$bin" "$1" --analyze | awk '
+        /^=== (table|index) / { object = 1 }
+        { split($0, field, ":"); n = field[2] + 0 }
+        /^Pages:/ { if (object) objects += n; else pages = n }
+        /^(B-tree|Overflow) pages:/ { trees += n }
+        /^(Freelist|Pointer map|Lock byte) pages:/ { other += n }
+        /^Unaccounted pages:/ { lost = n }
+        END { print pages + 0, objects + 0, trees + 0, other + 0, lost + 0 }')
+    set -- "$1" $got
+    if [ "$update" -eq 1 ]; then
+        return
+    elif [ "$2" -gt 0 ] && [ "$3" -eq "$4" ] && [ $(($4 + $5)) -eq "$2" ] &&
+         [ "$6" -eq 0 ]; then
+        passed=$((passed + 1))
+    else
+        fail "--analyze of $1 counts $2 pages: $3 in objects, $4 b-tree and \
+overflow, $5 others, $6 unaccounted"
+    fi
+}
+
+check summary "$db/test.db"
+
+check query-csv "$db/query.db" --table people --format csv
+check query-ndjson "$db/query.db" --table people --format ndjson
+check query-columns "$db/query.db" --table people --columns score,name,id \
+    --where "age >= 30" --where "note IS NOT NULL" --format csv
+check query-like-text "$db/query.db" --table people --columns id,name \
+    --where "name LIKE 'BOB1%'" --format csv
+check query-glob-text "$db/query.db" --table people --columns id,name \
+    --where "name GLOB 'smith, jr1*'" --format csv
+check query-like-integer "$db/query.db" --table people --columns id,age \
+    --where "age LIKE '1%'" --format csv
+check query-glob-real "$db/query.db" --table people --columns id,score \
+    --where "score GLOB '2*'" --format csv
+check query-like-any "$db/query.db" --table people --columns id,note \
+    --where "note LIKE '1%'" --format csv
+check query-checked "$db/query.db" --table checked --format csv
+check query-checked-where "$db/query.db" --table checked --where "b = 7" \
+    --format csv
+check query-checked-columns "$db/query.db" --table checked --columns a,b \
+    --where "a LIKE 'A1%'" --format csv
+check query-without-rowid "$db/query.db" --table keyed --format csv
+check query-long-types "$db/query.db" --table long_types --where "t = 3" \
+    --where "r > 0.5" --format csv
+check query-range "$db/query.db" --table people --columns id,age,score \
+    --rowid-range 40:60 --where "score < 30" --format csv
+
+fails "$db/query.db" --table people --rowid ""
+fails "$db/query.db" --table people --rowid 12x
+fails "$db/query.db" --table people --rowid 9223372036854775808
+fails "$db/query.db" --table people --rowid-range 99999999999999999999:
+fails "$db/query.db" --table people --rowid-range :-9223372036854775809
+fails "$db/query.db" --queue-depth 4
+fails "$db/query.db" --threads 1 --queue-depth 4
+
+# one committed transaction in the -wal and one that never committed
+check wal "$db/wal.db" --table t --format csv
+check wal-count "$db/wal.db" --table t --columns a --where "b LIKE 'wal-%'" \
+    --format csv
+check no-wal "$db/wal.db" --no-wal --table t --format csv
+check no-wal-summary "$db/wal.db" --no-wal
+rows 149 "$db/wal.db" --table t
+rows 100 "$db/wal.db" --no-wal --table t
+rows 0 "$db/wal.db" --table t --where "b GLOB 'uncommitted*'"
+rows 1 "$db/wal.db" --table t --where "b = 'updated'"
+rows 0 "$db/wal.db" --no-wal --table t --where "b = 'updated'"
+
+if [ "$update" -eq 0 ] && command -v sqlite3 > /dev/null; then
+    same_rows "age LIKE '1%'"
+    same_rows "age GLOB '-*'"
+    same_rows "score LIKE '1.%'"
+    same_rows "score GLOB '21.0*'"
+    same_rows "score LIKE '4%'"
+    same_rows "note LIKE '1%'"
+    same_rows "note GLOB '2*'"
+    same_rows "name LIKE 'o\"neil%'"
+    same_rows "age >= 30"
+    same_rows "score < 5.5"
+    same_rows "age = '16'"
+    same_rows "note IS NULL"
+
+    # AS, CAST and a type name inside CHECK and DEFAULT, generated columns
+    run checked "$db/query.db" --table checked --format csv
+    sql checked.sqlite "$db/query.db" \
+        "SELECT id, a, b, lower(hex(c)) AS c, s FROM checked"
+    same checked checked.sqlite
+    run checked-where "$db/query.db" --table checked --columns id,a,b,s \
+        --where "b = 7" --format csv
+    sql checked-where.sqlite "$db/query.db" \
+        "SELECT id, a, b, s FROM checked WHERE b = 7"
+    same checked-where checked-where.sqlite
+    run checked-columns "$db/query.db" --table checked --columns a,b \
+        --format csv
+    sql checked-columns.sqlite "$db/query.db" "SELECT a, b FROM checked"
+    same checked-columns checked-columns.sqlite
+
+    # affinity keywords beyond the first 64 bytes of the type name
+    run long-types "$db/query.db" --table long_types --where "t = 3" \
+        --where "r > 0.5" --format csv
+    sql long-types.sqlite "$db/query.db" \
+        "SELECT * FROM long_types WHERE t = 3 AND r > 0.5"
+    same long-types long-types.sqlite
+fi
+
+# The whole-file modes on features.db, each against the default path.
+features=$db/features.db
+run dump "$features"
+run dump-json "$features" --json
+run items "$features" --table items --format csv
+run seek "$features" --index items_qty_price --key 7
+
+# payloads read from overflow chains in place
+run dump-zero-copy "$features" --zero-copy
+same dump-zero-copy dump
+run big "$features" --table big --format ndjson
+run big-zero-copy "$features" --zero-copy --table big --format ndjson
+same big-zero-copy big
+rows 0 "$features" --index items_sku --key SKU-9999
+
+# pages rendered on several threads come out in page order
+for threads in 2 3 8; do
+    run "dump-threads-$threads" "$features" --threads "$threads"
+    same "dump-threads-$threads" dump
+    run "dump-json-threads-$threads" "$features" --json --threads "$threads"
+    same "dump-json-threads-$threads" dump-json
+done
+run dump-queue-depth "$features" --threads 4 --queue-depth 1
+same dump-queue-depth dump
+
+# every page source reads the same pages; stderr is left out, as uring
+# falls back to pread with a warning where the kernel has no io_uring
+for io in "pread" "pread --page-cache 4" "uring" "uring --page-cache 4"; do
+    name=$(echo "$io" | tr -d ' -')
+    "$bin" "$features" --io $io > "$tmp/dump-$name" 2> /dev/null
+    same "dump-$name" dump
+    "$bin" "$features" --json --io $io > "$tmp/dump-json-$name" 2> /dev/null
+    same "dump-json-$name" dump-json
+    "$bin" "$features" --table items --format csv --io $io \
+        > "$tmp/items-$name" 2> /dev/null
+    same "items-$name" items
+    "$bin" "$features" --table big --format ndjson --io $io \
+        > "$tmp/big-$name" 2> /dev/null
+    same "big-$name" big
+    "$bin" "$features" --index items_qty_price --key 7 --io $io \
+        > "$tmp/seek-$name" 2> /dev/null
+    same "seek-$name" seek
+done
+
+# windowed mapping under a memory cap, down to 4 windows of 4 KiB; a cap
+# too small for an overflow chain must fail rather than print less
+for cap in 16K 64K 1M; do
+    run "dump-$cap" "$features" --max-resident "$cap"
+    same "dump-$cap" dump
+    run "dump-json-$cap" "$features" --json --max-resident "$cap"
+    same "dump-json-$cap" dump-json
+    run "items-$cap" "$features" --table items --format csv --max-resident "$cap"
+    same "items-$cap" items
+    run "big-$cap" "$features" --table big --format ndjson --max-resident "$cap"
+    same "big-$cap" big
+    run "seek-$cap" "$features" --index items_qty_price --key 7 \
+        --max-resident "$cap"
+    same "seek-$cap" seek
+done
+fails "$features" --max-resident 8K
+fails "$features" --table big --format ndjson --max-resident 8K
+fails "$features" --max-resident 4K
+
+# the sidecar: built on the first --cache run, mapped on the next, and
+# rebuilt once the database changes
+cp "$features" "$tmp/cached.db"
+run dump-cache-cold "$tmp/cached.db" --cache
+same dump-cache-cold dump
+if [ ! -f "$tmp/cached.db.litereader-idx" ]; then
+    fail "--cache wrote no sidecar"
+fi
+cp "$tmp/cached.db.litereader-idx" "$tmp/sidecar-cold"
+run dump-cache-warm "$tmp/cached.db" --cache
+same dump-cache-warm dump
+same cached.db.litereader-idx sidecar-cold
+run items-cache "$tmp/cached.db" --cache --table items --format csv
+same items-cache items
+touch -t 200101010000 "$tmp/cached.db"
+run dump-cache-touched "$tmp/cached.db" --cache
+same dump-cache-touched dump
+if cmp -s "$tmp/cached.db.litereader-idx" "$tmp/sidecar-cold"; then
+    fail "--cache kept the sidecar of an older mtime"
+fi
+
+# columnar exports read back to the rows of the CSV export
+for table in "features.db items" "features.db big" "query.db checked"; do
+    set -- $table
+    "$bin" "$db/$1" --export-columnar "$2" "$tmp/$2.col" > /dev/null 2>&1
+    "$columnar_dump" "$tmp/$2.col" > "$tmp/$2.columnar" 2>&1
+    run "$2.csv" "$db/$1" --table "$2" --format csv
+    same "$2.columnar" "$2.csv"
+done
+
+# --analyze: every page is accounted for, on any number of threads
+check analyze "$features" --analyze
+check analyze-json "$features" --analyze --json
+for f in test.db query.db features.db wal.db; do
+    pages_accounted "$db/$f"
+done
+run analyze "$features" --analyze
+run analyze-json "$features" --analyze --json
+for threads in 1 3 8; do
+    run "analyze-threads-$threads" "$features" --analyze --threads "$threads"
+    same "analyze-threads-$threads" analyze
+    run "analyze-json-threads-$threads" "$features" --analyze --json \
+        --threads "$threads"
+    same "analyze-json-threads-$threads" analyze-json
+done
+
+# --batch over copies of the fixtures: one line per file in path order,
+# whatever the thread count, and the same from a list as from the
+# directory; stderr only has the timings
+mkdir "$tmp/fixtures"
+cp "$db/test.db" "$db/query.db" "$features" "$db/wal.db" "$db/wal.db-wal" \
+    "$tmp/fixtures"
+"$bin" --batch "$tmp/fixtures" > "$tmp/batch" 2> /dev/null
+for threads in 1 3 8; do
+    "$bin" --batch "$tmp/fixtures" --threads "$threads" \
+        > "$tmp/batch-threads-$threads" 2> /dev/null
+    same "batch-threads-$threads" batch
+done
+for f in features.db query.db test.db wal.db; do
+    echo "$tmp/fixtures/$f"
+done > "$tmp/batch-list"
+"$bin" --batch - < "$tmp/batch-list" > "$tmp/batch-stdin" 2> /dev/null
+same batch-stdin batch
+if [ "$update" -eq 0 ] && [ "$(grep -c '"ok":true' "$tmp/batch")" -ne 4 ]; then
+    fail "--batch found errors in the fixtures"
+fi
+printf '%s\n' "$db/query.db" "$db/make_fixtures.sh" > "$tmp/batch-bad"
+fails --batch "$tmp/batch-bad"
+printf '%s\n' "$db/query.db" "$tmp/missing.db" > "$tmp/batch-missing"
+fails --batch "$tmp/batch-missing"
+
+if [ "$update" -eq 0 ] && command -v sqlite3 > /dev/null; then
+    sqlite3 -readonly "$features" "SELECT json_object('id', id, 'title', title,
+        'body', body, 'data', CASE WHEN data IS NOT NULL
+                                   THEN lower(hex(data)) END) FROM big" \
+        > "$tmp/big.sqlite"
+    same big big.sqlite
+    run big-range "$features" --table big --rowid-range 10:25 --format csv
+    sql big-range.sqlite "$features" "SELECT id, title, body,
+        CASE WHEN data IS NOT NULL THEN lower(hex(data)) END AS data
+        FROM big WHERE id BETWEEN 10 AND 25"
+    same big-range big-range.sqlite
+
+    # index seeks and scans return the rows in index order, duplicate
+    # keys by rowid
+    run seek-sku "$features" --index items_sku --key SKU-0042 --format ndjson
+    items_sql seek-sku.sqlite "sku = 'SKU-0042'" "sku, id"
+    same seek-sku seek-sku.sqlite
+    run seek-qty "$features" --index items_qty_price --key 7 --format ndjson
+    items_sql seek-qty.sqlite "qty = 7" "qty, price, id"
+    same seek-qty seek-qty.sqlite
+    run seek-qty-price "$features" --index items_qty_price --key 7 \
+        --key 1.875 --format ndjson
+    items_sql seek-qty-price.sqlite "qty = 7 AND price = 1.875" "id"
+    same seek-qty-price seek-qty-price.sqlite
+    run scan-qty-price "$features" --index items_qty_price --format ndjson
+    items_sql scan-qty-price.sqlite "1" "qty, price, id"
+    same scan-qty-price scan-qty-price.sqlite
+    run seek-where "$features" --index items_sku --key SKU-0003 \
+        --where "qty > 20" --format ndjson
+    items_sql seek-where.sqlite "sku = 'SKU-0003' AND qty > 20" "id"
+    same seek-where seek-where.sqlite
+
+    # a write to the database makes the sidecar stale
+    sqlite3 "$tmp/cached.db" "UPDATE items SET note = 'changed' WHERE id = 5"
+    run items-cache-stale "$tmp/cached.db" --cache --table items --format csv
+    run items-changed "$tmp/cached.db" --table items --format csv
+    same items-cache-stale items-changed
+    if ! grep -q '^5,.*,changed$' "$tmp/items-cache-stale"; then
+        fail "--cache read a stale sidecar"
+    fi
+
+    # the row counts of --batch, WITHOUT ROWID tables and the -wal included
+    for f in features.db query.db test.db wal.db; do
+        ours=$(grep "\"file\":\"$tmp/fixtures/$f\"" "$tmp/batch" |
+               sed 's/.*"tables":\(\[[^]]*\]\).*/\1/')
+        theirs=$(sqlite3 -readonly "$tmp/fixtures/$f" "SELECT name
+                     FROM sqlite_master WHERE type = 'table' AND rootpage > 0
+                     ORDER BY rowid" |
+                 while read -r table; do
+                     rows=$(sqlite3 -readonly "$tmp/fixtures/$f" \
+                            "SELECT count(*) FROM \"$table\"")
+                     printf ',{"name":"%s","rows":%s}' "$table" "$rows"
+                 done)
+        if [ "$ours" = "[${theirs#,}]" ]; then
+            passed=$((passed + 1))
+        else
+            fail "--batch counts $ours in $f, sqlite3 [${theirs#,}]"
+        fi
+    done
+
+    # the pages of each object, as sqlite3's dbstat counts them where it
+    # is compiled in; sqlite3 names the schema table sqlite_schema
+    for f in query.db features.db; do
+        if ! sqlite3 -readonly "$db/$f" "SELECT 1 FROM dbstat LIMIT 1" \
+             > /dev/null 2>&1; then
+            break
+        fi
+        "$bin" "$db/$f" --analyze | awk '
+            /^=== (table|index) / { name = $3 }
+            /^Pages:/ && name != "" { print name "|" $2 }' |
+            LC_ALL=C sort > "$tmp/object-pages-$f"
+        sqlite3 -readonly "$db/$f" "SELECT CASE name
+                WHEN 'sqlite_schema' THEN 'sqlite_master' ELSE name END AS n,
+                count(*) FROM dbstat GROUP BY n" |
+            LC_ALL=C sort > "$tmp/object-pages-$f.sqlite"
+        same "object-pages-$f" "object-pages-$f.sqlite"
+    done
+fi
+
+if [ "$update" -eq 1 ]; then
+    echo "expected outputs written to $dir/expected"
+    exit 0
+fi
+echo "$passed passed, $failed failed"
+[ "$failed" -eq 0 ]